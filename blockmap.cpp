@@ -0,0 +1,122 @@
+
+#include "blockmap.h"
+#include "umath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BuildBlockmap implementation
+
+namespace RoadGen {
+	namespace Blockmap {
+		// lines closer to a block than that are put into it (in units of blocks)
+		static const double BLOCK_EDGE_DISTANCE = 1.0 / 256 / BLOCK_SIZE;
+
+		bool BuildBlockmap(const Udmf::Map& map, unsigned char float_precision, BlockGrid& blockmap) {
+			// the blockmap is built for the map as the game loads it
+			Udmf::LoadedGeometry geometry;
+			Udmf::GetLoadedGeometry(map, float_precision, geometry);
+			const std::vector<Math::Point2D>& points = geometry.vertices;
+
+			blockmap = BlockGrid();
+			blockmap.origin_x = (int16_t)std::floor(geometry.left);
+			blockmap.origin_y = (int16_t)std::floor(geometry.bottom);
+			blockmap.columns_count = (uint16_t)((int)std::floor(geometry.right - blockmap.origin_x) / BLOCK_SIZE + 1);
+			blockmap.rows_count = (uint16_t)((int)std::floor(geometry.top - blockmap.origin_y) / BLOCK_SIZE + 1);
+
+			const int columns_count = blockmap.columns_count, rows_count = blockmap.rows_count;
+			std::vector<std::vector<uint16_t> > blocks_linedefs((size_t)columns_count * rows_count);
+			const uint32_t linedefs_count = (uint32_t)geometry.map_linedefs.size();
+			for(uint32_t linedef_ix=0; linedef_ix<linedefs_count && linedef_ix<LIST_END; linedef_ix++) {
+				const Udmf::Linedef& linedef = map.linedefs[geometry.map_linedefs[linedef_ix]];
+
+				// ends in units of blocks from the origin, the first one is on the left
+				Math::Point2D p1((points[linedef.v1].x - blockmap.origin_x) / BLOCK_SIZE, (points[linedef.v1].y - blockmap.origin_y) / BLOCK_SIZE);
+				Math::Point2D p2((points[linedef.v2].x - blockmap.origin_x) / BLOCK_SIZE, (points[linedef.v2].y - blockmap.origin_y) / BLOCK_SIZE);
+				if(p1.x > p2.x) {
+					std::swap(p1, p2);
+				}
+
+				// the line is clipped by each column it crosses, the clipped part passes a range of rows
+				const int first_column = std::max(0, (int)std::floor(p1.x - BLOCK_EDGE_DISTANCE));
+				const int last_column = std::min(columns_count - 1, (int)std::floor(p2.x + BLOCK_EDGE_DISTANCE));
+				for(int column=first_column; column<=last_column; column++) {
+					double y1 = p1.y, y2 = p2.y;
+					if(p2.x > p1.x) {
+						const double x1 = std::max(p1.x, column - BLOCK_EDGE_DISTANCE);
+						const double x2 = std::min(p2.x, column + 1 + BLOCK_EDGE_DISTANCE);
+						y1 = p1.y + (p2.y - p1.y) * (x1 - p1.x) / (p2.x - p1.x);
+						y2 = p1.y + (p2.y - p1.y) * (x2 - p1.x) / (p2.x - p1.x);
+					}
+
+					const int first_row = std::max(0, (int)std::floor(std::min(y1, y2) - BLOCK_EDGE_DISTANCE));
+					const int last_row = std::min(rows_count - 1, (int)std::floor(std::max(y1, y2) + BLOCK_EDGE_DISTANCE));
+					for(int row=first_row; row<=last_row; row++) {
+						blocks_linedefs[(size_t)row * columns_count + column].push_back((uint16_t)linedef_ix);
+					}
+				}
+			}
+
+			// blocks with the same lists share one list (most blocks of a road map are empty)
+			std::map<std::vector<uint16_t>, uint32_t> lists_offsets;
+			std::vector<uint32_t> blocks_offsets(blocks_linedefs.size());
+			uint32_t words_count = 4 + (uint32_t)blocks_linedefs.size();
+			for(size_t bix=0; bix<blocks_linedefs.size(); bix++) {
+				const std::pair<std::map<std::vector<uint16_t>, uint32_t>::iterator, bool> inserted = lists_offsets.insert(std::make_pair(blocks_linedefs[bix], words_count));
+				if(inserted.second) {
+					words_count += 2 + (uint32_t)blocks_linedefs[bix].size();
+				}
+				blocks_offsets[bix] = inserted.first->second;
+			}
+
+			blockmap.lists_count = (uint32_t)lists_offsets.size();
+			blockmap.linedefs_count = linedefs_count;
+			blockmap.words_count = words_count;
+			if(words_count > LUMP_WORDS_MAX || linedefs_count >= LIST_END) {
+				return false;
+			}
+
+			blockmap.words.reserve(words_count);
+			blockmap.words.push_back((uint16_t)blockmap.origin_x);
+			blockmap.words.push_back((uint16_t)blockmap.origin_y);
+			blockmap.words.push_back(blockmap.columns_count);
+			blockmap.words.push_back(blockmap.rows_count);
+			for(size_t bix=0; bix<blocks_offsets.size(); bix++) {
+				blockmap.words.push_back((uint16_t)blocks_offsets[bix]);
+			}
+
+			// lists go in the order of their offsets
+			for(size_t bix=0; bix<blocks_offsets.size(); bix++) {
+				if(blocks_offsets[bix] != blockmap.words.size()) {
+					continue;
+				}
+
+				blockmap.words.push_back(0);
+				blockmap.words.insert(blockmap.words.end(), blocks_linedefs[bix].begin(), blocks_linedefs[bix].end());
+				blockmap.words.push_back(LIST_END);
+			}
+			return true;
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WriteBlockmapToStream implementation
+
+namespace RoadGen {
+	namespace Blockmap {
+		void WriteBlockmapToStream(const BlockGrid& blockmap, Io::OutStream& out_stream) {
+			CharArray data;
+			data.reserve(blockmap.words.size() * 2);
+			for(size_t wix=0; wix<blockmap.words.size(); wix++) {
+				data.push_back((char)(blockmap.words[wix] & 0xFF));
+				data.push_back((char)(blockmap.words[wix] >> 8));
+			}
+			out_stream.write(data.data(), data.size());
+		}
+	}
+}
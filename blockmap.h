@@ -0,0 +1,69 @@
+
+// blockmap builder - grid of blocks with lists of linedefs of the generated UDMF map, the game finds
+// linedefs near actors (collisions, hitscan attacks) by them
+// BLOCKMAP lump format: https://doomwiki.org/wiki/Blockmap
+
+#ifndef _ROAD_GEN_BLOCKMAP_H_
+#define _ROAD_GEN_BLOCKMAP_H_
+
+#include "common.h"
+#include "udmf.h"
+#include "io.h"
+
+#include <cstdint>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BlockGrid - blocks of the blockmap and the lump data; the lump is a sequence of 16-bit words: header
+// (origin, columns and rows), offset of the list of each block (in words from the lump start, rows go
+// from the bottom), lists of linedefs (each starts with 0 and ends with 0xFFFF)
+
+namespace RoadGen {
+	namespace Blockmap {
+		// size of square blocks in map units
+		const int BLOCK_SIZE = 128;
+
+		// the lump is addressed by 16-bit offsets, 0xFFFF ends lists of linedefs
+		const uint32_t LUMP_WORDS_MAX = 0xFFFF;
+		const uint16_t LIST_END = 0xFFFF;
+
+		struct BlockGrid {
+			// the bottom left corner of the grid
+			int16_t origin_x, origin_y;
+			uint16_t columns_count, rows_count;
+
+			// number of different lists of linedefs, blocks with the same lists share one list in the lump
+			uint32_t lists_count;
+
+			// number of linedefs the game loads (zero length ones are removed)
+			uint32_t linedefs_count;
+
+			// size of the lump in words; 'words' are empty if the lump does not fit into the format
+			uint32_t words_count;
+			std::vector<uint16_t> words;
+
+			BlockGrid()
+				: origin_x(0)
+				, origin_y(0)
+				, columns_count(0)
+				, rows_count(0)
+				, lists_count(0)
+				, linedefs_count(0)
+				, words_count(0)
+			{}
+		};
+
+		// build the blockmap of the map: a linedef is put into the blocks of each column, that its line clipped
+		// by the column passes (lines closer to a block than 1/256 of a unit are put into it too); linedefs are
+		// numbered as the game numbers them (zero length ones are removed); 'float_precision' - precision
+		// of coordinates in the written TEXTMAP, the blockmap is built for the rounded coordinates;
+		// returns 'false' if the lump does not fit into the format (65536 words or more, 65535 linedefs
+		// or more), the game builds its own blockmap then; throws if the map coordinates are out of map limits
+		bool BuildBlockmap(const Udmf::Map& map, unsigned char float_precision, BlockGrid& blockmap);
+
+		// write the blockmap as BLOCKMAP lump data
+		void WriteBlockmapToStream(const BlockGrid& blockmap, Io::OutStream& out_stream);
+	}
+}
+
+#endif // _ROAD_GEN_BLOCKMAP_H_
@@ -1,6 +1,8 @@
 
 #include "core.h"
 
+#include <atomic>
+#include <thread>
 #include <unordered_set>
 
 
@@ -182,6 +184,62 @@ namespace RoadGen {
 		} else {
 			config.light_level = 192;
 		}
+
+		const auto max_sector_linedefs_it = config_data.find("MaxSectorLinedefs");
+		if(max_sector_linedefs_it != config_data.end()) {
+			const Io::ConfigDataEntryArray& entries = max_sector_linedefs_it->second;
+			if(    entries.size() != 1
+				|| !entries[0].name.empty()
+				|| entries[0].fields.size() != 1
+				|| !entries[0].fields[0].name.empty()
+				|| entries[0].fields[0].field_type != Io::ConfigDataEntry::Field::enType_Int
+				|| entries[0].fields[0].value_int != 0 && (entries[0].fields[0].value_int < 32 || entries[0].fields[0].value_int > 65535))
+			{
+				throw Exception("bad road config - bad or empty value of 'MaxSectorLinedefs' setting, must be 0 or between 32 and 65535");
+			}
+
+			config.max_sector_linedefs = (unsigned int)entries[0].fields[0].value_int;
+		}
+
+		const auto road_mark_mode_it = config_data.find("RoadMarkMode");
+		if(road_mark_mode_it != config_data.end()) {
+			const Io::ConfigDataEntryArray& entries = road_mark_mode_it->second;
+			if(    entries.size() != 1
+				|| !entries[0].name.empty()
+				|| entries[0].fields.size() != 1
+				|| !entries[0].fields[0].name.empty()
+				|| entries[0].fields[0].field_type != Io::ConfigDataEntry::Field::enType_String
+				|| entries[0].fields[0].value_string != "sectors" && entries[0].fields[0].value_string != "texture")
+			{
+				throw Exception("bad road config - bad or empty value of 'RoadMarkMode' setting, must be \"sectors\" or \"texture\"");
+			}
+
+			config.road_mark_mode =
+				(entries[0].fields[0].value_string == "texture")
+					? RoadConfig::enRoadMarkMode_Texture
+					: RoadConfig::enRoadMarkMode_Sectors;
+		}
+
+		const auto fence_mode_it = config_data.find("FenceMode");
+		if(fence_mode_it != config_data.end()) {
+			const Io::ConfigDataEntryArray& entries = fence_mode_it->second;
+			if(    entries.size() != 1
+				|| !entries[0].name.empty()
+				|| entries[0].fields.size() != 1
+				|| !entries[0].fields[0].name.empty()
+				|| entries[0].fields[0].field_type != Io::ConfigDataEntry::Field::enType_String
+				|| entries[0].fields[0].value_string != "sectors" && entries[0].fields[0].value_string != "wall"
+				   && entries[0].fields[0].value_string != "sky")
+			{
+				throw Exception("bad road config - bad or empty value of 'FenceMode' setting, must be \"sectors\", \"wall\" or \"sky\"");
+			}
+
+			const std::string& fence_mode = entries[0].fields[0].value_string;
+			config.fence_mode =
+				(fence_mode == "wall")
+					? RoadConfig::enFenceMode_Wall
+					: (fence_mode == "sky") ? RoadConfig::enFenceMode_Sky : RoadConfig::enFenceMode_Sectors;
+		}
 	}
 }
 
@@ -596,6 +654,132 @@ namespace RoadGen {
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RoadCenterLine implementation
+
+namespace RoadGen {
+	void RoadCenterLine::Start(double x, double y, double angle, double zfloor) {
+		m_points.clear();
+		m_points.push_back(Point(0.0, x, y, angle, zfloor));
+	}
+
+	void RoadCenterLine::AddPoint(double x, double y, double angle, double zfloor) {
+		if(m_points.empty()) {
+			throw Exception("error generating a road - center line is not started, cannot add a point");
+		}
+
+		const Point& last_point = m_points.back();
+		const double distance = last_point.distance + Math::Get2DDistance(last_point.x, last_point.y, x, y);
+		m_points.push_back(Point(distance, x, y, angle, zfloor));
+	}
+
+	bool RoadCenterLine::IsEmpty() const {
+		return m_points.empty();
+	}
+
+	double RoadCenterLine::GetLength() const {
+		return m_points.empty() ? 0.0 : m_points.back().distance;
+	}
+
+	RoadCenterLine::Point RoadCenterLine::GetPointAt(double distance) const {
+		if(m_points.empty() || distance < 0.0 || distance > m_points.back().distance) {
+			throw Exception("error generating a road - center line distance '" + std::to_string(distance) + "' is out of range");
+		}
+
+		// the first point with the distance not less than the given one
+		size_t low = 0, high = m_points.size() - 1;
+		while(low < high) {
+			const size_t middle = (low + high) / 2;
+			if(m_points[middle].distance < distance) {
+				low = middle + 1;
+
+			} else {
+				high = middle;
+			}
+		}
+
+		const Point& p2 = m_points[low];
+		if(low == 0 || Math::IsZeroOrCloseTo(p2.distance - distance)) {
+			return Point(distance, p2.x, p2.y, p2.angle, p2.zfloor);
+		}
+
+		// the point is on the segment going to 'p2'
+		const Point& p1 = m_points[low - 1];
+		const double k = (distance - p1.distance) / (p2.distance - p1.distance);
+		return Point(distance,
+					 p1.x + k * (p2.x - p1.x),
+					 p1.y + k * (p2.y - p1.y),
+					 p2.angle,
+					 p1.zfloor + k * (p2.zfloor - p1.zfloor));
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RoadCenterTrace implementation
+
+namespace RoadGen {
+	RoadCenterTrace::RoadCenterTrace(const RoadFigureData& input_data)
+		: m_arcs(input_data.size())
+	{
+		// the default figure starts at the origin
+		Udmf::Vertex v_null(0.0, 0.0);
+		double angle = 0.0;
+
+		for(size_t i=0; i<input_data.size(); i++) {
+			const RoadFigureObject& obj = input_data[i];
+			if(obj.type == RoadFigureObject::enType_StartModifier) {
+				v_null = Udmf::Vertex(obj.start_modifier.x_null, obj.start_modifier.y_null);
+				angle = Math::GetNormalizedAngle(obj.start_modifier.angle);
+
+			} else if(obj.type == RoadFigureObject::enType_Line) {
+				v_null = v_null.GetMoved(obj.line.length * Math::Cos(angle), obj.line.length * Math::Sin(angle));
+
+			} else if(obj.type == RoadFigureObject::enType_Arc) {
+				TraceArc(obj.arc, v_null, angle, m_arcs[i]);
+				if(!m_arcs[i].steps.empty()) {
+					v_null = m_arcs[i].steps.back().v_null;
+					angle = m_arcs[i].steps.back().angle;
+				}
+			}
+		}
+	}
+
+	const RoadCenterTrace::Arc* RoadCenterTrace::GetArc(size_t object_index) const {
+		return (object_index < m_arcs.size() && !m_arcs[object_index].steps.empty()) ? &m_arcs[object_index] : NULL;
+	}
+
+	void RoadCenterTrace::TraceArc(const RoadFigureObject::ArcData& arc, const Udmf::Vertex& v_null, double angle, Arc& arc_trace) {
+		arc_trace.v_null = v_null;
+		arc_trace.angle = angle;
+		arc_trace.steps.clear();
+
+		if(arc.divider < 2 || Math::IsZeroOrCloseTo(arc.angle)) {
+			return;
+		}
+
+		const double turn_sign = (arc.angle > 0) ? 1.0 : -1.0;
+		const double angle_abs = turn_sign * arc.angle;
+		arc_trace.cx = v_null.x - turn_sign * arc.curve * Math::Sin(angle);
+		arc_trace.cy = v_null.y + turn_sign * arc.curve * Math::Cos(angle);
+
+		const double step = angle_abs / arc.divider;
+		arc_trace.steps.resize(arc.divider);
+		Udmf::Vertex v_step_null = v_null;
+		double step_angle = angle;
+		for(int angix=0; angix<arc.divider; angix++) {
+			Step& s = arc_trace.steps[angix];
+			s.da = (angix < (arc.divider - 1)) ? step : (angle_abs - (arc.divider - 1)*step);
+			s.v_null = v_step_null.GetRotated(arc_trace.cx, arc_trace.cy, turn_sign * s.da);
+			s.angle = Math::GetNormalizedAngle(step_angle + turn_sign * s.da);
+
+			v_step_null = s.v_null;
+			step_angle = s.angle;
+		}
+	}
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // RoadFigure implementation
 
@@ -637,6 +821,8 @@ namespace RoadGen {
 							+ ", fence_hight = " + std::to_string(m_config.sizes.fence_height));
 		}
 
+		m_counted_sidedefs_end = m_map.GetEndIds().sidedef;
+
 		// set map object template objects;
 		// then during building process copy values from these template objects
 		// and insert into the map with proper linking (setting of IDs)
@@ -648,36 +834,48 @@ namespace RoadGen {
 		m_v_background_west_left =
 			m_v_null.GetMoved(-background_gap_big, -background_gap_big - m_config.sizes.road_width/2.0 - m_config.sizes.road_side_width)
 				.GetRotated(m_v_null.x, m_v_null.y, m_angle);
-		m_last_ids[&m_v_background_west_left] = m_map << m_v_background_west_left;
-
 		m_v_background_west_right =
 			m_v_null.GetMoved(-background_gap_small, -background_gap_small - m_config.sizes.road_width/2.0 - m_config.sizes.road_side_width)
 				.GetRotated(m_v_null.x, m_v_null.y, m_angle);
-		m_last_ids[&m_v_background_west_right] = m_map << m_v_background_west_right;
-
 		m_v_background_east_left =
 			m_v_null.GetMoved(-background_gap_small, background_gap_small + m_config.sizes.road_width/2.0 + m_config.sizes.road_side_width)
 				.GetRotated(m_v_null.x, m_v_null.y, m_angle);
-		m_last_ids[&m_v_background_east_left] = m_map << m_v_background_east_left;
-
 		m_v_background_east_right =
 			m_v_null.GetMoved(-background_gap_big, background_gap_big + m_config.sizes.road_width/2.0 + m_config.sizes.road_side_width)
 				.GetRotated(m_v_null.x, m_v_null.y, m_angle);
-		m_last_ids[&m_v_background_east_right] = m_map << m_v_background_east_right;
 
-		m_last_ids[&m_s_background_sky] = m_map << m_s_background_sky;
-		const unsigned int id_s_background_body =
-			m_last_ids[&m_s_background_body_east] =
-			m_last_ids[&m_s_background_body_west] =
-				m_map << m_s_background_body_east;
+		// lean fence - the sky sector is bounded by the road frame from inside, no background body
+		if(m_have_background_sky) {
+			m_last_ids[&m_v_background_west_left] = m_map << m_v_background_west_left;
+			if(m_have_fence_sectors) {
+				m_last_ids[&m_v_background_west_right] = m_map << m_v_background_west_right;
+				m_last_ids[&m_v_background_east_left] = m_map << m_v_background_east_left;
+			}
+			m_last_ids[&m_v_background_east_right] = m_map << m_v_background_east_right;
+
+			m_last_ids[&m_s_background_sky] = m_map << m_s_background_sky;
+		}
+
+		unsigned int id_s_background_body = Udmf::ID_INVALID;
+		if(m_have_fence_sectors) {
+			id_s_background_body =
+				m_last_ids[&m_s_background_body_east] =
+				m_last_ids[&m_s_background_body_west] =
+					m_map << m_s_background_body_east;
+		}
+
+		if(m_have_background_sky) {
+			const unsigned int id_sd_background_sky = m_map << Sidedef(m_last_ids.at(&m_s_background_sky));
+			m_map << Linedef(m_last_ids.at(&m_v_background_west_left), m_last_ids.at(&m_v_background_east_right),
+							 id_sd_background_sky);
+		}
 
-		const unsigned int id_sd_background_sky = m_map << Sidedef(m_last_ids.at(&m_s_background_sky));
-		m_map << Linedef(m_last_ids.at(&m_v_background_west_left), m_last_ids.at(&m_v_background_east_right),
-						 id_sd_background_sky);
-		const unsigned int id_sd_background_body_outer = m_map << Sidedef(m_last_ids.at(&m_s_background_sky));
-		const unsigned int id_sd_background_body_inner = m_map << Sidedef(id_s_background_body);
-		m_map << Linedef(m_last_ids.at(&m_v_background_west_right), m_last_ids.at(&m_v_background_east_left),
-						 id_sd_background_body_inner, id_sd_background_body_outer);
+		if(m_have_fence_sectors) {
+			const unsigned int id_sd_background_body_outer = m_map << Sidedef(m_last_ids.at(&m_s_background_sky));
+			const unsigned int id_sd_background_body_inner = m_map << Sidedef(id_s_background_body);
+			m_map << Linedef(m_last_ids.at(&m_v_background_west_right), m_last_ids.at(&m_v_background_east_left),
+							 id_sd_background_body_inner, id_sd_background_body_outer);
+		}
 
 		const Vertex v_background_next_west_left =
 			m_v_null.GetMoved(0, -background_gap_big - m_config.sizes.road_width/2.0 - m_config.sizes.road_side_width)
@@ -700,40 +898,40 @@ namespace RoadGen {
 			m_v_null.GetMoved(-background_gap_big + FENCE_BACKGROUND_GAP,
 							  -background_gap_big - m_config.sizes.road_width/2.0 - m_config.sizes.road_side_width + FENCE_BACKGROUND_GAP)
 				.GetRotated(m_v_null.x, m_v_null.y, m_angle);
-		m_last_ids[&m_v_fence_west_left] = m_map << m_v_fence_west_left;
-
 		m_v_fence_west_right =
 			m_v_null.GetMoved(-background_gap_small + FENCE_BACKGROUND_GAP,
 							  -background_gap_small - m_config.sizes.road_width/2.0 - m_config.sizes.road_side_width + FENCE_BACKGROUND_GAP)
 				.GetRotated(m_v_null.x, m_v_null.y, m_angle);
-		m_last_ids[&m_v_fence_west_right] = m_map << m_v_fence_west_right;
-
 		m_v_fence_east_left =
 			m_v_null.GetMoved(-background_gap_small + FENCE_BACKGROUND_GAP,
 							  background_gap_small + m_config.sizes.road_width/2.0f + m_config.sizes.road_side_width - FENCE_BACKGROUND_GAP)
 				.GetRotated(m_v_null.x, m_v_null.y, m_angle);
-		m_last_ids[&m_v_fence_east_left] = m_map << m_v_fence_east_left;
-
 		m_v_fence_east_right =
 			m_v_null.GetMoved(-background_gap_big + FENCE_BACKGROUND_GAP,
 							  background_gap_big + m_config.sizes.road_width/2.0 + m_config.sizes.road_side_width - FENCE_BACKGROUND_GAP)
 				.GetRotated(m_v_null.x, m_v_null.y, m_angle);
-		m_last_ids[&m_v_fence_east_right] = m_map << m_v_fence_east_right;
 
-		const unsigned int id_s_fence =
-			m_last_ids[&m_s_fence_west] =
-			m_last_ids[&m_s_fence_east] =
-				m_map << m_s_fence_west;
+		if(m_have_fence_sectors) {
+			m_last_ids[&m_v_fence_west_left] = m_map << m_v_fence_west_left;
+			m_last_ids[&m_v_fence_west_right] = m_map << m_v_fence_west_right;
+			m_last_ids[&m_v_fence_east_left] = m_map << m_v_fence_east_left;
+			m_last_ids[&m_v_fence_east_right] = m_map << m_v_fence_east_right;
 
-		const unsigned int id_sd_fence_far_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body);
-		const unsigned int id_sd_fence_far_inner = m_map << Sidedef(id_s_fence);
-		m_map << Linedef(m_last_ids.at(&m_v_fence_west_left), m_last_ids.at(&m_v_fence_east_right),
-						 id_sd_fence_far_inner, id_sd_fence_far_outer);
+			const unsigned int id_s_fence =
+				m_last_ids[&m_s_fence_west] =
+				m_last_ids[&m_s_fence_east] =
+					m_map << m_s_fence_west;
 
-		const unsigned int id_sd_fence_near_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body);
-		const unsigned int id_sd_fence_near_inner = m_map << Sidedef(id_s_fence);
-		m_map << Linedef(m_last_ids.at(&m_v_fence_east_left), m_last_ids.at(&m_v_fence_west_right),
-						 id_sd_fence_near_inner, id_sd_fence_near_outer);
+			const unsigned int id_sd_fence_far_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body);
+			const unsigned int id_sd_fence_far_inner = m_map << Sidedef(id_s_fence);
+			m_map << Linedef(m_last_ids.at(&m_v_fence_west_left), m_last_ids.at(&m_v_fence_east_right),
+							 id_sd_fence_far_inner, id_sd_fence_far_outer);
+
+			const unsigned int id_sd_fence_near_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body);
+			const unsigned int id_sd_fence_near_inner = m_map << Sidedef(id_s_fence);
+			m_map << Linedef(m_last_ids.at(&m_v_fence_east_left), m_last_ids.at(&m_v_fence_west_right),
+							 id_sd_fence_near_inner, id_sd_fence_near_outer);
+		}
 
 		const Vertex v_fence_next_west_left =
 			m_v_null.GetMoved(0, -background_gap_big - m_config.sizes.road_width/2.0 - m_config.sizes.road_side_width + FENCE_BACKGROUND_GAP)
@@ -775,19 +973,19 @@ namespace RoadGen {
 		m_last_ids[&m_s_west_side] = m_map << m_s_west_side;
 		m_last_ids[&m_s_east_side] = m_map << m_s_east_side;
 
-		const unsigned int id_sd_west_outer = m_map << m_sd_roadside.GetWithSector(id_s_background_body);
-		const unsigned int id_sd_west_inner = m_map << Sidedef(m_last_ids.at(&m_s_west_side));
+		const unsigned int id_sd_west_outer = AddFrameOuterSidedef(m_sd_roadside, m_s_background_body_west);
+		const unsigned int id_sd_west_inner = AddFrameInnerSidedef(m_s_west_side);
 		m_map << Linedef(m_last_ids.at(&m_v_west_left), m_last_ids.at(&m_v_west_right),
 						 id_sd_west_inner, id_sd_west_outer);
 
-		const unsigned int id_sd_east_outer = m_map << m_sd_roadside.GetWithSector(id_s_background_body);
-		const unsigned int id_sd_east_inner = m_map << Sidedef(m_last_ids.at(&m_s_east_side));
+		const unsigned int id_sd_east_outer = AddFrameOuterSidedef(m_sd_roadside, m_s_background_body_east);
+		const unsigned int id_sd_east_inner = AddFrameInnerSidedef(m_s_east_side);
 		m_map << Linedef(m_last_ids.at(&m_v_east_left), m_last_ids.at(&m_v_east_right),
 						 id_sd_east_inner, id_sd_east_outer);
 
 		m_last_ids[&m_s_body] = m_map << m_s_body;
-		const unsigned int id_sd_middle_outer = m_map << Sidedef(id_s_background_body);
-		const unsigned int id_sd_middle_inner = m_map << Sidedef(m_last_ids.at(&m_s_body));
+		const unsigned int id_sd_middle_outer = AddFrameOuterSidedef(Sidedef(), m_s_background_body_east);
+		const unsigned int id_sd_middle_inner = AddFrameInnerSidedef(m_s_body);
 
 		// add road mark
 		m_v_mark_west =
@@ -797,7 +995,7 @@ namespace RoadGen {
 			m_v_null.GetMoved(0, m_config.sizes.road_mark_width/2.0)
 				.GetRotated(m_v_null.x, m_v_null.y, m_angle);
 
-		const bool have_mark = m_mark_coord < m_config.sizes.road_mark_length;
+		const bool have_mark = m_have_mark_sectors && m_mark_coord < m_config.sizes.road_mark_length;
 		if(have_mark) {
 			m_last_ids[&m_v_mark_east] = m_map << m_v_mark_east;
 			m_last_ids[&m_v_mark_west] = m_map << m_v_mark_west;
@@ -806,13 +1004,13 @@ namespace RoadGen {
 			m_map << Linedef(m_last_ids.at(&m_v_west_right), m_last_ids.at(&m_v_mark_west),
 							 id_sd_middle_inner, id_sd_middle_outer);
 
-			const unsigned int id_sd_mark_inner = m_map << Sidedef(m_last_ids.at(&m_s_mark));
-			const unsigned int id_sd_mark_outer = m_map << m_sd_markside.GetWithSector(id_s_background_body);
+			const unsigned int id_sd_mark_inner = AddFrameInnerSidedef(m_s_mark);
+			const unsigned int id_sd_mark_outer = AddFrameOuterSidedef(m_sd_markside, m_s_background_body_east);
 			m_map << Linedef(m_last_ids.at(&m_v_mark_west), m_last_ids.at(&m_v_mark_east),
 							 id_sd_mark_inner, id_sd_mark_outer);
 
-			const unsigned int id_sd_middle_inner2 = m_map << Sidedef(m_last_ids.at(&m_s_body));
-			const unsigned int id_sd_middle_outer2 = m_map << Sidedef(id_s_background_body);
+			const unsigned int id_sd_middle_inner2 = AddFrameInnerSidedef(m_s_body);
+			const unsigned int id_sd_middle_outer2 = AddFrameOuterSidedef(Sidedef(), m_s_background_body_east);
 			m_map << Linedef(m_last_ids.at(&m_v_mark_east), m_last_ids.at(&m_v_east_left),
 							 id_sd_middle_inner2, id_sd_middle_outer2);
 
@@ -823,6 +1021,9 @@ namespace RoadGen {
 							 id_sd_middle_inner, id_sd_middle_outer);
 		}
 
+		m_center_line.Start(m_v_null.x, m_v_null.y, m_angle, m_floorpos);
+		m_v_null_prev = m_v_null;
+
 		m_sectors_closed = false;
 		m_started_drawing = true;
 	}
@@ -840,6 +1041,10 @@ namespace RoadGen {
 			throw Exception("error generating a road - slope in the end of a figure is not allowed, make a horizontal line/arc after");
 		}
 
+		if(m_config.max_sector_linedefs > 0) {
+			SplitLargeEndSectors();
+		}
+
 		const double cos_angle = Math::Cos(m_angle);
 		const double sin_angle = Math::Sin(m_angle);
 
@@ -851,94 +1056,106 @@ namespace RoadGen {
 						 m_v_background_east_left.GetMoved(background_gap_small * cos_angle, background_gap_small * sin_angle),
 						 m_v_background_east_right.GetMoved(background_gap_big * cos_angle, background_gap_big * sin_angle));
 
-		const unsigned int id_v_background_west_left = m_last_ids.at(&m_v_background_west_left);
-		const unsigned int id_v_background_west_right = m_last_ids.at(&m_v_background_west_right);
-		const unsigned int id_v_background_east_left = m_last_ids.at(&m_v_background_east_left);
-		const unsigned int id_v_background_east_right = m_last_ids.at(&m_v_background_east_right);
-
-		const unsigned int id_s_background_sky = m_last_ids.at(&m_s_background_sky);
-		const unsigned int id_s_background_body_east = m_last_ids.at(&m_s_background_body_east);
-		const unsigned int id_s_background_body_west = m_last_ids.at(&m_s_background_body_west);
-
-		const unsigned int id_sd_background_sky = m_map << Sidedef(id_s_background_sky);
-		m_map << Linedef(id_v_background_east_right, id_v_background_west_left,
-						 id_sd_background_sky);
-
-		const Vertex v_background_middle((m_v_background_east_left.x + m_v_background_west_right.x) / 2.0,
-										 (m_v_background_east_left.y + m_v_background_west_right.y) / 2.0);
-		const unsigned int id_v_background_middle = m_map << v_background_middle;
-
-		const unsigned int id_sd_background_body_outer_east = m_map << Sidedef(id_s_background_sky);
-		const unsigned int id_sd_background_body_inner_east = m_map << Sidedef(id_s_background_body_east);
-		m_map << Linedef(id_v_background_east_left, id_v_background_middle,
-						 id_sd_background_body_inner_east, id_sd_background_body_outer_east);
-
-		const unsigned int id_sd_background_body_outer_west = m_map << Sidedef(id_s_background_sky);
-		const unsigned int id_sd_background_body_inner_west = m_map << Sidedef(id_s_background_body_west);
-		m_map << Linedef(id_v_background_middle, id_v_background_west_right,
-						 id_sd_background_body_inner_west, id_sd_background_body_outer_west);
-
-		// close fence (maybe two separated sectors)
-		const double fence_gap_larger = background_gap_small - FENCE_BACKGROUND_GAP + BACKGROUND_THICKNESS;
-		const double fence_gap_smaller = fence_gap_larger - FENCE_THICKNESS;
-		ExtendFence(m_v_fence_west_left.GetMoved(fence_gap_larger * cos_angle, fence_gap_larger * sin_angle),
-					m_v_fence_west_right.GetMoved(fence_gap_smaller *cos_angle, fence_gap_smaller * sin_angle),
-					m_v_fence_east_left.GetMoved(fence_gap_smaller * cos_angle, fence_gap_smaller * sin_angle),
-					m_v_fence_east_right.GetMoved(fence_gap_larger * cos_angle, fence_gap_larger * sin_angle));
-
-		const unsigned int id_v_fence_west_left = m_last_ids.at(&m_v_fence_west_left);
-		const unsigned int id_v_fence_west_right = m_last_ids.at(&m_v_fence_west_right);
-		const unsigned int id_v_fence_east_left = m_last_ids.at(&m_v_fence_east_left);
-		const unsigned int id_v_fence_east_right = m_last_ids.at(&m_v_fence_east_right);
-
-		const unsigned int id_s_fence_east = m_last_ids.at(&m_s_fence_east);
-		const unsigned int id_s_fence_west = m_last_ids.at(&m_s_fence_west);
-
-		const Vertex v_fence_middle_far((m_v_fence_west_left.x + m_v_fence_east_right.x) / 2.0,
-										(m_v_fence_west_left.y + m_v_fence_east_right.y) / 2.0);
-		const unsigned int id_v_fence_middle_far = m_map << v_fence_middle_far;
-
-		const unsigned int id_sd_fence_east_far_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body_east);
-		const unsigned int id_sd_fence_east_far_inner = m_map << Sidedef(id_s_fence_east);
-		m_map << Linedef(id_v_fence_east_right, id_v_fence_middle_far,
-						 id_sd_fence_east_far_inner, id_sd_fence_east_far_outer);
-
-		const unsigned int id_sd_fence_west_far_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body_west);
-		const unsigned int id_sd_fence_west_far_inner = m_map << Sidedef(id_s_fence_west);
-		m_map << Linedef(id_v_fence_middle_far, id_v_fence_west_left,
-						 id_sd_fence_west_far_inner, id_sd_fence_west_far_outer);
-
-		const Vertex v_fence_middle_near((m_v_fence_west_right.x + m_v_fence_east_left.x) / 2.0,
-										 (m_v_fence_west_right.y + m_v_fence_east_left.y) / 2.0);
-		const unsigned int id_v_fence_middle_near = m_map << v_fence_middle_near;
-
-		const unsigned int id_sd_fence_east_near_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body_east);
-		const unsigned int id_sd_fence_east_near_inner = m_map << Sidedef(id_s_fence_east);
-		m_map << Linedef(id_v_fence_middle_near, id_v_fence_east_left,
-						 id_sd_fence_east_near_inner, id_sd_fence_east_near_outer);
-
-		const unsigned int id_sd_fence_west_near_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body_west);
-		const unsigned int id_sd_fence_west_near_inner = m_map << Sidedef(id_s_fence_west);
-		m_map << Linedef(id_v_fence_west_right, id_v_fence_middle_near,
-						 id_sd_fence_west_near_inner, id_sd_fence_west_near_outer);
+		if(m_have_background_sky) {
+			const unsigned int id_sd_background_sky = m_map << Sidedef(m_last_ids.at(&m_s_background_sky));
+			m_map << Linedef(m_last_ids.at(&m_v_background_east_right), m_last_ids.at(&m_v_background_west_left),
+							 id_sd_background_sky);
+		}
+
+		// lean fence - no background body and fence sectors to close
+		unsigned int seam_vertex_ids[4];
+		IdPair seam_sector_id_pairs[3];
+		if(m_have_fence_sectors) {
+			const unsigned int id_v_background_west_right = m_last_ids.at(&m_v_background_west_right);
+			const unsigned int id_v_background_east_left = m_last_ids.at(&m_v_background_east_left);
+
+			const unsigned int id_s_background_sky = m_last_ids.at(&m_s_background_sky);
+			const unsigned int id_s_background_body_east = m_last_ids.at(&m_s_background_body_east);
+			const unsigned int id_s_background_body_west = m_last_ids.at(&m_s_background_body_west);
+
+			const Vertex v_background_middle((m_v_background_east_left.x + m_v_background_west_right.x) / 2.0,
+											 (m_v_background_east_left.y + m_v_background_west_right.y) / 2.0);
+			const unsigned int id_v_background_middle = m_map << v_background_middle;
+
+			const unsigned int id_sd_background_body_outer_east = m_map << Sidedef(id_s_background_sky);
+			const unsigned int id_sd_background_body_inner_east = m_map << Sidedef(id_s_background_body_east);
+			m_map << Linedef(id_v_background_east_left, id_v_background_middle,
+							 id_sd_background_body_inner_east, id_sd_background_body_outer_east);
+
+			const unsigned int id_sd_background_body_outer_west = m_map << Sidedef(id_s_background_sky);
+			const unsigned int id_sd_background_body_inner_west = m_map << Sidedef(id_s_background_body_west);
+			m_map << Linedef(id_v_background_middle, id_v_background_west_right,
+							 id_sd_background_body_inner_west, id_sd_background_body_outer_west);
+
+			// close fence (maybe two separated sectors)
+			const double fence_gap_larger = background_gap_small - FENCE_BACKGROUND_GAP + BACKGROUND_THICKNESS;
+			const double fence_gap_smaller = fence_gap_larger - FENCE_THICKNESS;
+			ExtendFence(m_v_fence_west_left.GetMoved(fence_gap_larger * cos_angle, fence_gap_larger * sin_angle),
+						m_v_fence_west_right.GetMoved(fence_gap_smaller *cos_angle, fence_gap_smaller * sin_angle),
+						m_v_fence_east_left.GetMoved(fence_gap_smaller * cos_angle, fence_gap_smaller * sin_angle),
+						m_v_fence_east_right.GetMoved(fence_gap_larger * cos_angle, fence_gap_larger * sin_angle));
+
+			const unsigned int id_v_fence_west_left = m_last_ids.at(&m_v_fence_west_left);
+			const unsigned int id_v_fence_west_right = m_last_ids.at(&m_v_fence_west_right);
+			const unsigned int id_v_fence_east_left = m_last_ids.at(&m_v_fence_east_left);
+			const unsigned int id_v_fence_east_right = m_last_ids.at(&m_v_fence_east_right);
+
+			const unsigned int id_s_fence_east = m_last_ids.at(&m_s_fence_east);
+			const unsigned int id_s_fence_west = m_last_ids.at(&m_s_fence_west);
+
+			const Vertex v_fence_middle_far((m_v_fence_west_left.x + m_v_fence_east_right.x) / 2.0,
+											(m_v_fence_west_left.y + m_v_fence_east_right.y) / 2.0);
+			const unsigned int id_v_fence_middle_far = m_map << v_fence_middle_far;
+
+			const unsigned int id_sd_fence_east_far_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body_east);
+			const unsigned int id_sd_fence_east_far_inner = m_map << Sidedef(id_s_fence_east);
+			m_map << Linedef(id_v_fence_east_right, id_v_fence_middle_far,
+							 id_sd_fence_east_far_inner, id_sd_fence_east_far_outer);
+
+			const unsigned int id_sd_fence_west_far_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body_west);
+			const unsigned int id_sd_fence_west_far_inner = m_map << Sidedef(id_s_fence_west);
+			m_map << Linedef(id_v_fence_middle_far, id_v_fence_west_left,
+							 id_sd_fence_west_far_inner, id_sd_fence_west_far_outer);
+
+			const Vertex v_fence_middle_near((m_v_fence_west_right.x + m_v_fence_east_left.x) / 2.0,
+											 (m_v_fence_west_right.y + m_v_fence_east_left.y) / 2.0);
+			const unsigned int id_v_fence_middle_near = m_map << v_fence_middle_near;
+
+			const unsigned int id_sd_fence_east_near_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body_east);
+			const unsigned int id_sd_fence_east_near_inner = m_map << Sidedef(id_s_fence_east);
+			m_map << Linedef(id_v_fence_middle_near, id_v_fence_east_left,
+							 id_sd_fence_east_near_inner, id_sd_fence_east_near_outer);
+
+			const unsigned int id_sd_fence_west_near_outer = m_map << m_sd_fenceside.GetWithSector(id_s_background_body_west);
+			const unsigned int id_sd_fence_west_near_inner = m_map << Sidedef(id_s_fence_west);
+			m_map << Linedef(id_v_fence_west_right, id_v_fence_middle_near,
+							 id_sd_fence_west_near_inner, id_sd_fence_west_near_outer);
+
+			// seams are drawn after the road frame
+			seam_vertex_ids[0] = id_v_background_middle;
+			seam_vertex_ids[1] = id_v_fence_middle_far;
+			seam_vertex_ids[2] = id_v_fence_middle_near;
+			seam_sector_id_pairs[0] = IdPair(id_s_background_body_east, id_s_background_body_west);
+			seam_sector_id_pairs[1] = IdPair(id_s_fence_east, id_s_fence_west);
+			seam_sector_id_pairs[2] = IdPair(id_s_background_body_east, id_s_background_body_west);
+		}
 
 		// close road frame
-		const unsigned int id_s_west = m_last_ids.at(&m_s_west_side);
-		const unsigned int id_s_east = m_last_ids.at(&m_s_east_side);
-		const unsigned int id_s_body = m_last_ids.at(&m_s_body);
-
 		const unsigned int id_v_west_left = m_last_ids.at(&m_v_west_left);
 		const unsigned int id_v_west_right = m_last_ids.at(&m_v_west_right);
 		const unsigned int id_v_east_left = m_last_ids.at(&m_v_east_left);
 		const unsigned int id_v_east_right = m_last_ids.at(&m_v_east_right);
 
-		const unsigned int id_sd_west_outer = m_map << m_sd_roadside.GetWithSector(id_s_background_body_west);
-		const unsigned int id_sd_west_inner = m_map << Sidedef(id_s_west);
+		// all linedefs up to the seams cross the road at its end
+		const unsigned int end_linedefs_begin = m_map.GetEndIds().linedef;
+
+		const unsigned int id_sd_west_outer = AddFrameOuterSidedef(m_sd_roadside, m_s_background_body_west);
+		const unsigned int id_sd_west_inner = AddFrameInnerSidedef(m_s_west_side);
 		m_map << Linedef(id_v_west_right, id_v_west_left,
 						 id_sd_west_inner, id_sd_west_outer);
 
-		const unsigned int id_sd_east_outer = m_map << m_sd_roadside.GetWithSector(id_s_background_body_east);
-		const unsigned int id_sd_east_inner = m_map << Sidedef(id_s_east);
+		const unsigned int id_sd_east_outer = AddFrameOuterSidedef(m_sd_roadside, m_s_background_body_east);
+		const unsigned int id_sd_east_inner = AddFrameInnerSidedef(m_s_east_side);
 		m_map << Linedef(id_v_east_right, id_v_east_left,
 						 id_sd_east_inner, id_sd_east_outer);
 
@@ -946,30 +1163,30 @@ namespace RoadGen {
 								   (m_v_east_left.y + m_v_west_right.y) / 2.0);
 		const unsigned int id_v_body_middle = m_map << v_body_middle;
 
-		const unsigned int id_sd_middle_outer_east = m_map << Sidedef(id_s_background_body_east);
-		const unsigned int id_sd_middle_inner_east = m_map << Sidedef(id_s_body);
+		const unsigned int id_sd_middle_outer_east = AddFrameOuterSidedef(Sidedef(), m_s_background_body_east);
+		const unsigned int id_sd_middle_inner_east = AddFrameInnerSidedef(m_s_body);
 
-		const unsigned int id_sd_middle_outer_west = m_map << Sidedef(id_s_background_body_west);
-		const unsigned int id_sd_middle_inner_west = m_map << Sidedef(id_s_body);
+		const unsigned int id_sd_middle_outer_west = AddFrameOuterSidedef(Sidedef(), m_s_background_body_west);
+		const unsigned int id_sd_middle_inner_west = AddFrameInnerSidedef(m_s_body);
 
-		const bool have_mark =   !Math::IsZeroOrCloseTo(m_mark_coord) && m_mark_coord < m_config.sizes.road_mark_length
-							  || Math::IsZeroOrCloseTo(m_mark_coord - m_config.sizes.road_mark_length);
+		const bool have_mark =    m_have_mark_sectors
+							   && (   !Math::IsZeroOrCloseTo(m_mark_coord) && m_mark_coord < m_config.sizes.road_mark_length
+								   || Math::IsZeroOrCloseTo(m_mark_coord - m_config.sizes.road_mark_length));
 		if(have_mark && !m_mark_sector_closed) {
 			// close road mark sector
 			const unsigned int id_v_mark_east = m_last_ids.at(&m_v_mark_east);
 			const unsigned int id_v_mark_west = m_last_ids.at(&m_v_mark_west);
-			const unsigned int id_s_mark = m_last_ids.at(&m_s_mark);
 
 			m_map << Linedef(id_v_east_left, id_v_mark_east,
 							 id_sd_middle_inner_east, id_sd_middle_outer_east);
 
-			const unsigned int id_sd_mark_inner_east = m_map << Sidedef(id_s_mark);
-			const unsigned int id_sd_mark_outer_east = m_map << m_sd_markside.GetWithSector(id_s_background_body_east);
+			const unsigned int id_sd_mark_inner_east = AddFrameInnerSidedef(m_s_mark);
+			const unsigned int id_sd_mark_outer_east = AddFrameOuterSidedef(m_sd_markside, m_s_background_body_east);
 			m_map << Linedef(id_v_mark_east, id_v_body_middle,
 							 id_sd_mark_inner_east, id_sd_mark_outer_east);
 
-			const unsigned int id_sd_mark_inner_west = m_map << Sidedef(id_s_mark);
-			const unsigned int id_sd_mark_outer_west = m_map << m_sd_markside.GetWithSector(id_s_background_body_west);
+			const unsigned int id_sd_mark_inner_west = AddFrameInnerSidedef(m_s_mark);
+			const unsigned int id_sd_mark_outer_west = AddFrameOuterSidedef(m_sd_markside, m_s_background_body_west);
 			m_map << Linedef(id_v_body_middle, id_v_mark_west,
 							 id_sd_mark_inner_west, id_sd_mark_outer_west);
 
@@ -986,33 +1203,95 @@ namespace RoadGen {
 							 id_sd_middle_inner_west, id_sd_middle_outer_west);
 		}
 
+		if(m_finish_action.special != Udmf::ID_NULL) {
+			for(unsigned int id_l=end_linedefs_begin; id_l<m_map.GetEndIds().linedef; id_l++) {
+				Linedef& l = m_map.GetLinedef(id_l);
+				l.action_special = m_finish_action;
+
+				// lean fence - the road end is a wall, it is bumped instead of being crossed
+				if(!m_have_fence_sectors && l.action_special.playercross) {
+					l.action_special.playercross = false;
+					l.action_special.playerpush = true;
+				}
+			}
+		}
+
 		// draw the line, separating two sectors for each group, that were created for slope needs,
 		// groups are: background body, fence
-		const unsigned int seam_vertex_ids[] = { 
-					id_v_background_middle, 
-					id_v_fence_middle_far,
-					id_v_fence_middle_near,
-					id_v_body_middle };
-		const IdPair seam_sector_id_pairs[] = {
-			IdPair(id_s_background_body_east, id_s_background_body_west),
-			IdPair(id_s_fence_east, id_s_fence_west),
-			IdPair(id_s_background_body_east, id_s_background_body_west),
-		};
-
-		for(int i=0; i<_countof(seam_sector_id_pairs); i++) {
-			const IdPair& sector_id_pair = seam_sector_id_pairs[i];
-			const unsigned int id_sd_front = m_map << Sidedef(sector_id_pair.first);
-			const unsigned int id_sd_back = m_map << Sidedef(sector_id_pair.second);
-			m_map << Linedef(seam_vertex_ids[i], seam_vertex_ids[i+1],
-							 id_sd_front, id_sd_back);
+		if(m_have_fence_sectors) {
+			seam_vertex_ids[3] = id_v_body_middle;
+			for(int i=0; i<_countof(seam_sector_id_pairs); i++) {
+				const IdPair& sector_id_pair = seam_sector_id_pairs[i];
+				const unsigned int id_sd_front = m_map << Sidedef(sector_id_pair.first);
+				const unsigned int id_sd_back = m_map << Sidedef(sector_id_pair.second);
+				m_map << Linedef(seam_vertex_ids[i], seam_vertex_ids[i+1],
+								 id_sd_front, id_sd_back);
+			}
 		}
 
+		PutThings();
+
 		m_sectors_closed = true;
 		m_started_drawing = false;
 		m_finished_drawing = true;
 	}
 
-	RoadFigure& RoadFigure::operator<< (const IRoadFigureObject::LineData& line) {
+	void RoadFigure::SetFinishAction(const Udmf::Linedef::ActionSpecial& finish_action) {
+		if(m_finished_drawing) {
+			throw Exception("error generating a road - already finished generating this figure, cannot set finish action");
+		}
+
+		m_finish_action = finish_action;
+	}
+
+	double RoadFigure::GetMaxDistanceFromCenterLine(const RoadConfig& config) {
+		// background corners are moved back/forth from the figure ends by the background gap
+		const double background_gap_big = config.sizes.background_dist + BACKGROUND_THICKNESS;
+		return     BACKGROUND_THICKNESS + config.sizes.background_dist + config.sizes.road_side_width + config.sizes.road_width/2.0
+				 + background_gap_big;
+	}
+
+	const RoadCenterLine& RoadFigure::GetCenterLine() const {
+		return m_center_line;
+	}
+
+	void RoadFigure::SetArcTrace(const RoadCenterTrace::Arc* arc_trace) {
+		m_arc_trace = arc_trace;
+	}
+
+	Udmf::MapIds RoadFigure::GetOpenIds() const {
+		Udmf::MapIds open_ids = m_map.GetEndIds();
+		if(!m_started_drawing) {
+			// not started or finished, elements of the figure do not change
+			return open_ids;
+		}
+
+		const void* const sector_templates[] = {&m_s_body, &m_s_east_side, &m_s_west_side, &m_s_mark,
+												&m_s_background_body_west, &m_s_background_body_east, &m_s_background_sky,
+												&m_s_fence_west, &m_s_fence_east};
+		for(auto it = m_last_ids.begin(); it != m_last_ids.end(); it++) {
+			bool is_sector = false;
+			for(size_t six=0; six<sizeof(sector_templates)/sizeof(sector_templates[0]); six++) {
+				is_sector |= (it->first == sector_templates[six]);
+			}
+
+			unsigned int& open_id = is_sector ? open_ids.sector : open_ids.vertex;
+			open_id = std::min(open_id, it->second);
+		}
+
+		for(auto it = m_v_mark_ids_prev.begin(); it != m_v_mark_ids_prev.end(); it++) {
+			open_ids.vertex = std::min(open_ids.vertex, std::min(it->second.first, it->second.second));
+		}
+
+		if(m_config.max_sector_linedefs > 0) {
+			open_ids.sidedef = std::min(open_ids.sidedef, m_counted_sidedefs_end);
+		}
+
+		// Finish changes only the linedefs it adds, other linedefs are final
+		return open_ids;
+	}
+
+	RoadFigure& RoadFigure::operator<< (const RoadFigureObject::LineData& line) {
 		if(!m_started_drawing || m_finished_drawing) {
 			throw Exception("error generating a road - did not start drawing or already finished drawing before drawing a line");
 		}
@@ -1024,40 +1303,26 @@ namespace RoadGen {
 		const double dx = line.length * Math::Cos(m_angle);
 		const double dy = line.length * Math::Sin(m_angle);
 
-		const Vertex v_new_background_west_left = m_v_background_west_left.GetMoved(dx, dy);
-		const Vertex v_new_background_west_right = m_v_background_west_right.GetMoved(dx, dy);
-		const Vertex v_new_background_east_left = m_v_background_east_left.GetMoved(dx, dy);
-		const Vertex v_new_background_east_right = m_v_background_east_right.GetMoved(dx, dy);
-
-		ExtendBackground(v_new_background_west_left, v_new_background_west_right,
-						 v_new_background_east_left, v_new_background_east_right);
-
-		const Vertex v_new_fence_west_left = m_v_fence_west_left.GetMoved(dx, dy);
-		const Vertex v_new_fence_west_right = m_v_fence_west_right.GetMoved(dx, dy);
-		const Vertex v_new_fence_east_left = m_v_fence_east_left.GetMoved(dx, dy);
-		const Vertex v_new_fence_east_right = m_v_fence_east_right.GetMoved(dx, dy);
-		ExtendFence(v_new_fence_west_left, v_new_fence_west_right,
-					v_new_fence_east_left, v_new_fence_east_right);
-
-		const Vertex v_new_west_left = m_v_west_left.GetMoved(dx, dy);
-		const Vertex v_new_west_right = m_v_west_right.GetMoved(dx, dy);
-		const Vertex v_new_east_left = m_v_east_left.GetMoved(dx, dy);
-		const Vertex v_new_east_right = m_v_east_right.GetMoved(dx, dy);
-		ExtendBody(v_new_west_left, v_new_west_right, v_new_east_left, v_new_east_right);
+		if(Math::IsZeroOrCloseTo(m_slope_modifier.tangent)) {
+			if(m_have_mark_sectors && m_config.max_sector_linedefs > 0) {
+				DrawMarkedLine(line.length);
 
-		const Vertex v_new_mark_west = m_v_mark_west.GetMoved(dx, dy);
-		const Vertex v_new_mark_east = m_v_mark_east.GetMoved(dx, dy);
-		ExtendMark(v_new_mark_west, v_new_mark_east);
+			} else if(m_have_mark_sectors) {
+				DrawLineT<false, true>(dx, dy);
 
-		const Vertex v_new_null = m_v_null.GetMoved(dx, dy);
-		SetNullVertex(v_new_null);
+			} else {
+				DrawLineT<false, false>(dx, dy);
+			}
 
-		m_sectors_closed = false;
+		} else if(m_have_mark_sectors) {
+			DrawLineT<true, true>(dx, dy);
 
-		if(!Math::IsZeroOrCloseTo(m_slope_modifier.tangent)) {
-			CloseSectors();
+		} else {
+			DrawLineT<true, false>(dx, dy);
 		}
 
+		AddCenterLinePoint(m_angle);
+
 		m_v_mark_ids_prev.clear();
 		m_have_shapes = true;
 		m_have_shape_with_current_slope = true;
@@ -1065,7 +1330,7 @@ namespace RoadGen {
 		return *this;
 	}
 
-	RoadFigure& RoadFigure::operator<< (const IRoadFigureObject::ArcData& arc) {
+	RoadFigure& RoadFigure::operator<< (const RoadFigureObject::ArcData& arc) {
 		if(!m_started_drawing || m_finished_drawing) {
 			throw Exception("error generating a road - did not start drawing or already finished drawing before drawing an arc");
 		}
@@ -1095,8 +1360,7 @@ namespace RoadGen {
 
 		const double cx = m_v_null.x - turn_sign * arc.curve * Math::Sin(m_angle);
 		const double cy = m_v_null.y + turn_sign * arc.curve * Math::Cos(m_angle);
-		const int steps_count = arc.divider;
-		const double step = angle_abs / steps_count;
+		const double step = angle_abs / arc.divider;
 
 		// restrict little angles;
 		// figure out, whether it is too small angle or not
@@ -1124,53 +1388,32 @@ namespace RoadGen {
 			}
 		}
 
+		// the traced arc is of use, if the figure has not drifted from the trace (e. g. by line pieces)
+		RoadCenterTrace::Arc arc_trace_own;
+		const RoadCenterTrace::Arc* arc_trace = m_arc_trace;
+		m_arc_trace = NULL;
+		if(arc_trace == NULL || arc_trace->v_null.x != m_v_null.x || arc_trace->v_null.y != m_v_null.y || arc_trace->angle != m_angle) {
+			RoadCenterTrace::TraceArc(arc, m_v_null, m_angle, arc_trace_own);
+			arc_trace = &arc_trace_own;
+		}
+
 		if(m_intersection_checker) {
 			m_intersection_checker->StartEncirclingQuad();
 		}
 
-		for(int angix=0; angix<steps_count; angix++) {
-			const double da = (angix < (steps_count - 1)) ? step : (angle_abs - (steps_count - 1)*step);
-
-			const double cur_angle = Math::GetNormalizedAngle(m_angle + turn_sign * da);
-			const Vertex v_new_null = m_v_null.GetRotated(cx, cy, turn_sign * da);
-			std::vector<Vertex*> source_vertices;
-			source_vertices.push_back(&m_v_background_west_left);
-			source_vertices.push_back(&m_v_background_west_right);
-			source_vertices.push_back(&m_v_background_east_left);
-			source_vertices.push_back(&m_v_background_east_right);
-			source_vertices.push_back(&m_v_fence_west_left);
-			source_vertices.push_back(&m_v_fence_west_right);
-			source_vertices.push_back(&m_v_fence_east_left);
-			source_vertices.push_back(&m_v_fence_east_right);
-			source_vertices.push_back(&m_v_west_left);
-			source_vertices.push_back(&m_v_west_right);
-			source_vertices.push_back(&m_v_east_left);
-			source_vertices.push_back(&m_v_east_right);
-			source_vertices.push_back(&m_v_mark_west);
-			source_vertices.push_back(&m_v_mark_east);
-
-			// map: prev vertex address -> new vertex
-			std::unordered_map<Vertex*, Vertex> vertices;
-			GetMovedVertices(source_vertices, m_v_null, v_new_null, cur_angle, vertices);
-
-			ExtendBackground(vertices.at(&m_v_background_west_left), vertices.at(&m_v_background_west_right),
-							 vertices.at(&m_v_background_east_left), vertices.at(&m_v_background_east_right));
-			ExtendFence(vertices.at(&m_v_fence_west_left), vertices.at(&m_v_fence_west_right),
-						vertices.at(&m_v_fence_east_left), vertices.at(&m_v_fence_east_right));
-			ExtendBody(vertices.at(&m_v_west_left), vertices.at(&m_v_west_right),
-					   vertices.at(&m_v_east_left), vertices.at(&m_v_east_right));
-			ExtendMark(vertices.at(&m_v_mark_west), vertices.at(&m_v_mark_east));
-
-			SetNullVertex(v_new_null);
-
-			m_sectors_closed = false;
+		if(Math::IsZeroOrCloseTo(m_slope_modifier.tangent)) {
+			if(m_have_mark_sectors) {
+				DrawArcT<false, true>(turn_sign, *arc_trace);
 
-			if(!Math::IsZeroOrCloseTo(m_slope_modifier.tangent)) {
-				CloseSectors();
+			} else {
+				DrawArcT<false, false>(turn_sign, *arc_trace);
 			}
 
-			m_v_mark_ids_prev.clear();
-			m_angle = cur_angle;
+		} else if(m_have_mark_sectors) {
+			DrawArcT<true, true>(turn_sign, *arc_trace);
+
+		} else {
+			DrawArcT<true, false>(turn_sign, *arc_trace);
 		}
 
 		if(m_intersection_checker) {
@@ -1205,65 +1448,251 @@ namespace RoadGen {
 		return *this;
 	}
 
-	void RoadFigure::InitMapElements() {
-		m_sd_roadside = Sidedef().GetWithBottomTexture(RoadConfig::enTexture_RoadSideWall);
-
-		m_s_body = Sector(m_floorpos, m_ceilingpos,
-						  RoadConfig::enTexture_RoadBody, RoadConfig::enTexture_Sky,
-						  m_config.light_level);
-		m_s_east_side =
-		m_s_west_side = Sector(m_floorpos + m_config.sizes.road_side_height, m_ceilingpos,
-							   RoadConfig::enTexture_RoadSide, RoadConfig::enTexture_Sky,
-							   m_config.light_level);
+	RoadFigure& RoadFigure::operator<< (const RoadFigureObject::ThingsModifierData& things_modifier) {
+		if(!m_started_drawing || m_finished_drawing) {
+			throw Exception("error generating a road - did not start drawing or already finished drawing before adding things");
+		}
 
-		m_sd_markside = Sidedef().GetWithBottomTexture(RoadConfig::enTexture_RoadMark);
+		if(things_modifier.thing_type < 1 || things_modifier.thing_type > 32767) {
+			throw Exception("error generating a road - thing type must be between 1 and 32767 but got '" + std::to_string(things_modifier.thing_type) + "'");
+		}
 
-		m_s_mark = Sector(m_floorpos + MARK_HEIGHT, m_ceilingpos,
-						  RoadConfig::enTexture_RoadMark, RoadConfig::enTexture_Sky,
-						  m_config.light_level);
+		if(things_modifier.every < 1.0 || things_modifier.every > 65535.0) {
+			throw Exception("error generating a road - distance between things must be between 1 and 65535 but got '" + std::to_string(things_modifier.every) + "'");
+		}
 
-		m_s_background_body_east =
-		m_s_background_body_west = Sector(m_floorpos, m_ceilingpos,
-										  RoadConfig::enTexture_Background, RoadConfig::enTexture_Sky,
-										  m_config.light_level);
+		// things are put on the road or on the road sides
+		const double offset_max = m_config.sizes.road_width / 2.0 + m_config.sizes.road_side_width;
+		if(things_modifier.offset < -offset_max || things_modifier.offset > offset_max) {
+			throw Exception("error generating a road - thing offset must be between " + std::to_string(-offset_max) + " and " + std::to_string(offset_max)
+							+ " but got '" + std::to_string(things_modifier.offset) + "'");
+		}
 
-		m_s_background_sky = Sector(m_floorpos, m_floorpos,
-									RoadConfig::enTexture_Background, RoadConfig::enTexture_Sky,
-									m_config.light_level);
+		if(things_modifier.first < 0.0) {
+			throw Exception("error generating a road - distance to the first thing must be non-negative but got '" + std::to_string(things_modifier.first) + "'");
+		}
 
-		m_sd_fenceside = Sidedef().GetWithBottomTexture(RoadConfig::enTexture_Fence);
-		
-		m_s_fence_east =
-		m_s_fence_west = Sector(m_floorpos + m_config.sizes.fence_height, m_ceilingpos,
-								RoadConfig::enTexture_FenceFloor, RoadConfig::enTexture_Sky,
-								m_config.light_level);
+		m_things_modifiers.push_back(std::make_pair(m_center_line.GetLength(), things_modifier));
+		return *this;
 	}
 
-	void RoadFigure::GetMovedVertices(const std::vector<Vertex*>& source_vertices,
-									  const Vertex& v_prev_null,
-									  const Vertex& v_null,
-									  double angle,
-									  std::unordered_map<Vertex*, Vertex>& vertices)
-	{
-		vertices.clear();
-		if(source_vertices.empty()) {
-			return;
+	template<bool HAVE_SLOPE, bool HAVE_MARK_SECTORS, bool ARE_SECTORS_SPLIT>
+	void RoadFigure::DrawLineT(double dx, double dy) {
+		if(!HAVE_SLOPE && !ARE_SECTORS_SPLIT && m_config.max_sector_linedefs > 0) {
+			SplitLargeSectors(Math::Get2DDistance(0.0, 0.0, dx, dy));
 		}
 
-		const double dir_prev_x = source_vertices[0]->x - v_prev_null.x;
-		const double dir_prev_y = source_vertices[0]->y - v_prev_null.y;
-
-		const double p_dir_x = -Math::Sin(angle);
-		const double p_dir_y = Math::Cos(angle);
+		const Vertex v_new_background_west_left = m_v_background_west_left.GetMoved(dx, dy);
+		const Vertex v_new_background_west_right = m_v_background_west_right.GetMoved(dx, dy);
+		const Vertex v_new_background_east_left = m_v_background_east_left.GetMoved(dx, dy);
+		const Vertex v_new_background_east_right = m_v_background_east_right.GetMoved(dx, dy);
 
-		const bool dir_ang_positive = (dir_prev_x*p_dir_x + dir_prev_y*p_dir_y) > 0;
-		
-		// consider that angle between dirs is always acute (do not turn around like 90+ degrees)
-		const double dir_x = dir_ang_positive ? p_dir_x : -p_dir_x;
-		const double dir_y = dir_ang_positive ? p_dir_y : -p_dir_y;
+		ExtendBackground(v_new_background_west_left, v_new_background_west_right,
+						 v_new_background_east_left, v_new_background_east_right);
 
-		for(int i=0; i<source_vertices.size(); i++) {
-			const Vertex& v = *source_vertices[i];
+		const Vertex v_new_fence_west_left = m_v_fence_west_left.GetMoved(dx, dy);
+		const Vertex v_new_fence_west_right = m_v_fence_west_right.GetMoved(dx, dy);
+		const Vertex v_new_fence_east_left = m_v_fence_east_left.GetMoved(dx, dy);
+		const Vertex v_new_fence_east_right = m_v_fence_east_right.GetMoved(dx, dy);
+		ExtendFence(v_new_fence_west_left, v_new_fence_west_right,
+					v_new_fence_east_left, v_new_fence_east_right);
+
+		const Vertex v_new_west_left = m_v_west_left.GetMoved(dx, dy);
+		const Vertex v_new_west_right = m_v_west_right.GetMoved(dx, dy);
+		const Vertex v_new_east_left = m_v_east_left.GetMoved(dx, dy);
+		const Vertex v_new_east_right = m_v_east_right.GetMoved(dx, dy);
+		if(!HAVE_MARK_SECTORS) {
+			StartBodySegment();
+		}
+		ExtendBody(v_new_west_left, v_new_west_right, v_new_east_left, v_new_east_right);
+
+		const Vertex v_new_mark_west = m_v_mark_west.GetMoved(dx, dy);
+		const Vertex v_new_mark_east = m_v_mark_east.GetMoved(dx, dy);
+		if(HAVE_MARK_SECTORS) {
+			ExtendMarkT<HAVE_SLOPE>(v_new_mark_west, v_new_mark_east);
+		}
+
+		const Vertex v_new_null = m_v_null.GetMoved(dx, dy);
+		SetNullVertex(v_new_null);
+
+		m_sectors_closed = false;
+
+		if(!HAVE_MARK_SECTORS) {
+			AlignBodyTexture(m_angle);
+		}
+
+		if(HAVE_SLOPE) {
+			CloseSectorsT<true>();
+		}
+	}
+
+	void RoadFigure::DrawMarkedLine(double length) {
+		const double cos_angle = Math::Cos(m_angle);
+		const double sin_angle = Math::Sin(m_angle);
+
+		for(double length_left = length; length_left > 0.0; ) {
+			// the piece is measured again for the new body sector, if sectors are closed before it
+			SplitLargeSectors(GetMarkedLinePieceLength(length_left));
+			const double piece_length = GetMarkedLinePieceLength(length_left);
+
+			DrawLineT<false, true, true>(piece_length * cos_angle, piece_length * sin_angle);
+			m_v_mark_ids_prev.clear();
+			length_left -= piece_length;
+		}
+	}
+
+	double RoadFigure::GetMarkedLinePieceLength(double length_left) {
+		const double mark_length = m_config.sizes.road_mark_length;
+		const double mark_period = mark_length + m_config.sizes.road_mark_gap;
+
+		// the piece adds two body sides and two more linedefs may close the body sector after it (the figure end
+		// or a seam split by a mark), a mark started before the piece adds less than a whole mark hole
+		const unsigned int sides_count = GetBodySidesCount() + 4;
+		const unsigned int marks_count = (sides_count + 4 < m_config.max_sector_linedefs) ? (m_config.max_sector_linedefs - sides_count) / 4 : 1;
+
+		double piece_length = mark_length + m_config.sizes.road_mark_gap / 2.0 - m_mark_coord;
+		if(piece_length < SMALLEST_MARK_LINE) {
+			piece_length += mark_period;
+		}
+		piece_length += (marks_count - 1) * mark_period;
+
+		// the rest of the line must not be too short to draw
+		return (piece_length > length_left - SMALLEST_MARK_LINE) ? length_left : piece_length;
+	}
+
+	template<bool HAVE_SLOPE, bool HAVE_MARK_SECTORS>
+	void RoadFigure::DrawArcT(double turn_sign, const RoadCenterTrace::Arc& arc_trace) {
+		// vertices to move on each step: four of each frame part and two of the mark, which are not moved
+		// without mark sectors
+		enum EnStepVertices {
+			enStepVertices_Background = 0,
+			enStepVertices_Fence = 4,
+			enStepVertices_Body = 8,
+			enStepVertices_Mark = 12,
+			enStepVertices_Count = 14
+		};
+		const Vertex* const source_vertices[enStepVertices_Count] = {
+			&m_v_background_west_left, &m_v_background_west_right, &m_v_background_east_left, &m_v_background_east_right,
+			&m_v_fence_west_left, &m_v_fence_west_right, &m_v_fence_east_left, &m_v_fence_east_right,
+			&m_v_west_left, &m_v_west_right, &m_v_east_left, &m_v_east_right,
+			&m_v_mark_west, &m_v_mark_east
+		};
+		const size_t moved_vertices_count = HAVE_MARK_SECTORS ? enStepVertices_Count : enStepVertices_Mark;
+
+		for(size_t angix=0; angix<arc_trace.steps.size(); angix++) {
+			const double da = arc_trace.steps[angix].da;
+
+			if(!HAVE_SLOPE && m_config.max_sector_linedefs > 0) {
+				// the mark goes along the center line
+				SplitLargeSectors(m_v_null.GetDistanceTo(Vertex(arc_trace.cx, arc_trace.cy)) * da);
+			}
+
+			const double cur_angle = arc_trace.steps[angix].angle;
+			const Vertex& v_new_null = arc_trace.steps[angix].v_null;
+			Vertex vertices[enStepVertices_Count];
+			GetMovedVertices(source_vertices, moved_vertices_count, m_v_null, v_new_null, cur_angle, vertices);
+
+			const Vertex* const v_background = vertices + enStepVertices_Background;
+			const Vertex* const v_fence = vertices + enStepVertices_Fence;
+			const Vertex* const v_body = vertices + enStepVertices_Body;
+			ExtendBackground(v_background[0], v_background[1], v_background[2], v_background[3]);
+			ExtendFence(v_fence[0], v_fence[1], v_fence[2], v_fence[3]);
+			if(!HAVE_MARK_SECTORS) {
+				StartBodySegment();
+			}
+			ExtendBody(v_body[0], v_body[1], v_body[2], v_body[3]);
+			if(HAVE_MARK_SECTORS) {
+				ExtendMarkT<HAVE_SLOPE>(vertices[enStepVertices_Mark], vertices[enStepVertices_Mark + 1]);
+			}
+
+			SetNullVertex(v_new_null);
+
+			m_sectors_closed = false;
+
+			// the step is a chord of the arc
+			const double segment_angle = Math::GetNormalizedAngle(m_angle + turn_sign * da / 2.0);
+			if(!HAVE_MARK_SECTORS) {
+				AlignBodyTexture(segment_angle);
+			}
+
+			if(HAVE_SLOPE) {
+				CloseSectorsT<true>();
+			}
+
+			AddCenterLinePoint(segment_angle);
+
+			m_v_mark_ids_prev.clear();
+			m_angle = cur_angle;
+
+			// a long arc is not kept in the map until its end
+			if(m_textmap_writer != NULL) {
+				m_textmap_writer->WriteFinalElements(GetOpenIds());
+			}
+		}
+	}
+
+	void RoadFigure::InitMapElements() {
+		m_sd_roadside = Sidedef().GetWithBottomTexture(RoadConfig::enTexture_RoadSideWall);
+
+		// texture road marks - the road mark texture includes the road body
+		m_s_body = Sector(m_floorpos, m_ceilingpos,
+						  m_have_mark_sectors ? RoadConfig::enTexture_RoadBody : RoadConfig::enTexture_RoadMark, RoadConfig::enTexture_Sky,
+						  m_config.light_level);
+		m_s_east_side =
+		m_s_west_side = Sector(m_floorpos + m_config.sizes.road_side_height, m_ceilingpos,
+							   RoadConfig::enTexture_RoadSide, RoadConfig::enTexture_Sky,
+							   m_config.light_level);
+
+		m_sd_markside = Sidedef().GetWithBottomTexture(RoadConfig::enTexture_RoadMark);
+
+		m_s_mark = Sector(m_floorpos + MARK_HEIGHT, m_ceilingpos,
+						  RoadConfig::enTexture_RoadMark, RoadConfig::enTexture_Sky,
+						  m_config.light_level);
+
+		m_s_background_body_east =
+		m_s_background_body_west = Sector(m_floorpos, m_ceilingpos,
+										  RoadConfig::enTexture_Background, RoadConfig::enTexture_Sky,
+										  m_config.light_level);
+
+		// lean fence - the sky sector is at the fence top, so the fence is the lower texture of the road frame
+		const int background_sky_pos = m_have_fence_sectors ? m_floorpos : (m_floorpos + m_config.sizes.fence_height);
+		m_s_background_sky = Sector(background_sky_pos, background_sky_pos,
+									RoadConfig::enTexture_Background, RoadConfig::enTexture_Sky,
+									m_config.light_level);
+
+		m_sd_fenceside = Sidedef().GetWithBottomTexture(RoadConfig::enTexture_Fence);
+		
+		m_s_fence_east =
+		m_s_fence_west = Sector(m_floorpos + m_config.sizes.fence_height, m_ceilingpos,
+								RoadConfig::enTexture_FenceFloor, RoadConfig::enTexture_Sky,
+								m_config.light_level);
+	}
+
+	void RoadFigure::GetMovedVertices(const Vertex* const* source_vertices,
+									  size_t source_vertices_count,
+									  const Vertex& v_prev_null,
+									  const Vertex& v_null,
+									  double angle,
+									  Vertex* vertices)
+	{
+		if(source_vertices_count == 0) {
+			return;
+		}
+
+		const double dir_prev_x = source_vertices[0]->x - v_prev_null.x;
+		const double dir_prev_y = source_vertices[0]->y - v_prev_null.y;
+
+		const double p_dir_x = -Math::Sin(angle);
+		const double p_dir_y = Math::Cos(angle);
+
+		const bool dir_ang_positive = (dir_prev_x*p_dir_x + dir_prev_y*p_dir_y) > 0;
+		
+		// consider that angle between dirs is always acute (do not turn around like 90+ degrees)
+		const double dir_x = dir_ang_positive ? p_dir_x : -p_dir_x;
+		const double dir_y = dir_ang_positive ? p_dir_y : -p_dir_y;
+
+		for(size_t i=0; i<source_vertices_count; i++) {
+			const Vertex& v = *source_vertices[i];
 
 			const double dist = v.GetDistanceTo(v_prev_null);
 
@@ -1284,7 +1713,34 @@ namespace RoadGen {
 			const double v_dir_x = dir_suits ? dir_x : -dir_x;
 			const double v_dir_y = dir_suits ? dir_y : -dir_y;
 
-			vertices[source_vertices[i]] = Vertex(v_null.x + dist * v_dir_x, v_null.y + dist * v_dir_y);
+			vertices[i] = Vertex(v_null.x + dist * v_dir_x, v_null.y + dist * v_dir_y);
+		}
+	}
+
+	void RoadFigure::AddCenterLinePoint(double segment_angle) {
+		m_center_line.AddPoint(m_v_null.x, m_v_null.y, segment_angle, m_floorpos);
+	}
+
+	void RoadFigure::PutThings() {
+		const double length = m_center_line.GetLength();
+		for(size_t tmix=0; tmix<m_things_modifiers.size(); tmix++) {
+			const double start_distance = m_things_modifiers[tmix].first;
+			const RoadFigureObject::ThingsModifierData& things_modifier = m_things_modifiers[tmix].second;
+
+			// both ends of the figure are included - if the figure is continued in another map, the thing at the end
+			// is not put there again (see GetRoadShards)
+			for(int tix=0; ; tix++) {
+				const double distance = start_distance + things_modifier.first + tix * things_modifier.every;
+				if(distance > length && !Math::IsZeroOrCloseTo(distance - length)) {
+					break;
+				}
+
+				const RoadCenterLine::Point p = m_center_line.GetPointAt(std::min(distance, length));
+				const double x = p.x - things_modifier.offset * Math::Sin(p.angle);
+				const double y = p.y + things_modifier.offset * Math::Cos(p.angle);
+				const int deg_angle = (int)Math::Floor(Math::RadiansToDegrees(Math::GetNormalizedAngle(p.angle)) + 0.5);
+				m_map << Udmf::Thing(x, y, deg_angle, things_modifier.thing_type);
+			}
 		}
 	}
 
@@ -1302,9 +1758,18 @@ namespace RoadGen {
 			m_intersection_checker->AddQuad(m_v_background_west_left, v_new_west_left, v_new_east_right, m_v_background_east_right);
 		}
 
+		if(!m_have_background_sky) {
+			// fence walls - nothing to draw
+			m_v_background_west_left = v_new_west_left;
+			m_v_background_west_right = v_new_west_right;
+			m_v_background_east_left = v_new_east_left;
+			m_v_background_east_right = v_new_east_right;
+			return;
+		}
+
 		const unsigned int id_v_prev_background_west_left = m_last_ids.at(&m_v_background_west_left);
-		const unsigned int id_v_prev_background_west_right = m_last_ids.at(&m_v_background_west_right);
-		const unsigned int id_v_prev_background_east_left = m_last_ids.at(&m_v_background_east_left);
+		const unsigned int id_v_prev_background_west_right = m_have_fence_sectors ? m_last_ids.at(&m_v_background_west_right) : Udmf::ID_INVALID;
+		const unsigned int id_v_prev_background_east_left = m_have_fence_sectors ? m_last_ids.at(&m_v_background_east_left) : Udmf::ID_INVALID;
 		const unsigned int id_v_prev_background_east_right = m_last_ids.at(&m_v_background_east_right);
 
 		m_v_background_west_left = v_new_west_left;
@@ -1313,8 +1778,10 @@ namespace RoadGen {
 		m_v_background_east_right = v_new_east_right;
 		
 		m_last_ids[&m_v_background_west_left] = m_map << m_v_background_west_left;
-		m_last_ids[&m_v_background_west_right] = m_map << m_v_background_west_right;
-		m_last_ids[&m_v_background_east_left] = m_map << m_v_background_east_left;
+		if(m_have_fence_sectors) {
+			m_last_ids[&m_v_background_west_right] = m_map << m_v_background_west_right;
+			m_last_ids[&m_v_background_east_left] = m_map << m_v_background_east_left;
+		}
 		m_last_ids[&m_v_background_east_right] = m_map << m_v_background_east_right;
 
 		const unsigned int id_s_background_sky = m_last_ids.at(&m_s_background_sky);
@@ -1327,6 +1794,11 @@ namespace RoadGen {
 		m_map << Linedef(id_v_prev_background_east_right, m_last_ids.at(&m_v_background_east_right),
 						 id_sd_background_sky_east);
 
+		if(!m_have_fence_sectors) {
+			// lean fence - the road frame is the inner bound of the sky sector
+			return;
+		}
+
 		const unsigned int id_sd_background_body_outer_west = m_map << Sidedef(id_s_background_sky);
 		const unsigned int id_sd_background_body_inner_west = m_map << Sidedef(m_last_ids.at(&m_s_background_body_west));
 		m_map << Linedef(m_last_ids.at(&m_v_background_west_right), id_v_prev_background_west_right,
@@ -1343,6 +1815,15 @@ namespace RoadGen {
 								 const Vertex& v_new_east_left,
 								 const Vertex& v_new_east_right)
 	{
+		if(!m_have_fence_sectors) {
+			// lean fence - the fence is on the road frame
+			m_v_fence_west_left = v_new_west_left;
+			m_v_fence_west_right = v_new_west_right;
+			m_v_fence_east_left = v_new_east_left;
+			m_v_fence_east_right = v_new_east_right;
+			return;
+		}
+
 		const unsigned int id_v_prev_west_left = m_last_ids.at(&m_v_fence_west_left);
 		const unsigned int id_v_prev_west_right = m_last_ids.at(&m_v_fence_west_right);
 		const unsigned int id_v_prev_east_left = m_last_ids.at(&m_v_fence_east_left);
@@ -1406,8 +1887,8 @@ namespace RoadGen {
 		m_last_ids[&m_v_east_left] = m_map << m_v_east_left;
 		m_last_ids[&m_v_east_right] = m_map << m_v_east_right;
 
-		const unsigned int id_sd_west_outer = m_map << m_sd_roadside.GetWithSector(m_last_ids.at(&m_s_background_body_west));
-		const unsigned int id_sd_west_left = m_map << Sidedef(m_last_ids.at(&m_s_west_side));
+		const unsigned int id_sd_west_outer = AddFrameOuterSidedef(m_sd_roadside, m_s_background_body_west);
+		const unsigned int id_sd_west_left = AddFrameInnerSidedef(m_s_west_side);
 		m_map << Linedef(m_last_ids.at(&m_v_west_left), id_v_prev_west_left,
 						 id_sd_west_left, id_sd_west_outer);
 
@@ -1421,37 +1902,127 @@ namespace RoadGen {
 		m_map << Linedef(id_v_prev_east_left, m_last_ids.at(&m_v_east_left),
 						 id_sd_body_right, id_sd_east_left);
 
-		const unsigned int id_sd_east_outer = m_map << m_sd_roadside.GetWithSector(m_last_ids.at(&m_s_background_body_east));
-		const unsigned int id_sd_east_right = m_map << Sidedef(m_last_ids.at(&m_s_east_side));
+		const unsigned int id_sd_east_outer = AddFrameOuterSidedef(m_sd_roadside, m_s_background_body_east);
+		const unsigned int id_sd_east_right = AddFrameInnerSidedef(m_s_east_side);
 		m_map << Linedef(id_v_prev_east_right, m_last_ids.at(&m_v_east_right),
 						 id_sd_east_right, id_sd_east_outer);
 	}
 
-	void RoadFigure::ExtendMark(const Vertex& v_new_mark_west, const Vertex& v_new_mark_east) {
-		const Vertex v_west_dir(v_new_mark_west.x - m_v_mark_west.x, v_new_mark_west.y - m_v_mark_west.y);
-		const Vertex v_east_dir(v_new_mark_east.x - m_v_mark_east.x, v_new_mark_east.y - m_v_mark_east.y);
+	unsigned int RoadFigure::AddFrameInnerSidedef(Sector& sector) {
+		const unsigned int id_s = m_last_ids.at(&sector);
+		switch(m_config.fence_mode) {
+		case RoadConfig::enFenceMode_Wall:
+			return m_map << Sidedef(id_s, RoadConfig::enTexture_Fence);
+
+		case RoadConfig::enFenceMode_Sky:
+			return m_map << m_sd_fenceside.GetWithSector(id_s);
+
+		default:
+			return m_map << Sidedef(id_s);
+		}
+	}
+
+	unsigned int RoadFigure::AddFrameOuterSidedef(const Sidedef& side, Sector& background_sector) {
+		switch(m_config.fence_mode) {
+		case RoadConfig::enFenceMode_Wall:
+			return Udmf::ID_INVALID;
 
+		case RoadConfig::enFenceMode_Sky:
+			return m_map << Sidedef(m_last_ids.at(&m_s_background_sky));
+
+		default:
+			return m_map << side.GetWithSector(m_last_ids.at(&background_sector));
+		}
+	}
+
+	void RoadFigure::StartBodySegment() {
+		if(!m_body_sector_aligned) {
+			return;
+		}
+
+		// the same way as CloseSectorsT closes the body sector, floor heights are the same
+		const unsigned int id_s_body_prev = m_last_ids.at(&m_s_body);
+		m_last_ids[&m_s_body] = m_map << m_s_body;
+
+		const unsigned int id_sd_front = m_map << Sidedef(m_last_ids.at(&m_s_body));
+		const unsigned int id_sd_back = m_map << Sidedef(id_s_body_prev);
+		Linedef l(m_last_ids.at(&m_v_west_right), m_last_ids.at(&m_v_east_left),
+				  id_sd_front, id_sd_back);
+		l.dontdraw = true;
+		m_map << l;
+
+		m_body_sector_aligned = false;
+	}
+
+	void RoadFigure::AlignBodyTexture(double segment_angle) {
+		// flats are 64x64
+		const double FLAT_SIZE = 64.0;
+
+		// distance of the segment end along the center line (the center line does not have the segment yet)
+		const double distance = m_center_line.GetLength() + m_v_null.GetDistanceTo(m_v_null_prev) + m_mark_coord;
+
+		// texture columns go along the segment, the road center line goes through the middle column of the texture
+		// (x offset), texture rows move along the road with the distance from the figure start (y offset)
+		const double cos_angle = Math::Cos(segment_angle);
+		const double sin_angle = Math::Sin(segment_angle);
+		const double xpanning = FLAT_SIZE / 2.0 - (m_v_null.x * sin_angle - m_v_null.y * cos_angle);
+		const double ypanning = (m_v_null.x * cos_angle + m_v_null.y * sin_angle) - distance;
+
+		Sector& body_sector = m_map.GetSector(m_last_ids.at(&m_s_body));
+		body_sector.xpanningfloor = xpanning - FLAT_SIZE * Math::Floor(xpanning / FLAT_SIZE);
+		body_sector.ypanningfloor = ypanning - FLAT_SIZE * Math::Floor(ypanning / FLAT_SIZE);
+		body_sector.rotationfloor = Math::RadiansToDegrees(Math::GetNormalizedAngle(Math::PI / 2.0 - segment_angle));
+
+		m_body_sector_aligned = true;
+	}
+
+	template<bool HAVE_SLOPE>
+	void RoadFigure::ExtendMarkT(const Vertex& v_new_mark_west, const Vertex& v_new_mark_east) {
 		const double length_east = m_v_mark_east.GetDistanceTo(v_new_mark_east);
 		const double length_west = m_v_mark_west.GetDistanceTo(v_new_mark_west);
 		const double length_middle = (length_east + length_west) / 2.0;
-
-		double length = length_middle;
-		if(length < SMALLEST_MARK_LINE) {
+		if(length_middle < SMALLEST_MARK_LINE) {
 			// should not happen
 			throw Exception("road generation error - too small mark to draw");
 		}
 
+		// most steps of a long gap neither end a mark, nor reach the next one
+		const double mark_length = m_config.sizes.road_mark_length;
+		const double gap_left = mark_length + m_config.sizes.road_mark_gap - m_mark_coord;
+		const bool in_gap = m_mark_coord >= mark_length || Math::IsZeroOrCloseTo(m_mark_coord - mark_length);
+		const bool at_open_mark_end = Math::IsZeroOrCloseTo(m_mark_coord - mark_length) && !m_mark_sector_closed;
+		if(in_gap && !at_open_mark_end && gap_left > length_middle && !Math::IsZeroOrCloseTo(length_middle - gap_left)) {
+			ExtendMarkT<HAVE_SLOPE, false>(v_new_mark_west, v_new_mark_east, length_middle);
+
+		} else {
+			ExtendMarkT<HAVE_SLOPE, true>(v_new_mark_west, v_new_mark_east, length_middle);
+		}
+	}
+
+	template<bool HAVE_SLOPE, bool HAVE_MARK>
+	void RoadFigure::ExtendMarkT(const Vertex& v_new_mark_west, const Vertex& v_new_mark_east, double length_middle) {
+		const Vertex v_west_dir(v_new_mark_west.x - m_v_mark_west.x, v_new_mark_west.y - m_v_mark_west.y);
+		const Vertex v_east_dir(v_new_mark_east.x - m_v_mark_east.x, v_new_mark_east.y - m_v_mark_east.y);
+
+		if(!HAVE_MARK) {
+			// the step stays in the gap - just move mark vertices
+			m_v_mark_west = m_v_mark_west.GetMoved(v_west_dir.x, v_west_dir.y);
+			m_v_mark_east = m_v_mark_east.GetMoved(v_east_dir.x, v_east_dir.y);
+			m_mark_coord += length_middle;
+			return;
+		}
+
+		double length = length_middle;
+
 		const auto id_v_mark_west_last_it = m_last_ids.find(&m_v_mark_west);
 		const auto id_v_mark_east_last_it = m_last_ids.find(&m_v_mark_east);
 		const bool is_v_mark_west_here =   id_v_mark_west_last_it != m_last_ids.end()
-										&& Math::IsZeroOrCloseTo(m_v_mark_west.GetDistanceTo(m_map.vertices.at(id_v_mark_west_last_it->second)));
+										&& Math::IsZeroOrCloseTo(m_v_mark_west.GetDistanceTo(m_map.GetVertex(id_v_mark_west_last_it->second)));
 		const bool is_v_mark_east_here =    id_v_mark_east_last_it != m_last_ids.end()
-										&& Math::IsZeroOrCloseTo(m_v_mark_east.GetDistanceTo(m_map.vertices.at(id_v_mark_east_last_it->second)));
+										&& Math::IsZeroOrCloseTo(m_v_mark_east.GetDistanceTo(m_map.GetVertex(id_v_mark_east_last_it->second)));
 
 		bool first_vertices_added = Math::IsZeroOrCloseTo(m_mark_coord) && is_v_mark_west_here && is_v_mark_east_here;
 
-		const bool have_slope = !Math::IsZeroOrCloseTo(m_slope_modifier.tangent);
-
 		// skip small lengths - just do not change the state
 		while(length >= 1.0) {
 			if(Math::IsZeroOrCloseTo(m_mark_coord) && !first_vertices_added) {
@@ -1489,7 +2060,7 @@ namespace RoadGen {
 				m_last_ids[&m_v_mark_east] = m_map << m_v_mark_east;
 
 				const unsigned int id_s_mark = m_last_ids.at(&m_s_mark);
-				if(have_slope) {
+				if(HAVE_SLOPE) {
 					// triangulate in case of slope to make vertex heights work
 					m_last_ids[&m_s_mark] = m_map << m_s_mark;
 				}
@@ -1506,7 +2077,7 @@ namespace RoadGen {
 				m_map << Linedef(id_v_prev_east, m_last_ids.at(&m_v_mark_east),
 									id_sd_inside_east, id_sd_outside_east);
 
-				if(have_slope) {
+				if(HAVE_SLOPE) {
 					// triangulate - divide quad
 					const unsigned int id_sd_front = m_map << Sidedef(id_s_mark);
 					const unsigned int id_sd_back = m_map << Sidedef(id_s_mark_new);
@@ -1555,30 +2126,222 @@ namespace RoadGen {
 	}
 
 	void RoadFigure::CloseSectors() {
+		if(Math::IsZeroOrCloseTo(m_slope_modifier.tangent)) {
+			CloseSectorsT<false>();
+
+		} else {
+			CloseSectorsT<true>();
+		}
+	}
+
+	void RoadFigure::SplitLargeSectors(double step_length) {
+		// nothing is drawn yet at the figure start
+		if(m_sectors_closed || Math::IsZeroOrCloseTo(m_v_null.GetDistanceTo(m_v_null_prev))) {
+			return;
+		}
+
+		m_step_sector_sides_counts.clear();
+		for(unsigned int id_sd=m_counted_sidedefs_end; id_sd<m_map.GetEndIds().sidedef; id_sd++) {
+			const unsigned int id_s = m_map.GetSidedef(id_sd).sector;
+			m_sector_sides_counts[id_s]++;
+			m_step_sector_sides_counts[id_s]++;
+		}
+		m_counted_sidedefs_end = m_map.GetEndIds().sidedef;
+
+		// the last step may have been in a mark gap, while the next one adds mark holes to the body sector:
+		// its two sides and the holes are expected, if they are more
+		const unsigned int id_s_body = m_last_ids.at(&m_s_body);
+		const unsigned int body_step_sides_count = m_have_mark_sectors ? (2 + GetStepMarkSidesCount(step_length)) : 0;
+
+		// sectors of previous steps are not touched by the last step, they do not grow
+		for(auto it = m_step_sector_sides_counts.begin(); it != m_step_sector_sides_counts.end(); it++) {
+			const unsigned int step_sides_count = (it->first == id_s_body && body_step_sides_count > it->second) ? body_step_sides_count : it->second;
+
+			if(m_sector_sides_counts.at(it->first) + step_sides_count + GetCloseSidesCount(it->first) > m_config.max_sector_linedefs) {
+				CloseSectorsT<false>(false);
+				return;
+			}
+		}
+	}
+
+	void RoadFigure::SplitLargeEndSectors() {
+		for(unsigned int id_sd=m_counted_sidedefs_end; id_sd<m_map.GetEndIds().sidedef; id_sd++) {
+			m_sector_sides_counts[m_map.GetSidedef(id_sd).sector]++;
+		}
+		m_counted_sidedefs_end = m_map.GetEndIds().sidedef;
+
+		// seams go from the background to the road frame on each side of the road as CloseSectorsT makes them,
+		// the road frame sectors are closed by the figure end
+		const size_t SEAMS_COUNT_MAX = 8;
+		Vertex* seam_vertices[SEAMS_COUNT_MAX][2];
+		Sector* seam_sectors[SEAMS_COUNT_MAX];
+		size_t seams_count = 0;
+
+		Vertex* const v_west_outer = m_have_fence_sectors ? &m_v_background_west_right : &m_v_west_left;
+		Vertex* const v_east_outer = m_have_fence_sectors ? &m_v_background_east_left : &m_v_east_right;
+		if(m_have_background_sky) {
+			seam_vertices[seams_count][0] = &m_v_background_west_left;
+			seam_vertices[seams_count][1] = v_west_outer;
+			seam_sectors[seams_count++] = &m_s_background_sky;
+		}
+		if(m_have_fence_sectors) {
+			Vertex* const vertices[] = {
+				&m_v_background_west_right, &m_v_fence_west_left, &m_v_fence_west_right, &m_v_west_left,
+				&m_v_east_right, &m_v_fence_east_left, &m_v_fence_east_right, &m_v_background_east_left
+			};
+			Sector* const sectors[] = {
+				&m_s_background_body_west, &m_s_fence_west, &m_s_background_body_west, NULL,
+				&m_s_background_body_east, &m_s_fence_east, &m_s_background_body_east
+			};
+			for(size_t i=0; i<_countof(sectors); i++) {
+				if(sectors[i]) {
+					seam_vertices[seams_count][0] = vertices[i];
+					seam_vertices[seams_count][1] = vertices[i+1];
+					seam_sectors[seams_count++] = sectors[i];
+				}
+			}
+		}
+		if(m_have_background_sky) {
+			seam_vertices[seams_count][0] = v_east_outer;
+			seam_vertices[seams_count][1] = &m_v_background_east_right;
+			seam_sectors[seams_count++] = &m_s_background_sky;
+		}
+
+		// a sector may be on both sides of the road, it gets the figure end of each side
+		Sector* const side_sectors[] = {
+			m_have_background_sky ? &m_s_background_sky : NULL,
+			m_have_fence_sectors ? &m_s_background_body_west : NULL, m_have_fence_sectors ? &m_s_fence_west : NULL,
+			m_have_background_sky ? &m_s_background_sky : NULL,
+			m_have_fence_sectors ? &m_s_background_body_east : NULL, m_have_fence_sectors ? &m_s_fence_east : NULL
+		};
+		std::unordered_map<unsigned int, unsigned int> end_sides_counts;
+		for(size_t i=0; i<_countof(side_sectors); i++) {
+			if(side_sectors[i]) {
+				end_sides_counts[m_last_ids.at(side_sectors[i])] += FIGURE_END_SIDE_LINEDEFS_MAX;
+			}
+		}
+
+		bool have_large_sectors = false;
+		for(auto it = end_sides_counts.begin(); it != end_sides_counts.end(); it++) {
+			const auto counted_it = m_sector_sides_counts.find(it->first);
+			const unsigned int sides_count = (counted_it != m_sector_sides_counts.end()) ? counted_it->second : 0;
+			if(sides_count + it->second > m_config.max_sector_linedefs) {
+				have_large_sectors = true;
+			}
+		}
+
+		if(!have_large_sectors) {
+			return;
+		}
+
+		// the same way as CloseSectorsT closes sectors, the road is flat at the figure end
+		unsigned int prev_sector_ids[SEAMS_COUNT_MAX];
+		for(size_t i=0; i<seams_count; i++) {
+			size_t first_ix = 0;
+			while(seam_sectors[first_ix] != seam_sectors[i]) {
+				first_ix++;
+			}
+
+			if(first_ix != i) {
+				prev_sector_ids[i] = prev_sector_ids[first_ix];
+
+			} else {
+				prev_sector_ids[i] = m_last_ids.at(seam_sectors[i]);
+				m_last_ids[seam_sectors[i]] = m_map << *seam_sectors[i];
+			}
+		}
+
+		for(size_t i=0; i<seams_count; i++) {
+			const unsigned int id_sd_front = m_map << Sidedef(m_last_ids.at(seam_sectors[i]));
+			const unsigned int id_sd_back = m_map << Sidedef(prev_sector_ids[i]);
+			Linedef l(m_last_ids.at(seam_vertices[i][0]), m_last_ids.at(seam_vertices[i][1]),
+					  id_sd_front, id_sd_back);
+			l.dontdraw = true;
+			m_map << l;
+		}
+	}
+
+	unsigned int RoadFigure::GetStepMarkSidesCount(double step_length) const {
+		const double mark_length = m_config.sizes.road_mark_length;
+		const double mark_period = mark_length + m_config.sizes.road_mark_gap;
+
+		// the current mark and marks starting within the step, each hole has 4 linedefs at most
+		const bool in_mark = m_mark_coord < mark_length && !Math::IsZeroOrCloseTo(m_mark_coord - mark_length);
+		const unsigned int marks_count = (in_mark ? 1 : 0) + (unsigned int)Math::Floor((m_mark_coord + step_length) / mark_period);
+		return 4 * marks_count;
+	}
+
+	unsigned int RoadFigure::GetCloseSidesCount(unsigned int id_s) {
+		// the same sectors as CloseSectorsT goes through, the body sector is crossed twice by a mark
+		Sector* const sectors[] = {
+			&m_s_background_sky, &m_s_background_sky,
+			&m_s_background_body_west, &m_s_background_body_west, &m_s_fence_west,
+			&m_s_west_side, &m_s_body, &m_s_body, &m_s_east_side,
+			&m_s_fence_east, &m_s_background_body_east, &m_s_background_body_east
+		};
+
+		unsigned int sides_count = 0;
+		for(size_t i=0; i<_countof(sectors); i++) {
+			const auto id_s_it = m_last_ids.find(sectors[i]);
+			if(id_s_it != m_last_ids.end() && id_s_it->second == id_s) {
+				sides_count++;
+			}
+		}
+
+		return sides_count;
+	}
+
+	unsigned int RoadFigure::GetBodySidesCount() {
+		const unsigned int id_s_body = m_last_ids.at(&m_s_body);
+		const auto counted_it = m_sector_sides_counts.find(id_s_body);
+		unsigned int sides_count = (counted_it != m_sector_sides_counts.end()) ? counted_it->second : 0;
+		for(unsigned int id_sd=m_counted_sidedefs_end; id_sd<m_map.GetEndIds().sidedef; id_sd++) {
+			if(m_map.GetSidedef(id_sd).sector == id_s_body) {
+				sides_count++;
+			}
+		}
+
+		return sides_count;
+	}
+
+	template<bool HAVE_SLOPE>
+	void RoadFigure::CloseSectorsT(bool for_slope) {
 		if(m_sectors_closed) {
 			// nothing to close
 			return;
 		}
 
-		const bool have_slope = !Math::IsZeroOrCloseTo(m_slope_modifier.tangent);
-		const bool at_mark_start = Math::IsZeroOrCloseTo(m_mark_coord);
-		const bool at_mark_end = Math::IsZeroOrCloseTo(m_mark_coord - m_config.sizes.road_mark_length);
-		const bool have_mark = m_mark_coord < m_config.sizes.road_mark_length || at_mark_start || at_mark_end;
+		const bool at_mark_start = m_have_mark_sectors && Math::IsZeroOrCloseTo(m_mark_coord);
+		const bool at_mark_end = m_have_mark_sectors && Math::IsZeroOrCloseTo(m_mark_coord - m_config.sizes.road_mark_length);
+		const bool have_mark = m_have_mark_sectors && (m_mark_coord < m_config.sizes.road_mark_length || at_mark_start || at_mark_end);
+
+		if(have_mark) {
+			CloseSectorsT<HAVE_SLOPE, true>(at_mark_start, at_mark_end, for_slope);
+
+		} else {
+			// not at mark start or end without a mark
+			CloseSectorsT<HAVE_SLOPE, false>(false, false, for_slope);
+		}
+	}
 
+	template<bool HAVE_SLOPE, bool HAVE_MARK>
+	void RoadFigure::CloseSectorsT(bool at_mark_start, bool at_mark_end, bool for_slope) {
 		// modify all sectors according to the slope modifier
 		const int floorpos_prev = m_floorpos;
-		if(have_slope) {
+		if(HAVE_SLOPE) {
+			// lean fence - there are no background body and fence sectors, fence walls - no sky sector
 			Sector* body_west_sector_ptr =
-				(m_last_ids.at(&m_s_background_body_east) != m_last_ids.at(&m_s_background_body_west))
+				(m_have_fence_sectors && m_last_ids.at(&m_s_background_body_east) != m_last_ids.at(&m_s_background_body_west))
 					? &m_s_background_body_west
 					: NULL;
 			Sector* fence_west_sector_ptr =
-				(m_last_ids.at(&m_s_fence_east) != m_last_ids.at(&m_s_fence_west))
+				(m_have_fence_sectors && m_last_ids.at(&m_s_fence_east) != m_last_ids.at(&m_s_fence_west))
 					? &m_s_fence_west
 					: NULL;
 			Sector* slope_sectors[] = {
-				&m_s_background_sky, &m_s_background_body_east, body_west_sector_ptr,
-				&m_s_fence_east, fence_west_sector_ptr,
+				m_have_background_sky ? &m_s_background_sky : NULL,
+				m_have_fence_sectors ? &m_s_background_body_east : NULL, body_west_sector_ptr,
+				m_have_fence_sectors ? &m_s_fence_east : NULL, fence_west_sector_ptr,
 				&m_s_west_side, &m_s_east_side,
 				&m_s_body, &m_s_mark
 			};
@@ -1591,7 +2354,7 @@ namespace RoadGen {
 				throw Exception("error generating a road - slope goes up after the ceiling, change slope tangent and/or figure height");
 			}
 
-			const bool had_mark = !have_mark && (m_mark_coord - width_diff_f) < m_config.sizes.road_mark_length;
+			const bool had_mark = m_have_mark_sectors && !HAVE_MARK && (m_mark_coord - width_diff_f) < m_config.sizes.road_mark_length;
 			for(unsigned int i=0; i<_countof(slope_sectors); i++) {
 				if(!slope_sectors[i]) {
 					continue;
@@ -1614,12 +2377,12 @@ namespace RoadGen {
 				if(m_slope_modifier.tangent > 0.0 && is_background_sky_sector) {
 					modify_prev_sector = false;
 
-				} else if(slope_sectors[i] == &m_s_mark && !(have_mark && !at_mark_start || had_mark)) {
+				} else if(slope_sectors[i] == &m_s_mark && !(HAVE_MARK && !at_mark_start || had_mark)) {
 					modify_prev_sector = false;
 				}
 
 				if(modify_prev_sector) {
-					Sector& prev_sector = m_map.sectors.at(m_last_ids.at(slope_sectors[i]));
+					Sector& prev_sector = m_map.GetSector(m_last_ids.at(slope_sectors[i]));
 					prev_sector.heightfloor = new_floorpos;
 					if(is_background_sky_sector) {
 						prev_sector.heightceiling = new_heightceiling;
@@ -1635,21 +2398,20 @@ namespace RoadGen {
 			// the linedef between mark vertices will be special
 			// having one sidedef as a part of the mark sector (next sector set, if it is a slope)
 			// and other one as a part of the body sector (current sector set, if it is a slope)
-			m_last_ids[&m_v_mark_west] = m_map << m_v_mark_west.GetWithZFloor(m_floorpos);
-			m_last_ids[&m_v_mark_east] = m_map << m_v_mark_east.GetWithZFloor(m_floorpos);
-			//m_v_mark_ids_prev.push_back(std::make_pair(0, IdPair(m_last_ids.at(&m_v_mark_west), m_last_ids.at(&m_v_mark_east))));
+			m_last_ids[&m_v_mark_west] = m_map << (for_slope ? m_v_mark_west.GetWithZFloor(m_floorpos) : m_v_mark_west);
+			m_last_ids[&m_v_mark_east] = m_map << (for_slope ? m_v_mark_east.GetWithZFloor(m_floorpos) : m_v_mark_east);
 		}
 
-		if(!have_slope) {
+		if(!HAVE_SLOPE && for_slope) {
 			// closing sectors before the slope - assign z position
 			// for bounding vertices of the mark
-			if(have_mark && !at_mark_start) {
+			if(HAVE_MARK && !at_mark_start) {
 				const auto id_v_mark_west_it = m_last_ids.find(&m_v_mark_west);
 				const auto id_v_mark_east_it = m_last_ids.find(&m_v_mark_east);
 				if (id_v_mark_west_it != m_last_ids.end()
 					&& id_v_mark_east_it != m_last_ids.end()
-					&& Math::IsZeroOrCloseTo(m_map.vertices.at(id_v_mark_west_it->second).GetDistanceTo(m_v_mark_west))
-					&& Math::IsZeroOrCloseTo(m_map.vertices.at(id_v_mark_east_it->second).GetDistanceTo(m_v_mark_east)))
+					&& Math::IsZeroOrCloseTo(m_map.GetVertex(id_v_mark_west_it->second).GetDistanceTo(m_v_mark_west))
+					&& Math::IsZeroOrCloseTo(m_map.GetVertex(id_v_mark_east_it->second).GetDistanceTo(m_v_mark_east)))
 				{
 					m_v_mark_ids_prev.push_back(std::make_pair(0, IdPair(id_v_mark_west_it->second, id_v_mark_east_it->second)));
 				}
@@ -1658,14 +2420,10 @@ namespace RoadGen {
 
 		// mark sector may be surrounded by a single body sector;
 		// assign height to mark vertices to make slopes
+		const unsigned int id_v_mark_west_prev = HAVE_MARK ? m_last_ids.at(&m_v_mark_west) : Udmf::ID_INVALID;
 		for(auto it = m_v_mark_ids_prev.begin(); it != m_v_mark_ids_prev.end(); it++) {
-			bool have_cur_vertices = false;
-			if(have_mark) {
-				const unsigned int id_v_mark_west_prev = m_last_ids.at(&m_v_mark_west);
-				if(id_v_mark_west_prev == it->second.first || id_v_mark_west_prev == it->second.second) {
-					have_cur_vertices = true;
-				}
-			}
+			const bool have_cur_vertices =    HAVE_MARK
+										   && (id_v_mark_west_prev == it->second.first || id_v_mark_west_prev == it->second.second);
 
 			const double vertex_height_diff = m_slope_modifier.tangent * it->first;
 			double mark_floorpos = (floorpos_prev + MARK_HEIGHT) + vertex_height_diff;
@@ -1674,9 +2432,9 @@ namespace RoadGen {
 			}
 
 			// set floor pos for each of two mark vertices
-			Vertex& mark_v1 = m_map.vertices.at(it->second.first);
+			Vertex& mark_v1 = m_map.GetVertex(it->second.first);
 			mark_v1 = mark_v1.GetWithZFloor(mark_floorpos);
-			Vertex& mark_v2 = m_map.vertices.at(it->second.second);
+			Vertex& mark_v2 = m_map.GetVertex(it->second.second);
 			mark_v2 = mark_v2.GetWithZFloor(mark_floorpos);
 		}
 
@@ -1685,60 +2443,90 @@ namespace RoadGen {
 		//
 
 		// close each sector the same way - create a line (linedef + 2 sidedefs),
-		// create new sector to replace the old one in the flow
-
-		std::vector<Vertex*> vertices;
-		vertices.push_back(&m_v_background_west_left);
-		vertices.push_back(&m_v_background_west_right);
-		vertices.push_back(&m_v_fence_west_left);
-		vertices.push_back(&m_v_fence_west_right);
-		vertices.push_back(&m_v_west_left);
-		vertices.push_back(&m_v_west_right);
-		if(have_mark) {
-			vertices.push_back(&m_v_mark_west);
-			vertices.push_back(&m_v_mark_east);
-		}
-		vertices.push_back(&m_v_east_left);
-		vertices.push_back(&m_v_east_right);
-		vertices.push_back(&m_v_fence_east_left);
-		vertices.push_back(&m_v_fence_east_right);
-		vertices.push_back(&m_v_background_east_left);
-		vertices.push_back(&m_v_background_east_right);
-
-		std::vector<Sector*> sectors;
-		sectors.push_back(&m_s_background_sky);
-		sectors.push_back(&m_s_background_body_west);
-		sectors.push_back(&m_s_fence_west);
-		sectors.push_back(&m_s_background_body_west);
-		sectors.push_back(&m_s_west_side);
-		sectors.push_back(&m_s_body);
-		if(have_mark) {
-			sectors.push_back(&m_s_mark);
-			sectors.push_back(&m_s_body);
-		}
-		sectors.push_back(&m_s_east_side);
-		sectors.push_back(&m_s_background_body_east);
-		sectors.push_back(&m_s_fence_east);
-		sectors.push_back(&m_s_background_body_east);
-		sectors.push_back(&m_s_background_sky);
-
-		// array of sectors may contain the same sector more than once
-		std::unordered_map<void *, unsigned int> prev_sectors_ids;
-		for(int i=0; i<sectors.size(); i++) {
+		// create new sector to replace the old one in the flow;
+		// mark adds two vertices and two sectors to the cross-section of the road,
+		// lean fence removes background body and fence ones (and the sky sector for fence walls)
+		const size_t SECTORS_COUNT_MAX = 13;
+		Vertex* vertices[SECTORS_COUNT_MAX + 1];
+		Sector* sectors[SECTORS_COUNT_MAX];
+		size_t vix = 0, six = 0;
+
+		if(m_have_background_sky) {
+			vertices[vix++] = &m_v_background_west_left;
+		}
+		if(m_have_fence_sectors) {
+			vertices[vix++] = &m_v_background_west_right;
+			vertices[vix++] = &m_v_fence_west_left;
+			vertices[vix++] = &m_v_fence_west_right;
+		}
+		vertices[vix++] = &m_v_west_left;
+		vertices[vix++] = &m_v_west_right;
+		if(HAVE_MARK) {
+			vertices[vix++] = &m_v_mark_west;
+			vertices[vix++] = &m_v_mark_east;
+		}
+		vertices[vix++] = &m_v_east_left;
+		vertices[vix++] = &m_v_east_right;
+		if(m_have_fence_sectors) {
+			vertices[vix++] = &m_v_fence_east_left;
+			vertices[vix++] = &m_v_fence_east_right;
+			vertices[vix++] = &m_v_background_east_left;
+		}
+		if(m_have_background_sky) {
+			vertices[vix++] = &m_v_background_east_right;
+		}
+
+		if(m_have_background_sky) {
+			sectors[six++] = &m_s_background_sky;
+		}
+		if(m_have_fence_sectors) {
+			sectors[six++] = &m_s_background_body_west;
+			sectors[six++] = &m_s_fence_west;
+			sectors[six++] = &m_s_background_body_west;
+		}
+		sectors[six++] = &m_s_west_side;
+		const size_t body_ix = six;
+		sectors[six++] = &m_s_body;
+		if(HAVE_MARK) {
+			sectors[six++] = &m_s_mark;
+			sectors[six++] = &m_s_body;
+		}
+		sectors[six++] = &m_s_east_side;
+		if(m_have_fence_sectors) {
+			sectors[six++] = &m_s_background_body_east;
+			sectors[six++] = &m_s_fence_east;
+			sectors[six++] = &m_s_background_body_east;
+		}
+		if(m_have_background_sky) {
+			sectors[six++] = &m_s_background_sky;
+		}
+
+		const size_t sectors_count = six;
+
+		// array of sectors may contain the same sector more than once,
+		// first appearance of a sector replaces it, others reuse its ids
+		unsigned int prev_sector_ids[SECTORS_COUNT_MAX];
+		for(size_t i=0; i<sectors_count; i++) {
 			Sector* sector = sectors[i];
-			if(prev_sectors_ids.find(sector) != prev_sectors_ids.end()) {
+
+			size_t first_ix = 0;
+			while(sectors[first_ix] != sector) {
+				first_ix++;
+			}
+
+			if(first_ix != i) {
 				// already processed
+				prev_sector_ids[i] = prev_sector_ids[first_ix];
 				continue;
 			}
 
-			if(at_mark_start && sector == &m_s_mark) {
-				// do not have previous sector
+			const bool is_mark_sector = HAVE_MARK && sector == &m_s_mark;
+			prev_sector_ids[i] =
+				(at_mark_start && is_mark_sector)
+					? Udmf::ID_INVALID // do not have previous sector
+					: m_last_ids.at(sector);
 
-			} else {
-				prev_sectors_ids[sector] = m_last_ids.at(sector);
-			}
-
-			if(at_mark_end && sector == &m_s_mark) {
+			if(at_mark_end && is_mark_sector) {
 				// do not have next sector
 
 			} else {
@@ -1746,26 +2534,33 @@ namespace RoadGen {
 			}
 		}
 
-		for(int i=0; i<sectors.size(); i++) {
+		// body sector always precedes the mark sector in the array
+		const unsigned int id_s_body_prev = prev_sector_ids[body_ix];
+
+		// seams are the first linedefs of new sectors
+		const unsigned int seam_sidedefs_begin = m_map.GetEndIds().sidedef;
+
+		for(size_t i=0; i<sectors_count; i++) {
 			Sector* sector = sectors[i];
+			const bool is_mark_sector = HAVE_MARK && sector == &m_s_mark;
 			const unsigned int id_sd_front =
-				(at_mark_end && sector == &m_s_mark)
+				(at_mark_end && is_mark_sector)
 					? m_map << m_sd_roadside.GetWithSector(m_last_ids.at(&m_s_body))
 					: m_map << Sidedef(m_last_ids.at(sector));
 			const unsigned int id_sd_back =
-				(at_mark_start && sector == &m_s_mark)
-					? m_map << m_sd_roadside.GetWithSector(prev_sectors_ids.at(&m_s_body))
-					: m_map << Sidedef(prev_sectors_ids.at(sector));
+				(at_mark_start && is_mark_sector)
+					? m_map << m_sd_roadside.GetWithSector(id_s_body_prev)
+					: m_map << Sidedef(prev_sector_ids[i]);
 
 			Linedef l(m_last_ids.at(vertices[i]), m_last_ids.at(vertices[i+1]),
 					  id_sd_front, id_sd_back);
 			l.dontdraw = true;
 
-			if(vertices[i] != &m_v_mark_west) {
-				// action 181 - Plane Aling (slope), 'arg0 = 1' - aling floor on front
-				const bool have_slope =    (vertices[i] != &m_v_background_west_left)
-										&& (vertices[i] != &m_v_background_east_left);
-				if(have_slope) {
+			if(!HAVE_MARK || vertices[i] != &m_v_mark_west) {
+				// action 181 - Plane Aling (slope), 'arg0 = 1' - aling floor on front;
+				// the floor of the sky sector is moved with its ceiling, split sectors are flat
+				const bool align_floor = for_slope && sectors[i] != &m_s_background_sky;
+				if(align_floor) {
 					l.action_special.special = 181;
 					l.action_special.arg0 = 1;
 				}
@@ -1778,6 +2573,11 @@ namespace RoadGen {
 		}
 
 		m_sectors_closed = true;
+		m_body_sector_aligned = false;
+
+		// new sectors are drawn from here, sector sizes are counted again
+		m_sector_sides_counts.clear();
+		m_counted_sidedefs_end = seam_sidedefs_begin;
 	}
 }
 
@@ -1786,85 +2586,692 @@ namespace RoadGen {
 // GetGeneratedRoad implementation
 
 namespace RoadGen {
-	void GetGeneratedRoad(const RoadFigureDataConst& input_data, const RoadConfig& road_config, Udmf::Map& map) {
+	static RoadFigureObject::StartModifierData GetDefaultStartData(const RoadConfig& road_config) {
+		RoadFigureObject::StartModifierData default_start_data;
+		default_start_data.x_null = 0.0;
+		default_start_data.y_null = 0.0;
+		default_start_data.angle = 0.0;
+		default_start_data.zpos = 0;
+		default_start_data.height = 1024;
+		default_start_data.mark_shift = road_config.sizes.road_mark_length + 3 * road_config.sizes.road_mark_gap / 4;
+		return default_start_data;
+	}
+
+	// consumes road figure objects one by one and draws figures
+	class RoadFigureDrawer {
+		const RoadConfig& m_road_config;
+		Udmf::Map& m_map;
+		const RoadCenterTrace* const m_center_trace;
+		IntersectionChecker m_intersection_checker;
+
+		std::unique_ptr<RoadFigure> m_cur_figure;
+		bool m_drawing_started;
+
+		Udmf::Map::PlayerStartInfo m_player_start_info;
+		bool m_have_player_start;
+
+		// writes final map elements after lines, arcs and figure starts, NULL - the whole map is kept
+		Udmf::TextmapStreamWriter* const m_textmap_writer;
+
+	public:
+		RoadFigureDrawer(const RoadConfig& road_config_, Udmf::Map& map_, const RoadCenterTrace* center_trace_ = NULL,
+						 Udmf::TextmapStreamWriter* textmap_writer_ = NULL)
+			: m_road_config(road_config_)
+			, m_map(map_)
+			, m_center_trace(center_trace_)
+			, m_drawing_started(false)
+			, m_player_start_info(0.0, 0.0, 0)
+			, m_have_player_start(false)
+			, m_textmap_writer(textmap_writer_)
+		{
+			m_cur_figure.reset(new RoadFigure(m_road_config, GetDefaultStartData(m_road_config), m_map, &m_intersection_checker, m_textmap_writer));
+		}
+
+		void Visit(size_t, const RoadFigureObject::StartModifierData& start_data) {
+			// a new figure
+			Finish();
+
+			m_cur_figure.reset(new RoadFigure(m_road_config, start_data, m_map, &m_intersection_checker, m_textmap_writer));
+			m_intersection_checker.CutFigure();
+
+			m_player_start_info.x = start_data.x_null;
+			m_player_start_info.y = start_data.y_null;
+			m_player_start_info.deg_angle = (int)Math::RadiansToDegrees(Math::GetNormalizedAngle(start_data.angle));
+
+			WriteFinalElements();
+		}
+
+		void Visit(size_t, const RoadFigureObject::LineData& line) {
+			PrepareDrawing();
+			*m_cur_figure << line;
+			WriteFinalElements();
+		}
+
+		void Visit(size_t index, const RoadFigureObject::ArcData& arc) {
+			PrepareDrawing();
+			if(m_center_trace) {
+				m_cur_figure->SetArcTrace(m_center_trace->GetArc(index));
+			}
+			*m_cur_figure << arc;
+			WriteFinalElements();
+		}
+
+		void Visit(size_t, const RoadFigureObject::SlopeModifierData& slope_modifier) {
+			PrepareDrawing();
+			*m_cur_figure << slope_modifier;
+		}
+
+		void Visit(size_t, const RoadFigureObject::ThingsModifierData& things_modifier) {
+			PrepareDrawing();
+			*m_cur_figure << things_modifier;
+		}
+
+		void SetFinishAction(const Udmf::Linedef::ActionSpecial& finish_action) {
+			m_cur_figure->SetFinishAction(finish_action);
+		}
+
+		void Finish() {
+			if(m_cur_figure != NULL && m_drawing_started) {
+				m_cur_figure->Finish();
+			}
+			m_drawing_started = false;
+		}
+
+		// drop the current figure after a drawing error, the next object must start a new figure;
+		// quads of the figure added before the error stay in the intersection checker
+		void AbandonFigure() {
+			m_cur_figure.reset();
+			m_drawing_started = false;
+			m_intersection_checker.EndEncirclingQuad();
+		}
+
+	private:
+		// start drawing the figure before extending it
+		void PrepareDrawing() {
+			if(!m_drawing_started) {
+				m_cur_figure->Start();
+				m_drawing_started = true;
+			}
+
+			if(!m_have_player_start) {
+				m_map << m_player_start_info;
+				m_have_player_start = true;
+			}
+		}
+
+		// map elements below the open ids of the current figure are not changed by drawing it further
+		void WriteFinalElements() {
+			if(m_textmap_writer != NULL) {
+				m_textmap_writer->WriteFinalElements(m_cur_figure->GetOpenIds());
+			}
+		}
+	};
+
+	static void InitRoadMap(const RoadConfig& road_config, Udmf::Map& map) {
 		map = Udmf::Map();
 
 		// set textures first
 		for(int i=0; i<RoadConfig::EnTexture_Size; i++) {
 			map.textures.push_back(road_config.textures[i]);
 		}
+	}
 
-		IntersectionChecker intersection_checker;
+	void GetGeneratedRoad(const RoadFigureData& input_data,
+						  const RoadConfig& road_config,
+						  Udmf::Map& map,
+						  const Udmf::Linedef::ActionSpecial& finish_action,
+						  const RoadCenterTrace* center_trace)
+	{
+		InitRoadMap(road_config, map);
 
-		// default start data
-		IRoadFigureObject::StartModifierData default_start_data;
-		default_start_data.x_null = 0.0;
-		default_start_data.y_null = 0.0;
-		default_start_data.angle = 0.0;
-		default_start_data.zpos = 0;
-		default_start_data.height = 1024;
-		default_start_data.mark_shift = road_config.sizes.road_mark_length + 3 * road_config.sizes.road_mark_gap / 4;
-		std::unique_ptr<RoadFigure> cur_figure(new RoadFigure(road_config, default_start_data, map, &intersection_checker));
-		bool drawing_started = false;
-
-		Udmf::Map::PlayerStartInfo player_start_info;
-		player_start_info.x = 0.0;
-		player_start_info.y = 0.0;
-		player_start_info.deg_angle = 0;
-		bool have_player_start = false;
-
-		for(int i=0; i<input_data.size(); i++) {
-			const IRoadFigureObjectConstPtr& obj_ptr = input_data[i];
-			const IRoadFigureObject::EnType obj_type = obj_ptr->GetType();
-			if(obj_type == IRoadFigureObject::enType_StartModifier) {
-				// a new figure
-				if(cur_figure != NULL && drawing_started) {
-					cur_figure->Finish();
+		RoadFigureDrawer drawer(road_config, map, center_trace);
+
+		VisitRoadFigureData(input_data, drawer);
+		drawer.SetFinishAction(finish_action);
+		drawer.Finish();
+	}
+
+	void WriteGeneratedRoad(const RoadFigureData& input_data,
+							const RoadConfig& road_config,
+							unsigned char float_precision,
+							Io::OutStream& out_stream,
+							bool compact)
+	{
+		Udmf::Map map;
+		InitRoadMap(road_config, map);
+
+		Udmf::TextmapStreamWriter textmap_writer(map, float_precision, out_stream, compact);
+		RoadFigureDrawer drawer(road_config, map, NULL, &textmap_writer);
+
+		VisitRoadFigureData(input_data, drawer);
+		drawer.Finish();
+		textmap_writer.Finish();
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GenerateMapsInParallel - generates independent maps by all hardware threads
+
+namespace RoadGen {
+	// call 'generate_map' with each map index in [maps_begin, maps_end), each map is generated by the first free thread;
+	// throws the error of the failed map with the lowest index, 'map_kind' names the map in the error message
+	template<class TGenerateMap>
+	static void GenerateMapsInParallel(size_t maps_begin, size_t maps_end, const char* map_kind, const TGenerateMap& generate_map) {
+		const size_t maps_count = (maps_end > maps_begin) ? (maps_end - maps_begin) : 0;
+		std::vector<std::exception_ptr> errors(maps_count);
+		std::atomic<size_t> next_map_ix(0);
+		const auto generate_maps = [&]() {
+			for(size_t mix=next_map_ix++; mix<maps_count; mix=next_map_ix++) {
+				try {
+					generate_map(maps_begin + mix);
+
+				} catch(...) {
+					errors[mix] = std::current_exception();
+				}
+			}
+		};
+
+		const size_t threads_count_max = (std::thread::hardware_concurrency() > 0) ? std::thread::hardware_concurrency() : 1;
+		const size_t threads_count = (maps_count < threads_count_max) ? maps_count : threads_count_max;
+		std::vector<std::thread> threads;
+		for(size_t thix=1; thix<threads_count; thix++) {
+			threads.push_back(std::thread(generate_maps));
+		}
+		generate_maps();
+		for(size_t thix=0; thix<threads.size(); thix++) {
+			threads[thix].join();
+		}
+
+		for(size_t mix=0; mix<errors.size(); mix++) {
+			if(!errors[mix]) {
+				continue;
+			}
+
+			try {
+				std::rethrow_exception(errors[mix]);
+
+			} catch(std::exception& e) {
+				throw Exception("error generating " + std::string(map_kind) + " " + std::to_string(maps_begin + mix) + " - " + e.what());
+			}
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RoadShard functions implementation
+
+namespace RoadGen {
+	void GetRoadShards(const RoadFigureData& input_data, const RoadConfig& road_config, double max_shard_size, std::vector<RoadShard>& shards) {
+		shards.clear();
+
+		if(max_shard_size <= 0.0 || max_shard_size > ROAD_SHARD_MAX_SIZE) {
+			throw Exception("error sharding a road - bad shard size '" + std::to_string(max_shard_size) + "', must be positive and not greater than "
+							+ std::to_string((int)ROAD_SHARD_MAX_SIZE));
+		}
+
+		// the state of drawing: the center line position of the current figure
+		// and all the data needed to continue the figure from this position
+		struct DrawingState {
+			Udmf::Vertex v_null;
+			double angle;
+			int floorpos;
+			int height;
+			double mark_shift;
+			double slope_tangent;
+
+			// things modifiers of the figure, 'first' is the distance from the current position to the next thing
+			std::vector<RoadFigureObject::ThingsModifierData> things_modifiers;
+
+			DrawingState()
+				: angle(0.0)
+				, floorpos(0)
+				, height(0)
+				, mark_shift(0.0)
+				, slope_tangent(0.0)
+			{}
+
+			explicit DrawingState(const RoadFigureObject::StartModifierData& start_data)
+				: v_null(start_data.x_null, start_data.y_null)
+				, angle(Math::GetNormalizedAngle(start_data.angle))
+				, floorpos(start_data.zpos)
+				, height(start_data.height)
+				, mark_shift(start_data.mark_shift)
+				, slope_tangent(0.0)
+			{}
+
+			RoadFigureObject::StartModifierData GetStartData(double x_offset, double y_offset) const {
+				RoadFigureObject::StartModifierData start_data;
+				start_data.x_null = v_null.x - x_offset;
+				start_data.y_null = v_null.y - y_offset;
+				start_data.angle = angle;
+				start_data.zpos = floorpos;
+				start_data.height = height;
+				start_data.mark_shift = mark_shift;
+				return start_data;
+			}
+
+			// move the center line the same way RoadFigure does, the floor changes
+			// with the same rounding on every step, so it stays exact
+			void MoveNullVertex(const Udmf::Vertex& v_new_null) {
+				const double dist = v_new_null.GetDistanceTo(v_null);
+				if(!Math::IsZeroOrCloseTo(slope_tangent)) {
+					floorpos += (int)(slope_tangent * dist);
+				}
+				mark_shift += dist;
+				v_null = v_new_null;
+
+				for(size_t tmix=0; tmix<things_modifiers.size(); tmix++) {
+					RoadFigureObject::ThingsModifierData& things_modifier = things_modifiers[tmix];
+					things_modifier.first -= dist;
+					if(things_modifier.first < 0.0) {
+						things_modifier.first = Math::Fmod(things_modifier.first, things_modifier.every);
+						if(things_modifier.first < 0.0) {
+							things_modifier.first += things_modifier.every;
+						}
+
+						// the thing is right here
+						if(Math::IsZeroOrCloseTo(things_modifier.first - things_modifier.every)) {
+							things_modifier.first = 0.0;
+						}
+					}
+				}
+			}
+		};
+
+		// bounding box of the center line points
+		struct BoundingBox {
+			bool is_empty;
+			double x_min, y_min, x_max, y_max;
+
+			BoundingBox()
+				: is_empty(true)
+				, x_min(0.0)
+				, y_min(0.0)
+				, x_max(0.0)
+				, y_max(0.0)
+			{}
+
+			void Add(const Udmf::Vertex& v) {
+				if(is_empty) {
+					x_min = x_max = v.x;
+					y_min = y_max = v.y;
+					is_empty = false;
+					return;
 				}
 
-				const IRoadFigureObject::StartModifierData* start_data = obj_ptr->GetStartModifierData();
-				cur_figure = std::unique_ptr<RoadFigure>(new RoadFigure(road_config, *start_data, map, &intersection_checker));
-				intersection_checker.CutFigure();
-				drawing_started = false;
+				x_min = (v.x < x_min) ? v.x : x_min;
+				y_min = (v.y < y_min) ? v.y : y_min;
+				x_max = (v.x > x_max) ? v.x : x_max;
+				y_max = (v.y > y_max) ? v.y : y_max;
+			}
+
+			double GetSize() const {
+				return is_empty ? 0.0 : (((x_max - x_min) > (y_max - y_min)) ? (x_max - x_min) : (y_max - y_min));
+			}
+		};
+
+		// a place, where the road data may be cut
+		struct CutPoint {
+			// index of the first object of the next shard
+			size_t index;
+
+			// 'true' - next shard continues the figure from 'state',
+			// 'false' - next shard begins with a new figure
+			bool continue_figure;
+			DrawingState state;
+
+			// bounding box of the shard ending here
+			BoundingBox bbox;
+
+			CutPoint()
+				: index(0)
+				, continue_figure(false)
+			{}
+		};
+
+		class Utils {
+		public:
+			// put center line points of a line/arc into the bounding box and update drawing state
+			void TraceShape(const RoadFigureObject& obj, DrawingState& state, BoundingBox& bbox) {
+				if(obj.type == RoadFigureObject::enType_Line) {
+					state.MoveNullVertex(state.v_null.GetMoved(obj.line.length * Math::Cos(state.angle),
+															   obj.line.length * Math::Sin(state.angle)));
+					bbox.Add(state.v_null);
+
+				} else if(obj.type == RoadFigureObject::enType_Arc) {
+					// bad arcs get no steps, they are reported by the road generation
+					RoadCenterTrace::TraceArc(obj.arc, state.v_null, state.angle, m_arc_trace);
+					for(size_t stix=0; stix<m_arc_trace.steps.size(); stix++) {
+						state.MoveNullVertex(m_arc_trace.steps[stix].v_null);
+						state.angle = m_arc_trace.steps[stix].angle;
+						bbox.Add(state.v_null);
+					}
+				}
+			}
+
+		private:
+			// steps of the last traced arc
+			RoadCenterTrace::Arc m_arc_trace;
+		} utils;
+
+		// center line points must be not closer to the shard bounds than road elements
+		const double shard_size = max_shard_size - 2 * RoadFigure::GetMaxDistanceFromCenterLine(road_config);
+		if(shard_size <= 0.0) {
+			throw Exception("error sharding a road - the road is too wide for the shard size '" + std::to_string(max_shard_size) + "'");
+		}
+
+		const RoadFigureObject* const objects = input_data.data();
+		const size_t objects_count = input_data.size();
+
+		// the shard being collected
+		size_t shard_begin = 0;
+		bool shard_continues_figure = objects_count == 0 || objects[0].type != RoadFigureObject::enType_StartModifier;
+		DrawingState shard_start_state(GetDefaultStartData(road_config));
+
+		DrawingState state = shard_start_state;
+		BoundingBox bbox;
+		if(shard_continues_figure) {
+			bbox.Add(state.v_null);
+		}
 
-				player_start_info.x = start_data->x_null;
-				player_start_info.y = start_data->y_null;
-				player_start_info.deg_angle = (int)Math::RadiansToDegrees(Math::GetNormalizedAngle(start_data->angle));
+		bool have_cut_point = false;
+		CutPoint cut_point;
 
+		class ShardWriter {
+			const RoadFigureObject* const m_objects;
+			std::vector<RoadShard>& m_shards;
+
+		public:
+			ShardWriter(const RoadFigureObject* objects_, std::vector<RoadShard>& shards_)
+				: m_objects(objects_)
+				, m_shards(shards_)
+			{}
+
+			void Write(size_t begin, size_t end, bool continue_figure, const DrawingState& start_state, const BoundingBox& bbox) {
+				RoadShard shard;
+
+				// the center of the shard becomes its origin
+				shard.x_offset = Math::Floor((bbox.x_min + bbox.x_max) / 2.0);
+				shard.y_offset = Math::Floor((bbox.y_min + bbox.y_max) / 2.0);
+
+				if(continue_figure) {
+					shard.data.push_back(RoadFigureObject(start_state.GetStartData(shard.x_offset, shard.y_offset)));
+					for(size_t tmix=0; tmix<start_state.things_modifiers.size(); tmix++) {
+						shard.data.push_back(RoadFigureObject(start_state.things_modifiers[tmix]));
+					}
+				}
+
+				for(size_t i=begin; i<end; i++) {
+					shard.data.push_back(m_objects[i]);
+
+					RoadFigureObject& obj = shard.data.back();
+					if(obj.type == RoadFigureObject::enType_StartModifier) {
+						obj.start_modifier.x_null -= shard.x_offset;
+						obj.start_modifier.y_null -= shard.y_offset;
+					}
+				}
+
+				if(!m_shards.empty()) {
+					m_shards.back().have_next = true;
+				}
+				m_shards.push_back(shard);
+			}
+		} shard_writer(objects, shards);
+
+		size_t i = 0;
+		while(i < objects_count) {
+			const RoadFigureObject& obj = objects[i];
+
+			DrawingState next_state = state;
+			BoundingBox next_bbox = bbox;
+			if(obj.type == RoadFigureObject::enType_StartModifier) {
+				// the previous figure ends here, the shard may be cut before the new figure
+				if(i > shard_begin) {
+					have_cut_point = true;
+					cut_point.index = i;
+					cut_point.continue_figure = false;
+					cut_point.bbox = bbox;
+				}
+
+				next_state = DrawingState(obj.start_modifier);
+				next_bbox.Add(next_state.v_null);
+
+			} else if(obj.type == RoadFigureObject::enType_SlopeModifier) {
+				next_state.slope_tangent = obj.slope_modifier.tangent;
+
+			} else if(obj.type == RoadFigureObject::enType_ThingsModifier) {
+				next_state.things_modifiers.push_back(obj.things_modifier);
+
+			} else {
+				utils.TraceShape(obj, next_state, next_bbox);
+			}
+
+			if(next_bbox.GetSize() > shard_size) {
+				if(!have_cut_point) {
+					throw Exception("error sharding a road - road figure object at pos " + std::to_string(i) + " does not fit into a single map;"
+									" make lines/arcs shorter or end slopes earlier");
+				}
+
+				shard_writer.Write(shard_begin, cut_point.index, shard_continues_figure, shard_start_state, cut_point.bbox);
+
+				// continue with the next shard from the cut point
+				shard_begin = cut_point.index;
+				shard_continues_figure = cut_point.continue_figure;
+				shard_start_state = cut_point.state;
+
+				state = cut_point.state;
+				bbox = BoundingBox();
+				if(shard_continues_figure) {
+					bbox.Add(state.v_null);
+				}
+
+				have_cut_point = false;
+				i = shard_begin;
 				continue;
 			}
 
-			if(!drawing_started) {
-				cur_figure->Start();
-				drawing_started = true;
+			state = next_state;
+			bbox = next_bbox;
+			i++;
+
+			// a figure may be finished only after a line/arc with no slope, a slope may not start the continued figure
+			// (things modifiers go to the continued figure before it)
+			size_t next_shape_index = i;
+			while(next_shape_index < objects_count && objects[next_shape_index].type == RoadFigureObject::enType_ThingsModifier) {
+				next_shape_index++;
+			}
+
+			if(   (obj.type == RoadFigureObject::enType_Line || obj.type == RoadFigureObject::enType_Arc)
+			   && Math::IsZeroOrCloseTo(state.slope_tangent)
+			   && (next_shape_index == objects_count || objects[next_shape_index].type != RoadFigureObject::enType_SlopeModifier))
+			{
+				have_cut_point = true;
+				cut_point.index = i;
+				cut_point.continue_figure = true;
+				cut_point.state = state;
+				cut_point.bbox = bbox;
+
+				// the thing right at the cut point is put at the end of the shard, not at the start of the next one
+				for(size_t tmix=0; tmix<cut_point.state.things_modifiers.size(); tmix++) {
+					RoadFigureObject::ThingsModifierData& things_modifier = cut_point.state.things_modifiers[tmix];
+					if(Math::IsZeroOrCloseTo(things_modifier.first)) {
+						things_modifier.first = things_modifier.every;
+					}
+				}
 			}
+		}
+
+		shard_writer.Write(shard_begin, objects_count, shard_continues_figure, shard_start_state, bbox);
+	}
+
+	void GetGeneratedRoadShards(const std::vector<RoadShard>& shards,
+								const RoadConfig& road_config,
+								int first_levelnum,
+								size_t shards_begin,
+								size_t shards_end,
+								std::vector<Udmf::Map>& maps)
+	{
+		maps.resize(shards.size());
 
-			if(!have_player_start) {
-				map << player_start_info;
-				have_player_start = true;
+		// action special 74 - Teleport_NewMap(map, position, face)
+		const unsigned int SPECIAL_TELEPORT_NEW_MAP = 74;
+
+		GenerateMapsInParallel(shards_begin, std::min(shards_end, shards.size()), "road shard", [&](size_t shix) {
+			Udmf::Linedef::ActionSpecial finish_action;
+			if(shards[shix].have_next) {
+				finish_action = Udmf::Linedef::ActionSpecial(SPECIAL_TELEPORT_NEW_MAP, first_levelnum + (int)shix + 1);
+				finish_action.playercross = true;
 			}
 
-			// extend existing figure
-			switch(obj_type) {
-			case IRoadFigureObject::enType_Line:
-				*cur_figure << *obj_ptr->GetLineData();
-				break;
+			GetGeneratedRoad(shards[shix].data, road_config, maps[shix], finish_action);
+		});
+	}
+}
 
-			case IRoadFigureObject::enType_Arc:
-				*cur_figure << *obj_ptr->GetArcData();
-				break;
 
-			case IRoadFigureObject::enType_SlopeModifier:
-				*cur_figure << *obj_ptr->GetSlopeModifierData();
-				break;
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GetGeneratedRoadVariants implementation
+
+namespace RoadGen {
+	void GetGeneratedRoadVariants(const RoadFigureData& input_data,
+								  const RoadCenterTrace& center_trace,
+								  const std::vector<RoadConfig>& road_configs,
+								  size_t variants_begin,
+								  size_t variants_end,
+								  std::vector<Udmf::Map>& maps)
+	{
+		maps.resize(road_configs.size());
 
-			default:
-				throw Exception("road generation error - unknown road figure object type at pos " + std::to_string(i) + " to draw");
+		GenerateMapsInParallel(variants_begin, std::min(variants_end, road_configs.size()), "road variant", [&](size_t vix) {
+			GetGeneratedRoad(input_data, road_configs[vix], maps[vix], Udmf::Linedef::ActionSpecial(), &center_trace);
+		});
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CheckRoad implementation
+
+namespace RoadGen {
+	// draws figures like GetGeneratedRoad, but puts drawing errors into problems instead of throwing;
+	// a figure with a problem is skipped up to the next figure start
+	class RoadChecker {
+		Udmf::Map& m_map;
+		RoadFigureDrawer m_drawer;
+		std::vector<RoadProblem>& m_problems;
+
+		// index of the object starting the current figure
+		size_t m_figure_index;
+
+		bool m_skipping_figure;
+
+		// vertices of the current figure before this one are checked already
+		size_t m_checked_vertices_count;
+
+	public:
+		RoadChecker(const RoadConfig& road_config_, Udmf::Map& map_, std::vector<RoadProblem>& problems_)
+			: m_map(map_)
+			, m_drawer(road_config_, map_)
+			, m_problems(problems_)
+			, m_figure_index(0)
+			, m_skipping_figure(false)
+			, m_checked_vertices_count(0)
+		{}
+
+		void Visit(size_t index, const RoadFigureObject::StartModifierData& start_data) {
+			FinishFigure();
+
+			m_figure_index = index;
+			m_skipping_figure = false;
+			Draw(index, start_data);
+		}
+
+		void Visit(size_t index, const RoadFigureObject::LineData& line) {
+			Draw(index, line);
+		}
+
+		void Visit(size_t index, const RoadFigureObject::ArcData& arc) {
+			Draw(index, arc);
+		}
+
+		void Visit(size_t index, const RoadFigureObject::SlopeModifierData& slope_modifier) {
+			Draw(index, slope_modifier);
+		}
+
+		void Visit(size_t index, const RoadFigureObject::ThingsModifierData& things_modifier) {
+			Draw(index, things_modifier);
+		}
+
+		void FinishFigure() {
+			if(!m_skipping_figure) {
+				try {
+					// things are put when the figure is finished, errors are related to the figure start
+					m_drawer.Finish();
+					CheckCoordinates();
+
+				} catch(std::exception& e) {
+					m_problems.push_back(RoadProblem(m_figure_index, e.what()));
+					m_drawer.AbandonFigure();
+				}
+			}
+
+			m_map.vertices.clear();
+			m_map.linedefs.clear();
+			m_map.sidedefs.clear();
+			m_map.sectors.clear();
+			m_map.things.clear();
+			m_checked_vertices_count = 0;
+		}
+
+	private:
+		template<typename TData>
+		void Draw(size_t index, const TData& data) {
+			if(m_skipping_figure) {
+				return;
+			}
+
+			try {
+				m_drawer.Visit(index, data);
+				CheckCoordinates();
+
+			} catch(std::exception& e) {
+				m_problems.push_back(RoadProblem(index, e.what()));
+				m_drawer.AbandonFigure();
+				m_skipping_figure = true;
 			}
 		}
 
-		if(cur_figure != NULL && drawing_started) {
-			cur_figure->Finish();
+		// check map coordinate limits of new vertices and of things (see Udmf::WriteMapToStream)
+		void CheckCoordinates() {
+			for(; m_checked_vertices_count<m_map.vertices.size(); m_checked_vertices_count++) {
+				const Udmf::Vertex& v = m_map.vertices[m_checked_vertices_count];
+				if(v.x < -32768.0 || v.x > 32767.0 || v.y < -32768.0 || v.y > 32767.0) {
+					throw Exception("error generating a road - vertex (" + std::to_string(v.x) + ", " + std::to_string(v.y) + ")"
+									" is out of map coordinate limits (-32768 - 32767)");
+				}
+			}
+
+			for(size_t tix=0; tix<m_map.things.size(); tix++) {
+				const Udmf::Thing& t = m_map.things[tix];
+				if(t.x < -32768.0 || t.x > 32767.0 || t.y < -32768.0 || t.y > 32767.0) {
+					throw Exception("error generating a road - thing (" + std::to_string(t.x) + ", " + std::to_string(t.y) + ")"
+									" is out of map coordinate limits (-32768 - 32767)");
+				}
+			}
 		}
+	};
+
+	void CheckRoad(const RoadFigureData& input_data, const RoadConfig& road_config, std::vector<RoadProblem>& problems) {
+		problems.clear();
+
+		// elements of a figure are dropped when the figure is finished, so the map holds one figure at most
+		Udmf::Map map;
+
+		RoadChecker checker(road_config, map, problems);
+
+		VisitRoadFigureData(input_data, checker);
+		checker.FinishFigure();
 	}
 }
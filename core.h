@@ -10,6 +10,7 @@
 #include "io.h"
 
 #include <memory>
+#include <type_traits>
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -53,8 +54,38 @@ namespace RoadGen {
 
 		unsigned char light_level;
 
+		enum EnRoadMarkMode {
+			// a sector per road mark
+			enRoadMarkMode_Sectors = 0,
+
+			// no mark sectors, road mark texture is put on the road body floor aligned along the road
+			enRoadMarkMode_Texture
+		};
+		EnRoadMarkMode road_mark_mode;
+
+		enum EnFenceMode {
+			// fence sectors with background sectors around them
+			enFenceMode_Sectors = 0,
+
+			// the fence is the one-sided outer wall of the road sides, no background
+			enFenceMode_Wall,
+
+			// the fence is the outer wall of the road sides with a single sky sector
+			// at the fence height behind it (the fence top is not drawn)
+			enFenceMode_Sky
+		};
+		EnFenceMode fence_mode;
+
+		// largest number of linedefs per sector, long unsloped sectors are split with seam linedefs at line ends,
+		// arc steps, in road mark gaps of long lines and before the figure end; linedefs of the closing seams
+		// are reserved in advance; sloped segments and a single arc step may go over it; 0 - no limit
+		unsigned int max_sector_linedefs;
+
 		RoadConfig()
 			: light_level(0)
+			, road_mark_mode(enRoadMarkMode_Sectors)
+			, fence_mode(enFenceMode_Sectors)
+			, max_sector_linedefs(0)
 		{
 			textures[enTexture_Null] = "-";
 		}
@@ -65,24 +96,20 @@ namespace RoadGen {
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// IRoadFigureObject - common interface for objects, that are consumed by RoadFigure,
-// this includes basic shapes (lines, arcs) and modifiers (start and slope modifiers)
+// RoadFigureObject - a value type for objects, that are consumed by RoadFigure,
+// this includes basic shapes (lines, arcs) and modifiers (start, slope and things modifiers);
+// stored as a tagged union, so road figure data is a flat contiguous array of these objects
 
 namespace RoadGen {
-	class IRoadFigureObject {
-	public:
+	struct RoadFigureObject {
 		enum EnType {
 			enType_StartModifier = 0,
 			enType_Line,
 			enType_Arc,
-			enType_SlopeModifier
+			enType_SlopeModifier,
+			enType_ThingsModifier
 		};
 
-		virtual ~IRoadFigureObject() {}
-
-		// return the only type this object offers data for
-		virtual EnType GetType() const = 0;
-
 		struct StartModifierData {
 			static const EnType obj_type_id = enType_StartModifier;
 
@@ -101,8 +128,6 @@ namespace RoadGen {
 				, mark_shift(0.0)
 			{}
 		};
-		virtual StartModifierData* GetStartModifierData() = 0;
-		virtual const StartModifierData* GetStartModifierData() const = 0;
 
 		struct LineData {
 			static const EnType obj_type_id = enType_Line;
@@ -113,9 +138,7 @@ namespace RoadGen {
 				: length(0.0)
 			{}
 		};
-		virtual LineData* GetLineData() = 0;
-		virtual const LineData* GetLineData() const = 0;
-		
+
 		struct ArcData {
 			static const EnType obj_type_id = enType_Arc;
 
@@ -129,9 +152,7 @@ namespace RoadGen {
 				, divider(0)
 			{}
 		};
-		virtual ArcData* GetArcData() = 0;
-		virtual const ArcData* GetArcData() const = 0;
-		
+
 		struct SlopeModifierData {
 			static const EnType obj_type_id = enType_SlopeModifier;
 
@@ -141,89 +162,110 @@ namespace RoadGen {
 				: tangent(0.0)
 			{}
 		};
-		virtual SlopeModifierData* GetSlopeModifierData() = 0;
-		virtual const SlopeModifierData* GetSlopeModifierData() const = 0;
-	};
-
-	template<typename T>
-	class RoadFigureObjectT: public IRoadFigureObject {
-	public:
-		T data;
 
-		EnType GetType() const {
-			return T::obj_type_id;
-		}
+		// places things along the rest of the figure
+		struct ThingsModifierData {
+			static const EnType obj_type_id = enType_ThingsModifier;
 
-		StartModifierData* GetStartModifierData() {
-			return GetData<StartModifierData>();
-		}
+			// thing type (DoomEdNum)
+			int thing_type;
 
-		const StartModifierData* GetStartModifierData() const {
-			return GetData<StartModifierData>();
-		}
+			// distance between two things along the center line
+			double every;
 
-		LineData* GetLineData() {
-			return GetData<LineData>();
-		}
+			// distance from the center line, positive values - to the left (the same side as for arcs with positive angles)
+			double offset;
 
-		const LineData* GetLineData() const {
-			return GetData<LineData>();
-		}
+			// distance from the modifier position to the first thing
+			double first;
 
-		ArcData* GetArcData() {
-			return GetData<ArcData>();
-		}
-
-		const ArcData* GetArcData() const {
-			return GetData<ArcData>();
-		}
+			ThingsModifierData()
+				: thing_type(0)
+				, every(0.0)
+				, offset(0.0)
+				, first(0.0)
+			{}
+		};
 
-		SlopeModifierData* GetSlopeModifierData() {
-			return GetData<SlopeModifierData>();
-		}
+		// the only type this object offers data for
+		EnType type;
 
-		const SlopeModifierData* GetSlopeModifierData() const {
-			return GetData<SlopeModifierData>();
-		}
+		// data of the type above, other members are undefined
+		union {
+			StartModifierData start_modifier;
+			LineData line;
+			ArcData arc;
+			SlopeModifierData slope_modifier;
+			ThingsModifierData things_modifier;
+		};
 
-	private:
-		template<typename G>
-		G* GetData() {
-			return static_cast<G*>(ThrowOnBadDataType<G>());
-		}
+	public:
+		RoadFigureObject(const StartModifierData& start_modifier_)
+			: type(enType_StartModifier)
+			, start_modifier(start_modifier_)
+		{}
 
-		template<>
-		T* GetData<T>() {
-			return &data;
-		}
+		RoadFigureObject(const LineData& line_)
+			: type(enType_Line)
+			, line(line_)
+		{}
 
-		template<typename G>
-		const G* GetData() const {
-			return static_cast<const G*>(ThrowOnBadDataType<G>());
-		}
+		RoadFigureObject(const ArcData& arc_)
+			: type(enType_Arc)
+			, arc(arc_)
+		{}
 
-		template<>
-		const T* GetData<T>() const {
-			return &data;
-		}
+		RoadFigureObject(const SlopeModifierData& slope_modifier_)
+			: type(enType_SlopeModifier)
+			, slope_modifier(slope_modifier_)
+		{}
 
-		template<typename G>
-		void* ThrowOnBadDataType() const {
-			static_assert(G::obj_type_id != T::obj_type_id,
-				"undefined data for a road figure object is specified - please, do not use a custom data struct for this template");
-			throw Exception("error generating a road - wrong type of road figure object is picked");
-		}
+		RoadFigureObject(const ThingsModifierData& things_modifier_)
+			: type(enType_ThingsModifier)
+			, things_modifier(things_modifier_)
+		{}
 	};
 
-	typedef RoadFigureObjectT<IRoadFigureObject::StartModifierData> RoadFigureStartModifier;
-	typedef RoadFigureObjectT<IRoadFigureObject::LineData> RoadFigureLine;
-	typedef RoadFigureObjectT<IRoadFigureObject::ArcData> RoadFigureArc;
-	typedef RoadFigureObjectT<IRoadFigureObject::SlopeModifierData> RoadFigureSlopeModifier;
-
-	typedef std::unique_ptr<IRoadFigureObject> IRoadFigureObjectPtr;
-	typedef std::vector<IRoadFigureObjectPtr> RoadFigureData;
-	typedef std::unique_ptr<const IRoadFigureObject> IRoadFigureObjectConstPtr;
-	typedef std::vector<IRoadFigureObjectConstPtr> RoadFigureDataConst;
+	// objects are plain data - road figure data can be copied,
+	// cached or serialized as a single block of memory
+	static_assert(std::is_trivially_copyable<RoadFigureObject>::value, "road figure object must be trivially copyable");
+
+	typedef std::vector<RoadFigureObject> RoadFigureData;
+
+	// call 'visitor.Visit(index, data)' for each object of road figure data,
+	// 'data' is the data struct of the object's type; does not allocate anything
+	template<typename TVisitor>
+	void VisitRoadFigureData(const RoadFigureData& road_data, TVisitor& visitor) {
+		const RoadFigureObject* const objects = road_data.data();
+		const size_t objects_count = road_data.size();
+		for(size_t i=0; i<objects_count; i++) {
+			const RoadFigureObject& obj = objects[i];
+			switch(obj.type) {
+			case RoadFigureObject::enType_StartModifier:
+				visitor.Visit(i, obj.start_modifier);
+				break;
+
+			case RoadFigureObject::enType_Line:
+				visitor.Visit(i, obj.line);
+				break;
+
+			case RoadFigureObject::enType_Arc:
+				visitor.Visit(i, obj.arc);
+				break;
+
+			case RoadFigureObject::enType_SlopeModifier:
+				visitor.Visit(i, obj.slope_modifier);
+				break;
+
+			case RoadFigureObject::enType_ThingsModifier:
+				visitor.Visit(i, obj.things_modifier);
+				break;
+
+			default:
+				throw Exception("road generation error - unknown road figure object type at pos " + std::to_string(i));
+			}
+		}
+	}
 }
 
 
@@ -303,6 +345,124 @@ namespace RoadGen {
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RoadCenterLine - arc-length index over the center line of a road figure; the center line is a polyline
+// passing through the null vertex positions of all drawing steps
+
+namespace RoadGen {
+	class RoadCenterLine {
+	public:
+		struct Point {
+			// distance from the figure start along the center line
+			double distance;
+
+			double x, y;
+
+			// direction of the center line segment ending at this point (radians),
+			// for the first point - the figure start direction
+			double angle;
+
+			// floor position of the road body
+			double zfloor;
+
+			Point()
+				: distance(0.0)
+				, x(0.0)
+				, y(0.0)
+				, angle(0.0)
+				, zfloor(0.0)
+			{}
+
+			Point(double distance_, double x_, double y_, double angle_, double zfloor_)
+				: distance(distance_)
+				, x(x_)
+				, y(y_)
+				, angle(angle_)
+				, zfloor(zfloor_)
+			{}
+		};
+
+	public:
+		// set the first point, remove all others
+		void Start(double x, double y, double angle, double zfloor);
+
+		// add the point at the end of a straight segment going from the last point;
+		// 'angle' is the segment direction
+		void AddPoint(double x, double y, double angle, double zfloor);
+
+		bool IsEmpty() const;
+
+		// total length of the center line
+		double GetLength() const;
+
+		// center line point at the distance from the figure start in the range [0, GetLength()];
+		// O(log n) - binary search of the segment, then linear interpolation within it
+		Point GetPointAt(double distance) const;
+
+	private:
+		std::vector<Point> m_points;
+	};
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RoadCenterTrace - center line steps of all arcs of the road; they do not depend on the road config,
+// so road variants of the same input data draw arcs from the same trace, moving their vertices by own widths
+
+namespace RoadGen {
+	class RoadCenterTrace {
+	public:
+		struct Step {
+			// null vertex after the step
+			Udmf::Vertex v_null;
+
+			// direction of the center line after the step (radians, normalized)
+			double angle;
+
+			// turn of the step (radians, positive)
+			double da;
+
+			Step()
+				: angle(0.0)
+				, da(0.0)
+			{}
+		};
+
+		struct Arc {
+			// null vertex and direction at the arc start, the arc is drawn from the trace only from this position
+			Udmf::Vertex v_null;
+			double angle;
+
+			// center of the arc
+			double cx, cy;
+
+			std::vector<Step> steps;
+
+			Arc()
+				: angle(0.0)
+				, cx(0.0)
+				, cy(0.0)
+			{}
+		};
+
+	public:
+		// trace the center line of all figures the way RoadFigure draws it
+		explicit RoadCenterTrace(const RoadFigureData& input_data);
+
+		// traced arc of the object, NULL if the object is not an arc or the arc is bad
+		const Arc* GetArc(size_t object_index) const;
+
+		// put steps of the arc drawn from 'v_null' in 'angle' direction into 'arc_trace';
+		// bad arcs (divider less than 2, zero angle) get no steps
+		static void TraceArc(const RoadFigureObject::ArcData& arc, const Udmf::Vertex& v_null, double angle, Arc& arc_trace);
+
+	private:
+		// an arc per road figure object, arcs of other objects have no steps
+		std::vector<Arc> m_arcs;
+	};
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // RoadFigure - single road segment; may be built using arcs or lines with the support of slopes
 
@@ -315,8 +475,8 @@ namespace RoadGen {
 		using Sidedef = Udmf::Sidedef;
 		using Sector = Udmf::Sector;
 
-		using StartModifier = IRoadFigureObject::StartModifierData;
-		using SlopeModifier = IRoadFigureObject::SlopeModifierData;
+		using StartModifier = RoadFigureObject::StartModifierData;
+		using SlopeModifier = RoadFigureObject::SlopeModifierData;
 
 		// background sector thickness
 		static const int BACKGROUND_THICKNESS = 16;
@@ -330,22 +490,31 @@ namespace RoadGen {
 		// mark sector height
 		static const int MARK_HEIGHT = 1;
 
+		// sector size cap: largest number of linedefs the figure end adds to a background or fence sector
+		// on one side of the road
+		static const int FIGURE_END_SIDE_LINEDEFS_MAX = 12;
+
 		static const int SMALLEST_ARC_LINE = 4;
 		static const int SMALLEST_MARK_LINE = 4;
 
 	public:
 		RoadFigure(const RoadConfig& config,
-				   const IRoadFigureObject::StartModifierData& start_data,
+				   const RoadFigureObject::StartModifierData& start_data,
 				   Udmf::Map& map,
-				   IntersectionChecker* intersection_checker = NULL)
+				   IntersectionChecker* intersection_checker = NULL,
+				   Udmf::TextmapStreamWriter* textmap_writer = NULL)
 			: m_config(config)
 			, m_map(map)
 			, m_intersection_checker(intersection_checker)
+			, m_textmap_writer(textmap_writer)
 			, m_total_width(2 * (BACKGROUND_THICKNESS + config.sizes.background_dist + config.sizes.road_side_width) + config.sizes.road_width)
 			, m_floorpos(start_data.zpos)
 			, m_ceilingpos(start_data.zpos + start_data.height)
 			, m_angle(start_data.angle)
 			, m_mark_coord(0.0)
+			, m_have_mark_sectors(config.road_mark_mode == RoadConfig::enRoadMarkMode_Sectors)
+			, m_have_fence_sectors(config.fence_mode == RoadConfig::enFenceMode_Sectors)
+			, m_have_background_sky(config.fence_mode != RoadConfig::enFenceMode_Wall)
 			, m_v_null(start_data.x_null, start_data.y_null)
 			, m_started_drawing(false)
 			, m_finished_drawing(false)
@@ -353,6 +522,9 @@ namespace RoadGen {
 			, m_have_shape_with_current_slope(false)
 			, m_sectors_closed(true)
 			, m_mark_sector_closed(true)
+			, m_body_sector_aligned(false)
+			, m_counted_sidedefs_end(0)
+			, m_arc_trace(NULL)
 		{
 			m_angle = Math::GetNormalizedAngle(m_angle);
 
@@ -367,18 +539,40 @@ namespace RoadGen {
 		void Start();
 		void Finish();
 
-		RoadFigure& operator<< (const IRoadFigureObject::LineData& line);
-		RoadFigure& operator<< (const IRoadFigureObject::ArcData& arc);
-		RoadFigure& operator<< (const IRoadFigureObject::SlopeModifierData& slope_modifier);
+		// action special for linedefs crossing the road at its end (set by Finish), e.g. a teleport to the next map
+		void SetFinishAction(const Udmf::Linedef::ActionSpecial& finish_action);
+
+		// distance from the center line of the road the figure's map elements may be located at
+		static double GetMaxDistanceFromCenterLine(const RoadConfig& config);
+
+		// center line drawn so far
+		const RoadCenterLine& GetCenterLine() const;
+
+		// the next arc is drawn from the trace instead of tracing it again, the trace must outlive drawing the arc
+		void SetArcTrace(const RoadCenterTrace::Arc* arc_trace);
+
+		RoadFigure& operator<< (const RoadFigureObject::LineData& line);
+		RoadFigure& operator<< (const RoadFigureObject::ArcData& arc);
+		RoadFigure& operator<< (const RoadFigureObject::SlopeModifierData& slope_modifier);
+
+		// things are put into the map when the figure is finished
+		RoadFigure& operator<< (const RoadFigureObject::ThingsModifierData& things_modifier);
+
+		// ids of the first map elements, that drawing the figure further may change or read back: sectors
+		// and vertices of the last steps (closing sectors changes their heights, the road mark is extended
+		// from its last vertices), sidedefs not counted by the sector size cap; the elements below are final
+		Udmf::MapIds GetOpenIds() const;
 
 	private:
 		void InitMapElements();
 
-		static void GetMovedVertices(const std::vector<Vertex*>& source_vertices,
+		// 'vertices' receives moved vertices in the order of 'source_vertices'
+		static void GetMovedVertices(const Vertex* const* source_vertices,
+									 size_t source_vertices_count,
 									 const Vertex& v_prev_null,
 									 const Vertex& v_null,
 									 double angle,
-									 std::unordered_map<Vertex*, Vertex>& vertices);
+									 Vertex* vertices);
 
 		void SetNullVertex(const Vertex& v_new_null);
 
@@ -397,15 +591,88 @@ namespace RoadGen {
 						const Vertex& v_new_east_left,
 						const Vertex& v_new_east_right);
 
-		void ExtendMark(const Vertex& v_new_mark_west,
-						const Vertex& v_new_mark_east);
+		// sidedefs of linedefs on the outer bound of the road frame (road sides and figure ends):
+		// the inner sidedef is in the road 'sector', the outer one is in the 'background_sector' with the texture of 'side';
+		// with lean fences the fence texture is on the inner sidedef and the outer one is in the sky sector
+		// or there is no outer sidedef (ID_INVALID - one-sided linedef)
+		unsigned int AddFrameInnerSidedef(Sector& sector);
+		unsigned int AddFrameOuterSidedef(const Sidedef& side, Sector& background_sector);
+
+		// drawing routines are specialized for sloped and unsloped segments and for road marks drawn
+		// by sectors or by the body texture, the specialization is chosen once per line or arc
+
+		// 'ARE_SECTORS_SPLIT' - large sectors are already split for the line by the caller
+		template<bool HAVE_SLOPE, bool HAVE_MARK_SECTORS, bool ARE_SECTORS_SPLIT = false>
+		void DrawLineT(double dx, double dy);
+
+		// sector size cap: every road mark is a hole of 4 linedefs in the body sector, an unsloped line with mark sectors
+		// is drawn by pieces ending in the middle of mark gaps to let sectors be split between them
+		void DrawMarkedLine(double length);
+
+		// sector size cap: length of the next piece of the line, as many marks as the body sector can get
+		double GetMarkedLinePieceLength(double length_left);
+
+		template<bool HAVE_SLOPE, bool HAVE_MARK_SECTORS>
+		void DrawArcT(double turn_sign, const RoadCenterTrace::Arc& arc_trace);
+
+		// add the current null vertex to the center line
+		void AddCenterLinePoint(double segment_angle);
+
+		// put things of all things modifiers along the center line into the map
+		void PutThings();
+
+		// mark sectors: the step is drawn by the specialization without a mark, if it stays in a gap
+		template<bool HAVE_SLOPE>
+		void ExtendMarkT(const Vertex& v_new_mark_west,
+						 const Vertex& v_new_mark_east);
+
+		template<bool HAVE_SLOPE, bool HAVE_MARK>
+		void ExtendMarkT(const Vertex& v_new_mark_west,
+						 const Vertex& v_new_mark_east,
+						 double length_middle);
+
+		// texture road marks: each line or arc step gets its own body sector to align the floor texture along it;
+		// split the body sector at the current position if it is aligned already
+		void StartBodySegment();
+
+		// texture road marks: align the floor texture of the body sector along the segment ending at the null vertex
+		void AlignBodyTexture(double segment_angle);
 
 		void CloseSectors();
 
+		// sector size cap: close unsloped sectors before the next step of the given length along the road,
+		// if it may make any of them larger than the cap (the growth of the last step is expected)
+		void SplitLargeSectors(double step_length);
+
+		// sector size cap: the figure end extends background and fence sectors beyond the road end,
+		// close them at the road end, if the figure end may make any of them larger than the cap
+		void SplitLargeEndSectors();
+
+		// sector size cap: linedefs of road mark holes, a step of the given length along the road may add to the body sector
+		unsigned int GetStepMarkSidesCount(double step_length) const;
+
+		// sector size cap: number of linedefs closing sectors adds to the given sector
+		unsigned int GetCloseSidesCount(unsigned int id_s);
+
+		// sector size cap: number of linedefs of the current body sector including ones of the sidedefs not counted yet
+		unsigned int GetBodySidesCount();
+
+		// 'for_slope' - a slope may follow, mark vertices get heights for it;
+		// 'false' - sectors are just split, the road goes on flat
+		template<bool HAVE_SLOPE>
+		void CloseSectorsT(bool for_slope = true);
+
+		template<bool HAVE_SLOPE, bool HAVE_MARK>
+		void CloseSectorsT(bool at_mark_start, bool at_mark_end, bool for_slope);
+
 	private:
 		const RoadConfig& m_config;
 		Udmf::Map& m_map;
 		IntersectionChecker* const m_intersection_checker;
+
+		// final map elements are written after each step of arcs (see GetOpenIds), NULL - the whole map is kept
+		Udmf::TextmapStreamWriter* const m_textmap_writer;
+
 		const double m_total_width;
 
 		int m_floorpos, m_ceilingpos;
@@ -413,9 +680,20 @@ namespace RoadGen {
 
 		// range: [0, road_mark_length + road_mark_gap)
 		// [0, road_mark_length) - drawing a mark
-		// [road_mark_length, road_mark_length + road_mark_gap) - leaving a gap
+		// [road_mark_length, road_mark_length + road_mark_gap) - leaving a gap;
+		// texture road marks - the texture shift at the figure start, does not change
 		double m_mark_coord;
 
+		// 'false' - texture road marks, no mark sectors are drawn
+		const bool m_have_mark_sectors;
+
+		// 'false' - lean fence, fence and background body sectors are not drawn
+		// (their vertices are still moved along the road for the intersection checker)
+		const bool m_have_fence_sectors;
+
+		// 'false' - fence walls, there is no sky sector around the road
+		const bool m_have_background_sky;
+
 		// center vertex, represents current position of the drawing
 		Vertex m_v_null;
 
@@ -428,6 +706,25 @@ namespace RoadGen {
 		bool m_sectors_closed;
 		bool m_mark_sector_closed;
 
+		// texture road marks: the floor texture of the current body sector is aligned along a segment
+		bool m_body_sector_aligned;
+
+		// sector size cap: numbers of sidedefs of sectors drawn since the sectors were closed,
+		// sidedefs are counted up to 'm_counted_sidedefs_end'; the last counted sidedefs only
+		std::unordered_map<unsigned int, unsigned int> m_sector_sides_counts;
+		std::unordered_map<unsigned int, unsigned int> m_step_sector_sides_counts;
+		unsigned int m_counted_sidedefs_end;
+
+		// trace of the next arc, NULL - the arc is traced by the figure
+		const RoadCenterTrace::Arc* m_arc_trace;
+
+		Udmf::Linedef::ActionSpecial m_finish_action;
+
+		RoadCenterLine m_center_line;
+
+		// things modifiers with center line distances of their positions
+		std::vector< std::pair<double, RoadFigureObject::ThingsModifierData> > m_things_modifiers;
+
 		//
 		// main road frame
 		//
@@ -476,7 +773,7 @@ namespace RoadGen {
 		// misc
 		Vertex m_v_null_prev;
 
-		// map: <map-obj-template-address> -> <last-object-id>
+		// map: <map-obj-template-address> -> <last-object-id> (vertices and sectors)
 		std::unordered_map<void *, unsigned int> m_last_ids;
 
 		// pair: [<mark-vertices-distance-from-the-start>, pair: [<mark-vertex-1>, <mark-vertex-2>]]
@@ -485,9 +782,105 @@ namespace RoadGen {
 
 	//
 	// Put a road into the map according to given object set in input data and config
+	// (arcs are drawn from 'center_trace' of the input data, if it is given)
 	//
 
-	void GetGeneratedRoad(const RoadFigureDataConst& input_data, const RoadConfig& road_config, Udmf::Map& map);
+	void GetGeneratedRoad(const RoadFigureData& input_data,
+						  const RoadConfig& road_config,
+						  Udmf::Map& map,
+						  const Udmf::Linedef::ActionSpecial& finish_action = Udmf::Linedef::ActionSpecial(),
+						  const RoadCenterTrace* center_trace = NULL);
+
+	// generate the road as GetGeneratedRoad does and write the map as TEXTMAP lump data into 'out_stream'
+	// (see Udmf::WriteMapToStream) while the road is generated: map elements, that the figures do not change
+	// anymore, are written and freed, so the memory does not grow with the length of the road
+	void WriteGeneratedRoad(const RoadFigureData& input_data,
+							const RoadConfig& road_config,
+							unsigned char float_precision,
+							Io::OutStream& out_stream,
+							bool compact = false);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RoadShard - a part of the road, that is put into a separate map; roads, that do not fit into
+// map coordinate limits, are split into shards at line/arc boundaries or at figure starts
+
+namespace RoadGen {
+	// largest width and height of the area covered by a single shard
+	const double ROAD_SHARD_MAX_SIZE = 60000.0;
+
+	struct RoadShard {
+		// shard road data, always begins with a start modifier, coordinates are local for the shard
+		RoadFigureData data;
+
+		// world coordinates of the shard origin (shard coordinate = world coordinate - offset)
+		double x_offset, y_offset;
+
+		// 'true' - the road continues in the next shard
+		bool have_next;
+
+		RoadShard()
+			: x_offset(0.0)
+			, y_offset(0.0)
+			, have_next(false)
+		{}
+	};
+
+	// split road input data into shards covering at most 'max_shard_size' x 'max_shard_size' area each;
+	// a figure is cut only after an unsloped line/arc, the rest of the figure continues
+	// in the next shard from the same position, direction, floor height and road mark phase,
+	// things modifiers of the figure are repeated there with the phase of the next thing
+	void GetRoadShards(const RoadFigureData& input_data, const RoadConfig& road_config, double max_shard_size, std::vector<RoadShard>& shards);
+
+	// generate a map for each shard of [shards_begin, shards_end) in parallel; the end of the last figure of a shard
+	// teleports the player to the next map, maps are numbered from 'first_levelnum'; 'maps' get a map per shard,
+	// maps of other shards are left as they are (they may be freed after writing, when maps are generated by parts)
+	void GetGeneratedRoadShards(const std::vector<RoadShard>& shards,
+								const RoadConfig& road_config,
+								int first_levelnum,
+								size_t shards_begin,
+								size_t shards_end,
+								std::vector<Udmf::Map>& maps);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GetGeneratedRoadVariants - the same road generated with different configs (sizes, textures, light level)
+
+namespace RoadGen {
+	// generate a map for each road config of [variants_begin, variants_end) in parallel from the same input data,
+	// arcs of all variants are drawn from 'center_trace' of the input data;
+	// maps are put in the order of configs; maps of other configs are left as they are
+	void GetGeneratedRoadVariants(const RoadFigureData& input_data,
+								  const RoadCenterTrace& center_trace,
+								  const std::vector<RoadConfig>& road_configs,
+								  size_t variants_begin,
+								  size_t variants_end,
+								  std::vector<Udmf::Map>& maps);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CheckRoad - validates road input data against the config without keeping the generated map
+
+namespace RoadGen {
+	struct RoadProblem {
+		// index of the road figure object the problem is found at
+		size_t object_index;
+
+		std::string message;
+
+		RoadProblem(size_t object_index_, const std::string& message_)
+			: object_index(object_index_)
+			, message(message_)
+		{}
+	};
+
+	// draw the road as GetGeneratedRoad does and put all problems into 'problems' in the order of objects:
+	// figure errors (arc radius, slopes, heights), intersections and vertices or things out of map coordinate limits;
+	// after a problem the rest of the figure is skipped; map elements are dropped after each figure
+	void CheckRoad(const RoadFigureData& input_data, const RoadConfig& road_config, std::vector<RoadProblem>& problems);
 }
 
 #endif // _ROAD_GEN_CORE_H_
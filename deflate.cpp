@@ -0,0 +1,626 @@
+
+#include "deflate.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <thread>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GetCrc32 implementation
+
+namespace RoadGen {
+	namespace Deflate {
+		uint32_t GetCrc32(const char* data, size_t size, uint32_t crc) {
+			class Utils {
+			public:
+				// CRC-32 of each byte value, polynomial 0xEDB88320 (reversed 0x04C11DB7)
+				Utils() {
+					for(uint32_t value=0; value<256; value++) {
+						uint32_t value_crc = value;
+						for(int bit=0; bit<8; bit++) {
+							value_crc = (value_crc & 1) ? (0xEDB88320 ^ (value_crc >> 1)) : (value_crc >> 1);
+						}
+						table[value] = value_crc;
+					}
+				}
+
+				uint32_t table[256];
+			};
+
+			static const Utils utils;
+
+			crc = ~crc;
+			for(size_t ix=0; ix<size; ix++) {
+				crc = utils.table[(crc ^ (unsigned char)data[ix]) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BitWriter - puts bits into DEFLATE stream data starting from the lowest bit of each byte
+
+namespace RoadGen {
+	namespace Deflate {
+		class BitWriter {
+		public:
+			BitWriter(CharArray& data)
+				: m_data(data)
+				, m_bits(0)
+				, m_bits_count(0)
+			{}
+
+			// 'count' - up to 32 bits
+			void PutBits(uint32_t value, unsigned int count) {
+				m_bits |= (uint64_t)value << m_bits_count;
+				m_bits_count += count;
+				if(m_bits_count >= 32) {
+					const char bytes[4] = {(char)m_bits, (char)(m_bits >> 8), (char)(m_bits >> 16), (char)(m_bits >> 24)};
+					m_data.insert(m_data.end(), bytes, bytes + 4);
+					m_bits >>= 32;
+					m_bits_count -= 32;
+				}
+			}
+
+			// puts the bits of the last byte (padded with zeros) into the data
+			void AlignToByte() {
+				while(m_bits_count > 0) {
+					m_data.push_back((char)m_bits);
+					m_bits >>= 8;
+					m_bits_count = (m_bits_count > 8) ? m_bits_count - 8 : 0;
+				}
+				m_bits = 0;
+			}
+
+			// puts bytes after AlignToByte
+			void PutBytes(const unsigned char* bytes, size_t count) {
+				m_data.insert(m_data.end(), bytes, bytes + count);
+			}
+
+		private:
+			CharArray& m_data;
+			uint64_t m_bits;
+			unsigned int m_bits_count;
+		};
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Huffman codes - code lengths limited to the given number of bits, canonical codes of DEFLATE
+
+namespace RoadGen {
+	namespace Deflate {
+		// the longest codes of literals, lengths and distances
+		static const unsigned int CODE_BITS_MAX = 15;
+
+		// get lengths of codes by frequencies of symbols (0 - unused symbol), codes of frequent symbols are shorter;
+		// a single used symbol gets a code of 1 bit (DEFLATE allows such incomplete codes)
+		static void GetCodeLengths(const uint32_t* freqs, unsigned int symbols_count, unsigned int bits_max, unsigned char* lengths) {
+			std::fill(lengths, lengths + symbols_count, (unsigned char)0);
+
+			// used symbols in order of frequencies
+			std::vector<std::pair<uint32_t, unsigned int> > symbols;
+			for(unsigned int six=0; six<symbols_count; six++) {
+				if(freqs[six] != 0) {
+					symbols.push_back(std::make_pair(freqs[six], six));
+				}
+			}
+
+			if(symbols.size() < 2) {
+				if(!symbols.empty()) {
+					lengths[symbols[0].second] = 1;
+				}
+				return;
+			}
+			std::sort(symbols.begin(), symbols.end());
+
+			// Huffman tree: leaves [0, count) are sorted, inner nodes [count, 2 * count - 1) are made in order
+			// of growing weights, so the two lightest nodes are at the fronts of these two queues
+			const size_t count = symbols.size();
+			std::vector<uint64_t> weights(2 * count - 1);
+			std::vector<size_t> parents(2 * count - 1);
+			for(size_t lix=0; lix<count; lix++) {
+				weights[lix] = symbols[lix].first;
+			}
+
+			size_t leaf_ix = 0, inner_ix = count;
+			for(size_t nix=count; nix<weights.size(); nix++) {
+				weights[nix] = 0;
+				for(int child=0; child<2; child++) {
+					const bool take_leaf = leaf_ix < count && (inner_ix >= nix || weights[leaf_ix] <= weights[inner_ix]);
+					const size_t child_ix = take_leaf ? leaf_ix++ : inner_ix++;
+					weights[nix] += weights[child_ix];
+					parents[child_ix] = nix;
+				}
+			}
+
+			// depths of leaves, parents are made after their children; depths over the limit are cut to it
+			std::vector<unsigned int> depths(weights.size(), 0);
+			std::vector<uint32_t> length_counts(bits_max + 1, 0);
+			for(size_t nix=weights.size()-1; nix>0; nix--) {
+				depths[nix - 1] = depths[parents[nix - 1]] + 1;
+			}
+			for(size_t lix=0; lix<count; lix++) {
+				length_counts[std::min(depths[lix], bits_max)]++;
+			}
+
+			// cut codes overfill the code space: a code of the longest length is dropped and a shorter code
+			// is made one bit longer (it frees place for two codes) until the code space is filled exactly
+			uint32_t code_space = 0;
+			for(unsigned int length=1; length<=bits_max; length++) {
+				code_space += length_counts[length] << (bits_max - length);
+			}
+
+			while(code_space > ((uint32_t)1 << bits_max)) {
+				length_counts[bits_max]--;
+				for(unsigned int length=bits_max-1; length>0; length--) {
+					if(length_counts[length] != 0) {
+						length_counts[length]--;
+						length_counts[length + 1] += 2;
+						break;
+					}
+				}
+				code_space--;
+			}
+
+			// the rarest symbols get the longest codes
+			size_t symbol_ix = 0;
+			for(unsigned int length=bits_max; length>0; length--) {
+				for(uint32_t cix=0; cix<length_counts[length]; cix++) {
+					lengths[symbols[symbol_ix++].second] = (unsigned char)length;
+				}
+			}
+		}
+
+		// get canonical codes by their lengths, bits of codes are reversed (DEFLATE puts them from the highest one)
+		static void GetCodes(const unsigned char* lengths, unsigned int symbols_count, uint16_t* codes) {
+			unsigned int length_counts[CODE_BITS_MAX + 1] = {0};
+			for(unsigned int six=0; six<symbols_count; six++) {
+				length_counts[lengths[six]]++;
+			}
+
+			unsigned int next_codes[CODE_BITS_MAX + 1] = {0};
+			unsigned int code = 0;
+			length_counts[0] = 0;
+			for(unsigned int length=1; length<=CODE_BITS_MAX; length++) {
+				code = (code + length_counts[length - 1]) << 1;
+				next_codes[length] = code;
+			}
+
+			for(unsigned int six=0; six<symbols_count; six++) {
+				codes[six] = 0;
+				if(lengths[six] != 0) {
+					const unsigned int symbol_code = next_codes[lengths[six]]++;
+					for(unsigned int bit=0; bit<lengths[six]; bit++) {
+						codes[six] |= (uint16_t)(((symbol_code >> bit) & 1) << (lengths[six] - 1 - bit));
+					}
+				}
+			}
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SegmentCompressor - compresses a segment of data by LZ77 with hash chains and lazy matching, matches are
+// looked for within the segment only; tokens are put into blocks with dynamic Huffman codes or stored blocks
+
+namespace RoadGen {
+	namespace Deflate {
+		// data is compressed by segments of that size in parallel
+		static const size_t DEFLATE_SEGMENT_SIZE = 1024 * 1024;
+
+		static const size_t WINDOW_SIZE = 32768;
+		static const size_t MATCH_LENGTH_MIN = 3;
+		static const size_t MATCH_LENGTH_MAX = 258;
+
+		// positions of matches are found by hashes of their first MATCH_LENGTH_MIN bytes
+		static const unsigned int HASH_BITS = 15;
+
+		// number of previous positions with the same hash, that are tried for a match
+		static const size_t CHAIN_LENGTH_MAX = 32;
+
+		// a match that long is taken without trying other positions and the next one
+		static const size_t NICE_MATCH_LENGTH = 128;
+
+		// tokens (literals and matches) of a block with its own Huffman codes
+		static const size_t BLOCK_TOKENS_MAX = 32768;
+
+		// the longest stored block
+		static const size_t STORED_BLOCK_SIZE_MAX = 65535;
+
+		static const unsigned int LITLEN_CODES_COUNT = 286;
+		static const unsigned int DISTANCE_CODES_COUNT = 30;
+		static const unsigned int CODE_LENGTH_CODES_COUNT = 19;
+		static const unsigned int CODE_LENGTH_BITS_MAX = 7;
+		static const unsigned int END_OF_BLOCK = 256;
+
+		static const unsigned int LENGTH_BASES[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+													  67, 83, 99, 115, 131, 163, 195, 227, 258};
+		static const unsigned int LENGTH_EXTRA_BITS[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+														   4, 4, 4, 4, 5, 5, 5, 5, 0};
+		static const unsigned int DISTANCE_BASES[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+														1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+		static const unsigned int DISTANCE_EXTRA_BITS[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+															 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+		// code lengths of the code length alphabet are put in that order
+		static const unsigned int CODE_LENGTH_ORDER[CODE_LENGTH_CODES_COUNT] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+		// token is a literal byte or a match: MATCH_FLAG | (length << 16) | distance
+		static const uint32_t MATCH_FLAG = 0x80000000;
+
+		class SegmentCompressor {
+		public:
+			SegmentCompressor(const unsigned char* data, size_t size, CharArray& compressed)
+				: m_data(data)
+				, m_size(size)
+				, m_bit_writer(compressed)
+				, m_hash_heads((size_t)1 << HASH_BITS, -1)
+				, m_previous_positions(size)
+				, m_block_begin(0)
+				, m_block_size(0)
+			{
+				m_tokens.reserve(BLOCK_TOKENS_MAX);
+				ResetFreqs();
+			}
+
+			// compresses the segment, it ends with an empty stored block (byte-aligned), not the final one
+			void Compress() {
+				size_t previous_length = 0, previous_distance = 0;
+				bool have_previous = false;
+
+				// a match is taken at the previous position, unless the match at the current one is longer
+				size_t pos = 0;
+				while(pos < m_size) {
+					InsertPosition(pos);
+					size_t length = 0, distance = 0;
+					if(previous_length < NICE_MATCH_LENGTH) {
+						FindMatch(pos, length, distance);
+					}
+
+					if(previous_length >= MATCH_LENGTH_MIN && length <= previous_length) {
+						AddMatch(previous_length, previous_distance);
+						const size_t match_end = pos - 1 + previous_length;
+						for(size_t ipos=pos+1; ipos<match_end; ipos++) {
+							InsertPosition(ipos);
+						}
+
+						pos = match_end;
+						previous_length = 0;
+						have_previous = false;
+						continue;
+					}
+
+					if(have_previous) {
+						AddLiteral(m_data[pos - 1]);
+					}
+
+					previous_length = length;
+					previous_distance = distance;
+					have_previous = true;
+					pos++;
+				}
+
+				// there is no match at the last byte
+				if(have_previous) {
+					AddLiteral(m_data[m_size - 1]);
+				}
+
+				if(!m_tokens.empty()) {
+					WriteBlock();
+				}
+
+				// empty stored block
+				m_bit_writer.PutBits(0, 3);
+				m_bit_writer.AlignToByte();
+				m_bit_writer.PutBits(0xFFFF0000, 32);
+				m_bit_writer.AlignToByte();
+			}
+
+		private:
+			uint32_t GetHash(size_t pos) const {
+				const uint32_t bytes = m_data[pos] | ((uint32_t)m_data[pos + 1] << 8) | ((uint32_t)m_data[pos + 2] << 16);
+				return (bytes * 2654435761u) >> (32 - HASH_BITS);
+			}
+
+			void InsertPosition(size_t pos) {
+				if(pos + MATCH_LENGTH_MIN <= m_size) {
+					const uint32_t hash = GetHash(pos);
+					m_previous_positions[pos] = m_hash_heads[hash];
+					m_hash_heads[hash] = (int32_t)pos;
+				}
+			}
+
+			// finds the longest match at the position (after InsertPosition), 'length' - 0 if there is no match
+			void FindMatch(size_t pos, size_t& length, size_t& distance) const {
+				length = 0;
+				if(pos + MATCH_LENGTH_MIN > m_size) {
+					return;
+				}
+
+				const size_t length_max = std::min(MATCH_LENGTH_MAX, m_size - pos);
+				size_t best_length = MATCH_LENGTH_MIN - 1;
+				int32_t candidate = m_previous_positions[pos];
+				for(size_t cix=0; cix<CHAIN_LENGTH_MAX && candidate >= 0 && pos - candidate <= WINDOW_SIZE; cix++) {
+					const unsigned char* candidate_data = m_data + candidate;
+					if(candidate_data[best_length] == m_data[pos + best_length] && candidate_data[0] == m_data[pos]) {
+						size_t match_length = 1;
+						while(match_length < length_max && candidate_data[match_length] == m_data[pos + match_length]) {
+							match_length++;
+						}
+
+						if(match_length > best_length) {
+							best_length = match_length;
+							distance = pos - candidate;
+							if(match_length >= NICE_MATCH_LENGTH || match_length == length_max) {
+								break;
+							}
+						}
+					}
+					candidate = m_previous_positions[candidate];
+				}
+
+				if(best_length >= MATCH_LENGTH_MIN) {
+					length = best_length;
+				}
+			}
+
+			static unsigned int GetLengthCodeIndex(size_t length) {
+				return (unsigned int)(std::upper_bound(LENGTH_BASES, LENGTH_BASES + 29, (unsigned int)length) - LENGTH_BASES - 1);
+			}
+
+			static unsigned int GetDistanceCodeIndex(size_t distance) {
+				return (unsigned int)(std::upper_bound(DISTANCE_BASES, DISTANCE_BASES + 30, (unsigned int)distance) - DISTANCE_BASES - 1);
+			}
+
+			void AddLiteral(unsigned char literal) {
+				m_tokens.push_back(literal);
+				m_litlen_freqs[literal]++;
+				m_block_size++;
+				if(m_tokens.size() >= BLOCK_TOKENS_MAX) {
+					WriteBlock();
+				}
+			}
+
+			void AddMatch(size_t length, size_t distance) {
+				m_tokens.push_back(MATCH_FLAG | (uint32_t)(length << 16) | (uint32_t)distance);
+				m_litlen_freqs[257 + GetLengthCodeIndex(length)]++;
+				m_distance_freqs[GetDistanceCodeIndex(distance)]++;
+				m_block_size += length;
+				if(m_tokens.size() >= BLOCK_TOKENS_MAX) {
+					WriteBlock();
+				}
+			}
+
+			void ResetFreqs() {
+				std::fill(m_litlen_freqs, m_litlen_freqs + LITLEN_CODES_COUNT, 0);
+				std::fill(m_distance_freqs, m_distance_freqs + DISTANCE_CODES_COUNT, 0);
+				m_litlen_freqs[END_OF_BLOCK] = 1;
+			}
+
+			// writes tokens of the block with dynamic Huffman codes or its data as stored blocks, if that is shorter
+			void WriteBlock() {
+				unsigned char litlen_lengths[LITLEN_CODES_COUNT];
+				unsigned char distance_lengths[DISTANCE_CODES_COUNT];
+				GetCodeLengths(m_litlen_freqs, LITLEN_CODES_COUNT, CODE_BITS_MAX, litlen_lengths);
+				GetCodeLengths(m_distance_freqs, DISTANCE_CODES_COUNT, CODE_BITS_MAX, distance_lengths);
+				if(*std::max_element(distance_lengths, distance_lengths + DISTANCE_CODES_COUNT) == 0) {
+					// a block without matches has one distance code
+					distance_lengths[0] = 1;
+				}
+
+				unsigned int litlen_count = LITLEN_CODES_COUNT;
+				while(litlen_lengths[litlen_count - 1] == 0) {
+					litlen_count--;
+				}
+
+				unsigned int distance_count = DISTANCE_CODES_COUNT;
+				while(distance_lengths[distance_count - 1] == 0) {
+					distance_count--;
+				}
+
+				// code lengths of both codes go as one sequence with runs of repeated lengths (16) and zeros (17, 18),
+				// an element - code length code | (extra bits << 8)
+				std::vector<unsigned char> lengths(litlen_lengths, litlen_lengths + litlen_count);
+				lengths.insert(lengths.end(), distance_lengths, distance_lengths + distance_count);
+				std::vector<uint32_t> length_codes;
+				uint32_t length_code_freqs[CODE_LENGTH_CODES_COUNT] = {0};
+				for(size_t lix=0; lix<lengths.size(); ) {
+					size_t run = 1;
+					while(lix + run < lengths.size() && lengths[lix + run] == lengths[lix]) {
+						run++;
+					}
+
+					const unsigned char length = lengths[lix];
+					lix += run;
+					if(length == 0) {
+						while(run >= 11) {
+							const size_t count = std::min(run, (size_t)138);
+							length_codes.push_back(18 | (uint32_t)((count - 11) << 8));
+							run -= count;
+						}
+						if(run >= 3) {
+							length_codes.push_back(17 | (uint32_t)((run - 3) << 8));
+							run = 0;
+						}
+
+					} else {
+						length_codes.push_back(length);
+						run--;
+						while(run >= 3) {
+							const size_t count = std::min(run, (size_t)6);
+							length_codes.push_back(16 | (uint32_t)((count - 3) << 8));
+							run -= count;
+						}
+					}
+
+					for(; run>0; run--) {
+						length_codes.push_back(length);
+					}
+				}
+
+				for(size_t cix=0; cix<length_codes.size(); cix++) {
+					length_code_freqs[length_codes[cix] & 0xFF]++;
+				}
+
+				unsigned char length_code_lengths[CODE_LENGTH_CODES_COUNT];
+				GetCodeLengths(length_code_freqs, CODE_LENGTH_CODES_COUNT, CODE_LENGTH_BITS_MAX, length_code_lengths);
+				unsigned int length_code_count = CODE_LENGTH_CODES_COUNT;
+				while(length_code_count > 4 && length_code_lengths[CODE_LENGTH_ORDER[length_code_count - 1]] == 0) {
+					length_code_count--;
+				}
+
+				// sizes of the block in both forms
+				uint64_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * length_code_count;
+				for(unsigned int cix=0; cix<CODE_LENGTH_CODES_COUNT; cix++) {
+					dynamic_bits += (uint64_t)length_code_freqs[cix] * length_code_lengths[cix];
+				}
+				dynamic_bits += 2 * length_code_freqs[16] + 3 * length_code_freqs[17] + 7 * length_code_freqs[18];
+				for(unsigned int cix=0; cix<LITLEN_CODES_COUNT; cix++) {
+					dynamic_bits += (uint64_t)m_litlen_freqs[cix] * (litlen_lengths[cix] + ((cix > END_OF_BLOCK) ? LENGTH_EXTRA_BITS[cix - 257] : 0));
+				}
+				for(unsigned int cix=0; cix<DISTANCE_CODES_COUNT; cix++) {
+					dynamic_bits += (uint64_t)m_distance_freqs[cix] * (distance_lengths[cix] + DISTANCE_EXTRA_BITS[cix]);
+				}
+
+				const size_t stored_blocks_count = (m_block_size + STORED_BLOCK_SIZE_MAX - 1) / STORED_BLOCK_SIZE_MAX;
+				const uint64_t stored_bits = (uint64_t)(m_block_size + 5 * stored_blocks_count) * 8;
+
+				if(stored_bits <= dynamic_bits) {
+					for(size_t begin=m_block_begin; begin<m_block_begin+m_block_size; begin+=STORED_BLOCK_SIZE_MAX) {
+						const uint32_t size = (uint32_t)std::min(STORED_BLOCK_SIZE_MAX, m_block_begin + m_block_size - begin);
+						m_bit_writer.PutBits(0, 3);
+						m_bit_writer.AlignToByte();
+						m_bit_writer.PutBits(size | ((~size & 0xFFFF) << 16), 32);
+						m_bit_writer.AlignToByte();
+						m_bit_writer.PutBytes(m_data + begin, size);
+					}
+
+				} else {
+					uint16_t litlen_codes[LITLEN_CODES_COUNT];
+					uint16_t distance_codes[DISTANCE_CODES_COUNT];
+					uint16_t length_code_codes[CODE_LENGTH_CODES_COUNT];
+					GetCodes(litlen_lengths, LITLEN_CODES_COUNT, litlen_codes);
+					GetCodes(distance_lengths, DISTANCE_CODES_COUNT, distance_codes);
+					GetCodes(length_code_lengths, CODE_LENGTH_CODES_COUNT, length_code_codes);
+
+					// not the final block, dynamic Huffman codes (2)
+					m_bit_writer.PutBits(2 << 1, 3);
+					m_bit_writer.PutBits(litlen_count - 257, 5);
+					m_bit_writer.PutBits(distance_count - 1, 5);
+					m_bit_writer.PutBits(length_code_count - 4, 4);
+					for(unsigned int cix=0; cix<length_code_count; cix++) {
+						m_bit_writer.PutBits(length_code_lengths[CODE_LENGTH_ORDER[cix]], 3);
+					}
+
+					static const unsigned int REPEAT_EXTRA_BITS[3] = {2, 3, 7};
+					for(size_t cix=0; cix<length_codes.size(); cix++) {
+						const unsigned int code = length_codes[cix] & 0xFF;
+						m_bit_writer.PutBits(length_code_codes[code], length_code_lengths[code]);
+						if(code >= 16) {
+							m_bit_writer.PutBits(length_codes[cix] >> 8, REPEAT_EXTRA_BITS[code - 16]);
+						}
+					}
+
+					for(size_t tix=0; tix<m_tokens.size(); tix++) {
+						const uint32_t token = m_tokens[tix];
+						if((token & MATCH_FLAG) == 0) {
+							m_bit_writer.PutBits(litlen_codes[token], litlen_lengths[token]);
+							continue;
+						}
+
+						const size_t length = (token >> 16) & 0x1FF;
+						const size_t distance = token & 0xFFFF;
+						const unsigned int length_ix = GetLengthCodeIndex(length);
+						const unsigned int distance_ix = GetDistanceCodeIndex(distance);
+						m_bit_writer.PutBits(litlen_codes[257 + length_ix], litlen_lengths[257 + length_ix]);
+						m_bit_writer.PutBits((uint32_t)(length - LENGTH_BASES[length_ix]), LENGTH_EXTRA_BITS[length_ix]);
+						m_bit_writer.PutBits(distance_codes[distance_ix], distance_lengths[distance_ix]);
+						m_bit_writer.PutBits((uint32_t)(distance - DISTANCE_BASES[distance_ix]), DISTANCE_EXTRA_BITS[distance_ix]);
+					}
+
+					m_bit_writer.PutBits(litlen_codes[END_OF_BLOCK], litlen_lengths[END_OF_BLOCK]);
+				}
+
+				m_tokens.clear();
+				ResetFreqs();
+				m_block_begin += m_block_size;
+				m_block_size = 0;
+			}
+
+		private:
+			const unsigned char* m_data;
+			size_t m_size;
+			BitWriter m_bit_writer;
+
+			// the last position of each hash and the previous position with the same hash of each position
+			std::vector<int32_t> m_hash_heads;
+			std::vector<int32_t> m_previous_positions;
+
+			// tokens of the current block, that starts at m_block_begin and covers m_block_size bytes of data
+			std::vector<uint32_t> m_tokens;
+			uint32_t m_litlen_freqs[LITLEN_CODES_COUNT];
+			uint32_t m_distance_freqs[DISTANCE_CODES_COUNT];
+			size_t m_block_begin;
+			size_t m_block_size;
+		};
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CompressData implementation
+
+namespace RoadGen {
+	namespace Deflate {
+		void CompressData(const char* data, size_t size, CharArray& compressed) {
+			const size_t segments_count = (size + DEFLATE_SEGMENT_SIZE - 1) / DEFLATE_SEGMENT_SIZE;
+			std::vector<CharArray> segments(segments_count);
+			std::vector<std::exception_ptr> errors(segments_count);
+			std::atomic<size_t> next_segment_ix(0);
+			const auto compress_segments = [&]() {
+				for(size_t six=next_segment_ix++; six<segments_count; six=next_segment_ix++) {
+					try {
+						const size_t begin = six * DEFLATE_SEGMENT_SIZE;
+						SegmentCompressor compressor((const unsigned char*)data + begin, std::min(DEFLATE_SEGMENT_SIZE, size - begin), segments[six]);
+						compressor.Compress();
+
+					} catch(...) {
+						errors[six] = std::current_exception();
+					}
+				}
+			};
+
+			const size_t threads_count = (std::thread::hardware_concurrency() > 0) ? std::thread::hardware_concurrency() : 1;
+			std::vector<std::thread> threads;
+			for(size_t thix=1; thix<std::min(threads_count, segments_count); thix++) {
+				threads.push_back(std::thread(compress_segments));
+			}
+			compress_segments();
+			for(size_t thix=0; thix<threads.size(); thix++) {
+				threads[thix].join();
+			}
+
+			compressed.clear();
+			for(size_t six=0; six<segments_count; six++) {
+				if(errors[six]) {
+					std::rethrow_exception(errors[six]);
+				}
+
+				compressed.insert(compressed.end(), segments[six].begin(), segments[six].end());
+				CharArray().swap(segments[six]);
+			}
+
+			// the final block: empty, fixed Huffman codes (1), the end of block code is 7 zero bits
+			compressed.push_back(0x03);
+			compressed.push_back(0x00);
+		}
+	}
+}
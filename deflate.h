@@ -0,0 +1,30 @@
+
+// Deflate compressor - raw DEFLATE streams for zip archives (PK3 files of ZDoom-based games)
+// DEFLATE specification: https://tools.ietf.org/html/rfc1951
+
+#ifndef _ROAD_GEN_DEFLATE_H_
+#define _ROAD_GEN_DEFLATE_H_
+
+#include "common.h"
+
+#include <cstdint>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Deflate - compression of data by LZ77 and Huffman codes
+
+namespace RoadGen {
+	namespace Deflate {
+		// CRC-32 of the data (the one of zip archives and gzip files), 'crc' - CRC-32 of the preceding data
+		uint32_t GetCrc32(const char* data, size_t size, uint32_t crc = 0);
+
+		// compress the data into a raw DEFLATE stream (without zlib or gzip headers); the data is split into
+		// segments, that are compressed independently (without matches to previous segments) by all hardware
+		// threads, compressed segments are byte-aligned by empty stored blocks and put one after another, so
+		// the result does not depend on the number of threads; blocks of a segment get dynamic Huffman codes
+		// or are stored if they do not compress
+		void CompressData(const char* data, size_t size, CharArray& compressed);
+	}
+}
+
+#endif // _ROAD_GEN_DEFLATE_H_
@@ -1,8 +1,23 @@
 
 #include "io.h"
+#include "deflate.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <unordered_set>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // InStreamWithBuffer implementation
@@ -762,6 +777,9 @@ namespace RoadGen {
 				}
 
 				if(!token.empty()) {
+					if(!have_tokens_on_the_line) {
+						processor->StartRow(in_stream_with_buffer.GetLineNumber());
+					}
 					processor->ProcessValue(token);
 					have_tokens_on_the_line = true;
 					token.clear();
@@ -783,11 +801,343 @@ namespace RoadGen {
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WadSink implementations
+
+namespace RoadGen {
+	namespace Io {
+		void StreamWadSink::Write(const char* data, size_t size) {
+			m_stream.write(data, size);
+		}
+
+		void StreamWadSink::WriteAt(uint64_t offset, const char* data, size_t size) {
+			const std::streampos end_pos = m_stream.tellp();
+			m_stream.seekp(m_start_pos + (std::streamoff)offset);
+			m_stream.write(data, size);
+			m_stream.seekp(end_pos);
+		}
+
+		uint64_t StreamWadSink::GetSize() const {
+			return (uint64_t)(m_stream.tellp() - m_start_pos);
+		}
+
+		void MemoryWadSink::Write(const char* data, size_t size) {
+			m_data.insert(m_data.end(), data, data + size);
+		}
+
+		void MemoryWadSink::WriteAt(uint64_t offset, const char* data, size_t size) {
+			if(offset + size > m_data.size()) {
+				throw Exception("WAD writing error - attempted to overwrite data, that is not written");
+			}
+
+			std::memcpy(m_data.data() + offset, data, size);
+		}
+
+		uint64_t MemoryWadSink::GetSize() const {
+			return m_data.size();
+		}
+
+		void MemoryWadSink::TakeData(CharArray& data) {
+			data.clear();
+			data.swap(m_data);
+		}
+
+		FileWadSink::FileWadSink(const std::string& file_path)
+			: m_file_path(file_path)
+			, m_size(0)
+		{
+#ifdef _WIN32
+			m_file = CreateFileA(file_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if(m_file == INVALID_HANDLE_VALUE) {
+				m_file = nullptr;
+				throw Exception("WAD writing error - cannot create file '" + file_path + "', error " + std::to_string(GetLastError()));
+			}
+#else
+			m_file = open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+			if(m_file < 0) {
+				throw Exception("WAD writing error - cannot create file '" + file_path + "', " + std::strerror(errno));
+			}
+#endif
+		}
+
+		FileWadSink::~FileWadSink() {
+#ifdef _WIN32
+			if(m_file != nullptr) {
+				CloseHandle(m_file);
+			}
+#else
+			if(m_file >= 0) {
+				close(m_file);
+			}
+#endif
+		}
+
+		void FileWadSink::Write(const char* data, size_t size) {
+			WriteAt(m_size, data, size);
+		}
+
+		void FileWadSink::WriteAt(uint64_t offset, const char* data, size_t size) {
+			// big data is written by parts, a write may put less than asked
+			const size_t part_size_max = 1 << 30;
+			while(size > 0) {
+				const size_t part_size = std::min(size, part_size_max);
+				size_t written_size = 0;
+#ifdef _WIN32
+				OVERLAPPED position = {};
+				position.Offset = (DWORD)offset;
+				position.OffsetHigh = (DWORD)(offset >> 32);
+				DWORD written_count = 0;
+				if(m_file == nullptr || !WriteFile(m_file, data, (DWORD)part_size, &written_count, &position)) {
+					throw Exception("WAD writing error - cannot write file '" + m_file_path + "', error " + std::to_string(GetLastError()));
+				}
+				written_size = written_count;
+#else
+				const ssize_t written_count = (m_file < 0) ? -1 : pwrite(m_file, data, part_size, (off_t)offset);
+				if(written_count < 0) {
+					if(errno == EINTR) {
+						continue;
+					}
+					throw Exception("WAD writing error - cannot write file '" + m_file_path + "', " + std::strerror(errno));
+				}
+				written_size = (size_t)written_count;
+#endif
+				data += written_size;
+				size -= written_size;
+				offset += written_size;
+				m_size = std::max(m_size, offset);
+			}
+		}
+
+		uint64_t FileWadSink::GetSize() const {
+			return m_size;
+		}
+
+		void FileWadSink::Close() {
+#ifdef _WIN32
+			if(m_file != nullptr) {
+				const bool is_closed = CloseHandle(m_file) != 0;
+				m_file = nullptr;
+				if(!is_closed) {
+					throw Exception("WAD writing error - cannot close file '" + m_file_path + "', error " + std::to_string(GetLastError()));
+				}
+			}
+#else
+			if(m_file >= 0) {
+				const bool is_closed = close(m_file) == 0;
+				m_file = -1;
+				if(!is_closed) {
+					throw Exception("WAD writing error - cannot close file '" + m_file_path + "', " + std::strerror(errno));
+				}
+			}
+#endif
+		}
+
+		MappedFileWadSink::MappedFileWadSink(const std::string& file_path, uint64_t size)
+			: m_file_path(file_path)
+#ifdef _WIN32
+			, m_mapping(nullptr)
+#endif
+			, m_view(nullptr)
+			, m_capacity(0)
+			, m_size(0)
+		{
+#ifdef _WIN32
+			m_file = CreateFileA(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if(m_file == INVALID_HANDLE_VALUE) {
+				m_file = nullptr;
+				throw Exception("WAD writing error - cannot create file '" + file_path + "', error " + std::to_string(GetLastError()));
+			}
+#else
+			m_file = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+			if(m_file < 0) {
+				throw Exception("WAD writing error - cannot create file '" + file_path + "', " + std::strerror(errno));
+			}
+#endif
+			// an empty file cannot be mapped
+			Map(std::max(size, (uint64_t)64 * 1024));
+		}
+
+		MappedFileWadSink::~MappedFileWadSink() {
+			Unmap();
+#ifdef _WIN32
+			if(m_file != nullptr) {
+				CloseHandle(m_file);
+			}
+#else
+			if(m_file >= 0) {
+				close(m_file);
+			}
+#endif
+		}
+
+		void MappedFileWadSink::Write(const char* data, size_t size) {
+			if(m_size + size > m_capacity) {
+				Map(std::max(m_capacity * 2, m_size + size));
+			}
+
+			std::memcpy(m_view + m_size, data, size);
+			m_size += size;
+		}
+
+		void MappedFileWadSink::WriteAt(uint64_t offset, const char* data, size_t size) {
+			if(offset + size > m_size) {
+				throw Exception("WAD writing error - attempted to overwrite data, that is not written");
+			}
+
+			std::memcpy(m_view + offset, data, size);
+		}
+
+		uint64_t MappedFileWadSink::GetSize() const {
+			return m_size;
+		}
+
+		void MappedFileWadSink::Map(uint64_t capacity) {
+			if((uint64_t)(size_t)capacity != capacity || !Unmap()) {
+				throw Exception("WAD writing error - cannot map file '" + m_file_path + "'");
+			}
+
+#ifdef _WIN32
+			if(m_file != nullptr) {
+				// the mapping makes the file of its size
+				m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, (DWORD)(capacity >> 32), (DWORD)capacity, nullptr);
+				if(m_mapping != nullptr) {
+					m_view = (char*)MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, (size_t)capacity);
+				}
+			}
+
+			if(m_view == nullptr) {
+				throw Exception("WAD writing error - cannot map file '" + m_file_path + "', error " + std::to_string(GetLastError()));
+			}
+#else
+			if(m_file >= 0 && ftruncate(m_file, (off_t)capacity) == 0) {
+				void* view = mmap(nullptr, (size_t)capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+				m_view = (view != MAP_FAILED) ? (char*)view : nullptr;
+			}
+
+			if(m_view == nullptr) {
+				throw Exception("WAD writing error - cannot map file '" + m_file_path + "', " + std::strerror(errno));
+			}
+#endif
+			m_capacity = capacity;
+		}
+
+		bool MappedFileWadSink::Unmap() {
+			bool is_unmapped = true;
+#ifdef _WIN32
+			if(m_view != nullptr) {
+				is_unmapped &= UnmapViewOfFile(m_view) != 0;
+			}
+			if(m_mapping != nullptr) {
+				is_unmapped &= CloseHandle(m_mapping) != 0;
+			}
+			m_mapping = nullptr;
+#else
+			if(m_view != nullptr) {
+				is_unmapped &= munmap(m_view, (size_t)m_capacity) == 0;
+			}
+#endif
+			m_view = nullptr;
+			m_capacity = 0;
+			return is_unmapped;
+		}
+
+		void MappedFileWadSink::Close() {
+			bool is_closed = Unmap();
+#ifdef _WIN32
+			if(m_file != nullptr) {
+				LARGE_INTEGER size;
+				size.QuadPart = (LONGLONG)m_size;
+				is_closed &= SetFilePointerEx(m_file, size, nullptr, FILE_BEGIN) != 0;
+				is_closed &= SetEndOfFile(m_file) != 0;
+				is_closed &= CloseHandle(m_file) != 0;
+				m_file = nullptr;
+			}
+#else
+			if(m_file >= 0) {
+				is_closed &= ftruncate(m_file, (off_t)m_size) == 0;
+				is_closed &= close(m_file) == 0;
+				m_file = -1;
+			}
+#endif
+			if(!is_closed) {
+				throw Exception("WAD writing error - cannot finish file '" + m_file_path + "'");
+			}
+		}
+
+		WadSinkBuffer::WadSinkBuffer(WadSink& sink)
+			: m_sink(sink)
+			, m_buffer(BUFFER_SIZE)
+		{
+			setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+		}
+
+		WadSinkBuffer::int_type WadSinkBuffer::overflow(int_type c) {
+			sync();
+			if(!traits_type::eq_int_type(c, traits_type::eof())) {
+				*pptr() = traits_type::to_char_type(c);
+				pbump(1);
+			}
+			return traits_type::not_eof(c);
+		}
+
+		std::streamsize WadSinkBuffer::xsputn(const char* data, std::streamsize size) {
+			if((size_t)size <= (size_t)(epptr() - pptr())) {
+				std::memcpy(pptr(), data, (size_t)size);
+				pbump((int)size);
+
+			} else {
+				// big data goes to the sink without copying
+				sync();
+				m_sink.Write(data, (size_t)size);
+			}
+			return size;
+		}
+
+		int WadSinkBuffer::sync() {
+			if(pptr() != pbase()) {
+				m_sink.Write(pbase(), pptr() - pbase());
+				setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+			}
+			return 0;
+		}
+	}
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // WadWriter implementation
 
 namespace RoadGen {
 	namespace Io {
+		WadWriter::WadWriter(OutStream& stream, bool is_iwad)
+			: m_stream_sink(new StreamWadSink(stream))
+			, m_sink(*m_stream_sink)
+			, m_lump_buffer(m_sink)
+			, m_lump_stream(&m_lump_buffer)
+			, m_is_iwad(is_iwad)
+			, m_start_off(0)
+			, m_writing_started(false)
+			, m_writing_finished(false)
+			, m_writing_lump(false)
+			, m_lump_start_off(0)
+		{
+			m_lump_stream.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+		}
+
+		WadWriter::WadWriter(WadSink& sink, bool is_iwad)
+			: m_sink(sink)
+			, m_lump_buffer(m_sink)
+			, m_lump_stream(&m_lump_buffer)
+			, m_is_iwad(is_iwad)
+			, m_start_off(0)
+			, m_writing_started(false)
+			, m_writing_finished(false)
+			, m_writing_lump(false)
+			, m_lump_start_off(0)
+		{
+			m_lump_stream.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+		}
+
 		void WadWriter::SetIsIwad(bool is_iwad) {
 			if(m_writing_started || m_writing_finished) {
 				throw Exception("WAD writing error - WAD type can be changed only before writing has started");
@@ -828,37 +1178,32 @@ namespace RoadGen {
 			}
 
 			if(!m_writing_started) {
-				m_start_pos = m_stream.tellp();
 				// write first block of data (type, stubs for directory pos and size) - 12 bytes
-				m_stream << (m_is_iwad ? "IWAD" : "PWAD");
-				m_dir_info_off = m_stream.tellp() - m_start_pos;
-
-				const std::string nulls4(4, '\0');
-				m_stream << nulls4
-						 << nulls4;
+				m_start_off = m_sink.GetSize();
+				m_sink.Write(m_is_iwad ? "IWAD\0\0\0\0\0\0\0\0" : "PWAD\0\0\0\0\0\0\0\0", 12);
 				m_writing_started = true;
 			}
 
-			const std::streamoff cur_off = FinishLumpWriting();
+			const uint64_t cur_off = FinishLumpWriting();
 			m_lump_name = lump_name;
 			m_lump_start_off = cur_off;
 			m_writing_lump = true;
 
-			return m_stream;
+			return m_lump_stream;
 		}
 
 		void WadWriter::FinishWriting() {
 			class Utils {
 			public:
-				void PutLower4BytesToStream(OutStream& stream, long long number) {
+				void PutLower4Bytes(CharArray& data, long long number) {
 					if(number < 0 || number > INT32_MAX) {
 						throw Exception("WAD writing error - too big WAD file");
 					}
 
-					stream << (char)(number & 0xFF)
-						   << (char)((number >> 8) & 0xFF)
-						   << (char)((number >> 16) & 0xFF)
-						   << (char)(number >> 24);
+					data.push_back((char)(number & 0xFF));
+					data.push_back((char)((number >> 8) & 0xFF));
+					data.push_back((char)((number >> 16) & 0xFF));
+					data.push_back((char)(number >> 24));
 				}
 			} utils;
 
@@ -875,27 +1220,27 @@ namespace RoadGen {
 				throw Exception("WAD writing error - too many entries in WAD file");
 			}
 
-			const std::streamoff directory_off = FinishLumpWriting();
+			const uint64_t directory_off = FinishLumpWriting();
 
 			// write the directory itself after all lumps
+			CharArray directory;
+			directory.reserve(m_directory.size() * 16);
 			for(size_t i=0; i<m_directory.size(); i++) {
 				const DirectoryEntry& entry = m_directory[i];
-				utils.PutLower4BytesToStream(m_stream, entry.start_pos);
-				utils.PutLower4BytesToStream(m_stream, entry.size);
-				for(size_t i=0; i<8; i++) {
-					m_stream << entry.name[i];
-				}
+				utils.PutLower4Bytes(directory, entry.start_pos);
+				utils.PutLower4Bytes(directory, entry.size);
+				directory.insert(directory.end(), entry.name, entry.name + 8);
 			}
+			m_sink.Write(directory.data(), directory.size());
 
 			// write directory info to the beginning of the WAD
-			const std::streampos post_end_pos = m_stream.tellp();
-			m_stream.seekp(m_start_pos + m_dir_info_off);
-			utils.PutLower4BytesToStream(m_stream, (long long)m_directory.size());
-			utils.PutLower4BytesToStream(m_stream, directory_off);
-			m_stream.seekp(post_end_pos);
-
-			m_start_pos = -1;
-			m_dir_info_off = -1;
+			CharArray directory_info;
+			utils.PutLower4Bytes(directory_info, (long long)m_directory.size());
+			utils.PutLower4Bytes(directory_info, (long long)directory_off);
+			m_sink.WriteAt(m_start_off + 4, directory_info.data(), directory_info.size());
+
+			m_directory.clear();
+			m_start_off = 0;
 			m_writing_started = false;
 			m_writing_finished = true;
 		}
@@ -905,8 +1250,9 @@ namespace RoadGen {
 			m_writing_finished = false;
 		}
 
-		std::streamoff WadWriter::FinishLumpWriting() {
-			const std::streampos cur_pos = m_stream.tellp();
+		uint64_t WadWriter::FinishLumpWriting() {
+			m_lump_buffer.pubsync();
+			const uint64_t cur_off = m_sink.GetSize() - m_start_off;
 			if(m_writing_lump) {
 				// finish writing of the lump - add matching directory entry
 				m_directory.push_back(DirectoryEntry());
@@ -918,18 +1264,193 @@ namespace RoadGen {
 				}
 				entry.start_pos = (long)m_lump_start_off;
 
-				const std::streamoff size = cur_pos - m_lump_start_off;
+				const uint64_t size = cur_off - m_lump_start_off;
 				if(size > INT32_MAX) {
 					throw Exception("WAD writing error - too big WAD file");
 				}
 				entry.size = (long)size;
 
-				m_lump_name.empty();
-				m_lump_start_off = -1;
+				m_lump_name.clear();
+				m_lump_start_off = 0;
 				m_writing_lump = false;
 			}
 
-			return cur_pos - m_start_pos;
+			return cur_off;
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ZipWriter implementation
+
+namespace RoadGen {
+	namespace Io {
+		// files are dated 1980-01-01 00:00 (the earliest DOS date), so archives of the same maps are the same
+		static const uint16_t ZIP_DOS_TIME = 0;
+		static const uint16_t ZIP_DOS_DATE = (1 << 5) | 1;
+
+		// zip 2.0 - deflate compression
+		static const uint16_t ZIP_VERSION = 20;
+
+		static const uint16_t ZIP_METHOD_STORED = 0;
+		static const uint16_t ZIP_METHOD_DEFLATED = 8;
+
+		// sizes, offsets and numbers of entries over these need zip64 extensions
+		static const uint64_t ZIP_SIZE_MAX = 0xFFFFFFFE;
+		static const size_t ZIP_ENTRIES_MAX = 0xFFFE;
+
+		static void PutZipUInt16(CharArray& data, uint32_t number) {
+			data.push_back((char)(number & 0xFF));
+			data.push_back((char)((number >> 8) & 0xFF));
+		}
+
+		static void PutZipUInt32(CharArray& data, uint32_t number) {
+			PutZipUInt16(data, number & 0xFFFF);
+			PutZipUInt16(data, number >> 16);
+		}
+
+		void ZipWriter::AddFile(const std::string& file_path, const char* data, size_t size) {
+			if(m_writing_finished) {
+				throw Exception("zip writing error - attempted to add a file after zip writing has ended");
+			}
+
+			if(file_path.empty() || file_path.size() > 0xFFFF) {
+				throw Exception("zip writing error - bad file path '" + file_path + "'");
+			}
+
+			if(!m_writing_started) {
+				m_start_pos = m_stream.tellp();
+				m_writing_started = true;
+			}
+
+			const std::streamoff header_off = m_stream.tellp() - m_start_pos;
+			if((uint64_t)size > ZIP_SIZE_MAX || (uint64_t)header_off > ZIP_SIZE_MAX || m_directory.size() >= ZIP_ENTRIES_MAX) {
+				throw Exception("zip writing error - too big zip file (zip64 format is not supported)");
+			}
+
+			CharArray compressed;
+			Deflate::CompressData(data, size, compressed);
+			const bool is_stored = compressed.size() >= size;
+
+			DirectoryEntry entry;
+			entry.path = file_path;
+			entry.method = is_stored ? ZIP_METHOD_STORED : ZIP_METHOD_DEFLATED;
+			entry.crc = Deflate::GetCrc32(data, size);
+			entry.compressed_size = (uint32_t)(is_stored ? size : compressed.size());
+			entry.size = (uint32_t)size;
+			entry.header_off = (uint32_t)header_off;
+
+			// local file header
+			CharArray header;
+			PutZipUInt32(header, 0x04034B50);
+			PutZipUInt16(header, ZIP_VERSION);
+			PutZipUInt16(header, 0); // flags
+			PutZipUInt16(header, entry.method);
+			PutZipUInt16(header, ZIP_DOS_TIME);
+			PutZipUInt16(header, ZIP_DOS_DATE);
+			PutZipUInt32(header, entry.crc);
+			PutZipUInt32(header, entry.compressed_size);
+			PutZipUInt32(header, entry.size);
+			PutZipUInt16(header, (uint32_t)file_path.size());
+			PutZipUInt16(header, 0); // extra field length
+			header.insert(header.end(), file_path.begin(), file_path.end());
+
+			m_stream.write(header.data(), header.size());
+			m_stream.write(is_stored ? data : compressed.data(), entry.compressed_size);
+			m_directory.push_back(entry);
+		}
+
+		void ZipWriter::FinishWriting() {
+			if(m_writing_finished) {
+				return;
+			}
+
+			if(!m_writing_started) {
+				// an empty archive has the end of central directory record only
+				m_start_pos = m_stream.tellp();
+				m_writing_started = true;
+			}
+
+			const std::streamoff directory_off = m_stream.tellp() - m_start_pos;
+			if((uint64_t)directory_off > ZIP_SIZE_MAX) {
+				throw Exception("zip writing error - too big zip file (zip64 format is not supported)");
+			}
+
+			// central directory
+			CharArray directory;
+			for(size_t i=0; i<m_directory.size(); i++) {
+				const DirectoryEntry& entry = m_directory[i];
+				PutZipUInt32(directory, 0x02014B50);
+				PutZipUInt16(directory, ZIP_VERSION); // version made by (MS-DOS)
+				PutZipUInt16(directory, ZIP_VERSION);
+				PutZipUInt16(directory, 0); // flags
+				PutZipUInt16(directory, entry.method);
+				PutZipUInt16(directory, ZIP_DOS_TIME);
+				PutZipUInt16(directory, ZIP_DOS_DATE);
+				PutZipUInt32(directory, entry.crc);
+				PutZipUInt32(directory, entry.compressed_size);
+				PutZipUInt32(directory, entry.size);
+				PutZipUInt16(directory, (uint32_t)entry.path.size());
+				PutZipUInt16(directory, 0); // extra field length
+				PutZipUInt16(directory, 0); // comment length
+				PutZipUInt16(directory, 0); // disk number
+				PutZipUInt16(directory, 0); // internal attributes
+				PutZipUInt32(directory, 0); // external attributes
+				PutZipUInt32(directory, entry.header_off);
+				directory.insert(directory.end(), entry.path.begin(), entry.path.end());
+			}
+
+			const size_t directory_size = directory.size();
+			if((uint64_t)directory_off + directory_size > ZIP_SIZE_MAX) {
+				throw Exception("zip writing error - too big zip file (zip64 format is not supported)");
+			}
+
+			// end of central directory record
+			PutZipUInt32(directory, 0x06054B50);
+			PutZipUInt16(directory, 0); // disk number
+			PutZipUInt16(directory, 0); // disk with the central directory
+			PutZipUInt16(directory, (uint32_t)m_directory.size());
+			PutZipUInt16(directory, (uint32_t)m_directory.size());
+			PutZipUInt32(directory, (uint32_t)directory_size);
+			PutZipUInt32(directory, (uint32_t)directory_off);
+			PutZipUInt16(directory, 0); // comment length
+			m_stream.write(directory.data(), directory.size());
+
+			m_directory.clear();
+			m_writing_finished = true;
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TempOutputFile implementation
+
+namespace RoadGen {
+	namespace Io {
+		TempOutputFile::~TempOutputFile() {
+			if(!m_committed) {
+				std::remove(m_temp_file_path.c_str());
+			}
+		}
+
+		void TempOutputFile::Commit() {
+			if(m_committed) {
+				return;
+			}
+
+#ifdef _WIN32
+			// unlike rename, replaces the existing file
+			const bool is_replaced = MoveFileExA(m_temp_file_path.c_str(), m_file_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+			const bool is_replaced = std::rename(m_temp_file_path.c_str(), m_file_path.c_str()) == 0;
+#endif
+			if(!is_replaced) {
+				throw Exception("output error - cannot replace file '" + m_file_path + "' by written file '" + m_temp_file_path + "'");
+			}
+
+			m_committed = true;
 		}
 	}
 }
@@ -6,6 +6,11 @@
 
 #include "common.h"
 
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Basic I/O, InStreamWithBuffer - input stream wrapper that reads buffer by buffer from this stream
@@ -170,6 +175,9 @@ namespace RoadGen {
 		public:
 			virtual ~TableConfigProcessor() {}
 
+			// called before the first value of a row, 'line_number' is the line of the value (from 1)
+			virtual void StartRow(size_t /*line_number*/) {}
+
 			// called for each value
 			virtual void ProcessValue(const std::string& value) = 0;
 
@@ -183,23 +191,170 @@ namespace RoadGen {
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// WadWriter - class, that write formatted WAD file
+// WadSink - destination of WAD file data: a stream, a buffer in memory, a file written by positioned writes
+// or a memory-mapped file
 
 namespace RoadGen {
 	namespace Io {
-		class WadWriter {
+		class WadSink {
 		public:
-			WadWriter(OutStream& stream, bool is_iwad=false)
+			virtual ~WadSink() {}
+
+			// append the data to the end
+			virtual void Write(const char* data, size_t size) = 0;
+
+			// overwrite the data written before at 'offset' (from the beginning of the sink)
+			virtual void WriteAt(uint64_t offset, const char* data, size_t size) = 0;
+
+			// size of the written data
+			virtual uint64_t GetSize() const = 0;
+		};
+
+		// StreamWadSink - writes to a seekable stream, offsets are counted from the position of the stream
+		// at the moment the sink is made
+		class StreamWadSink: public WadSink {
+		public:
+			StreamWadSink(OutStream& stream)
 				: m_stream(stream)
-				, m_is_iwad(is_iwad)
-				, m_start_pos(-1)
-				, m_dir_info_off(-1)
-				, m_writing_started(false)
-				, m_writing_finished(false)
-				, m_writing_lump(false)
-				, m_lump_start_off(-1)
+				, m_start_pos(stream.tellp())
 			{}
 
+			void Write(const char* data, size_t size) override;
+			void WriteAt(uint64_t offset, const char* data, size_t size) override;
+			uint64_t GetSize() const override;
+
+		private:
+			OutStream& m_stream;
+			std::streampos m_start_pos;
+		};
+
+		// MemoryWadSink - collects the data in a growable buffer, which is handed to the caller without copying
+		class MemoryWadSink: public WadSink {
+		public:
+			// 'size' - expected size of the data
+			MemoryWadSink(size_t size = 0) {
+				m_data.reserve(size);
+			}
+
+			void Write(const char* data, size_t size) override;
+			void WriteAt(uint64_t offset, const char* data, size_t size) override;
+			uint64_t GetSize() const override;
+
+			const CharArray& GetData() const {
+				return m_data;
+			}
+
+			// move the collected data into 'data', the sink becomes empty
+			void TakeData(CharArray& data);
+
+		private:
+			CharArray m_data;
+		};
+
+		// FileWadSink - writes the file by positioned writes of the file descriptor (file handle on Windows),
+		// without buffering of streams; the file is created or truncated
+		class FileWadSink: public WadSink {
+		public:
+			// throws if the file cannot be created
+			FileWadSink(const std::string& file_path);
+
+			// closes the file, errors are ignored
+			~FileWadSink();
+
+			void Write(const char* data, size_t size) override;
+			void WriteAt(uint64_t offset, const char* data, size_t size) override;
+			uint64_t GetSize() const override;
+
+			// close the file, throws on errors
+			void Close();
+
+		private:
+			FileWadSink(const FileWadSink&);
+			FileWadSink& operator=(const FileWadSink&);
+
+			std::string m_file_path;
+#ifdef _WIN32
+			void* m_file;
+#else
+			int m_file;
+#endif
+			uint64_t m_size;
+		};
+
+		// MappedFileWadSink - writes the file through memory mapping: the file is made of the expected size
+		// and mapped, the data is copied into the mapping (the header and the directory are patched in place);
+		// the file is mapped again with the doubled size if the data does not fit, and is cut to the size
+		// of the data when it is closed
+		class MappedFileWadSink: public WadSink {
+		public:
+			// 'size' - expected size of the file; throws if the file cannot be created or mapped
+			MappedFileWadSink(const std::string& file_path, uint64_t size);
+
+			// unmaps and closes the file, errors are ignored
+			~MappedFileWadSink();
+
+			void Write(const char* data, size_t size) override;
+			void WriteAt(uint64_t offset, const char* data, size_t size) override;
+			uint64_t GetSize() const override;
+
+			// unmap the file, cut it to the size of the data and close it, throws on errors
+			void Close();
+
+		private:
+			MappedFileWadSink(const MappedFileWadSink&);
+			MappedFileWadSink& operator=(const MappedFileWadSink&);
+
+			// maps the file of 'capacity' bytes
+			void Map(uint64_t capacity);
+
+			// returns 'false' on errors
+			bool Unmap();
+
+			std::string m_file_path;
+#ifdef _WIN32
+			void* m_file;
+			void* m_mapping;
+#else
+			int m_file;
+#endif
+			char* m_view;
+			uint64_t m_capacity;
+			uint64_t m_size;
+		};
+
+		// WadSinkBuffer - stream buffer, that puts the data written to a stream into the sink by big blocks
+		class WadSinkBuffer: public std::streambuf {
+		public:
+			WadSinkBuffer(WadSink& sink);
+
+		protected:
+			int_type overflow(int_type c) override;
+			std::streamsize xsputn(const char* data, std::streamsize size) override;
+			int sync() override;
+
+		private:
+			static const size_t BUFFER_SIZE = 64 * 1024;
+
+			WadSink& m_sink;
+			CharArray m_buffer;
+		};
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WadWriter - class, that write formatted WAD file
+
+namespace RoadGen {
+	namespace Io {
+		class WadWriter {
+		public:
+			// the WAD is written to the seekable stream
+			WadWriter(OutStream& stream, bool is_iwad=false);
+
+			// the WAD is written to the sink (it is not closed by the writer)
+			WadWriter(WadSink& sink, bool is_iwad=false);
+
 			~WadWriter() {
 				FinishWriting();
 			}
@@ -212,7 +367,8 @@ namespace RoadGen {
 			static bool IsValidLumpName(const std::string& lump_name);
 
 			// start new lump writing (end any previous one writing);
-			// return stream that lump should be written into
+			// return stream that lump should be written into (the data goes to the sink by big blocks,
+			// the stream throws errors of the sink)
 			OutStream& StartLumpWriting(const std::string& lump_name);
 
 			// finish writing WAD file
@@ -222,13 +378,19 @@ namespace RoadGen {
 			void Reset();
 
 		private:
-			std::streamoff FinishLumpWriting();
+			WadWriter(const WadWriter&);
+			WadWriter& operator=(const WadWriter&);
+
+			uint64_t FinishLumpWriting();
 
 		private:
-			OutStream& m_stream;
+			std::unique_ptr<StreamWadSink> m_stream_sink;
+			WadSink& m_sink;
+			WadSinkBuffer m_lump_buffer;
+			OutStream m_lump_stream;
+
 			bool m_is_iwad;
-			std::streampos m_start_pos;
-			std::streamoff m_dir_info_off;
+			uint64_t m_start_off;
 
 			bool m_writing_started;
 			bool m_writing_finished;
@@ -251,7 +413,93 @@ namespace RoadGen {
 
 			bool m_writing_lump;
 			std::string m_lump_name;
-			std::streamoff m_lump_start_off;
+			uint64_t m_lump_start_off;
+		};
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ZipWriter - class, that writes zip archive (PK3 file of ZDoom-based games) with deflated files
+// zip format specification: https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+
+namespace RoadGen {
+	namespace Io {
+		class ZipWriter {
+		public:
+			ZipWriter(OutStream& stream)
+				: m_stream(stream)
+				, m_start_pos(-1)
+				, m_writing_started(false)
+				, m_writing_finished(false)
+			{}
+
+			// compress the data (see Deflate::CompressData) and write it as a file of the archive, the data
+			// is stored as is if it does not compress; 'file_path' - path in the archive with '/' separators
+			void AddFile(const std::string& file_path, const char* data, size_t size);
+
+			// finish writing zip archive (the central directory); the archive is not valid before that
+			void FinishWriting();
+
+		private:
+			OutStream& m_stream;
+			std::streampos m_start_pos;
+
+			bool m_writing_started;
+			bool m_writing_finished;
+
+			struct DirectoryEntry {
+				std::string path;
+				uint16_t method;
+				uint32_t crc;
+				uint32_t compressed_size;
+				uint32_t size;
+				uint32_t header_off;
+			};
+
+			typedef std::vector<DirectoryEntry> DirectoryEntryArray;
+			DirectoryEntryArray m_directory;
+		};
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TempOutputFile - output file, that is written under a temporary name ("<file path>.tmp") and replaces the file
+// only when it is complete, so an error keeps the previous file and leaves no partial one
+
+namespace RoadGen {
+	namespace Io {
+		class TempOutputFile {
+		public:
+			TempOutputFile(const std::string& file_path)
+				: m_file_path(file_path)
+				, m_temp_file_path(file_path + ".tmp")
+				, m_committed(false)
+			{}
+
+			// removes the temporary file if it has not been committed (it must be closed before)
+			~TempOutputFile();
+
+			const std::string& GetFilePath() const {
+				return m_file_path;
+			}
+
+			// path of the file to write
+			const std::string& GetTempFilePath() const {
+				return m_temp_file_path;
+			}
+
+			// replace the file by the written temporary file (it must be closed before), throws on errors
+			void Commit();
+
+		private:
+			TempOutputFile(const TempOutputFile&);
+			TempOutputFile& operator=(const TempOutputFile&);
+
+			std::string m_file_path;
+			std::string m_temp_file_path;
+			bool m_committed;
 		};
 	}
 }
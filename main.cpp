@@ -1,23 +1,163 @@
 
 #include "core.h"
+#include "blockmap.h"
 #include "io.h"
+#include "mapproc.h"
+#include "nodes.h"
+#include "reject.h"
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <thread>
 
 using namespace RoadGen;
 
 
-static void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureDataConst& road_data);
+// 'line_numbers' - input line number of each road data object
+static void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureData& road_data, std::vector<size_t>& line_numbers);
+
+static bool TryGetLevelNumber(const std::string& map_name, int& levelnum);
+static std::string GetMapNameByLevelNumber(int levelnum);
+
+static std::string GetVariantWadFilePath(const std::string& wad_file_path, size_t variant_index);
+
+// creates the sink of the temporary WAD file (the file is written by positioned writes without stream buffering),
+// errors are printed
+static bool OpenWadFile(const Io::TempOutputFile& wad_file, std::unique_ptr<Io::FileWadSink>& wad_sink);
+
+// opens the temporary PK3 file for writing, errors are printed
+static bool OpenPk3File(const Io::TempOutputFile& pk3_file, std::ofstream& file_output);
+
+// write maps [maps_begin, maps_end) into the WAD, errors are printed;
+// 'maps_nodes' - nodes of each map to put into ZNODES lumps, empty - maps are written without nodes;
+// 'maps_rejects' - REJECT lumps of maps, empty - maps are written without them;
+// 'maps_blockmaps' - BLOCKMAP lumps of maps, empty - maps are written without them (as well as maps with empty lumps);
+// 'maps_hexen_lumps' - maps in Hexen format, empty - maps are written in UDMF format;
+// 'compact' - TEXTMAP is written in compact form (see Udmf::WriteMapToStream)
+static bool WriteMapsToWad(Io::WadWriter& wad_writer,
+						   const std::vector<Udmf::Map>& maps,
+						   const StringArray& map_names,
+						   const std::vector<Nodes::GlNodes>& maps_nodes,
+						   const std::vector<Reject::RejectTable>& maps_rejects,
+						   const std::vector<Blockmap::BlockGrid>& maps_blockmaps,
+						   const std::vector<Udmf::HexenMapLumps>& maps_hexen_lumps,
+						   size_t maps_begin,
+						   size_t maps_end,
+						   unsigned char float_precision,
+						   bool compact);
+
+// write maps [maps_begin, maps_end) into the PK3 archive, each map into its own WAD file "maps/<map name>.wad"
+// (see WriteMapsToWad), errors are printed
+static bool WriteMapsToPk3(Io::ZipWriter& zip_writer,
+						   const std::vector<Udmf::Map>& maps,
+						   const StringArray& map_names,
+						   const std::vector<Nodes::GlNodes>& maps_nodes,
+						   const std::vector<Reject::RejectTable>& maps_rejects,
+						   const std::vector<Blockmap::BlockGrid>& maps_blockmaps,
+						   const std::vector<Udmf::HexenMapLumps>& maps_hexen_lumps,
+						   size_t maps_begin,
+						   size_t maps_end,
+						   unsigned char float_precision,
+						   bool compact);
+
+// writes the WAD directory, closes the temporary file and replaces the WAD file by it, errors are printed
+static bool FinishWadFile(Io::TempOutputFile& wad_file, Io::WadWriter& wad_writer, Io::FileWadSink& wad_sink);
+
+// opens the WAD file, writes maps [maps_begin, maps_end) into it (see WriteMapsToWad) and finishes it
+static bool WriteMapsToWadFile(const std::string& wad_file_path,
+							   const std::vector<Udmf::Map>& maps,
+							   const StringArray& map_names,
+							   const std::vector<Nodes::GlNodes>& maps_nodes,
+							   const std::vector<Reject::RejectTable>& maps_rejects,
+							   const std::vector<Blockmap::BlockGrid>& maps_blockmaps,
+							   const std::vector<Udmf::HexenMapLumps>& maps_hexen_lumps,
+							   size_t maps_begin,
+							   size_t maps_end,
+							   unsigned char float_precision,
+							   bool compact);
+
+// writes maps [maps_begin, maps_end) into a WAD 'runs' times through each kind of WAD sinks (a buffer in memory,
+// a file written by positioned writes and a memory-mapped file pre-sized by the WAD size) and prints the average
+// writing times; the files are written under a temporary name next to 'wad_file_path' and removed, the mapped file
+// must be byte-identical to the WAD in memory; errors are printed
+static bool BenchWadSinks(const std::string& wad_file_path,
+						  const std::vector<Udmf::Map>& maps,
+						  const StringArray& map_names,
+						  const std::vector<Nodes::GlNodes>& maps_nodes,
+						  const std::vector<Reject::RejectTable>& maps_rejects,
+						  const std::vector<Blockmap::BlockGrid>& maps_blockmaps,
+						  const std::vector<Udmf::HexenMapLumps>& maps_hexen_lumps,
+						  size_t maps_begin,
+						  size_t maps_end,
+						  unsigned char float_precision,
+						  bool compact,
+						  int runs);
+
+// writes the central directory of the PK3 archive, closes the temporary file and replaces the PK3 file by it,
+// errors are printed
+static bool FinishPk3File(Io::TempOutputFile& pk3_file, Io::ZipWriter& zip_writer, std::ofstream& file_output);
+
+// opens the PK3 file, writes maps [maps_begin, maps_end) into it (see WriteMapsToPk3) and finishes it
+static bool WriteMapsToPk3File(const std::string& pk3_file_path,
+							   const std::vector<Udmf::Map>& maps,
+							   const StringArray& map_names,
+							   const std::vector<Nodes::GlNodes>& maps_nodes,
+							   const std::vector<Reject::RejectTable>& maps_rejects,
+							   const std::vector<Blockmap::BlockGrid>& maps_blockmaps,
+							   const std::vector<Udmf::HexenMapLumps>& maps_hexen_lumps,
+							   size_t maps_begin,
+							   size_t maps_end,
+							   unsigned char float_precision,
+							   bool compact);
 
 int main(int argc, char *argv[]) {
 	const StringArray args_and_opts(argv, argv + argc);
 
 	const std::string oname_config("-config");
 	const std::string oname_mapname("-mapname");
+	const std::string oname_weld("-weld");
+	const std::string oname_bench("-bench");
+	const std::string oname_shard("-shard");
+	const std::string oname_verify("-verify");
+	const std::string oname_passes("-passes");
+	const std::string oname_sweep("-sweep");
+	const std::string oname_check("-check");
+	const std::string oname_nodes("-nodes");
+	const std::string oname_reject("-reject");
+	const std::string oname_blockmap("-blockmap");
+	const std::string oname_hexen("-hexen");
+	const std::string oname_compact("-compact");
+	const std::string oname_pk3("-pk3");
+
+	// precision of floating point values in the output TEXTMAP
+	const unsigned char float_precision = 3;
 
 	bool display_help = false;
-	std::string config_file_path;
+	bool weld_vertices = false;
+	bool shard_road = false;
+	bool sweep_configs = false;
+	bool sweep_to_wads = false;
+	bool check_road = false;
+	bool build_nodes = false;
+	bool build_reject = false;
+	bool build_blockmap = false;
+	bool write_hexen = false;
+	bool write_compact = false;
+	bool write_pk3 = false;
+#ifdef _DEBUG
+	// debug builds always check generated maps
+	bool verify_maps = true;
+#else
+	bool verify_maps = false;
+#endif
+	int bench_runs = 0;
+	bool pass_names_are_set = false;
+	StringArray pass_names;
+	StringArray config_file_paths;
 	std::string map_name = "MAP01";
 	StringArray args;
 	for(size_t i=1; i<args_and_opts.size(); i++) {
@@ -38,7 +178,7 @@ int main(int argc, char *argv[]) {
 					return 1;
 				}
 
-				config_file_path = args_and_opts[i+1];
+				config_file_paths.push_back(args_and_opts[i+1]);
 				i++;
 
 			} else if(arg == oname_mapname) {
@@ -56,6 +196,88 @@ int main(int argc, char *argv[]) {
 				map_name = value;
 				i++;
 
+			} else if(arg == oname_weld) {
+				weld_vertices = true;
+
+			} else if(arg == oname_shard) {
+				shard_road = true;
+
+			} else if(arg == oname_sweep) {
+				if((i+1) >= args_and_opts.size() || args_and_opts[i+1].empty()) {
+					std::cout << "Error: an output mode (maps or wads) must be specified after option '" + arg + "'" << std::endl;
+					return 1;
+				}
+
+				const std::string& value = args_and_opts[i+1];
+				if(value != "maps" && value != "wads") {
+					std::cout << "Error: bad output mode '" + value + "' - must be maps or wads" << std::endl;
+					return 1;
+				}
+
+				sweep_configs = true;
+				sweep_to_wads = (value == "wads");
+				i++;
+
+			} else if(arg == oname_check) {
+				check_road = true;
+
+			} else if(arg == oname_nodes) {
+				build_nodes = true;
+
+			} else if(arg == oname_reject) {
+				build_reject = true;
+
+			} else if(arg == oname_blockmap) {
+				build_blockmap = true;
+
+			} else if(arg == oname_hexen) {
+				write_hexen = true;
+
+			} else if(arg == oname_compact) {
+				write_compact = true;
+
+			} else if(arg == oname_pk3) {
+				write_pk3 = true;
+
+			} else if(arg == oname_verify) {
+				verify_maps = true;
+
+			} else if(arg == oname_passes) {
+				if((i+1) >= args_and_opts.size() || args_and_opts[i+1].empty()) {
+					std::cout << "Error: a comma separated list of map passes must be specified after option '" + arg + "'" << std::endl;
+					return 1;
+				}
+
+				const std::string& value = args_and_opts[i+1];
+				pass_names.clear();
+				size_t name_begin = 0;
+				while(true) {
+					const size_t name_end = value.find(',', name_begin);
+					pass_names.push_back(value.substr(name_begin, (name_end == std::string::npos) ? std::string::npos : name_end - name_begin));
+					if(name_end == std::string::npos) {
+						break;
+					}
+					name_begin = name_end + 1;
+				}
+
+				pass_names_are_set = true;
+				i++;
+
+			} else if(arg == oname_bench) {
+				if((i+1) >= args_and_opts.size() || args_and_opts[i+1].empty()) {
+					std::cout << "Error: a number of runs must be specified after option '" + arg + "'" << std::endl;
+					return 1;
+				}
+
+				const std::string& value = args_and_opts[i+1];
+				if(value.find_first_not_of("0123456789") != std::string::npos || value.size() > 6 || std::stoi(value) < 1) {
+					std::cout << "Error: bad number of runs '" + value + "' - must be a positive integer" << std::endl;
+					return 1;
+				}
+
+				bench_runs = std::stoi(value);
+				i++;
+
 			} else if(arg == "--help" || arg == "-h" || arg == "/?") {
 				// display help
 				display_help = true;
@@ -81,8 +303,37 @@ int main(int argc, char *argv[]) {
 		std::cout << "  <input-file-path> - file path with road figures to generate (required)" << std::endl;
 		std::cout << "  <output-file-path> - output WAD file path (optional, default - 'roads.wad')" << std::endl;
 		std::cout << "Options: " << std::endl;
-		std::cout << "  -config <file-path> - road config file path; allows to change road sizes, textures, light settings, etc." << std::endl;
+		std::cout << "  -config <file-path> - road config file path; allows to change road sizes, textures, light settings, etc.;"
+		             " may be specified several times with option -sweep" << std::endl;
 		std::cout << "  -mapname <map-marker-lump-name> - output map name in the resulting WAD file; must be valid ZDoom map name, 8 chars maximum length (default - MAP01)" << std::endl;
+		std::cout << "  -bench <runs> - generate the road the given number of times and print the average generation time; WAD writing time is measured too (into memory, a file and a memory-mapped file)" << std::endl;
+		std::cout << "  -shard - split the road into several maps (MAP01, MAP02, ...) to get over map coordinate limits;"
+		             " the end of the road in a map teleports the player to the next map; map name must be MAPxx (first map name)" << std::endl;
+		std::cout << "  -sweep <maps|wads> - generate the road with each config given by -config options (variants) in parallel;"
+		             " maps - put a map per variant into the output WAD file (MAP01, MAP02, ...; map name must be MAPxx),"
+		             " wads - write a WAD file per variant (roads-1.wad, roads-2.wad, ... for the output file roads.wad)" << std::endl;
+		std::cout << "  -check - only check the road input data: report all figure errors, intersections and coordinates out of map limits"
+		             " with input line numbers; no WAD file is written" << std::endl;
+		std::cout << "  -passes <pass>[,<pass>...] - post-processing passes to run over generated maps in the given order: weld, stats, verify;"
+		             " overrides 'MapPasses' road config setting" << std::endl;
+		std::cout << "  -weld - merge coincident vertices of the generated map (vertices with the same output coordinates and heights);"
+		             " adds 'weld' pass in front of other passes" << std::endl;
+		std::cout << "  -verify - check topology of the generated map (closed sector boundaries, linedef sides, zero-length and duplicate linedefs,"
+		             " vertex heights in triangular sectors) and report all problems; adds 'verify' pass after other passes; always on in debug builds" << std::endl;
+		std::cout << "  -nodes - build BSP nodes of the generated maps and put them into ZNODES lumps (ZDoom GL nodes, XGL3 format);"
+		             " the game does not have to build nodes when the map is loaded" << std::endl;
+		std::cout << "  -reject - build REJECT lumps of the generated maps: sector pairs, that cannot see each other through the road,"
+		             " are found by portals between convex cells of the space between walls; the game skips sight checks between such sectors" << std::endl;
+		std::cout << "  -blockmap - build BLOCKMAP lumps of the generated maps (128x128 blocks with lists of linedefs, blocks with the same lists"
+		             " share them); maps too big for the lump format are written without it; with -bench building time is measured too" << std::endl;
+		std::cout << "  -hexen - write maps in Hexen binary format (THINGS, LINEDEFS, SIDEDEFS, VERTEXES, SECTORS lumps) instead of UDMF TEXTMAP;"
+		             " coordinates are rounded to integers, slopes are made by Plane_Align specials; maps, that need UDMF (vertex heights"
+		             " of road marks on slopes, panning of flats, etc.), are refused" << std::endl;
+		std::cout << "  -compact - write TEXTMAP without comments and whitespace, trailing zeros of numbers and fields with default values;"
+		             " the text is smaller and faster to write and to parse by the game" << std::endl;
+		std::cout << "  -pk3 - write a PK3 (zip) file instead of the WAD file: each map is put into its own WAD file maps/<map name>.wad"
+		             " compressed by deflate (segments of WAD files are compressed in parallel); with '-sweep wads' a PK3 file is written"
+		             " per road variant" << std::endl;
 		std::cout << "  --help, -h or /? - display this message" << std::endl;
 
 		if(args.empty()) {
@@ -90,12 +341,48 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	if(write_compact && write_hexen) {
+		std::cout << "Error: option '" + oname_compact + "' may not be specified with option '" + oname_hexen + "'" << std::endl;
+		return 1;
+	}
+
+	if(config_file_paths.size() > 1 && !sweep_configs) {
+		std::cout << "Error: option '" + oname_config + "' may be specified several times with option '" + oname_sweep + "' only" << std::endl;
+		return 1;
+	}
+
+	if(sweep_configs && shard_road) {
+		std::cout << "Error: options '" + oname_sweep + "' and '" + oname_shard + "' can not be used together" << std::endl;
+		return 1;
+	}
+
+	if(check_road && (shard_road || sweep_configs)) {
+		std::cout << "Error: option '" + oname_check + "' can not be used with options '" + oname_shard + "' and '" + oname_sweep + "'" << std::endl;
+		return 1;
+	}
+
+	if(sweep_configs && config_file_paths.empty()) {
+		std::cout << "Error: road config files must be specified with option '" + oname_config + "' for option '" + oname_sweep + "'" << std::endl;
+		return 1;
+	}
+
+	// maps are numbered when the road is split into several maps of one WAD file
+	const bool have_numbered_maps = shard_road || (sweep_configs && !sweep_to_wads);
+	int first_levelnum = 0;
+	if(have_numbered_maps && !TryGetLevelNumber(map_name, first_levelnum)) {
+		std::cout << "Error: bad map name '" + map_name + "' - must be MAPxx with option '" + (shard_road ? oname_shard : oname_sweep) + "'" << std::endl;
+		return 1;
+	}
+
 	//
-	// 1) Read road config data from file (if file is specified)
+	// 1) Read road config data from files (if files are specified), a config per road variant
 	//
 
-	Io::ConfigData road_config_data;
-	if(!config_file_path.empty()) {
+	std::vector<Io::ConfigData> road_configs_data(config_file_paths.empty() ? 1 : config_file_paths.size());
+	for(size_t cix=0; cix<config_file_paths.size(); cix++) {
+		const std::string& config_file_path = config_file_paths[cix];
+		Io::ConfigData& road_config_data = road_configs_data[cix];
+
 		std::ifstream file_input;
 		file_input.exceptions(std::ios_base::badbit | std::ios_base::failbit);
 		try {
@@ -122,13 +409,54 @@ int main(int argc, char *argv[]) {
 	// 2) Transform road config data into the struct
 	//
 
-	RoadConfig road_config;
-	try {
-		GetRoadConfig(road_config_data, road_config);
+	std::vector<RoadConfig> road_configs(road_configs_data.size());
+	for(size_t cix=0; cix<road_configs_data.size(); cix++) {
+		try {
+			GetRoadConfig(road_configs_data[cix], road_configs[cix]);
 
-	} catch(Exception& e) {
-		std::cout << "Error extracting road config: " << e.what() << std::endl;
-		return 1;
+		} catch(Exception& e) {
+			std::cout << "Error extracting road config" << (sweep_configs ? " '" + config_file_paths[cix] + "'" : std::string()) << ": " << e.what() << std::endl;
+			return 1;
+		}
+	}
+	const RoadConfig& road_config = road_configs[0];
+
+	// map passes from command line override ones from road config (the first one for all variants)
+	if(!pass_names_are_set) {
+		try {
+			MapProc::GetMapPassNames(road_configs_data[0], pass_names);
+
+		} catch(Exception& e) {
+			std::cout << "Error extracting road config: " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	if(weld_vertices && std::find(pass_names.begin(), pass_names.end(), "weld") == pass_names.end()) {
+		pass_names.insert(pass_names.begin(), "weld");
+	}
+
+	if(verify_maps && std::find(pass_names.begin(), pass_names.end(), "verify") == pass_names.end()) {
+		pass_names.push_back("verify");
+	}
+
+	// merge vertices which would be written with the same coordinates
+	MapProc::MapPassOptions pass_options;
+	pass_options.weld_tolerance = 1.0;
+	for(unsigned char i=0; i<float_precision; i++) {
+		pass_options.weld_tolerance /= 10;
+	}
+	pass_options.float_precision = float_precision;
+
+	MapProc::MapPassManager pass_manager;
+	for(size_t pix=0; pix<pass_names.size(); pix++) {
+		std::unique_ptr<MapProc::MapPass> pass = MapProc::CreateMapPass(pass_names[pix], pass_options);
+		if(!pass) {
+			std::cout << "Error: unknown map pass '" + pass_names[pix] + "' - must be weld, stats or verify" << std::endl;
+			return 1;
+		}
+
+		pass_manager.AddPass(std::move(pass));
 	}
 
 	//
@@ -136,7 +464,8 @@ int main(int argc, char *argv[]) {
 	//
 
 	const std::string input_file_path = args.at(0);
-	RoadFigureDataConst road_data;
+	RoadFigureData road_data;
+	std::vector<size_t> road_data_line_numbers;
 	{
 		std::ifstream file_input;
 		file_input.exceptions(std::ios_base::badbit | std::ios_base::failbit);
@@ -149,7 +478,7 @@ int main(int argc, char *argv[]) {
 		}
 
 		try {
-			ReadRoadInputDataFromTableConfigStream(file_input, road_data);
+			ReadRoadInputDataFromTableConfigStream(file_input, road_data, road_data_line_numbers);
 
 		} catch(Exception& e) {
 			std::cout << "Error reading road data file '" << input_file_path << "': " << e.what() << std::endl;
@@ -160,88 +489,398 @@ int main(int argc, char *argv[]) {
 		file_input.close();
 	}
 
+	if(check_road) {
+		std::vector<RoadProblem> problems;
+		try {
+			CheckRoad(road_data, road_config, problems);
 
-	//
-	// 4) Generate road figures, put them into Map object
-	//
+		} catch(std::exception& e) {
+			std::cout << "Error checking the road: " << e.what() << std::endl;
+			return 1;
+		}
 
-	Udmf::Map map;
-	try {
-		GetGeneratedRoad(road_data, road_config, map);
+		if(problems.empty()) {
+			std::cout << "Road data file '" << input_file_path << "' is valid" << std::endl;
+			return 0;
+		}
 
-	} catch(std::exception& e) {
-		std::cout << "Error generating the road: " << e.what() << std::endl;
+		std::cout << "Error checking road data file '" << input_file_path << "': " << problems.size() << " problem(s) found" << std::endl;
+		for(size_t pix=0; pix<problems.size(); pix++) {
+			std::cout << "  line " << road_data_line_numbers.at(problems[pix].object_index) << ": " << problems[pix].message << std::endl;
+		}
 		return 1;
 	}
 
 
 	//
-	// 5) Open WAD output stream
+	// 4) Split the road into shards if needed and name maps (one map, a map per road shard or a map per road variant)
 	//
 
-	const std::string output_wad_file_path = (args.size() > 1) ? args[1] : "roads.wad";
-	std::ofstream file_output;
-	file_output.exceptions(std::ios_base::badbit | std::ios_base::failbit);
-	try {
-		file_output.open(output_wad_file_path, std::ios::binary);
+	std::vector<RoadShard> shards;
+	if(shard_road) {
+		try {
+			GetRoadShards(road_data, road_config, ROAD_SHARD_MAX_SIZE, shards);
 
-	} catch(std::exception& e) {
-		std::cout << "Error opening output WAD file '" << output_wad_file_path << "': " << e.what() << std::endl;
-		return 1;
+		} catch(std::exception& e) {
+			std::cout << "Error generating the road: " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	const size_t maps_count = shard_road ? shards.size() : (sweep_configs ? road_configs.size() : 1);
+	std::vector<std::string> map_names(maps_count, map_name);
+	if(have_numbered_maps) {
+		for(size_t mix=1; mix<maps_count; mix++) {
+			map_names[mix] = GetMapNameByLevelNumber(first_levelnum + (int)mix);
+		}
+
+		if(!Io::WadWriter::IsValidLumpName(map_names.back())) {
+			std::cout << "Error: too many road " << (shard_road ? "shards" : "variants") << ", bad map name '" + map_names.back() + "' - must be valid lump name" << std::endl;
+			return 1;
+		}
+
+		std::cout << (shard_road ? "Road is split into " : "Road variants are put into ") << maps_count << " map(s): "
+				  << map_names.front() << " - " << map_names.back() << std::endl;
 	}
-	Io::WadWriter wad_writer(file_output);
 
 
 	//
-	// 6) Put TEXTMAP with generated figures into the WAD file
+	// 5) Generate road figures, put them into Map objects, process the maps and write them into the output WAD file
+	//    (or a WAD file per road variant); maps are generated by windows of as many maps as hardware threads, maps
+	//    of a window are written and freed before the next window, so the memory taken by maps does not grow
+	//    with the number of maps; a single map, that is not processed, is written while it is generated
 	//
 
-	try {
-		wad_writer.StartLumpWriting(map_name); // (empty marker lump)
-		Udmf::WriteMapToStream(map, 3, wad_writer.StartLumpWriting("TEXTMAP"));
-		wad_writer.StartLumpWriting("ENDMAP"); // (empty marker lump)
+	// road variants differ in widths only, the center line is the same for all of them
+	std::unique_ptr<RoadCenterTrace> center_trace;
+	if(sweep_configs) {
+		center_trace.reset(new RoadCenterTrace(road_data));
+	}
 
-	} catch(std::exception& e) {
-		file_output.close();
-		std::cout << "Error writing TEXTMAP lump to WAD file: " << e.what() << std::endl;
-		return 1;
+	const auto generate_maps = [&](size_t maps_begin, size_t maps_end, std::vector<Udmf::Map>& maps) {
+		if(shard_road) {
+			GetGeneratedRoadShards(shards, road_config, first_levelnum, maps_begin, maps_end, maps);
+
+		} else if(sweep_configs) {
+			GetGeneratedRoadVariants(road_data, *center_trace, road_configs, maps_begin, maps_end, maps);
+
+		} else {
+			maps.resize(1);
+			GetGeneratedRoad(road_data, road_config, maps[0]);
+		}
+	};
+
+	// Hexen format coordinates are integers, nodes and blockmap are built for them
+	const unsigned char map_float_precision = write_hexen ? 0 : float_precision;
+
+	// lumps built for maps, a map's ones are freed with the map; REJECT tables are built from the nodes,
+	// which are not written without '-nodes'
+	std::vector<Udmf::Map> maps;
+	std::vector<Udmf::HexenMapLumps> maps_hexen_lumps(write_hexen ? maps_count : 0);
+	std::vector<Nodes::GlNodes> maps_nodes((build_nodes || build_reject) ? maps_count : 0);
+	std::vector<Reject::RejectTable> maps_rejects(build_reject ? maps_count : 0);
+	std::vector<Blockmap::BlockGrid> maps_blockmaps(build_blockmap ? maps_count : 0);
+	const std::vector<Nodes::GlNodes> no_maps_nodes;
+
+	// the output WAD file is opened when the first window of maps is ready; it is written under a temporary name
+	// and replaces the file only when all maps are written, the temporary file is removed on errors
+	const std::string output_wad_file_path = (args.size() > 1) ? args[1] : (write_pk3 ? "roads.pk3" : "roads.wad");
+	std::unique_ptr<Io::TempOutputFile> output_file;
+	std::ofstream file_output;
+	std::unique_ptr<Io::FileWadSink> wad_sink;
+	std::unique_ptr<Io::WadWriter> wad_writer;
+	std::unique_ptr<Io::ZipWriter> zip_writer;
+
+	std::chrono::duration<double, std::milli> bench_duration(0.0);
+	size_t vertices_count = 0, linedefs_count = 0, sidedefs_count = 0, sectors_count = 0;
+
+	// without map passes, nodes, reject, blockmap and Hexen format nothing needs the whole map: map elements,
+	// that figures do not change anymore, are written into TEXTMAP and freed while the road is generated,
+	// so the memory does not grow with the length of the road
+	const bool stream_map =    !shard_road && !sweep_configs && !write_pk3 && bench_runs == 0 && pass_manager.IsEmpty()
+							&& !write_hexen && !build_nodes && !build_reject && !build_blockmap;
+	if(stream_map) {
+		output_file.reset(new Io::TempOutputFile(output_wad_file_path));
+		if(!OpenWadFile(*output_file, wad_sink)) {
+			return 1;
+		}
+		wad_writer.reset(new Io::WadWriter(*wad_sink));
+
+		try {
+			wad_writer->StartLumpWriting(map_names[0]); // (empty marker lump)
+			WriteGeneratedRoad(road_data, road_config, float_precision, wad_writer->StartLumpWriting("TEXTMAP"), write_compact);
+			wad_writer->StartLumpWriting("ENDMAP"); // (empty marker lump)
+
+		} catch(std::exception& e) {
+			std::cout << "Error generating the road: " << e.what() << std::endl;
+			return 1;
+		}
 	}
 
-	//
-	// 7) Finish writing WAD file
-	//
+	const size_t window_size = (std::thread::hardware_concurrency() > 0) ? std::thread::hardware_concurrency() : 1;
+	for(size_t window_begin=0; window_begin<maps_count && !stream_map; window_begin+=window_size) {
+		const size_t window_end = std::min(maps_count, window_begin + window_size);
+		try {
+			generate_maps(window_begin, window_end, maps);
 
-	try {
-		wad_writer.FinishWriting();
+		} catch(std::exception& e) {
+			std::cout << "Error generating the road: " << e.what() << std::endl;
+			return 1;
+		}
 
-	} catch(Exception& e) {
-		file_output.close();
-		std::cout << "Error writing WAD file '" + output_wad_file_path + "': " << e.what() << std::endl;
+		if(bench_runs > 0) {
+			// the road is already generated successfully once, measure next runs only
+			const std::chrono::steady_clock::time_point bench_start = std::chrono::steady_clock::now();
+			for(int i=0; i<bench_runs; i++) {
+				generate_maps(window_begin, window_end, maps);
+			}
+			bench_duration += std::chrono::steady_clock::now() - bench_start;
+
+			for(size_t mix=window_begin; mix<window_end; mix++) {
+				vertices_count += maps[mix].vertices.size();
+				linedefs_count += maps[mix].linedefs.size();
+				sidedefs_count += maps[mix].sidedefs.size();
+				sectors_count += maps[mix].sectors.size();
+			}
+		}
+
+		for(size_t mix=window_begin; mix<window_end && !pass_manager.IsEmpty(); mix++) {
+			std::vector<MapProc::MapPassResult> pass_results;
+			std::string pass_error;
+			try {
+				pass_manager.Run(maps[mix], pass_results);
+
+			} catch(Exception& e) {
+				pass_error = e.what();
+			}
+
+			// reports of the passes finished before an error are printed too
+			for(size_t rix=0; rix<pass_results.size(); rix++) {
+				std::cout << map_names[mix] << " - " << pass_results[rix].pass_name << ": " << pass_results[rix].report
+						  << " (" << pass_results[rix].duration_ms << " ms)" << std::endl;
+			}
+
+			if(!pass_error.empty()) {
+				std::cout << "Error processing map " << map_names[mix] << ": " << pass_error << std::endl;
+				return 1;
+			}
+		}
+
+		// Hexen format is refused before nodes are built for it
+		for(size_t mix=window_begin; mix<window_end && write_hexen; mix++) {
+			try {
+				Udmf::GetHexenMapLumps(maps[mix], maps_hexen_lumps[mix]);
+
+			} catch(Exception& e) {
+				std::cout << "Error: map " << map_names[mix] << " cannot be written in Hexen format: " << e.what() << std::endl;
+				return 1;
+			}
+		}
+
+		for(size_t mix=window_begin; mix<window_end && !maps_nodes.empty(); mix++) {
+			const std::chrono::steady_clock::time_point nodes_start = std::chrono::steady_clock::now();
+			try {
+				Nodes::BuildNodes(maps[mix], map_float_precision, maps_nodes[mix]);
+
+			} catch(Exception& e) {
+				std::cout << "Error building nodes of map " << map_names[mix] << ": " << e.what() << std::endl;
+				return 1;
+			}
+			const std::chrono::duration<double, std::milli> nodes_duration = std::chrono::steady_clock::now() - nodes_start;
+
+			const Nodes::GlNodes& nodes = maps_nodes[mix];
+			std::cout << map_names[mix] << " - nodes: " << nodes.nodes.size() << " nodes, " << nodes.subsector_segs_counts.size() << " subsectors, "
+					  << nodes.segs.size() << " segs, " << nodes.new_vertices.size() << " new vertices (" << nodes_duration.count() << " ms)" << std::endl;
+		}
+
+		for(size_t mix=window_begin; mix<window_end && build_reject; mix++) {
+			const std::chrono::steady_clock::time_point reject_start = std::chrono::steady_clock::now();
+			try {
+				Reject::BuildReject(maps[mix], maps_nodes[mix], map_float_precision, maps_rejects[mix]);
+
+			} catch(Exception& e) {
+				std::cout << "Error building reject of map " << map_names[mix] << ": " << e.what() << std::endl;
+				return 1;
+			}
+			const std::chrono::duration<double, std::milli> reject_duration = std::chrono::steady_clock::now() - reject_start;
+
+			const Reject::RejectTable& reject = maps_rejects[mix];
+			const uint64_t pairs_count = (uint64_t)reject.sectors_count * (reject.sectors_count - (reject.sectors_count > 0 ? 1 : 0));
+			std::cout << map_names[mix] << " - reject: " << reject.sectors_count << " sectors, " << reject.visible_pairs_count << " of "
+					  << pairs_count << " sector pairs may see each other, " << reject.fallback_cells_count
+					  << " cells see their whole component (" << reject_duration.count() << " ms)" << std::endl;
+		}
+
+		for(size_t mix=window_begin; mix<window_end && build_blockmap; mix++) {
+			std::chrono::duration<double, std::milli> blockmap_duration;
+			bool is_fitting = false;
+			try {
+				const std::chrono::steady_clock::time_point blockmap_start = std::chrono::steady_clock::now();
+				is_fitting = Blockmap::BuildBlockmap(maps[mix], map_float_precision, maps_blockmaps[mix]);
+				blockmap_duration = std::chrono::steady_clock::now() - blockmap_start;
+
+				// the blockmap is built successfully once, measure next runs only
+				if(bench_runs > 0) {
+					Blockmap::BlockGrid bench_blockmap;
+					const std::chrono::steady_clock::time_point blockmap_bench_start = std::chrono::steady_clock::now();
+					for(int i=0; i<bench_runs; i++) {
+						Blockmap::BuildBlockmap(maps[mix], map_float_precision, bench_blockmap);
+					}
+					const std::chrono::duration<double, std::milli> blockmap_bench_duration = std::chrono::steady_clock::now() - blockmap_bench_start;
+
+					std::cout << map_names[mix] << " - blockmap building time: " << blockmap_bench_duration.count() / bench_runs << " ms average over "
+							  << bench_runs << " runs" << std::endl;
+				}
+
+			} catch(Exception& e) {
+				std::cout << "Error building blockmap of map " << map_names[mix] << ": " << e.what() << std::endl;
+				return 1;
+			}
+
+			const Blockmap::BlockGrid& blockmap = maps_blockmaps[mix];
+			std::cout << map_names[mix] << " - blockmap: " << blockmap.columns_count << "x" << blockmap.rows_count << " blocks, "
+					  << blockmap.lists_count << " different lists, " << blockmap.words_count << " words ("
+					  << blockmap_duration.count() << " ms)" << std::endl;
+			if(!is_fitting) {
+				std::cout << "Warning: map " << map_names[mix] << " is written without BLOCKMAP lump - ";
+				if(blockmap.words_count > Blockmap::LUMP_WORDS_MAX) {
+					std::cout << blockmap.words_count << " words, the lump holds at most " << Blockmap::LUMP_WORDS_MAX;
+
+				} else {
+					std::cout << blockmap.linedefs_count << " linedefs, lists hold at most " << Blockmap::LIST_END - 1;
+				}
+				std::cout << "; the game builds the blockmap itself" << std::endl;
+			}
+		}
+
+		const std::vector<Nodes::GlNodes>& written_maps_nodes = build_nodes ? maps_nodes : no_maps_nodes;
+		if(sweep_to_wads) {
+			for(size_t mix=window_begin; mix<window_end; mix++) {
+				const std::string variant_file_path = GetVariantWadFilePath(output_wad_file_path, mix);
+				if(write_pk3) {
+					if(!WriteMapsToPk3File(variant_file_path, maps, map_names, written_maps_nodes, maps_rejects, maps_blockmaps, maps_hexen_lumps, mix, mix + 1, float_precision, write_compact)) {
+						return 1;
+					}
+
+				} else if(!WriteMapsToWadFile(variant_file_path, maps, map_names, written_maps_nodes, maps_rejects, maps_blockmaps, maps_hexen_lumps, mix, mix + 1, float_precision, write_compact)) {
+					return 1;
+				}
+			}
+
+		} else if(write_pk3) {
+			if(!zip_writer) {
+				output_file.reset(new Io::TempOutputFile(output_wad_file_path));
+				if(!OpenPk3File(*output_file, file_output)) {
+					return 1;
+				}
+				zip_writer.reset(new Io::ZipWriter(file_output));
+			}
+
+			if(!WriteMapsToPk3(*zip_writer, maps, map_names, written_maps_nodes, maps_rejects, maps_blockmaps, maps_hexen_lumps, window_begin, window_end, float_precision, write_compact)) {
+				return 1;
+			}
+
+		} else {
+			if(!wad_writer) {
+				output_file.reset(new Io::TempOutputFile(output_wad_file_path));
+				if(!OpenWadFile(*output_file, wad_sink)) {
+					return 1;
+				}
+				wad_writer.reset(new Io::WadWriter(*wad_sink));
+			}
+
+			if(!WriteMapsToWad(*wad_writer, maps, map_names, written_maps_nodes, maps_rejects, maps_blockmaps, maps_hexen_lumps, window_begin, window_end, float_precision, write_compact)) {
+				return 1;
+			}
+
+			// the maps are written successfully once, measure next runs only
+			if(   bench_runs > 0
+			   && !BenchWadSinks(output_wad_file_path, maps, map_names, written_maps_nodes, maps_rejects, maps_blockmaps, maps_hexen_lumps,
+								 window_begin, window_end, float_precision, write_compact, bench_runs))
+			{
+				return 1;
+			}
+		}
+
+		// written maps and their lumps are not needed anymore
+		for(size_t mix=window_begin; mix<window_end; mix++) {
+			maps[mix] = Udmf::Map();
+			if(!maps_hexen_lumps.empty()) {
+				maps_hexen_lumps[mix] = Udmf::HexenMapLumps();
+			}
+			if(!maps_nodes.empty()) {
+				maps_nodes[mix] = Nodes::GlNodes();
+			}
+			if(!maps_rejects.empty()) {
+				maps_rejects[mix] = Reject::RejectTable();
+			}
+			if(!maps_blockmaps.empty()) {
+				maps_blockmaps[mix] = Blockmap::BlockGrid();
+			}
+		}
+	}
+
+	if(bench_runs > 0) {
+		std::cout << "Generation time: " << bench_duration.count() / bench_runs << " ms average over " << bench_runs << " runs"
+				  << " (vertices: " << vertices_count << ", linedefs: " << linedefs_count
+				  << ", sidedefs: " << sidedefs_count << ", sectors: " << sectors_count << ")" << std::endl;
+	}
+
+	if(sweep_to_wads) {
+		std::cout << (write_pk3 ? "PK3" : "Wad") << " files created successfully!" << std::endl;
+		return 0;
+	}
+
+	if(write_pk3) {
+		if(!FinishPk3File(*output_file, *zip_writer, file_output)) {
+			return 1;
+		}
+
+		std::cout << "PK3 file created successfully!" << std::endl;
+		return 0;
+	}
+
+	if(!FinishWadFile(*output_file, *wad_writer, *wad_sink)) {
 		return 1;
 	}
 
-	file_output.close();
 	std::cout << "Wad file created successfully!" << std::endl;
 	return 0;
 }
 
-void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureDataConst& road_data) {
+void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureData& road_data, std::vector<size_t>& line_numbers) {
 	class RoadFigureDataReader: public Io::TableConfigProcessor {
-		RoadFigureDataConst& m_road_data;
+		RoadFigureData& m_road_data;
+		std::vector<size_t>& m_line_numbers;
 
-		IRoadFigureObject* m_cur_obj;
+		// current object is the last one in road data
+		bool m_have_cur_obj;
 		int m_index;
+
+		// 0 - no rows yet
+		size_t m_line_number;
 	public:
-		RoadFigureDataReader(RoadFigureDataConst& road_data_)
+		RoadFigureDataReader(RoadFigureData& road_data_, std::vector<size_t>& line_numbers_)
 			: m_road_data(road_data_)
-			, m_cur_obj(NULL)
+			, m_line_numbers(line_numbers_)
+			, m_have_cur_obj(false)
 			, m_index(0)
+			, m_line_number(0)
 		{
 			m_road_data.clear();
+			m_line_numbers.clear();
+		}
+
+		size_t GetLineNumber() const {
+			return m_line_number;
+		}
+
+		void StartRow(size_t line_number) {
+			m_line_number = line_number;
 		}
 
 		void ProcessValue(const std::string& value) {
-			if(!m_cur_obj) {
+			if(!m_have_cur_obj) {
 				if(m_index != 0) {
 					throw Exception("internal error - cannot parse road input data");
 				}
@@ -252,30 +891,36 @@ void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureD
 				}
 
 				if(value == "Figure") {
-					m_road_data.push_back(IRoadFigureObjectPtr(m_cur_obj = new RoadFigureStartModifier));
+					m_road_data.push_back(RoadFigureObject(RoadFigureObject::StartModifierData()));
 
 				} else if(value == "Line") {
-					m_road_data.push_back(IRoadFigureObjectPtr(m_cur_obj = new RoadFigureLine));
+					m_road_data.push_back(RoadFigureObject(RoadFigureObject::LineData()));
 
 				} else if(value == "Arc") {
-					m_road_data.push_back(IRoadFigureObjectPtr(m_cur_obj = new RoadFigureArc));
+					m_road_data.push_back(RoadFigureObject(RoadFigureObject::ArcData()));
 
 				} else if(value == "Slope") {
-					m_road_data.push_back(IRoadFigureObjectPtr(m_cur_obj = new RoadFigureSlopeModifier));
+					m_road_data.push_back(RoadFigureObject(RoadFigureObject::SlopeModifierData()));
+
+				} else if(value == "Thing") {
+					m_road_data.push_back(RoadFigureObject(RoadFigureObject::ThingsModifierData()));
 
 				} else {
-					throw Exception("bad road input data - unknown road figure object type '" + value + "', must be Figure, Line, Arc or Slope");
+					throw Exception("bad road input data - unknown road figure object type '" + value + "', must be Figure, Line, Arc, Slope or Thing");
 				}
 
+				m_line_numbers.push_back(m_line_number);
+				m_have_cur_obj = true;
 				m_index = 1;
 				return;
 			}
 
-			switch(m_cur_obj->GetType()) {
-			case IRoadFigureObject::enType_StartModifier:
+			RoadFigureObject& cur_obj = m_road_data.back();
+			switch(cur_obj.type) {
+			case RoadFigureObject::enType_StartModifier:
 				{
 					// x0, y0, angle, floorpos, height, mark_shift
-					IRoadFigureObject::StartModifierData& figure_start_data = *m_cur_obj->GetStartModifierData();
+					RoadFigureObject::StartModifierData& figure_start_data = cur_obj.start_modifier;
 					switch(m_index) {
 					case 1:
 						if(!TryParseDouble(value, figure_start_data.x_null)) {
@@ -325,10 +970,10 @@ void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureD
 				}
 				break;
 
-			case IRoadFigureObject::enType_Line:
+			case RoadFigureObject::enType_Line:
 				{
 					// length
-					IRoadFigureObject::LineData& line_data = *m_cur_obj->GetLineData();
+					RoadFigureObject::LineData& line_data = cur_obj.line;
 					switch(m_index) {
 					case 1:
 						if(!TryParseDouble(value, line_data.length)) {
@@ -342,10 +987,10 @@ void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureD
 				}
 				break;
 
-			case IRoadFigureObject::enType_Arc:
+			case RoadFigureObject::enType_Arc:
 				{
 					// curve (radius), angle, divider
-					IRoadFigureObject::ArcData& arc_data = *m_cur_obj->GetArcData();
+					RoadFigureObject::ArcData& arc_data = cur_obj.arc;
 					switch(m_index) {
 					case 1:
 						if(!TryParseDouble(value, arc_data.curve)) {
@@ -373,10 +1018,10 @@ void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureD
 				}
 				break;
 
-			case IRoadFigureObject::enType_SlopeModifier:
+			case RoadFigureObject::enType_SlopeModifier:
 				{
 					// tangent
-					IRoadFigureObject::SlopeModifierData& slope_modifier_data = *m_cur_obj->GetSlopeModifierData();
+					RoadFigureObject::SlopeModifierData& slope_modifier_data = cur_obj.slope_modifier;
 					switch(m_index) {
 					case 1:
 						if(!TryParseDouble(value, slope_modifier_data.tangent)) {
@@ -390,6 +1035,47 @@ void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureD
 				}
 				break;
 
+			case RoadFigureObject::enType_ThingsModifier:
+				{
+					// type, "every", distance between things, "offset", distance from the center line
+					RoadFigureObject::ThingsModifierData& things_modifier_data = cur_obj.things_modifier;
+					switch(m_index) {
+					case 1:
+						if(!TryParseInt(value, things_modifier_data.thing_type)) {
+							throw Exception("bad road input data - bad thing type value '" + value + "'");
+						}
+						break;
+
+					case 2:
+						if(value != "every") {
+							throw Exception("bad road input data - bad thing definition, expected 'every' but got '" + value + "'");
+						}
+						break;
+
+					case 3:
+						if(!TryParseDouble(value, things_modifier_data.every)) {
+							throw Exception("bad road input data - bad thing distance value '" + value + "'");
+						}
+						break;
+
+					case 4:
+						if(value != "offset") {
+							throw Exception("bad road input data - bad thing definition, expected 'offset' but got '" + value + "'");
+						}
+						break;
+
+					case 5:
+						if(!TryParseDouble(value, things_modifier_data.offset)) {
+							throw Exception("bad road input data - bad thing offset value '" + value + "'");
+						}
+						break;
+
+					default:
+						throw Exception("bad road input data - bad thing definition, too many fields");
+					}
+				}
+				break;
+
 			default:
 				// must not happen
 				throw Exception("internal error - bad parsing of road input data, unknown road object type");
@@ -399,43 +1085,49 @@ void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureD
 		}
 
 		void EndRow() {
-			if(!m_cur_obj) {
+			if(!m_have_cur_obj) {
 				// must not happen
 				throw Exception("internal error - road input data value on the row is not found");
 			}
 
 			// compare index with expected number of fields plus 1
-			switch(m_cur_obj->GetType()) {
-			case IRoadFigureObject::enType_StartModifier:
+			switch(m_road_data.back().type) {
+			case RoadFigureObject::enType_StartModifier:
 				if(m_index != 7) {
 					throw Exception("bad road input data - bad figure start definition, not enough fields");
 				}
 				break;
 
-			case IRoadFigureObject::enType_Line:
+			case RoadFigureObject::enType_Line:
 				if(m_index != 2) {
 					throw Exception("bad road input data - bad line definition, not enough fields");
 				}
 				break;
 
-			case IRoadFigureObject::enType_Arc:
+			case RoadFigureObject::enType_Arc:
 				if(m_index != 4) {
 					throw Exception("bad road input data - bad arc definition, not enough fields");
 				}
 				break;
 
-			case IRoadFigureObject::enType_SlopeModifier:
+			case RoadFigureObject::enType_SlopeModifier:
 				if(m_index != 2) {
 					throw Exception("bad road input data - bad slope modifier definition, not enough fields");
 				}
 				break;
 
+			case RoadFigureObject::enType_ThingsModifier:
+				if(m_index != 6) {
+					throw Exception("bad road input data - bad thing definition, not enough fields");
+				}
+				break;
+
 			default:
 				// must not happen
 				throw Exception("internal error - bad parsing of road input data, unknown road object type at end of a row");
 			}
 
-			m_cur_obj = NULL;
+			m_have_cur_obj = false;
 			m_index = 0;
 		}
 
@@ -519,7 +1211,319 @@ void ReadRoadInputDataFromTableConfigStream(Io::InStream& in_stream, RoadFigureD
 			return true;
 		}
 
-	} road_data_reader(road_data);
+	} road_data_reader(road_data, line_numbers);
+
+	try {
+		Io::ReadTableConfigFromStream(in_stream, &road_data_reader);
+
+	} catch(Exception& e) {
+		if(road_data_reader.GetLineNumber() == 0) {
+			throw;
+		}
+
+		throw Exception(std::string(e.what()) + " on line " + std::to_string(road_data_reader.GetLineNumber()));
+	}
+}
+
+bool TryGetLevelNumber(const std::string& map_name, int& levelnum) {
+	// MAPxx - level number is xx
+	const std::string prefix("MAP");
+	if(   map_name.size() <= prefix.size() || map_name.size() > prefix.size() + 5
+	   || map_name.compare(0, prefix.size(), prefix) != 0
+	   || map_name.find_first_not_of("0123456789", prefix.size()) != std::string::npos)
+	{
+		return false;
+	}
+
+	levelnum = std::stoi(map_name.substr(prefix.size()));
+	return true;
+}
+
+std::string GetMapNameByLevelNumber(int levelnum) {
+	return (levelnum < 10) ? ("MAP0" + std::to_string(levelnum)) : ("MAP" + std::to_string(levelnum));
+}
+
+std::string GetVariantWadFilePath(const std::string& wad_file_path, size_t variant_index) {
+	// roads.wad - roads-1.wad, roads-2.wad, ...
+	const std::string suffix = "-" + std::to_string(variant_index + 1);
+	const size_t name_begin = wad_file_path.find_last_of("/\\");
+	const size_t ext_begin = wad_file_path.rfind('.');
+	if(ext_begin == std::string::npos || (name_begin != std::string::npos && ext_begin < name_begin)) {
+		return wad_file_path + suffix;
+	}
+
+	return wad_file_path.substr(0, ext_begin) + suffix + wad_file_path.substr(ext_begin);
+}
+
+bool OpenWadFile(const Io::TempOutputFile& wad_file, std::unique_ptr<Io::FileWadSink>& wad_sink) {
+	try {
+		wad_sink.reset(new Io::FileWadSink(wad_file.GetTempFilePath()));
+
+	} catch(std::exception& e) {
+		std::cout << "Error opening output WAD file '" << wad_file.GetFilePath() << "': " << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool OpenPk3File(const Io::TempOutputFile& pk3_file, std::ofstream& file_output) {
+	file_output.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+	try {
+		file_output.open(pk3_file.GetTempFilePath(), std::ios::binary);
+
+	} catch(std::exception& e) {
+		std::cout << "Error opening output PK3 file '" << pk3_file.GetFilePath() << "': " << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool WriteMapsToWad(Io::WadWriter& wad_writer,
+					const std::vector<Udmf::Map>& maps,
+					const StringArray& map_names,
+					const std::vector<Nodes::GlNodes>& maps_nodes,
+					const std::vector<Reject::RejectTable>& maps_rejects,
+					const std::vector<Blockmap::BlockGrid>& maps_blockmaps,
+					const std::vector<Udmf::HexenMapLumps>& maps_hexen_lumps,
+					size_t maps_begin,
+					size_t maps_end,
+					unsigned char float_precision,
+					bool compact)
+{
+	// put TEXTMAP with generated figures (and ZNODES, BLOCKMAP, REJECT if they are built) into the WAD file
+	// or Hexen format lumps of maps
+	const auto write_lump = [&wad_writer](const char* lump_name, const CharArray& data) {
+		wad_writer.StartLumpWriting(lump_name).write(data.data(), data.size());
+	};
+
+	try {
+		for(size_t mix=maps_begin; mix<maps_end && !maps_hexen_lumps.empty(); mix++) {
+			// the game finds lumps of Hexen format maps in this order; it reads GL nodes from SSECTORS lump
+			const Udmf::HexenMapLumps& hexen_lumps = maps_hexen_lumps[mix];
+			wad_writer.StartLumpWriting(map_names[mix]); // (empty marker lump)
+			write_lump("THINGS", hexen_lumps.things);
+			write_lump("LINEDEFS", hexen_lumps.linedefs);
+			write_lump("SIDEDEFS", hexen_lumps.sidedefs);
+			write_lump("VERTEXES", hexen_lumps.vertexes);
+			if(!maps_nodes.empty()) {
+				wad_writer.StartLumpWriting("SEGS"); // (empty lump)
+				Nodes::WriteNodesToStream(maps_nodes[mix], wad_writer.StartLumpWriting("SSECTORS"));
+				wad_writer.StartLumpWriting("NODES"); // (empty lump)
+			}
+			write_lump("SECTORS", hexen_lumps.sectors);
+			if(!maps_rejects.empty()) {
+				Reject::WriteRejectToStream(maps_rejects[mix], wad_writer.StartLumpWriting("REJECT"));
+			}
+			if(!maps_blockmaps.empty() && !maps_blockmaps[mix].words.empty()) {
+				Blockmap::WriteBlockmapToStream(maps_blockmaps[mix], wad_writer.StartLumpWriting("BLOCKMAP"));
+			}
+			write_lump("BEHAVIOR", hexen_lumps.behavior);
+		}
+
+		for(size_t mix=maps_begin; mix<maps_end && maps_hexen_lumps.empty(); mix++) {
+			wad_writer.StartLumpWriting(map_names[mix]); // (empty marker lump)
+			Udmf::WriteMapToStream(maps[mix], float_precision, wad_writer.StartLumpWriting("TEXTMAP"), compact);
+			if(!maps_nodes.empty()) {
+				Nodes::WriteNodesToStream(maps_nodes[mix], wad_writer.StartLumpWriting("ZNODES"));
+			}
+			if(!maps_blockmaps.empty() && !maps_blockmaps[mix].words.empty()) {
+				Blockmap::WriteBlockmapToStream(maps_blockmaps[mix], wad_writer.StartLumpWriting("BLOCKMAP"));
+			}
+			if(!maps_rejects.empty()) {
+				Reject::WriteRejectToStream(maps_rejects[mix], wad_writer.StartLumpWriting("REJECT"));
+			}
+			wad_writer.StartLumpWriting("ENDMAP"); // (empty marker lump)
+		}
 
-	Io::ReadTableConfigFromStream(in_stream, &road_data_reader);
-}
\ No newline at end of file
+	} catch(std::exception& e) {
+		std::cout << "Error writing map lumps to WAD file: " << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool FinishWadFile(Io::TempOutputFile& wad_file, Io::WadWriter& wad_writer, Io::FileWadSink& wad_sink) {
+	try {
+		wad_writer.FinishWriting();
+		wad_sink.Close();
+		wad_file.Commit();
+
+	} catch(Exception& e) {
+		std::cout << "Error writing WAD file '" + wad_file.GetFilePath() + "': " << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool WriteMapsToWadFile(const std::string& wad_file_path,
+						const std::vector<Udmf::Map>& maps,
+						const StringArray& map_names,
+						const std::vector<Nodes::GlNodes>& maps_nodes,
+						const std::vector<Reject::RejectTable>& maps_rejects,
+						const std::vector<Blockmap::BlockGrid>& maps_blockmaps,
+						const std::vector<Udmf::HexenMapLumps>& maps_hexen_lumps,
+						size_t maps_begin,
+						size_t maps_end,
+						unsigned char float_precision,
+						bool compact)
+{
+	Io::TempOutputFile wad_file(wad_file_path);
+	std::unique_ptr<Io::FileWadSink> wad_sink;
+	if(!OpenWadFile(wad_file, wad_sink)) {
+		return false;
+	}
+
+	Io::WadWriter wad_writer(*wad_sink);
+	if(!WriteMapsToWad(wad_writer, maps, map_names, maps_nodes, maps_rejects, maps_blockmaps, maps_hexen_lumps, maps_begin, maps_end, float_precision, compact)) {
+		return false;
+	}
+
+	return FinishWadFile(wad_file, wad_writer, *wad_sink);
+}
+
+bool BenchWadSinks(const std::string& wad_file_path,
+				   const std::vector<Udmf::Map>& maps,
+				   const StringArray& map_names,
+				   const std::vector<Nodes::GlNodes>& maps_nodes,
+				   const std::vector<Reject::RejectTable>& maps_rejects,
+				   const std::vector<Blockmap::BlockGrid>& maps_blockmaps,
+				   const std::vector<Udmf::HexenMapLumps>& maps_hexen_lumps,
+				   size_t maps_begin,
+				   size_t maps_end,
+				   unsigned char float_precision,
+				   bool compact,
+				   int runs)
+{
+	const Io::TempOutputFile bench_file(wad_file_path + ".bench");
+	const auto write_maps = [&](Io::WadSink& wad_sink) {
+		Io::WadWriter wad_writer(wad_sink);
+		if(!WriteMapsToWad(wad_writer, maps, map_names, maps_nodes, maps_rejects, maps_blockmaps, maps_hexen_lumps, maps_begin, maps_end, float_precision, compact)) {
+			return false;
+		}
+		wad_writer.FinishWriting();
+		return true;
+	};
+
+	// memory, file and memory-mapped file
+	std::chrono::duration<double, std::milli> durations[3];
+	CharArray wad_data;
+	try {
+		const std::chrono::steady_clock::time_point memory_start = std::chrono::steady_clock::now();
+		for(int i=0; i<runs; i++) {
+			Io::MemoryWadSink wad_sink(wad_data.size());
+			if(!write_maps(wad_sink)) {
+				return false;
+			}
+			wad_sink.TakeData(wad_data);
+		}
+		durations[0] = std::chrono::steady_clock::now() - memory_start;
+
+		const std::chrono::steady_clock::time_point file_start = std::chrono::steady_clock::now();
+		for(int i=0; i<runs; i++) {
+			Io::FileWadSink wad_sink(bench_file.GetTempFilePath());
+			if(!write_maps(wad_sink)) {
+				return false;
+			}
+			wad_sink.Close();
+		}
+		durations[1] = std::chrono::steady_clock::now() - file_start;
+
+		const std::chrono::steady_clock::time_point mapped_file_start = std::chrono::steady_clock::now();
+		for(int i=0; i<runs; i++) {
+			Io::MappedFileWadSink wad_sink(bench_file.GetTempFilePath(), wad_data.size());
+			if(!write_maps(wad_sink)) {
+				return false;
+			}
+			wad_sink.Close();
+		}
+		durations[2] = std::chrono::steady_clock::now() - mapped_file_start;
+
+		std::ifstream file_input(bench_file.GetTempFilePath(), std::ios::binary);
+		const CharArray file_data((std::istreambuf_iterator<char>(file_input)), std::istreambuf_iterator<char>());
+		if(file_data != wad_data) {
+			throw Exception("the memory-mapped file differs from the WAD written into memory");
+		}
+
+	} catch(std::exception& e) {
+		std::cout << "Error measuring WAD writing time: " << e.what() << std::endl;
+		return false;
+	}
+
+	std::cout << map_names[maps_begin] << ((maps_end - maps_begin > 1) ? ("-" + map_names[maps_end - 1]) : std::string())
+			  << " - WAD writing time: memory " << durations[0].count() / runs << " ms, file " << durations[1].count() / runs
+			  << " ms, memory-mapped file " << durations[2].count() / runs << " ms average over " << runs << " runs" << std::endl;
+	return true;
+}
+
+bool WriteMapsToPk3(Io::ZipWriter& zip_writer,
+					const std::vector<Udmf::Map>& maps,
+					const StringArray& map_names,
+					const std::vector<Nodes::GlNodes>& maps_nodes,
+					const std::vector<Reject::RejectTable>& maps_rejects,
+					const std::vector<Blockmap::BlockGrid>& maps_blockmaps,
+					const std::vector<Udmf::HexenMapLumps>& maps_hexen_lumps,
+					size_t maps_begin,
+					size_t maps_end,
+					unsigned char float_precision,
+					bool compact)
+{
+	// the game loads WAD files from "maps" directory of the archive as maps named by the files;
+	// the WAD of a map is collected in memory and compressed from there without copying
+	for(size_t mix=maps_begin; mix<maps_end; mix++) {
+		Io::MemoryWadSink wad_sink;
+		Io::WadWriter wad_writer(wad_sink);
+		if(!WriteMapsToWad(wad_writer, maps, map_names, maps_nodes, maps_rejects, maps_blockmaps, maps_hexen_lumps, mix, mix + 1, float_precision, compact)) {
+			return false;
+		}
+
+		try {
+			wad_writer.FinishWriting();
+			const CharArray& wad_data = wad_sink.GetData();
+			zip_writer.AddFile("maps/" + map_names[mix] + ".wad", wad_data.data(), wad_data.size());
+
+		} catch(std::exception& e) {
+			std::cout << "Error writing map " << map_names[mix] << " to PK3 file: " << e.what() << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FinishPk3File(Io::TempOutputFile& pk3_file, Io::ZipWriter& zip_writer, std::ofstream& file_output) {
+	try {
+		zip_writer.FinishWriting();
+		file_output.close();
+		pk3_file.Commit();
+
+	} catch(std::exception& e) {
+		std::cout << "Error writing PK3 file '" + pk3_file.GetFilePath() + "': " << e.what() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool WriteMapsToPk3File(const std::string& pk3_file_path,
+						const std::vector<Udmf::Map>& maps,
+						const StringArray& map_names,
+						const std::vector<Nodes::GlNodes>& maps_nodes,
+						const std::vector<Reject::RejectTable>& maps_rejects,
+						const std::vector<Blockmap::BlockGrid>& maps_blockmaps,
+						const std::vector<Udmf::HexenMapLumps>& maps_hexen_lumps,
+						size_t maps_begin,
+						size_t maps_end,
+						unsigned char float_precision,
+						bool compact)
+{
+	Io::TempOutputFile pk3_file(pk3_file_path);
+	std::ofstream file_output;
+	if(!OpenPk3File(pk3_file, file_output)) {
+		return false;
+	}
+
+	Io::ZipWriter zip_writer(file_output);
+	if(!WriteMapsToPk3(zip_writer, maps, map_names, maps_nodes, maps_rejects, maps_blockmaps, maps_hexen_lumps, maps_begin, maps_end, float_precision, compact)) {
+		return false;
+	}
+
+	return FinishPk3File(pk3_file, zip_writer, file_output);
+}
@@ -0,0 +1,810 @@
+
+#include "mapproc.h"
+#include "umath.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WeldVertices implementation
+
+namespace RoadGen {
+	namespace MapProc {
+		static bool VerticesHaveSameHeights(const Udmf::Vertex& v1, const Udmf::Vertex& v2) {
+			if(v1.have_zfloor != v2.have_zfloor || v1.have_zceiling != v2.have_zceiling) {
+				return false;
+			}
+
+			if(v1.have_zfloor && !Math::IsZeroOrCloseTo(v1.zfloor - v2.zfloor)) {
+				return false;
+			}
+
+			if(v1.have_zceiling && !Math::IsZeroOrCloseTo(v1.zceiling - v2.zceiling)) {
+				return false;
+			}
+
+			return true;
+		}
+
+		WeldResult WeldVertices(Udmf::Map& map, double tolerance) {
+			if(tolerance <= 0.0) {
+				throw Exception("error welding map vertices - tolerance must be positive");
+			}
+
+			WeldResult result;
+
+			std::vector<Udmf::Vertex>& vertices = map.vertices;
+			const unsigned int vertices_count = (unsigned int)vertices.size();
+
+			// the map is not changed if it has bad linedefs
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				if(map.linedefs[lix].v1 >= vertices_count || map.linedefs[lix].v2 >= vertices_count) {
+					throw Exception("error welding map vertices - linedef " + std::to_string(lix) + " references non-existing vertex");
+				}
+			}
+
+			// spatial hash: cell key -> first vertex in the cell,
+			// other vertices of the cell are linked through 'next_in_cell';
+			// only vertices which are kept in the map are put into the hash
+			std::unordered_map<unsigned long long, unsigned int> cells;
+			cells.reserve(vertices_count);
+			std::vector<unsigned int> next_in_cell(vertices_count, Udmf::ID_INVALID);
+
+			// map: old vertex id -> new vertex id
+			std::vector<unsigned int> new_ids(vertices_count, Udmf::ID_INVALID);
+
+			class Utils {
+			public:
+				long long GetCellCoord(double coord, double cell_size) {
+					return (long long)Math::Floor(coord / cell_size);
+				}
+
+				unsigned long long GetCellKey(long long cx, long long cy) {
+					return ((unsigned long long)cx << 32) ^ ((unsigned long long)cy & 0xFFFFFFFFull);
+				}
+
+				unsigned long long GetPairKey(unsigned int id1, unsigned int id2) {
+					return (id1 < id2) ? (((unsigned long long)id1 << 32) | id2) : (((unsigned long long)id2 << 32) | id1);
+				}
+
+				// sector of the sidedef, Udmf::ID_INVALID - no sidedef
+				unsigned int GetSideSector(const Udmf::Map& map, unsigned int sidedef) {
+					return (sidedef < map.sidedefs.size()) ? map.sidedefs[sidedef].sector : Udmf::ID_INVALID;
+				}
+			} utils;
+
+			const double tolerance_squared = tolerance * tolerance;
+			unsigned int kept_count = 0;
+			for(unsigned int vix=0; vix<vertices_count; vix++) {
+				const Udmf::Vertex& v = vertices[vix];
+				const long long cx = utils.GetCellCoord(v.x, tolerance);
+				const long long cy = utils.GetCellCoord(v.y, tolerance);
+
+				// look for a kept vertex in this cell and neighbor ones
+				unsigned int found_id = Udmf::ID_INVALID;
+				for(long long ncx=cx-1; ncx<=cx+1 && found_id == Udmf::ID_INVALID; ncx++) {
+					for(long long ncy=cy-1; ncy<=cy+1 && found_id == Udmf::ID_INVALID; ncy++) {
+						const auto cell_it = cells.find(utils.GetCellKey(ncx, ncy));
+						if(cell_it == cells.end()) {
+							continue;
+						}
+
+						for(unsigned int cvix=cell_it->second; cvix!=Udmf::ID_INVALID; cvix=next_in_cell[cvix]) {
+							const Udmf::Vertex& cv = vertices[cvix];
+							if(    Math::Get2DDistanceSquared(v.x, v.y, cv.x, cv.y) <= tolerance_squared
+								&& VerticesHaveSameHeights(v, cv))
+							{
+								found_id = cvix;
+								break;
+							}
+						}
+					}
+				}
+
+				if(found_id != Udmf::ID_INVALID) {
+					new_ids[vix] = new_ids[found_id];
+					result.merged_vertices++;
+					continue;
+				}
+
+				// keep the vertex
+				const auto cell_it = cells.find(utils.GetCellKey(cx, cy));
+				if(cell_it != cells.end()) {
+					next_in_cell[vix] = cell_it->second;
+					cell_it->second = vix;
+
+				} else {
+					cells[utils.GetCellKey(cx, cy)] = vix;
+				}
+
+				new_ids[vix] = kept_count++;
+			}
+
+			if(result.merged_vertices == 0) {
+				return result;
+			}
+
+			// compact vertices - kept vertices preserve their order
+			std::vector<Udmf::Vertex> kept_vertices;
+			kept_vertices.reserve(kept_count);
+			for(unsigned int vix=0; vix<vertices_count; vix++) {
+				if(new_ids[vix] == kept_vertices.size()) {
+					kept_vertices.push_back(vertices[vix]);
+				}
+			}
+			vertices.swap(kept_vertices);
+
+			// update linedefs, remove zero-length ones and duplicates with the same sectors on the same sides
+			// (merged seams of a sector drawn twice); other duplicates are kept
+			std::unordered_map<unsigned long long, size_t> linedef_ids;
+			linedef_ids.reserve(map.linedefs.size());
+			std::vector<bool> sidedef_is_used(map.sidedefs.size(), false);
+			size_t kept_linedefs_count = 0;
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				Udmf::Linedef l = map.linedefs[lix];
+				l.v1 = new_ids[l.v1];
+				l.v2 = new_ids[l.v2];
+				if(l.v1 == l.v2) {
+					result.removed_linedefs++;
+					continue;
+				}
+
+				const auto linedef_id_it = linedef_ids.find(utils.GetPairKey(l.v1, l.v2));
+				if(linedef_id_it != linedef_ids.end()) {
+					const Udmf::Linedef& kept_l = map.linedefs[linedef_id_it->second];
+					const unsigned int front_sector = utils.GetSideSector(map, l.sidefront), back_sector = utils.GetSideSector(map, l.sideback);
+					const unsigned int kept_front_sector = utils.GetSideSector(map, kept_l.sidefront), kept_back_sector = utils.GetSideSector(map, kept_l.sideback);
+					if(   (l.v1 == kept_l.v1 && front_sector == kept_front_sector && back_sector == kept_back_sector)
+					   || (l.v1 == kept_l.v2 && front_sector == kept_back_sector && back_sector == kept_front_sector))
+					{
+						result.removed_duplicate_linedefs++;
+						continue;
+					}
+					result.duplicate_linedefs++;
+
+				} else {
+					linedef_ids[utils.GetPairKey(l.v1, l.v2)] = kept_linedefs_count;
+				}
+
+				if(l.sidefront < sidedef_is_used.size()) {
+					sidedef_is_used[l.sidefront] = true;
+				}
+				if(l.sideback < sidedef_is_used.size()) {
+					sidedef_is_used[l.sideback] = true;
+				}
+
+				map.linedefs[kept_linedefs_count++] = l;
+			}
+			map.linedefs.resize(kept_linedefs_count);
+
+			if(result.removed_linedefs == 0 && result.removed_duplicate_linedefs == 0) {
+				return result;
+			}
+
+			// remove sidedefs of removed linedefs
+			std::vector<unsigned int> new_sidedef_ids(map.sidedefs.size(), Udmf::ID_INVALID);
+			size_t kept_sidedefs_count = 0;
+			for(size_t sdix=0; sdix<map.sidedefs.size(); sdix++) {
+				if(!sidedef_is_used[sdix]) {
+					continue;
+				}
+
+				new_sidedef_ids[sdix] = (unsigned int)kept_sidedefs_count;
+				map.sidedefs[kept_sidedefs_count++] = map.sidedefs[sdix];
+			}
+			map.sidedefs.resize(kept_sidedefs_count);
+
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				Udmf::Linedef& l = map.linedefs[lix];
+				l.sidefront = (l.sidefront < new_sidedef_ids.size()) ? new_sidedef_ids[l.sidefront] : l.sidefront;
+				l.sideback = (l.sideback < new_sidedef_ids.size()) ? new_sidedef_ids[l.sideback] : l.sideback;
+			}
+
+			return result;
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// VerifyTopology implementation
+
+namespace RoadGen {
+	namespace MapProc {
+		bool VerifyTopology(const Udmf::Map& map, unsigned char float_precision, StringArray& problems) {
+			const size_t problems_count_start = problems.size();
+
+			class Utils {
+			public:
+				unsigned long long GetPairKey(unsigned int id1, unsigned int id2) {
+					return ((unsigned long long)id1 << 32) | id2;
+				}
+
+				bool HaveZ(const Udmf::Vertex& v) {
+					return v.have_zfloor || v.have_zceiling;
+				}
+			} utils;
+
+			// sidedef references
+			for(size_t sdix=0; sdix<map.sidedefs.size(); sdix++) {
+				if(map.sidedefs[sdix].sector >= map.sectors.size()) {
+					problems.push_back("sidedef " + std::to_string(sdix) + " references non-existing sector " + std::to_string(map.sidedefs[sdix].sector));
+				}
+			}
+
+			// map: linedef vertices (smaller id first) -> first linedef connecting them
+			std::unordered_map<unsigned long long, size_t> linedef_ids;
+			linedef_ids.reserve(map.linedefs.size());
+
+			// map: sector and vertex -> outgoing sides minus incoming sides of the sector boundary at the vertex
+			std::unordered_map<unsigned long long, int> boundary_balances;
+			boundary_balances.reserve(map.linedefs.size() * 2);
+
+			// number of sides of each sector boundary
+			std::vector<unsigned int> sector_sides_counts(map.sectors.size(), 0);
+
+			// linedefs with valid references
+			std::vector<bool> linedef_is_valid(map.linedefs.size(), false);
+
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				const Udmf::Linedef& l = map.linedefs[lix];
+				const std::string linedef_str = "linedef " + std::to_string(lix);
+
+				bool is_valid = true;
+				if(l.v1 >= map.vertices.size() || l.v2 >= map.vertices.size()) {
+					problems.push_back(linedef_str + " references non-existing vertex " + std::to_string((l.v1 >= map.vertices.size()) ? l.v1 : l.v2));
+					is_valid = false;
+				}
+
+				if(l.sidefront >= map.sidedefs.size()) {
+					problems.push_back(linedef_str + " has no front sidedef or references non-existing sidedef " + std::to_string(l.sidefront));
+					is_valid = false;
+				}
+
+				const bool have_back = l.sideback != Udmf::ID_INVALID;
+				if(have_back && l.sideback >= map.sidedefs.size()) {
+					problems.push_back(linedef_str + " references non-existing sidedef " + std::to_string(l.sideback));
+					is_valid = false;
+				}
+
+				// bad sector references are reported for sidedefs
+				if(   is_valid
+				   && (   map.sidedefs[l.sidefront].sector >= map.sectors.size()
+					   || (have_back && map.sidedefs[l.sideback].sector >= map.sectors.size())))
+				{
+					is_valid = false;
+				}
+
+				if(l.twosided != have_back) {
+					problems.push_back(linedef_str + (l.twosided ? " is two-sided, but has one sidedef" : " is not two-sided, but has two sidedefs"));
+				}
+
+				if(!is_valid) {
+					continue;
+				}
+
+				const Udmf::Vertex& v1 = map.vertices[l.v1];
+				const Udmf::Vertex& v2 = map.vertices[l.v2];
+				if(   l.v1 == l.v2
+				   || (   Udmf::GetLoadedCoordinate(v1.x, float_precision) == Udmf::GetLoadedCoordinate(v2.x, float_precision)
+					   && Udmf::GetLoadedCoordinate(v1.y, float_precision) == Udmf::GetLoadedCoordinate(v2.y, float_precision)))
+				{
+					problems.push_back(linedef_str + " has zero length (vertices " + std::to_string(l.v1) + " and " + std::to_string(l.v2) + ")");
+				}
+
+				const unsigned long long vertices_key = (l.v1 < l.v2) ? utils.GetPairKey(l.v1, l.v2) : utils.GetPairKey(l.v2, l.v1);
+				const auto linedef_id_it = linedef_ids.find(vertices_key);
+				if(linedef_id_it != linedef_ids.end()) {
+					problems.push_back(linedef_str + " duplicates linedef " + std::to_string(linedef_id_it->second)
+									   + " (vertices " + std::to_string(l.v1) + " and " + std::to_string(l.v2) + ")");
+
+				} else {
+					linedef_ids[vertices_key] = lix;
+				}
+
+				// front side boundary goes from v1 to v2, back side one - from v2 to v1
+				const unsigned int sidedef_ids[] = { l.sidefront, l.sideback };
+				for(int i=0; i<_countof(sidedef_ids); i++) {
+					if(sidedef_ids[i] == Udmf::ID_INVALID) {
+						continue;
+					}
+
+					const unsigned int sector_id = map.sidedefs[sidedef_ids[i]].sector;
+					boundary_balances[utils.GetPairKey(sector_id, (i == 0) ? l.v1 : l.v2)]++;
+					boundary_balances[utils.GetPairKey(sector_id, (i == 0) ? l.v2 : l.v1)]--;
+					sector_sides_counts[sector_id]++;
+				}
+
+				linedef_is_valid[lix] = true;
+			}
+
+			// report problems in the order of linedefs, each sector and vertex pair once
+			std::unordered_set<unsigned int> triangular_z_vertices;
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				if(!linedef_is_valid[lix]) {
+					continue;
+				}
+
+				const Udmf::Linedef& l = map.linedefs[lix];
+				const unsigned int sidedef_ids[] = { l.sidefront, l.sideback };
+				const unsigned int vertex_ids[] = { l.v1, l.v2 };
+				for(int sdi=0; sdi<_countof(sidedef_ids); sdi++) {
+					if(sidedef_ids[sdi] == Udmf::ID_INVALID) {
+						continue;
+					}
+
+					const unsigned int sector_id = map.sidedefs[sidedef_ids[sdi]].sector;
+					for(int vi=0; vi<_countof(vertex_ids); vi++) {
+						const auto balance_it = boundary_balances.find(utils.GetPairKey(sector_id, vertex_ids[vi]));
+						if(balance_it != boundary_balances.end()) {
+							if(balance_it->second != 0) {
+								problems.push_back("sector " + std::to_string(sector_id) + " boundary is not closed at vertex " + std::to_string(vertex_ids[vi])
+												   + " (see linedef " + std::to_string(lix) + ")");
+							}
+							boundary_balances.erase(balance_it);
+						}
+
+						if(utils.HaveZ(map.vertices[vertex_ids[vi]]) && sector_sides_counts[sector_id] == 3) {
+							triangular_z_vertices.insert(vertex_ids[vi]);
+						}
+					}
+				}
+			}
+
+			// vertex heights work only in triangular sectors, other sectors of the vertex ignore them
+			for(size_t vix=0; vix<map.vertices.size(); vix++) {
+				if(utils.HaveZ(map.vertices[vix]) && triangular_z_vertices.find((unsigned int)vix) == triangular_z_vertices.end()) {
+					problems.push_back("vertex " + std::to_string(vix) + " has zfloor/zceiling set, but does not belong to any triangular sector");
+				}
+			}
+
+			return problems.size() == problems_count_start;
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// HalfEdgeMap implementation
+
+namespace RoadGen {
+	namespace MapProc {
+		HalfEdgeMap::HalfEdgeMap(const Udmf::Map& map)
+			: m_vertex_half_edges(map.vertices.size(), Udmf::ID_INVALID)
+			, m_sector_loops_begin(map.sectors.size() + 1, 0)
+		{
+			if(map.linedefs.size() > Udmf::ID_MAX / 2) {
+				throw Exception("error building half-edge map - too many linedefs");
+			}
+
+			class Utils {
+				const Udmf::Map& m_map;
+
+			public:
+				Utils(const Udmf::Map& map_)
+					: m_map(map_)
+				{}
+
+				unsigned int GetSectorOfSide(size_t lix, unsigned int sidedef) {
+					if(sidedef == Udmf::ID_INVALID) {
+						return Udmf::ID_INVALID;
+					}
+
+					if(sidedef >= m_map.sidedefs.size() || m_map.sidedefs[sidedef].sector >= m_map.sectors.size()) {
+						throw Exception("error building half-edge map - linedef " + std::to_string(lix) + " references non-existing sidedef or sector");
+					}
+
+					return m_map.sidedefs[sidedef].sector;
+				}
+			} utils(map);
+
+			// two half-edges per linedef
+			m_half_edges.resize(2 * map.linedefs.size());
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				const Udmf::Linedef& l = map.linedefs[lix];
+				if(l.v1 >= map.vertices.size() || l.v2 >= map.vertices.size()) {
+					throw Exception("error building half-edge map - linedef " + std::to_string(lix) + " references non-existing vertex");
+				}
+
+				if(l.sidefront == Udmf::ID_INVALID) {
+					throw Exception("error building half-edge map - linedef " + std::to_string(lix) + " has no front sidedef");
+				}
+
+				HalfEdge& front = m_half_edges[GetLinedefHalfEdge((unsigned int)lix, true)];
+				front.origin = l.v1;
+				front.linedef = (unsigned int)lix;
+				front.sidedef = l.sidefront;
+				front.sector = utils.GetSectorOfSide(lix, l.sidefront);
+
+				HalfEdge& back = m_half_edges[GetLinedefHalfEdge((unsigned int)lix, false)];
+				back.origin = l.v2;
+				back.linedef = (unsigned int)lix;
+				back.sidedef = l.sideback;
+				back.sector = utils.GetSectorOfSide(lix, l.sideback);
+			}
+
+			// group half-edges by their origins (counting sort)
+			std::vector<size_t> vertex_half_edges_begin(map.vertices.size() + 1, 0);
+			for(size_t hix=0; hix<m_half_edges.size(); hix++) {
+				vertex_half_edges_begin[m_half_edges[hix].origin + 1]++;
+			}
+
+			for(size_t vix=0; vix<map.vertices.size(); vix++) {
+				vertex_half_edges_begin[vix + 1] += vertex_half_edges_begin[vix];
+			}
+
+			std::vector<unsigned int> vertex_half_edges(m_half_edges.size());
+			{
+				std::vector<size_t> vertex_half_edges_end(vertex_half_edges_begin.begin(), vertex_half_edges_begin.end() - 1);
+				for(size_t hix=0; hix<m_half_edges.size(); hix++) {
+					vertex_half_edges[vertex_half_edges_end[m_half_edges[hix].origin]++] = (unsigned int)hix;
+				}
+			}
+
+			std::vector<double> half_edge_angles(m_half_edges.size());
+			for(size_t hix=0; hix<m_half_edges.size(); hix++) {
+				const Udmf::Vertex& v_origin = map.vertices[m_half_edges[hix].origin];
+				const Udmf::Vertex& v_destination = map.vertices[GetDestination((unsigned int)hix)];
+				half_edge_angles[hix] = Math::Atan2(v_destination.y - v_origin.y, v_destination.x - v_origin.x);
+			}
+
+			// sort half-edges counter-clockwise around each vertex, the boundary loop coming
+			// into the vertex by a half-edge twin continues by the next half-edge counter-clockwise
+			for(size_t vix=0; vix<map.vertices.size(); vix++) {
+				const auto begin = vertex_half_edges.begin() + vertex_half_edges_begin[vix];
+				const auto end = vertex_half_edges.begin() + vertex_half_edges_begin[vix + 1];
+				if(begin == end) {
+					continue;
+				}
+
+				std::sort(begin, end, [&half_edge_angles](unsigned int h1, unsigned int h2) {
+					return half_edge_angles[h1] < half_edge_angles[h2];
+				});
+
+				m_vertex_half_edges[vix] = *begin;
+				for(auto it=begin; it!=end; ++it) {
+					const unsigned int h_in = GetTwin(*it);
+					const unsigned int h_out = ((it + 1) != end) ? *(it + 1) : *begin;
+					m_half_edges[h_in].next = h_out;
+					m_half_edges[h_out].prev = h_in;
+				}
+			}
+
+			// collect boundary loops, each half-edge belongs to exactly one loop
+			std::vector<bool> half_edge_is_visited(m_half_edges.size(), false);
+			std::vector< std::pair<unsigned int, unsigned int> > sector_loops;
+			for(size_t hix=0; hix<m_half_edges.size(); hix++) {
+				if(half_edge_is_visited[hix]) {
+					continue;
+				}
+
+				for(unsigned int h=(unsigned int)hix; h!=Udmf::ID_INVALID && !half_edge_is_visited[h]; h=m_half_edges[h].next) {
+					half_edge_is_visited[h] = true;
+				}
+
+				const unsigned int sector = m_half_edges[hix].sector;
+				if(sector != Udmf::ID_INVALID) {
+					sector_loops.push_back(std::make_pair(sector, (unsigned int)hix));
+					m_sector_loops_begin[sector + 1]++;
+				}
+			}
+
+			for(size_t six=0; six<map.sectors.size(); six++) {
+				m_sector_loops_begin[six + 1] += m_sector_loops_begin[six];
+			}
+
+			m_sector_loops.resize(sector_loops.size());
+			std::vector<size_t> sector_loops_end(m_sector_loops_begin.begin(), m_sector_loops_begin.end() - 1);
+			for(size_t lpix=0; lpix<sector_loops.size(); lpix++) {
+				m_sector_loops[sector_loops_end[sector_loops[lpix].first]++] = sector_loops[lpix].second;
+			}
+		}
+
+		void HalfEdgeMap::WriteToMap(Udmf::Map& map) const {
+			if(2 * map.linedefs.size() != m_half_edges.size()) {
+				throw Exception("error writing half-edge map - the map does not match the view");
+			}
+
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				const HalfEdge& front = m_half_edges[GetLinedefHalfEdge((unsigned int)lix, true)];
+				const HalfEdge& back = m_half_edges[GetLinedefHalfEdge((unsigned int)lix, false)];
+				if(   front.origin >= map.vertices.size() || back.origin >= map.vertices.size()
+				   || front.sidedef >= map.sidedefs.size() || (back.sidedef != Udmf::ID_INVALID && back.sidedef >= map.sidedefs.size()))
+				{
+					throw Exception("error writing half-edge map - linedef " + std::to_string(lix) + " references non-existing vertex or sidedef");
+				}
+
+				Udmf::Linedef& l = map.linedefs[lix];
+				l.v1 = front.origin;
+				l.v2 = back.origin;
+				l.sidefront = front.sidedef;
+				l.sideback = back.sidedef;
+				l.twosided = back.sidedef != Udmf::ID_INVALID;
+
+				map.sidedefs[front.sidedef].sector = front.sector;
+				if(back.sidedef != Udmf::ID_INVALID) {
+					map.sidedefs[back.sidedef].sector = back.sector;
+				}
+			}
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MapPass implementations, MapPassManager implementation
+
+namespace RoadGen {
+	namespace MapProc {
+		class WeldMapPass: public MapPass {
+			const double m_tolerance;
+
+		public:
+			explicit WeldMapPass(double tolerance)
+				: m_tolerance(tolerance)
+			{}
+
+			const char* GetName() const {
+				return "weld";
+			}
+
+			unsigned int GetReadSet() const {
+				return enMapElements_Vertices | enMapElements_Linedefs | enMapElements_Sidedefs;
+			}
+
+			unsigned int GetWriteSet() const {
+				return enMapElements_Vertices | enMapElements_Linedefs | enMapElements_Sidedefs;
+			}
+
+			std::string Run(Udmf::Map& map) {
+				const WeldResult weld_result = WeldVertices(map, m_tolerance);
+				return std::to_string(weld_result.merged_vertices) + " vertices merged, "
+					   + std::to_string(weld_result.removed_linedefs) + " zero-length linedefs removed, "
+					   + std::to_string(weld_result.removed_duplicate_linedefs) + " duplicate linedefs removed, "
+					   + std::to_string(weld_result.duplicate_linedefs) + " duplicate linedefs with other sides kept";
+			}
+		};
+
+		class StatsMapPass: public MapPass {
+		public:
+			const char* GetName() const {
+				return "stats";
+			}
+
+			unsigned int GetReadSet() const {
+				return enMapElements_All;
+			}
+
+			unsigned int GetWriteSet() const {
+				return enMapElements_None;
+			}
+
+			std::string Run(Udmf::Map& map) {
+				const HalfEdgeMap half_edge_map(map);
+
+				size_t loops_count = 0;
+				size_t sectors_with_holes_count = 0;
+				for(unsigned int six=0; six<map.sectors.size(); six++) {
+					const size_t sector_loops_count = half_edge_map.GetSectorLoopsCount(six);
+					loops_count += sector_loops_count;
+					if(sector_loops_count > 1) {
+						sectors_with_holes_count++;
+					}
+				}
+
+				return   std::to_string(map.vertices.size()) + " vertices, "
+					   + std::to_string(map.linedefs.size()) + " linedefs, "
+					   + std::to_string(map.sidedefs.size()) + " sidedefs, "
+					   + std::to_string(map.sectors.size()) + " sectors ("
+					   + std::to_string(loops_count) + " boundary loops, " + std::to_string(sectors_with_holes_count) + " sectors with holes), "
+					   + std::to_string(map.things.size() + (map.have_player_start ? 1 : 0)) + " things; "
+					   + GetSectorSizesReport(map);
+			}
+
+		private:
+			// distribution of numbers of linedefs per sector (the engine goes through sector linedefs
+			// for lighting, sound and specials): counts of sectors in ranges of sizes by powers of 4 and the largest size
+			static std::string GetSectorSizesReport(const Udmf::Map& map) {
+				std::vector<unsigned int> sector_linedefs_counts(map.sectors.size(), 0);
+				for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+					const Udmf::Linedef& l = map.linedefs[lix];
+					const unsigned int id_s_front = (l.sidefront < map.sidedefs.size()) ? map.sidedefs[l.sidefront].sector : Udmf::ID_INVALID;
+					const unsigned int id_s_back = (l.sideback < map.sidedefs.size()) ? map.sidedefs[l.sideback].sector : Udmf::ID_INVALID;
+					if(id_s_front < sector_linedefs_counts.size()) {
+						sector_linedefs_counts[id_s_front]++;
+					}
+					if(id_s_back < sector_linedefs_counts.size() && id_s_back != id_s_front) {
+						sector_linedefs_counts[id_s_back]++;
+					}
+				}
+
+				// ranges: 1-16, 17-64, 65-256, 257-1024, 1025+
+				const unsigned int RANGE_ENDS[] = { 16, 64, 256, 1024 };
+				size_t range_sectors_counts[_countof(RANGE_ENDS) + 1] = {};
+				unsigned int linedefs_count_max = 0;
+				for(size_t six=0; six<sector_linedefs_counts.size(); six++) {
+					const unsigned int linedefs_count = sector_linedefs_counts[six];
+					size_t rix = 0;
+					while(rix < _countof(RANGE_ENDS) && linedefs_count > RANGE_ENDS[rix]) {
+						rix++;
+					}
+					range_sectors_counts[rix]++;
+					linedefs_count_max = (linedefs_count > linedefs_count_max) ? linedefs_count : linedefs_count_max;
+				}
+
+				std::string report = "sector sizes (linedefs):";
+				for(size_t rix=0; rix<_countof(range_sectors_counts); rix++) {
+					const unsigned int range_start = (rix == 0) ? 1 : (RANGE_ENDS[rix - 1] + 1);
+					report +=   " " + std::to_string(range_start)
+							  + ((rix < _countof(RANGE_ENDS)) ? ("-" + std::to_string(RANGE_ENDS[rix])) : std::string("+"))
+							  + ": " + std::to_string(range_sectors_counts[rix]) + ",";
+				}
+				return report + " max " + std::to_string(linedefs_count_max);
+			}
+		};
+
+		class VerifyMapPass: public MapPass {
+			const unsigned char m_float_precision;
+
+		public:
+			explicit VerifyMapPass(unsigned char float_precision)
+				: m_float_precision(float_precision)
+			{}
+
+			const char* GetName() const {
+				return "verify";
+			}
+
+			unsigned int GetReadSet() const {
+				return enMapElements_Vertices | enMapElements_Linedefs | enMapElements_Sidedefs | enMapElements_Sectors;
+			}
+
+			unsigned int GetWriteSet() const {
+				return enMapElements_None;
+			}
+
+			std::string Run(Udmf::Map& map) {
+				StringArray problems;
+				if(!VerifyTopology(map, m_float_precision, problems)) {
+					std::string message = std::to_string(problems.size()) + " problem(s) found:";
+					for(size_t pix=0; pix<problems.size(); pix++) {
+						message += "\n  " + problems[pix];
+					}
+					throw Exception(message);
+				}
+
+				return "no problems found";
+			}
+		};
+
+		std::unique_ptr<MapPass> CreateMapPass(const std::string& name, const MapPassOptions& options) {
+			if(name == "weld") {
+				return std::unique_ptr<MapPass>(new WeldMapPass(options.weld_tolerance));
+
+			} else if(name == "stats") {
+				return std::unique_ptr<MapPass>(new StatsMapPass());
+
+			} else if(name == "verify") {
+				return std::unique_ptr<MapPass>(new VerifyMapPass(options.float_precision));
+			}
+
+			return std::unique_ptr<MapPass>();
+		}
+
+		void GetMapPassNames(const Io::ConfigData& config_data, StringArray& pass_names) {
+			pass_names.clear();
+
+			const auto map_passes_it = config_data.find("MapPasses");
+			if(map_passes_it == config_data.end()) {
+				return;
+			}
+
+			// entries go in the order of the config file
+			const Io::ConfigDataEntryArray& entries = map_passes_it->second;
+			for(size_t eix=0; eix<entries.size(); eix++) {
+				if(    !entries[eix].name.empty()
+					|| entries[eix].fields.size() != 1
+					|| !entries[eix].fields[0].name.empty()
+					|| entries[eix].fields[0].field_type != Io::ConfigDataEntry::Field::enType_String)
+				{
+					throw Exception("bad road config - bad value of 'MapPasses' setting, must be a list of pass names (strings)");
+				}
+
+				pass_names.push_back(entries[eix].fields[0].value_string);
+			}
+		}
+
+		void MapPassManager::AddPass(std::unique_ptr<MapPass> pass) {
+			if(!pass) {
+				throw Exception("error adding a map pass - no pass");
+			}
+
+			m_passes.push_back(std::move(pass));
+		}
+
+		void MapPassManager::Run(Udmf::Map& map, std::vector<MapPassResult>& results) const {
+			results.clear();
+			results.resize(m_passes.size());
+
+			class Utils {
+			public:
+				bool PassesAreIndependent(const MapPass& pass1, const MapPass& pass2) {
+					return    (pass1.GetWriteSet() & (pass2.GetReadSet() | pass2.GetWriteSet())) == 0
+						   && (pass2.GetWriteSet() & (pass1.GetReadSet() | pass1.GetWriteSet())) == 0;
+				}
+
+				void RunPass(MapPass& pass, Udmf::Map& map, MapPassResult& result, std::exception_ptr& error) {
+					const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+					try {
+						result.report = pass.Run(map);
+
+					} catch(...) {
+						error = std::current_exception();
+					}
+					const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+					result.pass_name = pass.GetName();
+					result.duration_ms = duration.count();
+				}
+			} utils;
+
+			size_t group_begin = 0;
+			while(group_begin < m_passes.size()) {
+				// collect the group of independent passes
+				size_t group_end = group_begin + 1;
+				for(; group_end<m_passes.size(); group_end++) {
+					bool is_independent = true;
+					for(size_t pix=group_begin; pix<group_end && is_independent; pix++) {
+						is_independent = utils.PassesAreIndependent(*m_passes[pix], *m_passes[group_end]);
+					}
+
+					if(!is_independent) {
+						break;
+					}
+				}
+
+				// the first pass of the group runs in this thread
+				std::vector<std::exception_ptr> errors(group_end - group_begin);
+				std::vector<std::thread> threads;
+				for(size_t pix=group_begin+1; pix<group_end; pix++) {
+					threads.push_back(std::thread(&Utils::RunPass, &utils, std::ref(*m_passes[pix]), std::ref(map),
+												  std::ref(results[pix]), std::ref(errors[pix - group_begin])));
+				}
+				utils.RunPass(*m_passes[group_begin], map, results[group_begin], errors[0]);
+				for(size_t thix=0; thix<threads.size(); thix++) {
+					threads[thix].join();
+				}
+
+				for(size_t eix=0; eix<errors.size(); eix++) {
+					if(!errors[eix]) {
+						continue;
+					}
+
+					std::string error_message;
+					try {
+						std::rethrow_exception(errors[eix]);
+
+					} catch(std::exception& e) {
+						error_message = "map pass '" + results[group_begin + eix].pass_name + "' failed - " + e.what();
+					}
+
+					// keep the results of the passes, that have finished successfully
+					std::vector<MapPassResult> finished_results(results.begin(), results.begin() + group_begin);
+					for(size_t pix=group_begin; pix<group_end; pix++) {
+						if(!errors[pix - group_begin]) {
+							finished_results.push_back(results[pix]);
+						}
+					}
+					results.swap(finished_results);
+
+					throw Exception(error_message);
+				}
+
+				group_begin = group_end;
+			}
+		}
+	}
+}
@@ -0,0 +1,255 @@
+
+// post-processing of generated UDMF maps - transformations and checks
+// that work on the whole map after road generation
+
+#ifndef _ROAD_GEN_MAPPROC_H_
+#define _ROAD_GEN_MAPPROC_H_
+
+#include "common.h"
+#include "udmf.h"
+#include "io.h"
+
+#include <memory>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WeldVertices - merges coincident vertices of the map
+
+namespace RoadGen {
+	namespace MapProc {
+		struct WeldResult {
+			// number of vertices removed from the map (merged into other ones)
+			unsigned int merged_vertices;
+
+			// number of linedefs removed from the map because both of their vertices were merged into one
+			unsigned int removed_linedefs;
+
+			// number of linedefs removed from the map because they connect the same vertices as another linedef
+			// and have the same sectors on the same sides
+			unsigned int removed_duplicate_linedefs;
+
+			// number of kept linedefs, that connect the same vertices as another linedef, but have other sectors
+			// on their sides (the map does not pass VerifyTopology)
+			unsigned int duplicate_linedefs;
+
+			WeldResult()
+				: merged_vertices(0)
+				, removed_linedefs(0)
+				, removed_duplicate_linedefs(0)
+				, duplicate_linedefs(0)
+			{}
+		};
+
+		// merge vertices located closer than 'tolerance' to each other (uses spatial hash with cell size
+		// equal to 'tolerance'); vertices are merged only if they have the same zfloor and zceiling settings;
+		// linedefs are updated to reference merged vertices, zero-length linedefs and duplicates of other linedefs
+		// with the same sectors on the same sides are removed with their sidedefs; the map is not changed
+		// if an exception is thrown
+		WeldResult WeldVertices(Udmf::Map& map, double tolerance);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// VerifyTopology - checks that the map is correctly linked
+
+namespace RoadGen {
+	namespace MapProc {
+		// check the map in linear time (hash maps keyed by element ids), put all found problems
+		// with element ids into 'problems'; checks are:
+		//  - linedefs and sidedefs reference existing elements;
+		//  - 'twosided' flag of a linedef matches the number of its sidedefs;
+		//  - there are no zero-length linedefs (vertices at the same coordinates as the game loads them from TEXTMAP
+		//    written with 'float_precision', see Udmf::GetLoadedCoordinate) and no linedefs connecting the same vertices twice;
+		//  - boundary of each sector forms closed loops (for each vertex of a sector boundary
+		//    the number of incoming sides equals the number of outgoing ones);
+		//  - vertices with 'zfloor' or 'zceiling' set belong to triangular sectors (at least one of the vertex sectors
+		//    must be triangular - vertex heights are ignored by other sectors);
+		// returns 'true' if there are no problems
+		bool VerifyTopology(const Udmf::Map& map, unsigned char float_precision, StringArray& problems);
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// HalfEdgeMap - half-edge (DCEL) adjacency view of the map topology; each linedef gives two half-edges:
+// front one goes from v1 to v2, back one - from v2 to v1; the sector of a half-edge is on its right
+// (as the front sidedef in Doom maps), half-edges of one-sided linedefs' back sides have no sector
+
+namespace RoadGen {
+	namespace MapProc {
+		class HalfEdgeMap {
+		public:
+			struct HalfEdge {
+				// start vertex
+				unsigned int origin;
+
+				unsigned int linedef;
+
+				// ID_INVALID - the side is out of the map
+				unsigned int sidedef;
+				unsigned int sector;
+
+				// neighbor half-edges of the boundary loop, ID_INVALID - the loop is broken
+				unsigned int next, prev;
+
+				HalfEdge()
+					: origin(Udmf::ID_INVALID)
+					, linedef(Udmf::ID_INVALID)
+					, sidedef(Udmf::ID_INVALID)
+					, sector(Udmf::ID_INVALID)
+					, next(Udmf::ID_INVALID)
+					, prev(Udmf::ID_INVALID)
+				{}
+			};
+
+		public:
+			// build the view in O(n log d) time, d - the largest number of linedefs at a vertex
+			// (half-edges are sorted by angle around each vertex); throws if the map references non-existing elements
+			explicit HalfEdgeMap(const Udmf::Map& map);
+
+			size_t GetHalfEdgesCount() const {
+				return m_half_edges.size();
+			}
+
+			const HalfEdge& GetHalfEdge(unsigned int half_edge) const {
+				return m_half_edges[half_edge];
+			}
+
+			// half-edges may be changed (vertices, sides, sectors) and written back with WriteToMap;
+			// navigation data (next/prev, vertex and sector half-edges) is not updated - build a new view for that
+			HalfEdge& GetHalfEdge(unsigned int half_edge) {
+				return m_half_edges[half_edge];
+			}
+
+			static unsigned int GetLinedefHalfEdge(unsigned int linedef, bool front) {
+				return 2 * linedef + (front ? 0 : 1);
+			}
+
+			// the other half-edge of the same linedef
+			static unsigned int GetTwin(unsigned int half_edge) {
+				return half_edge ^ 1u;
+			}
+
+			unsigned int GetDestination(unsigned int half_edge) const {
+				return m_half_edges[GetTwin(half_edge)].origin;
+			}
+
+			// any half-edge going from the vertex, ID_INVALID - no linedefs at the vertex
+			unsigned int GetVertexHalfEdge(unsigned int vertex) const {
+				return m_vertex_half_edges[vertex];
+			}
+
+			// next half-edge going from the same vertex counter-clockwise
+			unsigned int GetNextAroundVertex(unsigned int half_edge) const {
+				return m_half_edges[GetTwin(half_edge)].next;
+			}
+
+			// number of boundary loops of the sector (outer bound and holes)
+			size_t GetSectorLoopsCount(unsigned int sector) const {
+				return m_sector_loops_begin[sector + 1] - m_sector_loops_begin[sector];
+			}
+
+			// any half-edge of the sector boundary loop
+			unsigned int GetSectorLoop(unsigned int sector, size_t loop_index) const {
+				return m_sector_loops[m_sector_loops_begin[sector] + loop_index];
+			}
+
+			// write linedef vertices and sidedefs, sidedef sectors back to the map the view is built from
+			void WriteToMap(Udmf::Map& map) const;
+
+		private:
+			std::vector<HalfEdge> m_half_edges;
+			std::vector<unsigned int> m_vertex_half_edges;
+
+			// sector loops of the sector 's' are [m_sector_loops_begin[s], m_sector_loops_begin[s + 1]) in m_sector_loops
+			std::vector<size_t> m_sector_loops_begin;
+			std::vector<unsigned int> m_sector_loops;
+		};
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MapPass - a post-processing step over a generated map (weld, stats, verify); MapPassManager runs passes
+// in the given order, consecutive passes with independent read/write sets run concurrently
+
+namespace RoadGen {
+	namespace MapProc {
+		// map element sets - flags for read/write sets of passes
+		enum EnMapElements {
+			enMapElements_None = 0,
+			enMapElements_Vertices = 1 << 0,
+			enMapElements_Linedefs = 1 << 1,
+			enMapElements_Sidedefs = 1 << 2,
+			enMapElements_Sectors = 1 << 3,
+			enMapElements_Things = 1 << 4,
+
+			enMapElements_All = enMapElements_Vertices | enMapElements_Linedefs | enMapElements_Sidedefs | enMapElements_Sectors | enMapElements_Things
+		};
+
+		class MapPass {
+		public:
+			virtual ~MapPass() {}
+
+			virtual const char* GetName() const = 0;
+
+			// map elements (EnMapElements flags) the pass reads and writes
+			virtual unsigned int GetReadSet() const = 0;
+			virtual unsigned int GetWriteSet() const = 0;
+
+			// process the map, elements out of the write set must not be changed;
+			// returns a short report for the user, throws on errors
+			virtual std::string Run(Udmf::Map& map) = 0;
+		};
+
+		struct MapPassOptions {
+			// see WeldVertices
+			double weld_tolerance;
+
+			// see VerifyTopology
+			unsigned char float_precision;
+
+			MapPassOptions()
+				: weld_tolerance(0.001)
+				, float_precision(3)
+			{}
+		};
+
+		// create a pass by its name: "weld", "stats" or "verify"; returns NULL for unknown names
+		std::unique_ptr<MapPass> CreateMapPass(const std::string& name, const MapPassOptions& options);
+
+		// read pass names from 'MapPasses' road config setting (a list of strings), leave 'pass_names' empty if there is no setting
+		void GetMapPassNames(const Io::ConfigData& config_data, StringArray& pass_names);
+
+		struct MapPassResult {
+			std::string pass_name;
+			std::string report;
+			double duration_ms;
+
+			MapPassResult()
+				: duration_ms(0.0)
+			{}
+		};
+
+		class MapPassManager {
+		public:
+			void AddPass(std::unique_ptr<MapPass> pass);
+
+			bool IsEmpty() const {
+				return m_passes.empty();
+			}
+
+			// run passes over the map in the order they were added; a group of consecutive passes, which do not write
+			// elements read or written by each other, runs concurrently; results are put in the order of passes;
+			// throws the error of the first failed pass after its group is finished, 'results' keep the results
+			// of the passes finished successfully before that (including ones of the failed group)
+			void Run(Udmf::Map& map, std::vector<MapPassResult>& results) const;
+
+		private:
+			std::vector< std::unique_ptr<MapPass> > m_passes;
+		};
+	}
+}
+
+#endif // _ROAD_GEN_MAPPROC_H_
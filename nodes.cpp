@@ -0,0 +1,954 @@
+
+#include "nodes.h"
+#include "umath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BuildNodes implementation
+
+namespace RoadGen {
+	namespace Nodes {
+		// points closer to a line than that are on the line (more than the distance of a split point rounded
+		// to fixed point coordinates from the partition - all points of the tree are rounded, as ZNODES stores them)
+		static const double ON_LINE_DISTANCE = 1.0 / 8192;
+
+		// fixed point numbers (16.16) of ZNODES
+		static const double FIXED_POINT_SCALE = 65536.0;
+
+		// partition lines passing closer to seg ends (but not through them) are penalized as splits
+		static const double NEAR_MISS_DISTANCE = 1.0 / 32;
+
+		// segs closer than that to an edge of the subsector polygon lie on it (ends of segs are rounded to fixed point
+		// coordinates, corners of polygons are not), minisegs shorter than that are removed
+		static const double EDGE_MATCH_DISTANCE = 1.0 / 128;
+
+		// a split seg costs as much as that number of segs of imbalance between partition sides
+		static const size_t PARTITION_SPLIT_COST = 8;
+
+		// maximum number of segs tried as partitions, segs are sampled evenly; all segs are tried only if none
+		// of the sampled ones divides segs (there are no other segs in the subsector then)
+		static const size_t PARTITION_CANDIDATES_MAX = 64;
+
+		// side regions of a partition thinner than that may not have segs (a bit more than a seg end rounded
+		// to fixed point coordinates may be off its line, and close polygon points are merged)
+		static const double SLIVER_REGION_WIDTH = 2 * ON_LINE_DISTANCE;
+
+		// subtrees with fewer segs are not worth a thread
+		static const size_t PARALLEL_SUBTREE_SEGS_MIN = 2048;
+
+		// map coordinates limit of fixed point numbers
+		static const double COORDINATE_MAX = 32767.0;
+
+		// the value rounded to fixed point numbers
+		static double GetFixedPointValue(double value) {
+			return std::round(value * FIXED_POINT_SCALE) / FIXED_POINT_SCALE;
+		}
+
+		struct BuildPoint {
+			double x, y;
+
+			// map vertex at the point, ID_NONE - new vertex
+			uint32_t vertex;
+
+			BuildPoint()
+				: x(0.0)
+				, y(0.0)
+				, vertex(ID_NONE)
+			{}
+
+			BuildPoint(double x_, double y_, uint32_t vertex_)
+				: x(x_)
+				, y(y_)
+				, vertex(vertex_)
+			{}
+		};
+
+		// line through the point (x, y) with the direction (dx, dy); the right side of it is the front one
+		struct BuildLine {
+			double x, y, dx, dy;
+			double length;
+
+			BuildLine()
+				: x(0.0)
+				, y(0.0)
+				, dx(0.0)
+				, dy(0.0)
+				, length(0.0)
+			{}
+
+			BuildLine(const BuildPoint& p1, const BuildPoint& p2)
+				: x(p1.x)
+				, y(p1.y)
+				, dx(p2.x - p1.x)
+				, dy(p2.y - p1.y)
+				, length(Math::Get2DDistance(p1.x, p1.y, p2.x, p2.y))
+			{}
+
+			// signed distance from the line to the point: negative - front side, positive - back side
+			double GetDistance(double px, double py) const {
+				return (dx * (py - y) - dy * (px - x)) / length;
+			}
+
+			// position of the point projection on the line
+			double GetProjection(double px, double py) const {
+				return (dx * (px - x) + dy * (py - y)) / length;
+			}
+		};
+
+		struct BuildSeg {
+			BuildPoint p1, p2;
+
+			// ID_NONE - miniseg
+			uint32_t linedef;
+			uint8_t side;
+
+			// the whole line of the linedef side the seg is a part of - partition lines and subsector bounds
+			// are taken from it, since the direction of a short piece of a split seg is not precise
+			BuildLine line;
+
+			// 'false' if the line does not divide segs of a subtree the seg is in - it does not divide segs
+			// of its subtrees either
+			bool is_partition_candidate;
+
+			BuildSeg()
+				: linedef(ID_NONE)
+				, side(0)
+				, is_partition_candidate(true)
+			{}
+
+			BuildSeg(const BuildPoint& p1_, const BuildPoint& p2_, uint32_t linedef_, uint8_t side_, const BuildLine& line_)
+				: p1(p1_)
+				, p2(p2_)
+				, linedef(linedef_)
+				, side(side_)
+				, line(line_)
+				, is_partition_candidate(true)
+			{}
+		};
+
+		typedef std::vector<BuildSeg> BuildSegArray;
+
+		// convex polygon, points go clockwise
+		typedef std::vector<BuildPoint> BuildPolygon;
+
+		struct BuildBox {
+			double top, bottom, left, right;
+
+			BuildBox()
+				: top(-COORDINATE_MAX)
+				, bottom(COORDINATE_MAX)
+				, left(COORDINATE_MAX)
+				, right(-COORDINATE_MAX)
+			{}
+
+			void Add(double x, double y) {
+				top = std::max(top, y);
+				bottom = std::min(bottom, y);
+				left = std::min(left, x);
+				right = std::max(right, x);
+			}
+
+			void Add(const BuildBox& box) {
+				Add(box.left, box.top);
+				Add(box.right, box.bottom);
+			}
+		};
+
+		// node of the tree being built: a node with a partition line and two children or a subsector
+		struct BuildTreeNode {
+			BuildLine partition;
+
+			// NULL for subsectors
+			std::unique_ptr<BuildTreeNode> children[2];
+
+			// closed loop of subsector segs - a seg ends at the start of the next one
+			BuildSegArray segs;
+
+			BuildBox box;
+		};
+
+		class NodesBuilder {
+		public:
+			// build the tree for 'segs' in the convex 'region', 'segs' are consumed
+			static std::unique_ptr<BuildTreeNode> BuildSubtree(BuildSegArray& segs, const BuildPolygon& region, unsigned int parallel_depth) {
+				std::unique_ptr<BuildTreeNode> tree_node(new BuildTreeNode());
+
+				// a partition, that leaves segs in a side region thinner than fixed point precision (the seg lies on
+				// the bound of the region after rounding), is chosen again without it; if every partition does that,
+				// the first one is taken
+				std::vector<BuildLine> rejected_partitions;
+				BuildSegArray sides_segs[2];
+				BuildPolygon sides_regions[2];
+				for(;;) {
+					if(!ChoosePartition(segs, rejected_partitions, tree_node->partition)) {
+						if(rejected_partitions.empty()) {
+							BuildSubsector(segs, region, *tree_node);
+							return tree_node;
+						}
+						tree_node->partition = rejected_partitions[0];
+					}
+
+					for(size_t six=0; six<2; six++) {
+						sides_segs[six].clear();
+					}
+					SplitSegs(segs, tree_node->partition, sides_segs);
+
+					sides_regions[0] = GetClippedPolygon(region, tree_node->partition, true);
+					sides_regions[1] = GetClippedPolygon(region, tree_node->partition, false);
+
+					if(   (rejected_partitions.size() > 0 && IsSameLine(tree_node->partition, rejected_partitions[0]))
+					   || (!IsSliverRegion(sides_regions[0], sides_segs[0]) && !IsSliverRegion(sides_regions[1], sides_segs[1])))
+					{
+						break;
+					}
+					rejected_partitions.push_back(tree_node->partition);
+				}
+				BuildSegArray().swap(segs);
+
+				if(parallel_depth > 0 && sides_segs[0].size() + sides_segs[1].size() >= PARALLEL_SUBTREE_SEGS_MIN) {
+					// the back subtree is built by a new thread
+					std::exception_ptr errors[2];
+					std::thread thread([&]() {
+						try {
+							tree_node->children[1] = BuildSubtree(sides_segs[1], sides_regions[1], parallel_depth - 1);
+
+						} catch(...) {
+							errors[1] = std::current_exception();
+						}
+					});
+
+					try {
+						tree_node->children[0] = BuildSubtree(sides_segs[0], sides_regions[0], parallel_depth - 1);
+
+					} catch(...) {
+						errors[0] = std::current_exception();
+					}
+					thread.join();
+
+					for(size_t eix=0; eix<2; eix++) {
+						if(errors[eix]) {
+							std::rethrow_exception(errors[eix]);
+						}
+					}
+
+				} else {
+					for(size_t six=0; six<2; six++) {
+						tree_node->children[six] = BuildSubtree(sides_segs[six], sides_regions[six], 0);
+					}
+				}
+
+				tree_node->box.Add(tree_node->children[0]->box);
+				tree_node->box.Add(tree_node->children[1]->box);
+				return tree_node;
+			}
+
+		private:
+			enum EnSegSide {
+				enSegSide_Front = 0,
+				enSegSide_Back = 1,
+				enSegSide_Split
+			};
+
+			// side of the seg: ends closer to the line than ON_LINE_DISTANCE are on it; a crossing seg is split at
+			// 'split_point' (in fixed point coordinates), it is not split if the point is rounded to its end -
+			// the seg goes to the side of its other end then
+			static EnSegSide GetSegSide(const BuildSeg& seg, const BuildLine& line, double& distance1, double& distance2, BuildPoint& split_point) {
+				distance1 = line.GetDistance(seg.p1.x, seg.p1.y);
+				distance2 = line.GetDistance(seg.p2.x, seg.p2.y);
+				const bool is_on_line1 = std::abs(distance1) <= ON_LINE_DISTANCE, is_on_line2 = std::abs(distance2) <= ON_LINE_DISTANCE;
+
+				if(is_on_line1 && is_on_line2) {
+					// on the line - the side is given by the direction
+					const double dot = line.dx * (seg.p2.x - seg.p1.x) + line.dy * (seg.p2.y - seg.p1.y);
+					return (dot > 0.0) ? enSegSide_Front : enSegSide_Back;
+				}
+
+				if(is_on_line1 || is_on_line2) {
+					return ((is_on_line1 ? distance2 : distance1) < 0.0) ? enSegSide_Front : enSegSide_Back;
+				}
+
+				if((distance1 < 0.0) == (distance2 < 0.0)) {
+					return (distance1 < 0.0) ? enSegSide_Front : enSegSide_Back;
+				}
+
+				split_point = GetSplitPoint(seg, line, distance1, distance2);
+				if(split_point.x == seg.p1.x && split_point.y == seg.p1.y) {
+					return (distance2 < 0.0) ? enSegSide_Front : enSegSide_Back;
+				}
+
+				if(split_point.x == seg.p2.x && split_point.y == seg.p2.y) {
+					return (distance1 < 0.0) ? enSegSide_Front : enSegSide_Back;
+				}
+
+				return enSegSide_Split;
+			}
+
+			// the crossing of the line with the whole line of the seg, as the corners of subsector polygons are;
+			// the crossing with the seg itself is taken if the lines are too close to parallel for it
+			static BuildPoint GetSplitPoint(const BuildSeg& seg, const BuildLine& line, double distance1, double distance2) {
+				const double line_distance1 = line.GetDistance(seg.line.x, seg.line.y);
+				const double line_distance2 = line.GetDistance(seg.line.x + seg.line.dx, seg.line.y + seg.line.dy);
+				const double line_t = line_distance1 / (line_distance1 - line_distance2);
+				const double x = seg.line.x + line_t * seg.line.dx, y = seg.line.y + line_t * seg.line.dy;
+				const BuildLine seg_line(seg.p1, seg.p2);
+				const double split_pos = seg_line.GetProjection(x, y);
+				if(std::isfinite(split_pos) && split_pos > 0.0 && split_pos < seg_line.length) {
+					return BuildPoint(GetFixedPointValue(x), GetFixedPointValue(y), ID_NONE);
+				}
+
+				const double t = distance1 / (distance1 - distance2);
+				return BuildPoint(GetFixedPointValue(seg.p1.x + t * (seg.p2.x - seg.p1.x)), GetFixedPointValue(seg.p1.y + t * (seg.p2.y - seg.p1.y)), ID_NONE);
+			}
+
+			static bool IsSameLine(const BuildLine& line1, const BuildLine& line2) {
+				return line1.x == line2.x && line1.y == line2.y && line1.dx == line2.dx && line1.dy == line2.dy;
+			}
+
+			// segs in the region cannot be closed into a subsector, if it is empty or thinner than SLIVER_REGION_WIDTH
+			// (the width of a convex polygon is the smallest distance between a line of its edge and its farthest point)
+			static bool IsSliverRegion(const BuildPolygon& region, const BuildSegArray& segs) {
+				if(segs.empty()) {
+					return false;
+				}
+
+				for(size_t pix=0; pix<region.size(); pix++) {
+					const BuildLine edge(region[pix], region[(pix + 1) % region.size()]);
+					double width = 0.0;
+					for(size_t wix=0; wix<region.size() && width <= SLIVER_REGION_WIDTH; wix++) {
+						width = std::max(width, std::abs(edge.GetDistance(region[wix].x, region[wix].y)));
+					}
+
+					if(width <= SLIVER_REGION_WIDTH) {
+						return true;
+					}
+				}
+
+				return region.empty();
+			}
+
+			static bool IsNearMiss(double distance) {
+				return std::abs(distance) > ON_LINE_DISTANCE && std::abs(distance) < NEAR_MISS_DISTANCE;
+			}
+
+			// choose the line of a seg that divides segs with the fewest slivers (segs along the line closer to it
+			// than NEAR_MISS_DISTANCE, but not on it, and pieces of split segs shorter than that - they would get
+			// subsectors thinner than that) and the lowest score (splits and imbalance); returns 'false' if no seg
+			// line divides segs - they form a subsector
+			static bool ChoosePartition(BuildSegArray& segs, const std::vector<BuildLine>& rejected_partitions, BuildLine& partition) {
+				size_t best_slivers = SIZE_MAX;
+				size_t best_score = SIZE_MAX;
+				const size_t sample_step = (segs.size() > PARTITION_CANDIDATES_MAX) ? segs.size() / PARTITION_CANDIDATES_MAX : 1;
+				for(size_t pass=0; pass<2 && best_score == SIZE_MAX; pass++) {
+					const size_t step = (pass == 0) ? sample_step : 1;
+					if(pass == 1 && sample_step == 1) {
+						// all segs are tried already
+						break;
+					}
+
+					for(size_t cix=0; cix<segs.size(); cix+=step) {
+						if(!segs[cix].is_partition_candidate) {
+							continue;
+						}
+
+						const BuildLine& line = segs[cix].line;
+						bool is_rejected = false;
+						for(size_t rix=0; rix<rejected_partitions.size() && !is_rejected; rix++) {
+							is_rejected = IsSameLine(line, rejected_partitions[rix]);
+						}
+						if(is_rejected) {
+							continue;
+						}
+						size_t sides_counts[2] = {0, 0};
+						size_t splits = 0, near_misses = 0, slivers = 0;
+						size_t six = 0;
+						for(; six<segs.size(); six++) {
+							double distance1, distance2;
+							BuildPoint split_point;
+							const EnSegSide side = GetSegSide(segs[six], line, distance1, distance2, split_point);
+							if(side == enSegSide_Split) {
+								splits++;
+
+								// a piece split off near a seg end gets a thin subsector if the seg is at a sharp angle
+								const double piece_ratio = std::min(std::abs(distance1), std::abs(distance2)) / std::abs(distance1 - distance2);
+								if(piece_ratio * Math::Get2DDistance(segs[six].p1.x, segs[six].p1.y, segs[six].p2.x, segs[six].p2.y) < NEAR_MISS_DISTANCE) {
+									slivers++;
+								}
+
+							} else {
+								sides_counts[side]++;
+							}
+
+							// a line passing very close to a seg end makes thin subsectors
+							if(IsNearMiss(distance1) || IsNearMiss(distance2)) {
+								near_misses++;
+								if(std::abs(distance1) < NEAR_MISS_DISTANCE && std::abs(distance2) < NEAR_MISS_DISTANCE) {
+									slivers++;
+								}
+							}
+
+							if(slivers > best_slivers || (slivers == best_slivers && (splits + near_misses) * PARTITION_SPLIT_COST >= best_score)) {
+								break;
+							}
+						}
+
+						if(sides_counts[enSegSide_Back] == 0 && splits == 0) {
+							// all segs are on the front side
+							segs[cix].is_partition_candidate = (six < segs.size());
+							continue;
+						}
+
+						const size_t imbalance = (sides_counts[0] > sides_counts[1]) ? sides_counts[0] - sides_counts[1] : sides_counts[1] - sides_counts[0];
+						const size_t score = (splits + near_misses) * PARTITION_SPLIT_COST + imbalance;
+						if(slivers < best_slivers || (slivers == best_slivers && score < best_score)) {
+							best_slivers = slivers;
+							best_score = score;
+							partition = line;
+						}
+					}
+				}
+
+				return best_score != SIZE_MAX;
+			}
+
+			static void SplitSegs(const BuildSegArray& segs, const BuildLine& partition, BuildSegArray sides_segs[2]) {
+				for(size_t six=0; six<segs.size(); six++) {
+					const BuildSeg& seg = segs[six];
+					double distance1, distance2;
+					BuildPoint split_point;
+					const EnSegSide side = GetSegSide(seg, partition, distance1, distance2, split_point);
+					if(side != enSegSide_Split) {
+						sides_segs[side].push_back(seg);
+						continue;
+					}
+
+					const size_t first_side = (distance1 < 0.0) ? enSegSide_Front : enSegSide_Back;
+					sides_segs[first_side].push_back(seg);
+					sides_segs[first_side].back().p2 = split_point;
+					sides_segs[1 - first_side].push_back(seg);
+					sides_segs[1 - first_side].back().p1 = split_point;
+				}
+			}
+
+			// the part of the convex polygon on the front or the back side of the line
+			static BuildPolygon GetClippedPolygon(const BuildPolygon& polygon, const BuildLine& line, bool front) {
+				BuildPolygon clipped;
+				if(polygon.empty()) {
+					return clipped;
+				}
+
+				// positive - inside, negative - outside
+				std::vector<double> distances(polygon.size());
+				for(size_t pix=0; pix<polygon.size(); pix++) {
+					const double distance = line.GetDistance(polygon[pix].x, polygon[pix].y);
+					distances[pix] = front ? -distance : distance;
+				}
+
+				for(size_t pix=0; pix<polygon.size(); pix++) {
+					const size_t next_pix = (pix + 1) % polygon.size();
+					const double distance = distances[pix];
+					const double next_distance = distances[next_pix];
+					if(distance >= 0.0) {
+						clipped.push_back(polygon[pix]);
+					}
+
+					// points are cut exactly, so corners are precise crossings of lines, close points are merged below
+					if((distance > 0.0 && next_distance < 0.0) || (distance < 0.0 && next_distance > 0.0)) {
+						const double t = distance / (distance - next_distance);
+						clipped.push_back(BuildPoint(polygon[pix].x + t * (polygon[next_pix].x - polygon[pix].x),
+													 polygon[pix].y + t * (polygon[next_pix].y - polygon[pix].y), ID_NONE));
+					}
+				}
+
+				// remove coincident points
+				BuildPolygon result;
+				for(size_t pix=0; pix<clipped.size(); pix++) {
+					const BuildPoint& point = clipped[pix];
+					const BuildPoint& prev_point = result.empty() ? clipped.back() : result.back();
+					if(Math::Get2DDistance(point.x, point.y, prev_point.x, prev_point.y) > ON_LINE_DISTANCE) {
+						result.push_back(point);
+					}
+				}
+
+				return (result.size() < 3) ? BuildPolygon() : result;
+			}
+
+			// make a closed loop of 'segs' and minisegs: the subsector is the part of the region
+			// in front of all segs, minisegs close the parts of its boundary that are not covered by segs
+			static void BuildSubsector(BuildSegArray& segs, const BuildPolygon& region, BuildTreeNode& tree_node) {
+				BuildPolygon polygon = region;
+				for(size_t six=0; six<segs.size() && !polygon.empty(); six++) {
+					polygon = GetClippedPolygon(polygon, segs[six].line, true);
+				}
+
+				// remove points in the middle of straight parts of the boundary, so a seg lies on a single edge
+				for(size_t pix=0; pix<polygon.size() && polygon.size() > 3; ) {
+					const BuildPoint& prev_point = polygon[(pix + polygon.size() - 1) % polygon.size()];
+					const BuildPoint& next_point = polygon[(pix + 1) % polygon.size()];
+					if(std::abs(BuildLine(prev_point, next_point).GetDistance(polygon[pix].x, polygon[pix].y)) <= ON_LINE_DISTANCE) {
+						polygon.erase(polygon.begin() + pix);
+
+					} else {
+						pix++;
+					}
+				}
+
+				// put each seg on the edge of the same direction closest to it, segs of an edge are ordered along it
+				std::vector< std::vector< std::pair<double, size_t> > > edges_segs(polygon.size());
+				size_t put_segs_count = 0;
+				for(size_t six=0; six<segs.size(); six++) {
+					const BuildSeg& seg = segs[six];
+					size_t best_pix = polygon.size();
+					double best_distance = EDGE_MATCH_DISTANCE;
+					for(size_t pix=0; pix<polygon.size(); pix++) {
+						const BuildLine edge(polygon[pix], polygon[(pix + 1) % polygon.size()]);
+						if(edge.dx * (seg.p2.x - seg.p1.x) + edge.dy * (seg.p2.y - seg.p1.y) <= 0.0) {
+							continue;
+						}
+
+						const double distance = std::max(std::abs(edge.GetDistance(seg.p1.x, seg.p1.y)), std::abs(edge.GetDistance(seg.p2.x, seg.p2.y)));
+						if(distance <= best_distance) {
+							best_distance = distance;
+							best_pix = pix;
+						}
+					}
+
+					if(best_pix < polygon.size()) {
+						const BuildLine edge(polygon[best_pix], polygon[(best_pix + 1) % polygon.size()]);
+						edges_segs[best_pix].push_back(std::make_pair(edge.GetProjection(seg.p1.x, seg.p1.y), six));
+						put_segs_count++;
+					}
+				}
+
+				// walk the boundary, gaps between segs longer than ON_LINE_DISTANCE are closed by minisegs
+				BuildSegArray& loop = tree_node.segs;
+				if(put_segs_count == segs.size()) {
+					BuildLoopOnPolygon(segs, polygon, edges_segs, loop);
+				}
+
+				// the region is thinner than fixed point precision (at a sliver of a sector after rounding of coordinates
+				// or between lines crossing at a tiny angle) - segs are off the polygon, run past its corners
+				// or the loop collapses after rounding
+				if(!IsClosedLoop(loop)) {
+					BuildSliverLoop(segs, loop);
+				}
+
+				for(size_t lix=0; lix<loop.size(); lix++) {
+					tree_node.box.Add(loop[lix].p1.x, loop[lix].p1.y);
+				}
+				BuildSegArray().swap(segs);
+			}
+
+			static void BuildLoopOnPolygon(const BuildSegArray& segs,
+										   const BuildPolygon& polygon,
+										   std::vector< std::vector< std::pair<double, size_t> > >& edges_segs,
+										   BuildSegArray& loop)
+			{
+				BuildPoint cur_point = polygon[0];
+				for(size_t pix=0; pix<polygon.size(); pix++) {
+					const BuildPoint& edge_end = polygon[(pix + 1) % polygon.size()];
+					const BuildLine edge(polygon[pix], edge_end);
+					std::vector< std::pair<double, size_t> >& edge_segs = edges_segs[pix];
+					std::sort(edge_segs.begin(), edge_segs.end());
+
+					// the last seg of the previous edge may end short of its end (or a bit beyond it)
+					if(Math::Get2DDistance(cur_point.x, cur_point.y, polygon[pix].x, polygon[pix].y) > ON_LINE_DISTANCE) {
+						loop.push_back(BuildSeg(cur_point, polygon[pix], ID_NONE, 0, BuildLine()));
+						cur_point = polygon[pix];
+					}
+
+					for(size_t eix=0; eix<edge_segs.size(); eix++) {
+						const BuildSeg& seg = segs[edge_segs[eix].second];
+						if(edge_segs[eix].first - edge.GetProjection(cur_point.x, cur_point.y) > ON_LINE_DISTANCE) {
+							loop.push_back(BuildSeg(cur_point, seg.p1, ID_NONE, 0, BuildLine()));
+						}
+
+						loop.push_back(seg);
+						cur_point = seg.p2;
+					}
+
+					if(edge.length - edge.GetProjection(cur_point.x, cur_point.y) > ON_LINE_DISTANCE) {
+						loop.push_back(BuildSeg(cur_point, edge_end, ID_NONE, 0, BuildLine()));
+						cur_point = edge_end;
+					}
+				}
+
+				// polygon corners are not exactly at seg ends, minisegs through them may go back and forth - a miniseg
+				// ends where the next seg starts, short minisegs are removed, minisegs through a corner that does not
+				// turn the loop are joined
+				for(bool changed=true; changed && loop.size() > 3; ) {
+					changed = false;
+					for(size_t lix=0; lix<loop.size() && loop.size() > 3; ) {
+						const BuildSeg& seg = loop[lix];
+						const BuildSeg& next_seg = loop[(lix + 1) % loop.size()];
+						const BuildSeg& prev_seg = loop[(lix + loop.size() - 1) % loop.size()];
+						if(   (seg.linedef == ID_NONE && Math::Get2DDistance(seg.p1.x, seg.p1.y, next_seg.p1.x, next_seg.p1.y) <= EDGE_MATCH_DISTANCE)
+						   || (seg.linedef == ID_NONE && prev_seg.linedef == ID_NONE
+						       && BuildLine(prev_seg.p1, next_seg.p1).GetDistance(seg.p1.x, seg.p1.y) <= ON_LINE_DISTANCE))
+						{
+							loop.erase(loop.begin() + lix);
+							changed = true;
+
+						} else {
+							lix++;
+						}
+					}
+				}
+
+				for(size_t lix=0; lix<loop.size(); lix++) {
+					if(loop[lix].linedef == ID_NONE) {
+						loop[lix].p2 = loop[(lix + 1) % loop.size()].p1;
+					}
+				}
+			}
+
+			// the loop of segs alone, they are snapped to the smallest subsector fixed point coordinates can hold: segs go
+			// clockwise around their center and are joined by minisegs, segs on one line are closed by a point in front
+			// of them at SLIVER_REGION_WIDTH
+			static void BuildSliverLoop(const BuildSegArray& segs, BuildSegArray& loop) {
+				const BuildLine& first_line = segs[0].line;
+				bool is_straight = true;
+				double cx = 0.0, cy = 0.0;
+				for(size_t six=0; six<segs.size(); six++) {
+					const BuildSeg& seg = segs[six];
+					is_straight = is_straight && std::abs(first_line.GetDistance(seg.p1.x, seg.p1.y)) <= ON_LINE_DISTANCE
+											  && std::abs(first_line.GetDistance(seg.p2.x, seg.p2.y)) <= ON_LINE_DISTANCE;
+					cx += (seg.p1.x + seg.p2.x) / (2 * segs.size());
+					cy += (seg.p1.y + seg.p2.y) / (2 * segs.size());
+				}
+
+				// segs on one line are ordered along it, others - by the clockwise angle around the center
+				std::vector< std::pair<double, size_t> > ordered_segs;
+				for(size_t six=0; six<segs.size(); six++) {
+					const BuildSeg& seg = segs[six];
+					const double order = is_straight ? first_line.GetProjection(seg.p1.x, seg.p1.y)
+													 : -std::atan2((seg.p1.y + seg.p2.y) / 2.0 - cy, (seg.p1.x + seg.p2.x) / 2.0 - cx);
+					ordered_segs.push_back(std::make_pair(order, six));
+				}
+				std::sort(ordered_segs.begin(), ordered_segs.end());
+
+				loop.clear();
+				for(size_t oix=0; oix<ordered_segs.size(); oix++) {
+					const BuildSeg& seg = segs[ordered_segs[oix].second];
+					const BuildSeg& next_seg = segs[ordered_segs[(oix + 1) % ordered_segs.size()].second];
+					loop.push_back(seg);
+					if(is_straight && oix == ordered_segs.size() - 1) {
+						const BuildPoint front_point(GetFixedPointValue((seg.p2.x + next_seg.p1.x) / 2.0 + first_line.dy / first_line.length * SLIVER_REGION_WIDTH),
+													 GetFixedPointValue((seg.p2.y + next_seg.p1.y) / 2.0 - first_line.dx / first_line.length * SLIVER_REGION_WIDTH), ID_NONE);
+						loop.push_back(BuildSeg(seg.p2, front_point, ID_NONE, 0, BuildLine()));
+						loop.push_back(BuildSeg(front_point, next_seg.p1, ID_NONE, 0, BuildLine()));
+
+					} else if(Math::Get2DDistance(seg.p2.x, seg.p2.y, next_seg.p1.x, next_seg.p1.y) > ON_LINE_DISTANCE) {
+						loop.push_back(BuildSeg(seg.p2, next_seg.p1, ID_NONE, 0, BuildLine()));
+					}
+				}
+			}
+
+			// 'true' if each seg ends where the next one starts and the loop has at least 3 different points
+			// in fixed point coordinates
+			static bool IsClosedLoop(const BuildSegArray& loop) {
+				std::vector< std::pair<double, double> > points;
+				for(size_t lix=0; lix<loop.size(); lix++) {
+					const BuildSeg& seg = loop[lix];
+					const BuildSeg& next_seg = loop[(lix + 1) % loop.size()];
+					if(Math::Get2DDistance(seg.p2.x, seg.p2.y, next_seg.p1.x, next_seg.p1.y) > EDGE_MATCH_DISTANCE) {
+						return false;
+					}
+					points.push_back(std::make_pair(GetFixedPointValue(seg.p1.x), GetFixedPointValue(seg.p1.y)));
+				}
+
+				std::sort(points.begin(), points.end());
+				return std::unique(points.begin(), points.end()) - points.begin() >= 3;
+			}
+		};
+
+		// put the built tree into GlNodes in the order of ZDoom nodes (children go before parents)
+		class NodesSerializer {
+		public:
+			// 'sides_sectors' - sector of each linedef side (index - linedef * 2 + side)
+			NodesSerializer(const std::vector<BuildPoint>& map_points, const std::vector<uint32_t>& sides_sectors, GlNodes& nodes)
+				: m_nodes(nodes)
+				, m_sides_sectors(sides_sectors)
+			{
+				m_nodes.original_vertices_count = (uint32_t)map_points.size();
+				m_nodes.new_vertices.clear();
+				m_nodes.subsector_segs_counts.clear();
+				m_nodes.segs.clear();
+				m_nodes.nodes.clear();
+
+				for(size_t vix=0; vix<map_points.size(); vix++) {
+					m_vertices_by_position.insert(std::make_pair(GetPositionKey(GetFixed(map_points[vix].x), GetFixed(map_points[vix].y)), (uint32_t)vix));
+				}
+			}
+
+			// returns the child reference to the subtree
+			uint32_t PutSubtree(const BuildTreeNode& tree_node) {
+				if(!tree_node.children[0]) {
+					std::vector<GlNodes::Seg> segs(tree_node.segs.size());
+					for(size_t six=0; six<segs.size(); six++) {
+						segs[six].v1 = GetVertex(tree_node.segs[six].p1);
+						segs[six].linedef = tree_node.segs[six].linedef;
+						segs[six].side = tree_node.segs[six].side;
+					}
+
+					// segs of zero length after rounding to fixed point are dropped (minisegs and segs of linedefs that
+					// overlap closer than fixed point precision)
+					std::vector<size_t> kept_segs;
+					for(size_t six=0; six<segs.size(); six++) {
+						if(segs[six].v1 != segs[(six + 1) % segs.size()].v1) {
+							kept_segs.push_back(six);
+						}
+					}
+
+					if(kept_segs.size() < 3) {
+						size_t linedef_six = 0;
+						while(linedef_six < segs.size() - 1 && segs[linedef_six].linedef == ID_NONE) {
+							linedef_six++;
+						}
+						throw Exception("error building nodes - subsector of linedef " + std::to_string(segs[linedef_six].linedef) + " has less than 3 segs");
+					}
+
+					// linedefs crossing closer than fixed point precision (at slivers of sectors) can leave segs of several
+					// sectors in a subsector; ZDoom takes the sector of the first seg of a linedef - the loop starts at
+					// a seg of the sector of the longest segs
+					std::map<uint32_t, double> sectors_lengths;
+					for(size_t kix=0; kix<kept_segs.size(); kix++) {
+						const BuildSeg& seg = tree_node.segs[kept_segs[kix]];
+						if(seg.linedef != ID_NONE) {
+							sectors_lengths[m_sides_sectors[seg.linedef * 2 + seg.side]] += Math::Get2DDistance(seg.p1.x, seg.p1.y, seg.p2.x, seg.p2.y);
+						}
+					}
+
+					size_t first_kix = 0;
+					if(sectors_lengths.size() > 1) {
+						uint32_t sector = ID_NONE;
+						double best_length = -1.0;
+						for(std::map<uint32_t, double>::const_iterator it=sectors_lengths.begin(); it!=sectors_lengths.end(); ++it) {
+							if(it->second > best_length) {
+								best_length = it->second;
+								sector = it->first;
+							}
+						}
+
+						while(segs[kept_segs[first_kix]].linedef == ID_NONE || m_sides_sectors[segs[kept_segs[first_kix]].linedef * 2 + segs[kept_segs[first_kix]].side] != sector) {
+							first_kix++;
+						}
+					}
+
+					for(size_t kix=0; kix<kept_segs.size(); kix++) {
+						m_nodes.segs.push_back(segs[kept_segs[(first_kix + kix) % kept_segs.size()]]);
+					}
+
+					m_nodes.subsector_segs_counts.push_back((uint32_t)kept_segs.size());
+					return (uint32_t)(m_nodes.subsector_segs_counts.size() - 1) | CHILD_SUBSECTOR_FLAG;
+				}
+
+				GlNodes::Node node;
+				for(size_t cix=0; cix<2; cix++) {
+					node.children[cix] = PutSubtree(*tree_node.children[cix]);
+
+					const BuildBox& box = tree_node.children[cix]->box;
+					node.bbox[cix][0] = (int16_t)Math::Ceil(box.top);
+					node.bbox[cix][1] = (int16_t)Math::Floor(box.bottom);
+					node.bbox[cix][2] = (int16_t)Math::Floor(box.left);
+					node.bbox[cix][3] = (int16_t)Math::Ceil(box.right);
+				}
+
+				const BuildLine& partition = tree_node.partition;
+				node.x = GetFixed(partition.x);
+				node.y = GetFixed(partition.y);
+				node.dx = GetFixed(partition.dx);
+				node.dy = GetFixed(partition.dy);
+				m_nodes.nodes.push_back(node);
+				return (uint32_t)(m_nodes.nodes.size() - 1);
+			}
+
+		private:
+			static int32_t GetFixed(double value) {
+				return (int32_t)std::llround(value * FIXED_POINT_SCALE);
+			}
+
+			static uint64_t GetPositionKey(int32_t x, int32_t y) {
+				return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+			}
+
+			// map vertex or new vertex at the point; points that round to the same fixed point position
+			// as a map vertex get that vertex
+			uint32_t GetVertex(const BuildPoint& point) {
+				if(point.vertex != ID_NONE) {
+					return point.vertex;
+				}
+
+				const int32_t x = GetFixed(point.x);
+				const int32_t y = GetFixed(point.y);
+				const std::unordered_map<uint64_t, uint32_t>::const_iterator found = m_vertices_by_position.find(GetPositionKey(x, y));
+				if(found != m_vertices_by_position.end()) {
+					return found->second;
+				}
+
+				const uint32_t vertex = m_nodes.original_vertices_count + (uint32_t)m_nodes.new_vertices.size();
+				GlNodes::Vertex new_vertex;
+				new_vertex.x = x;
+				new_vertex.y = y;
+				m_nodes.new_vertices.push_back(new_vertex);
+				m_vertices_by_position.insert(std::make_pair(GetPositionKey(x, y), vertex));
+				return vertex;
+			}
+
+		private:
+			GlNodes& m_nodes;
+			const std::vector<uint32_t>& m_sides_sectors;
+			std::unordered_map<uint64_t, uint32_t> m_vertices_by_position;
+		};
+
+		static uint32_t GetSideSector(const Udmf::Map& map, unsigned int sidedef) {
+			if(sidedef == Udmf::ID_INVALID) {
+				return ID_NONE;
+			}
+
+			if(sidedef >= map.sidedefs.size()) {
+				throw Exception("error building nodes - linedef references non-existing sidedef");
+			}
+
+			return map.sidedefs[sidedef].sector;
+		}
+
+		void BuildNodes(const Udmf::Map& map, unsigned char float_precision, GlNodes& nodes) {
+			if(map.linedefs.empty()) {
+				throw Exception("error building nodes - the map has no linedefs");
+			}
+
+			// the tree is built for the map as the game loads it
+			Udmf::LoadedGeometry geometry;
+			Udmf::GetLoadedGeometry(map, float_precision, geometry);
+
+			std::vector<BuildPoint> map_points(geometry.vertices.size());
+			for(size_t vix=0; vix<geometry.vertices.size(); vix++) {
+				map_points[vix] = BuildPoint(geometry.vertices[vix].x, geometry.vertices[vix].y, (uint32_t)vix);
+			}
+
+			nodes.map_linedefs = geometry.map_linedefs;
+			BuildSegArray segs;
+			std::vector<uint32_t> sides_sectors;
+			for(size_t lix=0; lix<geometry.map_linedefs.size(); lix++) {
+				const Udmf::Linedef& linedef = map.linedefs[geometry.map_linedefs[lix]];
+				const BuildPoint& p1 = map_points[linedef.v1];
+				const BuildPoint& p2 = map_points[linedef.v2];
+				sides_sectors.push_back(GetSideSector(map, linedef.sidefront));
+				sides_sectors.push_back(GetSideSector(map, linedef.sideback));
+				segs.push_back(BuildSeg(p1, p2, (uint32_t)lix, 0, BuildLine(p1, p2)));
+				if(linedef.sideback != Udmf::ID_INVALID) {
+					segs.push_back(BuildSeg(p2, p1, (uint32_t)lix, 1, BuildLine(p2, p1)));
+				}
+			}
+
+			if(segs.empty()) {
+				throw Exception("error building nodes - the map has no linedefs of non-zero length");
+			}
+
+			// the region of the root node - the map bounding box with a margin, clockwise
+			const double margin = 64.0;
+			BuildPolygon region;
+			region.push_back(BuildPoint(geometry.left - margin, geometry.top + margin, ID_NONE));
+			region.push_back(BuildPoint(geometry.right + margin, geometry.top + margin, ID_NONE));
+			region.push_back(BuildPoint(geometry.right + margin, geometry.bottom - margin, ID_NONE));
+			region.push_back(BuildPoint(geometry.left - margin, geometry.bottom - margin, ID_NONE));
+
+			// each level of parallel subtrees doubles the number of threads
+			const unsigned int threads_count = (std::thread::hardware_concurrency() > 0) ? std::thread::hardware_concurrency() : 1;
+			unsigned int parallel_depth = 0;
+			while((1u << parallel_depth) < threads_count) {
+				parallel_depth++;
+			}
+
+			const std::unique_ptr<BuildTreeNode> root = NodesBuilder::BuildSubtree(segs, region, parallel_depth);
+
+			NodesSerializer serializer(map_points, sides_sectors, nodes);
+			serializer.PutSubtree(*root);
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WriteNodesToStream implementation
+
+namespace RoadGen {
+	namespace Nodes {
+		void WriteNodesToStream(const GlNodes& nodes, Io::OutStream& out_stream) {
+			class Utils {
+			public:
+				Utils(CharArray& data)
+					: m_data(data)
+				{}
+
+				void Put4Bytes(uint32_t number) {
+					m_data.push_back((char)(number & 0xFF));
+					m_data.push_back((char)((number >> 8) & 0xFF));
+					m_data.push_back((char)((number >> 16) & 0xFF));
+					m_data.push_back((char)(number >> 24));
+				}
+
+				void Put2Bytes(uint16_t number) {
+					m_data.push_back((char)(number & 0xFF));
+					m_data.push_back((char)(number >> 8));
+				}
+
+			private:
+				CharArray& m_data;
+			};
+
+			CharArray data;
+			data.reserve(32 + nodes.new_vertices.size() * 8 + nodes.subsector_segs_counts.size() * 4 + nodes.segs.size() * 13 + nodes.nodes.size() * 32);
+			Utils utils(data);
+
+			const char magic[] = "XGL3";
+			data.insert(data.end(), magic, magic + 4);
+
+			utils.Put4Bytes(nodes.original_vertices_count);
+			utils.Put4Bytes((uint32_t)nodes.new_vertices.size());
+			for(size_t vix=0; vix<nodes.new_vertices.size(); vix++) {
+				utils.Put4Bytes((uint32_t)nodes.new_vertices[vix].x);
+				utils.Put4Bytes((uint32_t)nodes.new_vertices[vix].y);
+			}
+
+			utils.Put4Bytes((uint32_t)nodes.subsector_segs_counts.size());
+			for(size_t six=0; six<nodes.subsector_segs_counts.size(); six++) {
+				utils.Put4Bytes(nodes.subsector_segs_counts[six]);
+			}
+
+			utils.Put4Bytes((uint32_t)nodes.segs.size());
+			for(size_t six=0; six<nodes.segs.size(); six++) {
+				const GlNodes::Seg& seg = nodes.segs[six];
+				utils.Put4Bytes(seg.v1);
+				utils.Put4Bytes(seg.partner);
+				utils.Put4Bytes(seg.linedef);
+				data.push_back((char)seg.side);
+			}
+
+			utils.Put4Bytes((uint32_t)nodes.nodes.size());
+			for(size_t nix=0; nix<nodes.nodes.size(); nix++) {
+				const GlNodes::Node& node = nodes.nodes[nix];
+				utils.Put4Bytes((uint32_t)node.x);
+				utils.Put4Bytes((uint32_t)node.y);
+				utils.Put4Bytes((uint32_t)node.dx);
+				utils.Put4Bytes((uint32_t)node.dy);
+				for(size_t cix=0; cix<2; cix++) {
+					for(size_t bix=0; bix<4; bix++) {
+						utils.Put2Bytes((uint16_t)node.bbox[cix][bix]);
+					}
+				}
+				utils.Put4Bytes(node.children[0]);
+				utils.Put4Bytes(node.children[1]);
+			}
+
+			out_stream.write(data.data(), data.size());
+		}
+	}
+}
@@ -0,0 +1,109 @@
+
+// node builder - BSP tree of the generated UDMF map in ZDoom GL nodes format
+// ZDoom nodes formats: https://zdoom.org/wiki/Node#ZDoom_extended_nodes
+
+#ifndef _ROAD_GEN_NODES_H_
+#define _ROAD_GEN_NODES_H_
+
+#include "common.h"
+#include "udmf.h"
+#include "io.h"
+
+#include <cstdint>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GlNodes - BSP tree of the map: nodes, subsectors (convex parts of sectors) and segs (parts of linedefs
+// and minisegs) that close subsectors; coordinates are fixed point numbers (16.16)
+
+namespace RoadGen {
+	namespace Nodes {
+		const uint32_t ID_NONE = 0xFFFFFFFF;
+
+		// child of a node is a subsector if the flag is set
+		const uint32_t CHILD_SUBSECTOR_FLAG = 0x80000000;
+
+		struct GlNodes {
+			struct Vertex {
+				int32_t x, y;
+
+				Vertex()
+					: x(0)
+					, y(0)
+				{}
+			};
+
+			// seg ends at the start vertex of the next seg of its subsector (the last one - at the first one)
+			struct Seg {
+				uint32_t v1;
+
+				// seg on the other side of the same line, ID_NONE - not set
+				uint32_t partner;
+
+				// ID_NONE - miniseg (a part of a partition line)
+				uint32_t linedef;
+
+				// 0 - front side of the linedef, 1 - back side
+				uint8_t side;
+
+				Seg()
+					: v1(ID_NONE)
+					, partner(ID_NONE)
+					, linedef(ID_NONE)
+					, side(0)
+				{}
+			};
+
+			struct Node {
+				// partition line, child 0 is on the right of it
+				int32_t x, y, dx, dy;
+
+				// bounding boxes of children: top, bottom, left, right
+				int16_t bbox[2][4];
+
+				// node index or subsector index with CHILD_SUBSECTOR_FLAG
+				uint32_t children[2];
+
+				Node()
+					: x(0)
+					, y(0)
+					, dx(0)
+					, dy(0)
+				{
+					std::fill(&bbox[0][0], &bbox[0][0] + 8, (int16_t)0);
+					children[0] = children[1] = ID_NONE;
+				}
+			};
+
+			// vertices [0, original_vertices_count) are the map vertices, new ones follow them
+			uint32_t original_vertices_count;
+			std::vector<Vertex> new_vertices;
+
+			// segs of a subsector follow the ones of the previous subsector
+			std::vector<uint32_t> subsector_segs_counts;
+			std::vector<Seg> segs;
+
+			// the root node is the last one
+			std::vector<Node> nodes;
+
+			// map linedef of each linedef referenced by segs (ZDoom removes zero length linedefs
+			// while loading the map, next linedefs are renumbered)
+			std::vector<uint32_t> map_linedefs;
+
+			GlNodes()
+				: original_vertices_count(0)
+			{}
+		};
+
+		// build the BSP tree of the map: partition lines are chosen from the lines of segs by the fast heuristic
+		// (a sample of segs is scored by splits and balance), subtrees of the top levels are built in parallel
+		// by all hardware threads; 'float_precision' - precision of coordinates in the written TEXTMAP,
+		// the tree is built for the rounded coordinates; throws if the map coordinates are out of map limits
+		void BuildNodes(const Udmf::Map& map, unsigned char float_precision, GlNodes& nodes);
+
+		// write the nodes as ZNODES lump data in uncompressed 'XGL3' format (GL nodes with fixed point partition lines)
+		void WriteNodesToStream(const GlNodes& nodes, Io::OutStream& out_stream);
+	}
+}
+
+#endif // _ROAD_GEN_NODES_H_
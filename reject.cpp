@@ -0,0 +1,1243 @@
+
+#include "reject.h"
+#include "umath.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <thread>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BuildReject implementation
+
+namespace RoadGen {
+	namespace Reject {
+		// points closer to a line than that are on the line, portals are clipped with this tolerance
+		static const double ON_LINE_DISTANCE = 1.0 / 1024;
+
+		// ends of the edges of neighbor subsectors on the same line differ by rounding to fixed point numbers
+		static const double EDGE_MATCH_DISTANCE = 1.0 / 64;
+
+		// merged parts of portals are extended to that number of steps of portals length
+		static const double PORTAL_STEPS_COUNT = 16.0;
+
+		// maximum number of edges and portals passed from one source portal per portal of its component; if there
+		// are more, all cells of the component are visible from the source cell
+		static const size_t FLOW_STEPS_PER_PORTAL = 64;
+
+		// ends of portals of neighbor cells differ that much, portals are clipped with that margin (more is kept)
+		// near the ends of the clipping line, the margin grows with the distance from them (see ClipPortal)
+		static const double CLIP_DISTANCE = 1.0 / 64;
+
+		// part of a subsector edge, that leads into the neighbor subsector; 'left' and 'right' are the ends
+		// on the left and on the right hand when going through the portal out of the subsector
+		struct Portal {
+			Math::Point2D left, right;
+			uint32_t subsector;
+
+			Portal()
+				: subsector(Nodes::ID_NONE)
+			{}
+
+			Portal(const Math::Point2D& left_, const Math::Point2D& right_, uint32_t subsector_)
+				: left(left_)
+				, right(right_)
+				, subsector(subsector_)
+			{}
+
+			// the same portal passed in the opposite direction
+			Portal GetReversed() const {
+				return Portal(right, left, subsector);
+			}
+		};
+
+		// subsector of the BSP tree of walls - convex cell of the space, where sight passes
+		struct Cell {
+			// edge of the cell, that is split into portals; 'left' and 'right' are as the ones of its portals
+			struct Edge {
+				Math::Point2D left, right;
+
+				// portals of the edge follow each other in 'portals'
+				size_t first_portal_ix, portals_count;
+
+				Edge(const Math::Point2D& left_, const Math::Point2D& right_, size_t first_portal_ix_, size_t portals_count_)
+					: left(left_)
+					, right(right_)
+					, first_portal_ix(first_portal_ix_)
+					, portals_count(portals_count_)
+				{}
+			};
+
+			// cells of one component are connected by portals
+			uint32_t component;
+
+			std::vector<Portal> portals;
+			std::vector<Edge> edges;
+
+			Cell()
+				: component(0)
+			{}
+		};
+
+		// subsectors of the BSP tree as polygons in map coordinates
+		class NodesGeometry {
+		public:
+			// 'float_precision' - the one the nodes are built for, map vertices are taken as the game loads them
+			// (see Udmf::GetLoadedGeometry), so they match new vertices of the nodes
+			NodesGeometry(const Udmf::Map& map, const Nodes::GlNodes& nodes, unsigned char float_precision)
+				: m_map(map)
+				, m_nodes(nodes)
+				, m_first_segs(nodes.subsector_segs_counts.size() + 1, 0)
+			{
+				for(size_t six=0; six<nodes.subsector_segs_counts.size(); six++) {
+					m_first_segs[six + 1] = m_first_segs[six] + nodes.subsector_segs_counts[six];
+				}
+
+				if(nodes.subsector_segs_counts.empty() || m_first_segs.back() != nodes.segs.size()) {
+					throw Exception("error building reject - bad nodes, segs of subsectors do not match the segs");
+				}
+
+				Udmf::LoadedGeometry geometry;
+				Udmf::GetLoadedGeometry(map, float_precision, geometry);
+				m_vertices.swap(geometry.vertices);
+			}
+
+			size_t GetSubsectorsCount() const {
+				return m_nodes.subsector_segs_counts.size();
+			}
+
+			// vertices of the subsector go clockwise (the subsector is on the right of its edges)
+			void GetSubsectorPolygon(uint32_t subsector, std::vector<Math::Point2D>& polygon) const {
+				polygon.clear();
+				for(size_t gix=m_first_segs[subsector]; gix<m_first_segs[subsector + 1]; gix++) {
+					polygon.push_back(GetVertex(m_nodes.segs[gix].v1));
+				}
+			}
+
+			// the sector of the subsector by its segs of linedefs, Nodes::ID_NONE - the subsector has none
+			uint32_t GetSubsectorSector(uint32_t subsector) const {
+				for(size_t gix=m_first_segs[subsector]; gix<m_first_segs[subsector + 1]; gix++) {
+					const Nodes::GlNodes::Seg& seg = m_nodes.segs[gix];
+					if(seg.linedef == Nodes::ID_NONE) {
+						continue;
+					}
+
+					if(seg.linedef >= m_nodes.map_linedefs.size() || m_nodes.map_linedefs[seg.linedef] >= m_map.linedefs.size()) {
+						throw Exception("error building reject - nodes reference non-existing linedef " + std::to_string(seg.linedef));
+					}
+
+					const Udmf::Linedef& linedef = m_map.linedefs[m_nodes.map_linedefs[seg.linedef]];
+					const unsigned int sidedef = (seg.side == 0) ? linedef.sidefront : linedef.sideback;
+					if(sidedef >= m_map.sidedefs.size() || m_map.sidedefs[sidedef].sector >= m_map.sectors.size()) {
+						throw Exception("error building reject - linedef " + std::to_string(m_nodes.map_linedefs[seg.linedef]) + " has no sector on the side of a seg");
+					}
+
+					return m_map.sidedefs[sidedef].sector;
+				}
+				return Nodes::ID_NONE;
+			}
+
+			// put subsectors, that the polygon (of another tree) may overlap, into 'subsectors': the polygon goes
+			// down to both children of nodes, which partition lines cross it
+			void GetOverlappedSubsectors(const std::vector<Math::Point2D>& polygon, std::vector<uint32_t>& subsectors) const {
+				subsectors.clear();
+				if(m_nodes.nodes.empty()) {
+					subsectors.push_back(0);
+					return;
+				}
+
+				std::vector<uint32_t> nodes(1, (uint32_t)m_nodes.nodes.size() - 1);
+				while(!nodes.empty()) {
+					const uint32_t node_ix = nodes.back();
+					nodes.pop_back();
+
+					// distances of the polygon vertices to the back of the partition line
+					const Nodes::GlNodes::Node& node = m_nodes.nodes[node_ix];
+					const double dx = node.dx / 65536.0, dy = node.dy / 65536.0;
+					const double length = std::sqrt(dx * dx + dy * dy);
+					double min_distance = -ON_LINE_DISTANCE, max_distance = ON_LINE_DISTANCE;
+					if(length > 0.0) {
+						min_distance = std::numeric_limits<double>::max();
+						max_distance = -std::numeric_limits<double>::max();
+						for(size_t pix=0; pix<polygon.size(); pix++) {
+							const double distance = (dx * (polygon[pix].y - node.y / 65536.0) - dy * (polygon[pix].x - node.x / 65536.0)) / length;
+							min_distance = std::min(min_distance, distance);
+							max_distance = std::max(max_distance, distance);
+						}
+					}
+
+					const bool are_sides_overlapped[] = {min_distance < ON_LINE_DISTANCE, max_distance > -ON_LINE_DISTANCE};
+					for(size_t cix=0; cix<_countof(are_sides_overlapped); cix++) {
+						if(!are_sides_overlapped[cix]) {
+							continue;
+						}
+
+						if(node.children[cix] & Nodes::CHILD_SUBSECTOR_FLAG) {
+							subsectors.push_back(GetChildSubsector(node.children[cix]));
+
+						} else {
+							CheckChildNode(node_ix, node.children[cix]);
+							nodes.push_back(node.children[cix]);
+						}
+					}
+				}
+			}
+
+			// the subsector, which the point is in by partition lines of nodes (the point on the line goes to the front)
+			uint32_t LocateSubsector(const Math::Point2D& point) const {
+				if(m_nodes.nodes.empty()) {
+					return 0;
+				}
+
+				uint32_t node_ix = (uint32_t)m_nodes.nodes.size() - 1;
+				for(;;) {
+					const Nodes::GlNodes::Node& node = m_nodes.nodes[node_ix];
+					const double distance = node.dx / 65536.0 * (point.y - node.y / 65536.0) - node.dy / 65536.0 * (point.x - node.x / 65536.0);
+					const uint32_t child = node.children[(distance > 0.0) ? 1 : 0];
+					if(child & Nodes::CHILD_SUBSECTOR_FLAG) {
+						return GetChildSubsector(child);
+					}
+
+					CheckChildNode(node_ix, child);
+					node_ix = child;
+				}
+			}
+
+		private:
+			Math::Point2D GetVertex(uint32_t vertex) const {
+				if(vertex < m_nodes.original_vertices_count) {
+					if(vertex >= m_vertices.size()) {
+						throw Exception("error building reject - nodes reference non-existing vertex " + std::to_string(vertex));
+					}
+
+					return m_vertices[vertex];
+				}
+
+				const size_t new_vertex_ix = vertex - m_nodes.original_vertices_count;
+				if(new_vertex_ix >= m_nodes.new_vertices.size()) {
+					throw Exception("error building reject - nodes reference non-existing vertex " + std::to_string(vertex));
+				}
+
+				return Math::Point2D(m_nodes.new_vertices[new_vertex_ix].x / 65536.0, m_nodes.new_vertices[new_vertex_ix].y / 65536.0);
+			}
+
+			uint32_t GetChildSubsector(uint32_t child) const {
+				const uint32_t subsector = child & ~Nodes::CHILD_SUBSECTOR_FLAG;
+				if(subsector >= m_nodes.subsector_segs_counts.size()) {
+					throw Exception("error building reject - nodes reference non-existing subsector " + std::to_string(subsector));
+				}
+				return subsector;
+			}
+
+			static void CheckChildNode(uint32_t node, uint32_t child) {
+				if(child >= node) {
+					throw Exception("error building reject - bad nodes, node " + std::to_string(node) + " references node " + std::to_string(child));
+				}
+			}
+
+			const Udmf::Map& m_map;
+			const Nodes::GlNodes& m_nodes;
+			std::vector<Math::Point2D> m_vertices;
+
+			// the first seg of each subsector, the last one is the number of segs
+			std::vector<size_t> m_first_segs;
+		};
+
+		// cells and portals between them from the subsectors of the BSP tree of walls: segs of linedefs
+		// are walls, minisegs are split into portals by neighbor subsectors
+		class CellsBuilder {
+		public:
+			explicit CellsBuilder(const NodesGeometry& geometry)
+				: m_geometry(geometry)
+			{}
+
+			// 'components_cells' - cells of each component; returns 'false' if a part of an edge between cells leads
+			// into no cell (sight may pass there, the cells are not exact)
+			bool Build(const Nodes::GlNodes& nodes, std::vector<Cell>& cells, std::vector<std::vector<uint32_t> >& components_cells) {
+				const size_t subsectors_count = m_geometry.GetSubsectorsCount();
+				m_polygons.resize(subsectors_count);
+				for(size_t six=0; six<subsectors_count; six++) {
+					m_geometry.GetSubsectorPolygon((uint32_t)six, m_polygons[six]);
+				}
+
+				cells.assign(subsectors_count, Cell());
+				bool are_exact = true;
+				size_t first_seg_ix = 0;
+				for(size_t six=0; six<subsectors_count; six++) {
+					const std::vector<Math::Point2D>& polygon = m_polygons[six];
+					for(size_t gix=0; gix<polygon.size(); gix++) {
+						if(nodes.segs[first_seg_ix + gix].linedef == Nodes::ID_NONE) {
+							const Math::Point2D& p = polygon[gix];
+							const Math::Point2D& q = polygon[(gix + 1) % polygon.size()];
+							const size_t first_portal_ix = cells[six].portals.size();
+							are_exact &= AddEdgePortals((uint32_t)six, p, q, cells[six].portals);
+							if(cells[six].portals.size() > first_portal_ix) {
+								cells[six].edges.push_back(Cell::Edge(p, q, first_portal_ix, cells[six].portals.size() - first_portal_ix));
+							}
+						}
+					}
+					first_seg_ix += polygon.size();
+				}
+
+				// connected components (union-find with path halving)
+				std::vector<uint32_t> parents(subsectors_count);
+				for(size_t six=0; six<subsectors_count; six++) {
+					parents[six] = (uint32_t)six;
+				}
+
+				const auto find_root = [&parents](uint32_t ix) {
+					while(parents[ix] != ix) {
+						parents[ix] = parents[parents[ix]];
+						ix = parents[ix];
+					}
+					return ix;
+				};
+
+				for(size_t six=0; six<subsectors_count; six++) {
+					for(size_t pix=0; pix<cells[six].portals.size(); pix++) {
+						const uint32_t root1 = find_root((uint32_t)six);
+						const uint32_t root2 = find_root(cells[six].portals[pix].subsector);
+						parents[std::max(root1, root2)] = std::min(root1, root2);
+					}
+				}
+
+				std::vector<uint32_t> roots_components(subsectors_count, Nodes::ID_NONE);
+				components_cells.clear();
+				for(size_t six=0; six<subsectors_count; six++) {
+					const uint32_t root = find_root((uint32_t)six);
+					if(roots_components[root] == Nodes::ID_NONE) {
+						roots_components[root] = (uint32_t)components_cells.size();
+						components_cells.push_back(std::vector<uint32_t>());
+					}
+
+					cells[six].component = roots_components[root];
+					components_cells[cells[six].component].push_back((uint32_t)six);
+				}
+				return are_exact;
+			}
+
+		private:
+			// split the edge 'p' - 'q' of the subsector into portals by neighbor subsectors: a portal is the overlap
+			// with an edge of a neighbor on the same line going in the opposite direction, extended by EDGE_MATCH_DISTANCE
+			// (ends of edges differ by rounding, neighbors touching the edge at a point get a portal too); parts of the edge,
+			// that no such edge covers, lead into all subsectors touching them; returns 'false' if no subsector touches
+			// such a part
+			bool AddEdgePortals(uint32_t subsector, const Math::Point2D& p, const Math::Point2D& q, std::vector<Portal>& portals) const {
+				struct EdgePart {
+					double begin, end;
+					uint32_t subsector;
+
+					EdgePart(double begin_, double end_, uint32_t subsector_)
+						: begin(begin_)
+						, end(end_)
+						, subsector(subsector_)
+					{}
+
+					bool operator< (const EdgePart& part) const {
+						return (begin != part.begin) ? begin < part.begin : subsector < part.subsector;
+					}
+				};
+
+				const double length = Math::Get2DDistance(p.x, p.y, q.x, q.y);
+				if(length < ON_LINE_DISTANCE) {
+					return true;
+				}
+
+				// the subsector is on the right of its edges
+				const double dx = (q.x - p.x) / length, dy = (q.y - p.y) / length;
+				const double out_dx = -dy * EDGE_MATCH_DISTANCE, out_dy = dx * EDGE_MATCH_DISTANCE;
+
+				// subsectors touching the edge - the ones overlapping a thin band around it
+				std::vector<Math::Point2D> band;
+				band.push_back(Math::Point2D(p.x - out_dx, p.y - out_dy));
+				band.push_back(Math::Point2D(p.x + out_dx, p.y + out_dy));
+				band.push_back(Math::Point2D(q.x + out_dx, q.y + out_dy));
+				band.push_back(Math::Point2D(q.x - out_dx, q.y - out_dy));
+				std::vector<uint32_t> neighbors;
+				m_geometry.GetOverlappedSubsectors(band, neighbors);
+
+				std::vector<EdgePart> parts;
+				for(size_t nix=0; nix<neighbors.size(); nix++) {
+					if(neighbors[nix] == subsector) {
+						continue;
+					}
+
+					const std::vector<Math::Point2D>& polygon = m_polygons[neighbors[nix]];
+					for(size_t gix=0; gix<polygon.size(); gix++) {
+						const Math::Point2D& a = polygon[gix];
+						const Math::Point2D& b = polygon[(gix + 1) % polygon.size()];
+						if(   std::abs(dx * (a.y - p.y) - dy * (a.x - p.x)) > EDGE_MATCH_DISTANCE
+						   || std::abs(dx * (b.y - p.y) - dy * (b.x - p.x)) > EDGE_MATCH_DISTANCE)
+						{
+							continue;
+						}
+
+						const double begin = std::max(0.0, dx * (b.x - p.x) + dy * (b.y - p.y) - EDGE_MATCH_DISTANCE);
+						const double end = std::min(length, dx * (a.x - p.x) + dy * (a.y - p.y) + EDGE_MATCH_DISTANCE);
+						if(end > begin) {
+							parts.push_back(EdgePart(begin, end, neighbors[nix]));
+						}
+					}
+				}
+				std::sort(parts.begin(), parts.end());
+
+				// uncovered parts of the edge
+				std::vector<EdgePart> gaps;
+				bool are_gaps_touched = true;
+				double covered_end = 0.0;
+				for(size_t pix=0; pix<=parts.size(); pix++) {
+					const double begin = (pix < parts.size()) ? parts[pix].begin : length;
+					if(begin - covered_end > ON_LINE_DISTANCE) {
+						const size_t gaps_count = gaps.size();
+						for(size_t nix=0; nix<neighbors.size(); nix++) {
+							if(neighbors[nix] != subsector && IsTouchingPart(m_polygons[neighbors[nix]], p, dx, dy, covered_end, begin)) {
+								gaps.push_back(EdgePart(covered_end, begin, neighbors[nix]));
+							}
+						}
+						are_gaps_touched &= gaps.size() > gaps_count;
+					}
+
+					if(pix < parts.size()) {
+						covered_end = std::max(covered_end, parts[pix].end);
+					}
+				}
+				parts.insert(parts.end(), gaps.begin(), gaps.end());
+				std::sort(parts.begin(), parts.end());
+
+				for(size_t pix=0; pix<parts.size(); pix++) {
+					portals.push_back(Portal(Math::Point2D(p.x + dx * parts[pix].begin, p.y + dy * parts[pix].begin),
+											 Math::Point2D(p.x + dx * parts[pix].end, p.y + dy * parts[pix].end), parts[pix].subsector));
+				}
+				return are_gaps_touched;
+			}
+
+			// whether the convex polygon comes closer than EDGE_MATCH_DISTANCE to the part [begin, end] of the line
+			// through 'p' with the direction ('dx', 'dy')
+			static bool IsTouchingPart(const std::vector<Math::Point2D>& polygon, const Math::Point2D& p, double dx, double dy, double begin, double end) {
+				// the polygon is clipped to the band around the part, something must be left
+				std::vector<Math::Point2D> clipped = polygon;
+				const double bounds[][3] = {
+					// direction of the distance and the limit
+					{dx, dy, end + EDGE_MATCH_DISTANCE},
+					{-dx, -dy, -begin + EDGE_MATCH_DISTANCE},
+					{-dy, dx, EDGE_MATCH_DISTANCE},
+					{dy, -dx, EDGE_MATCH_DISTANCE}
+				};
+				for(size_t bix=0; bix<_countof(bounds) && !clipped.empty(); bix++) {
+					std::vector<Math::Point2D> next_clipped;
+					for(size_t pix=0; pix<clipped.size(); pix++) {
+						const Math::Point2D& a = clipped[pix];
+						const Math::Point2D& b = clipped[(pix + 1) % clipped.size()];
+						const double a_excess = bounds[bix][0] * (a.x - p.x) + bounds[bix][1] * (a.y - p.y) - bounds[bix][2];
+						const double b_excess = bounds[bix][0] * (b.x - p.x) + bounds[bix][1] * (b.y - p.y) - bounds[bix][2];
+						if(a_excess <= 0.0) {
+							next_clipped.push_back(a);
+						}
+
+						if((a_excess < 0.0 && b_excess > 0.0) || (a_excess > 0.0 && b_excess < 0.0)) {
+							const double t = a_excess / (a_excess - b_excess);
+							next_clipped.push_back(Math::Point2D(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t));
+						}
+					}
+					clipped.swap(next_clipped);
+				}
+				return !clipped.empty();
+			}
+
+			const NodesGeometry& m_geometry;
+			std::vector<std::vector<Math::Point2D> > m_polygons;
+		};
+
+		// visibility of cells by the flow through chains of portals: the portal leading out of the chain
+		// is clipped to the part, that a straight line through the first portal and the last one can reach,
+		// the first portal is clipped back the same way; chains entering a cell through the same edge
+		// are merged (clipped parts are extended to cover both chains), so each edge is passed a few times
+		// instead of once per chain (or per portal of narrow neighbor cells on a long edge); the flow stops as soon
+		// as cells of every sector of the component are visible - sectors see each other, whatever else is found
+		class VisibilityFlow {
+		public:
+			// 'cells_sectors' - sectors, that each cell overlaps
+			VisibilityFlow(const std::vector<Cell>& cells,
+						   const std::vector<std::vector<uint32_t> >& components_cells,
+						   const std::vector<std::vector<uint32_t> >& cells_sectors,
+						   size_t sectors_count)
+				: m_cells(cells)
+				, m_components_cells(components_cells)
+				, m_cells_sectors(cells_sectors)
+				, m_first_portals_ids(cells.size() + 1, 0)
+				, m_flow_ix(0)
+				, m_cells_marks(cells.size(), 0)
+				, m_sectors_marks(sectors_count, 0)
+				, m_mark(0)
+				, m_visible_sectors_count(0)
+				, m_component_sectors_count(0)
+			{
+				for(size_t cix=0; cix<cells.size(); cix++) {
+					m_first_portals_ids[cix + 1] = m_first_portals_ids[cix] + cells[cix].portals.size();
+				}
+
+				// entries through edges of cells go first, the ones through portals, that are on no edge
+				// of the entered cell, follow them
+				std::vector<size_t> first_edges_ids(cells.size() + 1, 0);
+				for(size_t cix=0; cix<cells.size(); cix++) {
+					first_edges_ids[cix + 1] = first_edges_ids[cix] + cells[cix].edges.size();
+					for(size_t eix=0; eix<cells[cix].edges.size(); eix++) {
+						const Cell::Edge& edge = cells[cix].edges[eix];
+						m_entries.push_back(Portal(edge.right, edge.left, (uint32_t)cix));
+					}
+				}
+
+				m_portals_entries_ids.resize(m_first_portals_ids.back());
+				for(size_t cix=0; cix<cells.size(); cix++) {
+					for(size_t pix=0; pix<cells[cix].portals.size(); pix++) {
+						const Portal& portal = cells[cix].portals[pix];
+						size_t entry_id = GetEntryEdgeId(portal, first_edges_ids);
+						if(entry_id == SIZE_MAX) {
+							entry_id = m_entries.size();
+							m_entries.push_back(portal);
+						}
+						m_portals_entries_ids[m_first_portals_ids[cix] + pix] = entry_id;
+					}
+				}
+				m_entries_states.resize(m_entries.size());
+
+				// the flow from a source portal is bounded by the number of portals of its component
+				m_components_steps_max.assign(components_cells.size(), 0);
+				for(size_t cix=0; cix<cells.size(); cix++) {
+					m_components_steps_max[cells[cix].component] += cells[cix].portals.size() * FLOW_STEPS_PER_PORTAL;
+				}
+
+				m_components_sectors_counts.assign(components_cells.size(), 0);
+				for(size_t cix=0; cix<components_cells.size(); cix++) {
+					m_mark++;
+					for(size_t ccix=0; ccix<components_cells[cix].size(); ccix++) {
+						const std::vector<uint32_t>& sectors = cells_sectors[components_cells[cix][ccix]];
+						for(size_t six=0; six<sectors.size(); six++) {
+							if(m_sectors_marks[sectors[six]] != m_mark) {
+								m_sectors_marks[sectors[six]] = m_mark;
+								m_components_sectors_counts[cix]++;
+							}
+						}
+					}
+				}
+			}
+
+			// put sorted cells, that may be seen from the cell (and the cell itself), into 'visible_cells'; the cells
+			// of every sector of the component may be not all there, if a cell of each is; returns 'false' if the flow
+			// has too many steps, all cells of the component are put then
+			bool GetVisibleCells(uint32_t cell, std::vector<uint32_t>& visible_cells) {
+				visible_cells.clear();
+				m_mark++;
+				m_visible_sectors_count = 0;
+				MarkCell(cell, visible_cells);
+
+				const uint32_t component = m_cells[cell].component;
+				m_component_sectors_count = m_components_sectors_counts[component];
+
+				// a line from the cell to another one leaves the cell for the last time through one of its portals,
+				// so chains start with them and do not enter the cell; collinear portals are passed as one source
+				std::vector<SourcePortal> sources;
+				const std::vector<Portal>& portals = m_cells[cell].portals;
+				for(size_t pix=0; pix<portals.size(); pix++) {
+					sources.push_back(SourcePortal(portals[pix]));
+				}
+				MergeSourcePortals(sources);
+
+				bool is_exact = true;
+				for(size_t six=0; six<sources.size() && m_visible_sectors_count < m_component_sectors_count; six++) {
+					const SourcePortal& source = sources[six];
+
+					// states of entries are valid during one flow
+					m_flow_ix++;
+					const size_t steps_max = m_components_steps_max[component];
+					size_t steps_count = 0;
+					bool is_passed = true;
+					for(size_t pix=0; pix<source.passes.size() && is_passed; pix++) {
+						MarkCell(source.passes[pix].subsector, visible_cells);
+						is_passed = PassCell(cell, source.portal, source.portal, source.passes[pix], true, steps_max, steps_count, visible_cells);
+					}
+
+					while(is_passed && !m_queue.empty() && m_visible_sectors_count < m_component_sectors_count) {
+						const size_t entry_id = m_queue.top().entry_id;
+						m_queue.pop();
+
+						EntryState& entry_state = m_entries_states[entry_id];
+						entry_state.is_queued = false;
+						is_passed = PassCell(cell,
+											 source.portal,
+											 GetPart(source.portal, entry_state.source_begin, entry_state.source_end),
+											 GetPart(m_entries[entry_id], entry_state.pass_begin, entry_state.pass_end),
+											 false,
+											 steps_max,
+											 steps_count,
+											 visible_cells);
+					}
+
+					m_queue = std::priority_queue<QueuedEntry>();
+					if(!is_passed) {
+						// too many chains - everything connected to the cell is visible
+						const std::vector<uint32_t>& component_cells = m_components_cells[component];
+						for(size_t cix=0; cix<component_cells.size(); cix++) {
+							MarkCell(component_cells[cix], visible_cells);
+						}
+						is_exact = false;
+						break;
+					}
+				}
+
+				std::sort(visible_cells.begin(), visible_cells.end());
+				return is_exact;
+			}
+
+			// 'true' if cells of every sector of the component are visible from the last cell
+			bool AreAllSectorsVisible() const {
+				return m_visible_sectors_count >= m_component_sectors_count;
+			}
+
+		private:
+			// first portal of chains - collinear portals out of the cell joined together
+			struct SourcePortal {
+				Portal portal;
+				std::vector<Portal> passes;
+
+				explicit SourcePortal(const Portal& portal_)
+					: portal(portal_)
+					, passes(1, portal_)
+				{}
+			};
+
+			// chains that entered a cell through an edge (or a portal) from the current first portal; parts
+			// of the first portal and of the entry are positions of ends on them, [0, 1]
+			struct EntryState {
+				uint32_t flow_ix;
+
+				// the cell behind the portal is waiting to be passed with the state
+				bool is_queued;
+
+				double source_begin, source_end;
+				double pass_begin, pass_end;
+
+				EntryState()
+					: flow_ix(0)
+					, is_queued(false)
+					, source_begin(0.0)
+					, source_end(0.0)
+					, pass_begin(0.0)
+					, pass_end(0.0)
+				{}
+			};
+
+			// entries closer to the first portal are passed first, so chains are mostly merged before they go further
+			struct QueuedEntry {
+				double distance;
+				size_t entry_id;
+
+				QueuedEntry(double distance_, size_t entry_id_)
+					: distance(distance_)
+					, entry_id(entry_id_)
+				{}
+
+				bool operator< (const QueuedEntry& queued_entry) const {
+					return distance > queued_entry.distance;
+				}
+			};
+
+			// edge of the cell behind the portal, that the portal is on, as the entry into the cell
+			// (ends of the edge and of the portal differ by rounding); SIZE_MAX - the portal is on no edge
+			size_t GetEntryEdgeId(const Portal& portal, const std::vector<size_t>& first_edges_ids) const {
+				const std::vector<Cell::Edge>& edges = m_cells[portal.subsector].edges;
+				const Math::Point2D middle((portal.left.x + portal.right.x) / 2, (portal.left.y + portal.right.y) / 2);
+				for(size_t eix=0; eix<edges.size(); eix++) {
+					const Portal& entry = m_entries[first_edges_ids[portal.subsector] + eix];
+					const double position = GetPosition(entry, middle);
+					if(   position > 0.0 && position < 1.0
+					   && (portal.right.x - portal.left.x) * (entry.right.x - entry.left.x)
+						  + (portal.right.y - portal.left.y) * (entry.right.y - entry.left.y) > 0.0
+					   && GetDistanceToLine(portal.left, entry.left, entry.right) <= EDGE_MATCH_DISTANCE
+					   && GetDistanceToLine(portal.right, entry.left, entry.right) <= EDGE_MATCH_DISTANCE)
+					{
+						return first_edges_ids[portal.subsector] + eix;
+					}
+				}
+				return SIZE_MAX;
+			}
+
+			// join source portals, that continue each other on one line
+			static void MergeSourcePortals(std::vector<SourcePortal>& sources) {
+				// the portal, that continues each portal, Nodes::ID_NONE - none
+				std::vector<uint32_t> next_ixs(sources.size(), Nodes::ID_NONE);
+				std::vector<char> are_continuing(sources.size(), 0);
+				for(size_t six=0; six<sources.size(); six++) {
+					const Portal& portal = sources[six].portal;
+					for(size_t tix=0; tix<sources.size(); tix++) {
+						const Portal& next_portal = sources[tix].portal;
+						if(   tix == six || are_continuing[tix]
+						   || Math::Get2DDistance(portal.right.x, portal.right.y, next_portal.left.x, next_portal.left.y) > ON_LINE_DISTANCE
+						   || (portal.right.x - portal.left.x) * (next_portal.right.x - next_portal.left.x)
+							  + (portal.right.y - portal.left.y) * (next_portal.right.y - next_portal.left.y) <= 0.0
+						   || GetDistanceToLine(next_portal.right, portal.left, portal.right) > ON_LINE_DISTANCE
+						   || GetDistanceToLine(portal.left, next_portal.left, next_portal.right) > ON_LINE_DISTANCE)
+						{
+							continue;
+						}
+
+						next_ixs[six] = (uint32_t)tix;
+						are_continuing[tix] = 1;
+						break;
+					}
+				}
+
+				std::vector<SourcePortal> merged_sources;
+				std::vector<char> are_merged(sources.size(), 0);
+				for(size_t six=0; six<sources.size(); six++) {
+					if(are_continuing[six]) {
+						continue;
+					}
+
+					merged_sources.push_back(sources[six]);
+					are_merged[six] = 1;
+					for(uint32_t tix=next_ixs[six]; tix!=Nodes::ID_NONE && !are_merged[tix]; tix=next_ixs[tix]) {
+						merged_sources.back().portal.right = sources[tix].portal.right;
+						merged_sources.back().passes.push_back(sources[tix].portal);
+						are_merged[tix] = 1;
+					}
+				}
+
+				// (portals of a loop, that must not happen on one line)
+				for(size_t six=0; six<sources.size(); six++) {
+					if(!are_merged[six]) {
+						merged_sources.push_back(sources[six]);
+					}
+				}
+				sources.swap(merged_sources);
+			}
+
+			// pass the cell behind the 'pass' portal: clip its portals and merge chains into their states;
+			// 'is_first' - 'pass' is the first portal of chains; returns 'false' if there are too many steps
+			bool PassCell(uint32_t source_cell,
+						  const Portal& first_portal,
+						  const Portal& source,
+						  const Portal& pass,
+						  bool is_first,
+						  size_t steps_max,
+						  size_t& steps_count,
+						  std::vector<uint32_t>& visible_cells)
+			{
+				// lines cross the source before the pass: only the part of the source behind the pass and the part of the pass
+				// in front of the source are crossed by them (long portals of wedge cells reach over the lines of each other)
+				Portal source_part = source, pass_part = pass;
+				if(!is_first && (!ClipPortal(source_part, pass.left, pass.right) || !ClipPortal(pass_part, source.right, source.left))) {
+					return true;
+				}
+
+				const Cell& cell = m_cells[pass.subsector];
+				for(size_t eix=0; eix<cell.edges.size(); eix++) {
+					const Cell::Edge& edge = cell.edges[eix];
+					if(++steps_count > steps_max) {
+						return false;
+					}
+
+					// portals of the edge are on its line, they are clipped the same way as the edge is: only the ones
+					// overlapping the part of the edge left by clipping are clipped themselves (long edges of wide
+					// cells have many portals of narrow neighbor cells)
+					const Portal edge_portal(edge.left, edge.right, Nodes::ID_NONE);
+					Portal edge_part = edge_portal;
+					if(!ClipPortal(edge_part, pass.right, pass.left) || (!is_first && !ClipByAntipenumbra(source_part, pass_part, edge_part))) {
+						continue;
+					}
+
+					const double tolerance = ON_LINE_DISTANCE / Math::Get2DDistance(edge.left.x, edge.left.y, edge.right.x, edge.right.y);
+					const double part_begin = GetPosition(edge_portal, edge_part.left) - tolerance;
+					const double part_end = GetPosition(edge_portal, edge_part.right) + tolerance;
+					for(size_t pix=edge.first_portal_ix; pix<edge.first_portal_ix + edge.portals_count; pix++) {
+						const Portal& portal = cell.portals[pix];
+						if(   portal.subsector == source_cell
+						   || GetPosition(edge_portal, portal.right) < part_begin || GetPosition(edge_portal, portal.left) > part_end)
+						{
+							continue;
+						}
+
+						if(++steps_count > steps_max) {
+							return false;
+						}
+
+						// the next cell is in front of the portal the current one is entered through
+						Portal target = portal;
+						if(!ClipPortal(target, pass.right, pass.left)) {
+							continue;
+						}
+
+						Portal target_source = source_part;
+						if(!is_first) {
+							if(!ClipByAntipenumbra(source_part, pass_part, target)) {
+								continue;
+							}
+
+							Portal reversed_source = source_part.GetReversed();
+							if(!ClipByAntipenumbra(target.GetReversed(), pass_part.GetReversed(), reversed_source)) {
+								continue;
+							}
+							target_source = reversed_source.GetReversed();
+						}
+
+						MarkCell(portal.subsector, visible_cells);
+						MergeEntryState(m_portals_entries_ids[m_first_portals_ids[pass.subsector] + pix], first_portal, target_source, target);
+					}
+				}
+				return true;
+			}
+
+			// merge the chains with the ones, that entered the cell through the entry before; the entry is queued
+			// if the chains are not covered by the previous ones
+			void MergeEntryState(size_t entry_id, const Portal& first_portal, const Portal& source, const Portal& pass) {
+				const Portal& entry = m_entries[entry_id];
+				double source_begin = GetPosition(first_portal, source.left), source_end = GetPosition(first_portal, source.right);
+				double pass_begin = GetPosition(entry, pass.left), pass_end = GetPosition(entry, pass.right);
+
+				// parts are extended to steps of portals, so states of an entry change a few times only
+				source_begin = std::floor(source_begin * PORTAL_STEPS_COUNT) / PORTAL_STEPS_COUNT;
+				source_end = std::ceil(source_end * PORTAL_STEPS_COUNT) / PORTAL_STEPS_COUNT;
+				pass_begin = std::floor(pass_begin * PORTAL_STEPS_COUNT) / PORTAL_STEPS_COUNT;
+				pass_end = std::ceil(pass_end * PORTAL_STEPS_COUNT) / PORTAL_STEPS_COUNT;
+
+				EntryState& entry_state = m_entries_states[entry_id];
+				if(entry_state.flow_ix == m_flow_ix) {
+					if(   source_begin >= entry_state.source_begin && source_end <= entry_state.source_end
+					   && pass_begin >= entry_state.pass_begin && pass_end <= entry_state.pass_end)
+					{
+						return;
+					}
+
+					source_begin = std::min(source_begin, entry_state.source_begin);
+					source_end = std::max(source_end, entry_state.source_end);
+					pass_begin = std::min(pass_begin, entry_state.pass_begin);
+					pass_end = std::max(pass_end, entry_state.pass_end);
+
+				} else {
+					entry_state.flow_ix = m_flow_ix;
+					entry_state.is_queued = false;
+				}
+
+				entry_state.source_begin = source_begin;
+				entry_state.source_end = source_end;
+				entry_state.pass_begin = pass_begin;
+				entry_state.pass_end = pass_end;
+				if(!entry_state.is_queued) {
+					entry_state.is_queued = true;
+					m_queue.push(QueuedEntry(Math::Get2DDistanceSquared((first_portal.left.x + first_portal.right.x) / 2, (first_portal.left.y + first_portal.right.y) / 2,
+																		 (entry.left.x + entry.right.x) / 2, (entry.left.y + entry.right.y) / 2), entry_id));
+				}
+			}
+
+			void MarkCell(uint32_t cell, std::vector<uint32_t>& visible_cells) {
+				if(m_cells_marks[cell] != m_mark) {
+					m_cells_marks[cell] = m_mark;
+					visible_cells.push_back(cell);
+
+					const std::vector<uint32_t>& sectors = m_cells_sectors[cell];
+					for(size_t six=0; six<sectors.size(); six++) {
+						if(m_sectors_marks[sectors[six]] != m_mark) {
+							m_sectors_marks[sectors[six]] = m_mark;
+							m_visible_sectors_count++;
+						}
+					}
+				}
+			}
+
+			// distance from the point to the line through 'a' and 'b'
+			static double GetDistanceToLine(const Math::Point2D& point, const Math::Point2D& a, const Math::Point2D& b) {
+				return std::abs((b.x - a.x) * (point.y - a.y) - (b.y - a.y) * (point.x - a.x)) / Math::Get2DDistance(a.x, a.y, b.x, b.y);
+			}
+
+			// position of the point of the portal: 0 - left end, 1 - right end
+			static double GetPosition(const Portal& portal, const Math::Point2D& point) {
+				const double dx = portal.right.x - portal.left.x, dy = portal.right.y - portal.left.y;
+				return (dx * (point.x - portal.left.x) + dy * (point.y - portal.left.y)) / (dx * dx + dy * dy);
+			}
+
+			static Portal GetPart(const Portal& portal, double begin, double end) {
+				const double dx = portal.right.x - portal.left.x, dy = portal.right.y - portal.left.y;
+				return Portal(Math::Point2D(portal.left.x + dx * begin, portal.left.y + dy * begin),
+							  Math::Point2D(portal.left.x + dx * end, portal.left.y + dy * end), portal.subsector);
+			}
+
+			// keep the part of the portal on the right of the line 'a' - 'b' (or closer to it than the margin); the ends
+			// of the line are known up to CLIP_DISTANCE, so the line may turn around one end by the other one: the margin
+			// is CLIP_DISTANCE at 'a' and grows by 2 * CLIP_DISTANCE per length of the line away from it (a short line
+			// clips far portals a little or not at all); returns 'false' if nothing is left
+			static bool ClipPortal(Portal& portal, const Math::Point2D& a, const Math::Point2D& b) {
+				// (the hottest place of the flow, the distance is not taken from Math)
+				const double length = std::sqrt((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+				if(length < ON_LINE_DISTANCE) {
+					// the line is not defined, nothing is clipped
+					return true;
+				}
+
+				const double reach = std::sqrt(std::max((portal.left.x - a.x) * (portal.left.x - a.x) + (portal.left.y - a.y) * (portal.left.y - a.y),
+														(portal.right.x - a.x) * (portal.right.x - a.x) + (portal.right.y - a.y) * (portal.right.y - a.y)));
+				const double margin = CLIP_DISTANCE * (1.0 + 2.0 * reach / length);
+
+				// distances to the left of the line
+				const double left_distance = ((b.x - a.x) * (portal.left.y - a.y) - (b.y - a.y) * (portal.left.x - a.x)) / length;
+				const double right_distance = ((b.x - a.x) * (portal.right.y - a.y) - (b.y - a.y) * (portal.right.x - a.x)) / length;
+				if(left_distance > margin && right_distance > margin) {
+					return false;
+				}
+
+				if(left_distance > margin) {
+					const double t = (left_distance - margin) / (left_distance - right_distance);
+					portal.left = Math::Point2D(portal.left.x + (portal.right.x - portal.left.x) * t, portal.left.y + (portal.right.y - portal.left.y) * t);
+
+				} else if(right_distance > margin) {
+					const double t = (right_distance - margin) / (right_distance - left_distance);
+					portal.right = Math::Point2D(portal.right.x + (portal.left.x - portal.right.x) * t, portal.right.y + (portal.left.y - portal.right.y) * t);
+				}
+				return true;
+			}
+
+			// keep the part of the portal, that lines through 'source' and then through 'pass' may reach:
+			// the region is bounded by the lines through the crossed ends of 'source' and 'pass'
+			static bool ClipByAntipenumbra(const Portal& source, const Portal& pass, Portal& portal) {
+				return ClipPortal(portal, source.right, pass.left) && ClipPortal(portal, pass.right, source.left);
+			}
+
+			const std::vector<Cell>& m_cells;
+			const std::vector<std::vector<uint32_t> >& m_components_cells;
+			const std::vector<std::vector<uint32_t> >& m_cells_sectors;
+
+			// portals of a cell are numbered after the ones of the previous cell
+			std::vector<size_t> m_first_portals_ids;
+
+			// ways into cells, that chains are merged by: edges of cells, the ones going into the cell,
+			// and portals, that are on no edge of the cell behind them
+			std::vector<Portal> m_entries;
+			std::vector<size_t> m_portals_entries_ids;
+			std::vector<EntryState> m_entries_states;
+			uint32_t m_flow_ix;
+
+			std::priority_queue<QueuedEntry> m_queue;
+
+			// a cell (a sector) is already visible if it is marked with the current mark
+			std::vector<uint32_t> m_cells_marks;
+			std::vector<uint32_t> m_sectors_marks;
+			uint32_t m_mark;
+
+			// number of sectors marked with the current mark, of sectors of the component of the current cell
+			size_t m_visible_sectors_count;
+			size_t m_component_sectors_count;
+
+			std::vector<size_t> m_components_steps_max;
+			std::vector<size_t> m_components_sectors_counts;
+		};
+
+		void BuildReject(const Udmf::Map& map, const Nodes::GlNodes& nodes, unsigned char float_precision, RejectTable& reject) {
+			class Utils {
+			public:
+				static bool HasPlaneEquation(const Udmf::Sector::PlaneEquation& plane_equation) {
+					return plane_equation.cx != 0.0 || plane_equation.cy != 0.0 || plane_equation.cz != 0.0 || plane_equation.c != 0.0;
+				}
+
+				static bool HasHeights(const Udmf::Vertex& vertex) {
+					return vertex.have_zfloor || vertex.have_zceiling;
+				}
+
+				// run the work in all hardware threads, the first error of threads is thrown
+				static void RunInThreads(const std::function<void()>& work) {
+					const auto run_work = [&work](std::exception_ptr& error) {
+						try {
+							work();
+
+						} catch(...) {
+							error = std::current_exception();
+						}
+					};
+
+					const size_t threads_count = (std::thread::hardware_concurrency() > 0) ? std::thread::hardware_concurrency() : 1;
+					std::vector<std::exception_ptr> errors(threads_count);
+					std::vector<std::thread> threads;
+					for(size_t thix=1; thix<threads_count; thix++) {
+						threads.push_back(std::thread(run_work, std::ref(errors[thix])));
+					}
+					run_work(errors[0]);
+					for(size_t thix=0; thix<threads.size(); thix++) {
+						threads[thix].join();
+					}
+
+					for(size_t thix=0; thix<errors.size(); thix++) {
+						if(errors[thix]) {
+							std::rethrow_exception(errors[thix]);
+						}
+					}
+				}
+			};
+
+			const size_t sectors_count = map.sectors.size();
+			const NodesGeometry geometry(map, nodes, float_precision);
+
+			// sight does not pass through lines of closed sectors (the ceiling is not above the floor),
+			// sectors with heights of vertices may be open at some points
+			std::vector<char> closed_sectors(sectors_count, 0);
+			for(size_t six=0; six<sectors_count; six++) {
+				const Udmf::Sector& sector = map.sectors[six];
+				closed_sectors[six] = sector.heightceiling <= sector.heightfloor
+									  && !Utils::HasPlaneEquation(sector.floor_plane_equation) && !Utils::HasPlaneEquation(sector.ceiling_plane_equation);
+			}
+
+			std::vector<uint32_t> linedefs_sectors[2];
+			for(size_t six=0; six<_countof(linedefs_sectors); six++) {
+				linedefs_sectors[six].assign(map.linedefs.size(), Nodes::ID_NONE);
+			}
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				const Udmf::Linedef& linedef = map.linedefs[lix];
+				const unsigned int sidedefs[] = {linedef.sidefront, linedef.sideback};
+				for(size_t six=0; six<_countof(sidedefs); six++) {
+					if(sidedefs[six] < map.sidedefs.size() && map.sidedefs[sidedefs[six]].sector < sectors_count) {
+						linedefs_sectors[six][lix] = map.sidedefs[sidedefs[six]].sector;
+					}
+				}
+
+				if(   linedef.v1 < map.vertices.size() && linedef.v2 < map.vertices.size()
+				   && (Utils::HasHeights(map.vertices[linedef.v1]) || Utils::HasHeights(map.vertices[linedef.v2])))
+				{
+					for(size_t six=0; six<_countof(linedefs_sectors); six++) {
+						if(linedefs_sectors[six][lix] != Nodes::ID_NONE) {
+							closed_sectors[linedefs_sectors[six][lix]] = 0;
+						}
+					}
+				}
+			}
+
+			// walls - linedefs with an open sector on one side only, they face the open sector; heights are not
+			// checked otherwise, so the space where sight passes is split into convex cells by their own BSP tree,
+			// that has much fewer cells than the tree of the map (sector bounds do not stop sight)
+			Udmf::Map walls_map;
+			walls_map.vertices = map.vertices;
+			walls_map.sectors.push_back(Udmf::Sector());
+			walls_map.sidedefs.push_back(Udmf::Sidedef(0));
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				const Udmf::Linedef& linedef = map.linedefs[lix];
+				const bool is_front_open = linedefs_sectors[0][lix] != Nodes::ID_NONE && !closed_sectors[linedefs_sectors[0][lix]];
+				const bool is_back_open = linedefs_sectors[1][lix] != Nodes::ID_NONE && !closed_sectors[linedefs_sectors[1][lix]];
+				if(is_front_open != is_back_open) {
+					walls_map.linedefs.push_back(is_front_open ? Udmf::Linedef(linedef.v1, linedef.v2, 0) : Udmf::Linedef(linedef.v2, linedef.v1, 0));
+				}
+			}
+
+			// cells of the sight space, that subsectors of open sectors of the map overlap
+			std::vector<Cell> cells;
+			std::vector<std::vector<uint32_t> > components_cells;
+			std::vector<std::vector<uint32_t> > sectors_cells(sectors_count);
+			std::vector<char> placed_sectors(sectors_count, 0);
+			bool are_cells_exact = true;
+			if(!walls_map.linedefs.empty()) {
+				Nodes::GlNodes walls_nodes;
+				Nodes::BuildNodes(walls_map, float_precision, walls_nodes);
+				const NodesGeometry walls_geometry(walls_map, walls_nodes, float_precision);
+				are_cells_exact = CellsBuilder(walls_geometry).Build(walls_nodes, cells, components_cells);
+
+				std::vector<Math::Point2D> polygon;
+				std::vector<uint32_t> overlapped_cells;
+				for(size_t six=0; six<geometry.GetSubsectorsCount(); six++) {
+					const uint32_t sector = geometry.GetSubsectorSector((uint32_t)six);
+					if(sector == Nodes::ID_NONE) {
+						continue;
+					}
+
+					placed_sectors[sector] = 1;
+					if(!closed_sectors[sector]) {
+						geometry.GetSubsectorPolygon((uint32_t)six, polygon);
+						walls_geometry.GetOverlappedSubsectors(polygon, overlapped_cells);
+						sectors_cells[sector].insert(sectors_cells[sector].end(), overlapped_cells.begin(), overlapped_cells.end());
+					}
+				}
+
+			} else {
+				// nothing stops sight - one cell
+				cells.resize(1);
+				components_cells.assign(1, std::vector<uint32_t>(1, 0));
+				for(size_t six=0; six<geometry.GetSubsectorsCount(); six++) {
+					const uint32_t sector = geometry.GetSubsectorSector((uint32_t)six);
+					if(sector != Nodes::ID_NONE) {
+						placed_sectors[sector] = 1;
+						if(!closed_sectors[sector]) {
+							sectors_cells[sector].assign(1, 0);
+						}
+					}
+				}
+			}
+
+			std::vector<std::vector<uint32_t> > cells_sectors(cells.size());
+			for(size_t six=0; six<sectors_count; six++) {
+				std::vector<uint32_t>& sector_cells = sectors_cells[six];
+				std::sort(sector_cells.begin(), sector_cells.end());
+				sector_cells.erase(std::unique(sector_cells.begin(), sector_cells.end()), sector_cells.end());
+				for(size_t cix=0; cix<sector_cells.size(); cix++) {
+					cells_sectors[sector_cells[cix]].push_back((uint32_t)six);
+				}
+			}
+
+			// cells are taken by the first free thread; cells without sectors see nothing themselves (they are seen
+			// from cells with sectors), there is no flow at all if sight may leak out of the cells; first cells of sectors
+			// go first, the other cells of a sector, that sees all sectors connected to it from the first one, are skipped
+			// (a long road has a few sectors and many cells)
+			std::vector<char> are_first_cells(cells.size(), 0);
+			for(size_t six=0; six<sectors_count; six++) {
+				if(!sectors_cells[six].empty()) {
+					are_first_cells[sectors_cells[six].front()] = 1;
+				}
+			}
+
+			std::vector<std::vector<uint32_t> > cells_visible_cells(cells.size());
+			std::vector<char> are_seeing_all_sectors(cells.size(), 0);
+			std::vector<char> are_sectors_seeing_all(sectors_count, 0);
+			std::atomic<uint32_t> fallback_cells_count(0);
+			for(int pass=0; pass<2 && are_cells_exact; pass++) {
+				const bool are_first = (pass == 0);
+				if(!are_first) {
+					for(size_t cix=0; cix<cells.size(); cix++) {
+						for(size_t six=0; six<cells_sectors[cix].size() && are_seeing_all_sectors[cix]; six++) {
+							are_sectors_seeing_all[cells_sectors[cix][six]] = 1;
+						}
+					}
+				}
+
+				std::atomic<size_t> next_cell_ix(0);
+				Utils::RunInThreads([&]() {
+					VisibilityFlow flow(cells, components_cells, cells_sectors, sectors_count);
+					for(size_t cix=next_cell_ix++; cix<cells.size(); cix=next_cell_ix++) {
+						const std::vector<uint32_t>& sectors = cells_sectors[cix];
+						bool is_skipped = sectors.empty() || (are_first_cells[cix] != 0) != are_first;
+						if(!are_first && !is_skipped) {
+							is_skipped = true;
+							for(size_t six=0; six<sectors.size() && is_skipped; six++) {
+								is_skipped = are_sectors_seeing_all[sectors[six]] != 0;
+							}
+						}
+						if(is_skipped) {
+							continue;
+						}
+
+						if(!flow.GetVisibleCells((uint32_t)cix, cells_visible_cells[cix])) {
+							fallback_cells_count++;
+						}
+						are_seeing_all_sectors[cix] = flow.AreAllSectorsVisible() ? 1 : 0;
+					}
+				});
+			}
+			reject.fallback_cells_count = are_cells_exact ? fallback_cells_count.load() : (uint32_t)cells.size();
+
+			// visibility is symmetric, a pair of cells is visible if it is found from any of them
+			std::vector<std::vector<uint32_t> > cells_seeing_cells(cells.size());
+			for(size_t cix=0; cix<cells.size(); cix++) {
+				for(size_t vix=0; vix<cells_visible_cells[cix].size(); vix++) {
+					cells_seeing_cells[cells_visible_cells[cix][vix]].push_back((uint32_t)cix);
+				}
+			}
+			for(size_t cix=0; cix<cells.size(); cix++) {
+				std::vector<uint32_t>& visible_cells = cells_visible_cells[cix];
+				const size_t found_cells_count = visible_cells.size();
+				visible_cells.insert(visible_cells.end(), cells_seeing_cells[cix].begin(), cells_seeing_cells[cix].end());
+				std::inplace_merge(visible_cells.begin(), visible_cells.begin() + found_cells_count, visible_cells.end());
+				visible_cells.erase(std::unique(visible_cells.begin(), visible_cells.end()), visible_cells.end());
+			}
+
+			// sectors without subsectors have no place for actors, but they are not rejected anyway
+			std::vector<uint32_t> unplaced_sectors;
+			for(size_t six=0; six<sectors_count; six++) {
+				if(!placed_sectors[six]) {
+					unplaced_sectors.push_back((uint32_t)six);
+				}
+			}
+
+			// a sector can see the sectors of the cells visible from its cells; rows are built by threads
+			// in groups of 8, so each thread writes its own bytes
+			reject.sectors_count = (uint32_t)sectors_count;
+			reject.data.assign((sectors_count * sectors_count + 7) / 8, (char)0xFF);
+			std::atomic<uint64_t> visible_pairs_count(0);
+			std::atomic<size_t> next_group_ix(0);
+			Utils::RunInThreads([&]() {
+				uint64_t group_visible_pairs_count = 0;
+				const auto set_visible = [&reject, &group_visible_pairs_count, sectors_count](size_t row, size_t column) {
+					const size_t bit_ix = row * sectors_count + column;
+					const char mask = (char)(1 << (bit_ix % 8));
+					if(reject.data[bit_ix / 8] & mask) {
+						reject.data[bit_ix / 8] &= ~mask;
+						if(row != column) {
+							group_visible_pairs_count++;
+						}
+					}
+				};
+
+				std::vector<uint32_t> cells_marks(cells.size(), 0);
+				uint32_t mark = 0;
+				for(size_t gix=next_group_ix++; gix*8<sectors_count; gix=next_group_ix++) {
+					for(size_t row=gix*8; row<std::min(gix*8 + 8, sectors_count); row++) {
+						if(!placed_sectors[row]) {
+							for(size_t column=0; column<sectors_count; column++) {
+								set_visible(row, column);
+							}
+							continue;
+						}
+
+						set_visible(row, row);
+						for(size_t six=0; six<unplaced_sectors.size(); six++) {
+							set_visible(row, unplaced_sectors[six]);
+						}
+
+						if(!are_cells_exact) {
+							// open sectors see each other
+							if(!sectors_cells[row].empty()) {
+								for(size_t column=0; column<sectors_count; column++) {
+									if(!sectors_cells[column].empty()) {
+										set_visible(row, column);
+									}
+								}
+							}
+							continue;
+						}
+
+						mark++;
+						const std::vector<uint32_t>& sector_cells = sectors_cells[row];
+						for(size_t cix=0; cix<sector_cells.size(); cix++) {
+							const std::vector<uint32_t>& visible_cells = cells_visible_cells[sector_cells[cix]];
+							for(size_t vix=0; vix<visible_cells.size(); vix++) {
+								if(cells_marks[visible_cells[vix]] == mark) {
+									continue;
+								}
+
+								cells_marks[visible_cells[vix]] = mark;
+								const std::vector<uint32_t>& visible_sectors = cells_sectors[visible_cells[vix]];
+								for(size_t six=0; six<visible_sectors.size(); six++) {
+									set_visible(row, visible_sectors[six]);
+								}
+							}
+						}
+					}
+				}
+				visible_pairs_count += group_visible_pairs_count;
+			});
+			reject.visible_pairs_count = visible_pairs_count;
+
+			// bits after the table
+			if(sectors_count * sectors_count % 8 != 0) {
+				reject.data.back() &= (char)((1 << (sectors_count * sectors_count % 8)) - 1);
+			}
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WriteRejectToStream implementation
+
+namespace RoadGen {
+	namespace Reject {
+		void WriteRejectToStream(const RejectTable& reject, Io::OutStream& out_stream) {
+			out_stream.write(reject.data.data(), reject.data.size());
+		}
+	}
+}
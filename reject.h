@@ -0,0 +1,59 @@
+
+// REJECT builder - sector-to-sector visibility of the generated UDMF map
+// REJECT lump format: https://zdoom.org/wiki/REJECT
+
+#ifndef _ROAD_GEN_REJECT_H_
+#define _ROAD_GEN_REJECT_H_
+
+#include "common.h"
+#include "udmf.h"
+#include "io.h"
+#include "nodes.h"
+
+#include <cstdint>
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RejectTable - bit table of sector pairs, that cannot see each other; the game skips sight checks
+// between actors in such sectors (monsters do not wake up, do not attack)
+
+namespace RoadGen {
+	namespace Reject {
+		struct RejectTable {
+			uint32_t sectors_count;
+
+			// bit (row * sectors_count + column) is set if the sector 'row' cannot see the sector 'column',
+			// bits go from the lowest one of each byte
+			CharArray data;
+
+			// number of pairs of different sectors (ordered), that may see each other
+			uint64_t visible_pairs_count;
+
+			// number of cells, that see all cells connected to them - their flow has too many steps, or portals
+			// between cells do not close the space (all cells then)
+			uint32_t fallback_cells_count;
+
+			RejectTable()
+				: sectors_count(0)
+				, visible_pairs_count(0)
+				, fallback_cells_count(0)
+			{}
+		};
+
+		// build the table from the BSP tree of the map: linedefs with an open sector (the ceiling is above the floor)
+		// on one side only are walls, the space between walls is split into convex cells by the BSP tree of walls;
+		// cells see each other if a straight line passes through a chain of portals between them (heights are not
+		// checked otherwise); the table is conservative: portals are widened and clipped with margins, that cover
+		// the precision of coordinates, a flow with too many steps makes the whole component visible, all open
+		// sectors see each other if the cells do not close the space;
+		// a sector sees the sectors of the cells visible from the cells its subsectors overlap; cells and rows
+		// are built in parallel by all hardware threads; 'nodes' - built by Nodes::BuildNodes for the same map,
+		// 'float_precision' - precision of coordinates in the written TEXTMAP
+		void BuildReject(const Udmf::Map& map, const Nodes::GlNodes& nodes, unsigned char float_precision, RejectTable& reject);
+
+		// write the table as REJECT lump data
+		void WriteRejectToStream(const RejectTable& reject, Io::OutStream& out_stream);
+	}
+}
+
+#endif // _ROAD_GEN_REJECT_H_
@@ -2,8 +2,13 @@
 #include "udmf.h"
 #include "umath.h"
 
-#include <iomanip>
-#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -214,31 +219,36 @@ namespace RoadGen {
 
 namespace RoadGen {
 	namespace Udmf {
+		// 'first_id' - id of the first element of the array (see Map::first_ids)
 		template< typename T, typename A=std::vector<T> >
-		static unsigned int AddMapEntryT(A& entries, const T& new_entry) {
-			if(entries.size() > ID_MAX) {
+		static unsigned int AddMapEntryT(A& entries, unsigned int first_id, const T& new_entry) {
+			if(first_id + entries.size() > ID_MAX) {
 				throw Exception("error constructing UDMF map - too many elements in UDMF map");
 			}
 
-			const unsigned int id = (unsigned int)entries.size();
+			const unsigned int id = first_id + (unsigned int)entries.size();
 			entries.push_back(new_entry);
 			return id;
 		}
 
 		unsigned int operator<< (Map& map, const Vertex& v) {
-			return AddMapEntryT(map.vertices, v);
+			return AddMapEntryT(map.vertices, map.first_ids.vertex, v);
 		}
 
 		unsigned int operator<< (Map& map, const Linedef& l) {
-			return AddMapEntryT(map.linedefs, l);
+			return AddMapEntryT(map.linedefs, map.first_ids.linedef, l);
 		}
 
 		unsigned int operator<< (Map& map, const Sidedef& sd) {
-			return AddMapEntryT(map.sidedefs, sd);
+			return AddMapEntryT(map.sidedefs, map.first_ids.sidedef, sd);
 		}
 
 		unsigned int operator<< (Map& map, const Sector& s) {
-			return AddMapEntryT(map.sectors, s);
+			return AddMapEntryT(map.sectors, map.first_ids.sector, s);
+		}
+
+		unsigned int operator<< (Map& map, const Thing& t) {
+			return AddMapEntryT(map.things, 0, t);
 		}
 
 		void operator<< (Map& map, const Map::PlayerStartInfo& player_start_info) {
@@ -265,336 +275,1254 @@ namespace RoadGen {
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// WriteMapToStream implementation
+// ValidateMap implementation
 
 namespace RoadGen {
 	namespace Udmf {
-		void WriteMapToStream(const Map& map, unsigned char float_precision, Io::OutStream& out_stream) {
+		bool ValidateMap(const Map& map, StringArray& problems) {
 			class Utils {
-				std::stringstream m_ss;
-				double m_eps;
-
 			public:
-				Utils(unsigned char precision) {
-					m_ss << std::fixed << std::setprecision(precision);
-					m_eps = 1;
-					const unsigned char max_ix = (precision < 7) ? precision : 7;
-					for(unsigned char ix=0; ix<max_ix; ix++) {
-						m_eps /= 10;
-					}
+				// 'false' for NaN coordinates too
+				static bool IsInMapLimits(double x, double y) {
+					return (x >= -32768.0) & (x <= 32767.0) & (y >= -32768.0) & (y <= 32767.0);
 				}
 
-				std::string FormatDoubleStr(double number) {
-					m_ss.str("");
-					m_ss << number;
-					return m_ss.str();
+				static std::string GetCoordinatesStr(double x, double y) {
+					return "(" + std::to_string(x) + ", " + std::to_string(y) + ")";
 				}
+			};
+
+			problems.clear();
+			const size_t vertices_count = map.vertices.size();
+			const size_t sidedefs_count = map.sidedefs.size();
+			const size_t sectors_count = map.sectors.size();
+			const size_t textures_count = map.textures.size();
+
+			// references are checked against the end ids, elements removed from the map by TextmapStreamWriter
+			// may be referenced; problems name elements by their ids
+			const MapIds end_ids = map.GetEndIds();
+
+			// each array is scanned by a loop without branches first, problems of an array are looked for
+			// element by element only if the scan finds any
+			if(map.have_player_start && !Utils::IsInMapLimits(map.player_start_info.x, map.player_start_info.y)) {
+				problems.push_back("player start has bad coordinates " + Utils::GetCoordinatesStr(map.player_start_info.x, map.player_start_info.y));
+			}
+
+			bool have_bad_things = false;
+			for(size_t tix=0; tix<map.things.size(); tix++) {
+				have_bad_things |= !Utils::IsInMapLimits(map.things[tix].x, map.things[tix].y);
+			}
 
-				bool IsDoubleNonZero(double value) {
-					return value <= -m_eps || value >= m_eps;
+			for(size_t tix=0; tix<map.things.size() && have_bad_things; tix++) {
+				const Thing& t = map.things[tix];
+				if(!Utils::IsInMapLimits(t.x, t.y)) {
+					problems.push_back("thing " + std::to_string(tix) + " has bad coordinates " + Utils::GetCoordinatesStr(t.x, t.y));
 				}
-			} utils(float_precision);
+			}
 
-			out_stream << "namespace = \"zdoom\";\n\n";
+			bool have_bad_vertices = false;
+			for(size_t vix=0; vix<vertices_count; vix++) {
+				have_bad_vertices |= !Utils::IsInMapLimits(map.vertices[vix].x, map.vertices[vix].y);
+			}
 
-			// add things (now it is only player start)
-			if(map.have_player_start) {
-				out_stream << "thing // 0\n"
-							<< "{\n"
-							<< "x = " << utils.FormatDoubleStr(map.player_start_info.x) << ";\n"
-							<< "y = " << utils.FormatDoubleStr(map.player_start_info.y) << ";\n"
-							<< "angle = " << map.player_start_info.deg_angle << ";\n"
-							<< "type = 1;\n"
-							<< "skill1 = true;\n"
-							<< "skill2 = true;\n"
-							<< "skill3 = true;\n"
-							<< "skill4 = true;\n"
-							<< "skill5 = true;\n"
-							<< "skill6 = true;\n"
-							<< "skill7 = true;\n"
-							<< "skill8 = true;\n"
-							<< "single = true;\n"
-							<< "coop = true;\n"
-							<< "dm = true;\n"
-							<< "class1 = true;\n"
-							<< "class2 = true;\n"
-							<< "class3 = true;\n"
-							<< "class4 = true;\n"
-							<< "class5 = true;\n"
-							<< "class6 = true;\n"
-							<< "class7 = true;\n"
-							<< "class8 = true;\n"
-							<< "}\n"
-							<< "\n";
-			}
-
-			// add vertices
-			for(unsigned int vix=0; vix<map.vertices.size(); vix++) {
+			for(size_t vix=0; vix<vertices_count && have_bad_vertices; vix++) {
 				const Vertex& v = map.vertices[vix];
-				if(   v.x < -32768.0 || v.x > 32767.0
-				   || v.y < -32768.0 || v.y > 32767.0)
-				{
-					throw Exception("error writing UDMF map to stream - vertex " + std::to_string(vix) + " has bad coordinates (" + std::to_string(v.x) + ", " + std::to_string(v.y) + ")");
+				if(!Utils::IsInMapLimits(v.x, v.y)) {
+					problems.push_back("vertex " + std::to_string(map.first_ids.vertex + vix) + " has bad coordinates " + Utils::GetCoordinatesStr(v.x, v.y));
 				}
+			}
+
+			bool have_bad_linedefs = false;
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				const Linedef& l = map.linedefs[lix];
+				have_bad_linedefs |= (l.v1 >= end_ids.vertex) | (l.v2 >= end_ids.vertex) | (l.sidefront >= end_ids.sidedef)
+									 | ((l.sideback != ID_INVALID) & (l.sideback >= end_ids.sidedef));
+			}
 
-				out_stream << "vertex // " << vix << "\n"
-							<< "{\n"
-							<< "x = " << utils.FormatDoubleStr(v.x) << ";\n"
-							<< "y = " << utils.FormatDoubleStr(v.y) << ";\n";
+			for(size_t lix=0; lix<map.linedefs.size() && have_bad_linedefs; lix++) {
+				const Linedef& l = map.linedefs[lix];
+				const std::string linedef_str = "linedef " + std::to_string(map.first_ids.linedef + lix);
+				if(l.v1 >= end_ids.vertex) {
+					problems.push_back(linedef_str + " has number of non-existing vertex " + std::to_string(l.v1) + " set as v1");
+				}
 
-				if(v.have_zfloor) {
-					out_stream << "zfloor = " << utils.FormatDoubleStr(v.zfloor) << ";\n";
+				if(l.v2 >= end_ids.vertex) {
+					problems.push_back(linedef_str + " has number of non-existing vertex " + std::to_string(l.v2) + " set as v2");
 				}
 
-				if(v.have_zceiling) {
-					out_stream << "zceiling = " << utils.FormatDoubleStr(v.zceiling) << ";\n";
+				if(l.sidefront >= end_ids.sidedef) {
+					problems.push_back(linedef_str + " has number of non-existing sidedef " + std::to_string(l.sidefront) + " set as sidefront");
 				}
 
-				out_stream << "}\n"
-							<< "\n";
+				if(l.sideback != ID_INVALID && l.sideback >= end_ids.sidedef) {
+					problems.push_back(linedef_str + " has number of non-existing sidedef " + std::to_string(l.sideback) + " set as sideback");
+				}
 			}
 
-			// add linedefs
-			for(unsigned int lix=0; lix<map.linedefs.size(); lix++) {
-				const Linedef& l = map.linedefs[lix];
+			// no texture ("-") of a sidedef is ID_NULL
+			bool have_bad_sidedefs = false;
+			for(size_t sdix=0; sdix<sidedefs_count; sdix++) {
+				const Sidedef& sd = map.sidedefs[sdix];
+				have_bad_sidedefs |= (sd.sector >= end_ids.sector) | ((sd.texturetop != ID_NULL) & (sd.texturetop >= textures_count))
+									 | ((sd.texturebottom != ID_NULL) & (sd.texturebottom >= textures_count))
+									 | ((sd.texturemiddle != ID_NULL) & (sd.texturemiddle >= textures_count));
+			}
 
-				out_stream << "linedef // " << lix << "\n"
-							<< "{\n";
+			for(size_t sdix=0; sdix<sidedefs_count && have_bad_sidedefs; sdix++) {
+				const Sidedef& sd = map.sidedefs[sdix];
+				const std::string sidedef_str = "sidedef " + std::to_string(map.first_ids.sidedef + sdix);
+				if(sd.sector >= end_ids.sector) {
+					problems.push_back(sidedef_str + " has number of non-existing sector " + std::to_string(sd.sector) + " set as sector");
+				}
 
-				if(l.v1 >= map.vertices.size()) {
-					throw Exception("error writing UDMF map to stream - bad UDMF map, linedef " + std::to_string(lix) + " has number of non-existing vertex "
-									+ std::to_string(l.v1) + " set as v1");
+				if(sd.texturetop != ID_NULL && sd.texturetop >= textures_count) {
+					problems.push_back(sidedef_str + " has id of non-existing texture " + std::to_string(sd.texturetop) + " set as texturetop");
 				}
-				out_stream << "v1 = " << l.v1 << ";\n";
 
-				if(l.v2 >= map.vertices.size()) {
-					throw Exception("error writing UDMF map to stream - bad UDMF map, linedef " + std::to_string(lix) + " has number of non-existing vertex "
-									+ std::to_string(l.v2) + " set as v2");
+				if(sd.texturebottom != ID_NULL && sd.texturebottom >= textures_count) {
+					problems.push_back(sidedef_str + " has id of non-existing texture " + std::to_string(sd.texturebottom) + " set as texturebottom");
 				}
-				out_stream << "v2 = " << l.v2 << ";\n";
 
-				if(l.sidefront >= map.sidedefs.size()) {
-					throw Exception("error writing UDMF map to stream - bad UDMF map, linedef " + std::to_string(lix) + " has number of non-existing sidedef "
-									+ std::to_string(l.sidefront) + " set as sidefront");
+				if(sd.texturemiddle != ID_NULL && sd.texturemiddle >= textures_count) {
+					problems.push_back(sidedef_str + " has id of non-existing texture " + std::to_string(sd.texturemiddle) + " set as texturemiddle");
 				}
-				out_stream << "sidefront = " << l.sidefront << ";\n";
+			}
 
-				if(l.sideback != ID_INVALID) {
-					if(l.sideback >= map.sidedefs.size()) {
-						throw Exception("error writing UDMF map to stream - bad UDMF map, linedef " + std::to_string(lix) + " has number of non-existing sidedef "
-										+ std::to_string(l.sideback) + " set as sideback");
+			bool have_bad_sectors = false;
+			for(size_t six=0; six<sectors_count; six++) {
+				have_bad_sectors |= (map.sectors[six].texturefloor >= textures_count) | (map.sectors[six].textureceiling >= textures_count);
+			}
+
+			for(size_t six=0; six<sectors_count && have_bad_sectors; six++) {
+				const Sector& s = map.sectors[six];
+				const std::string sector_str = "sector " + std::to_string(map.first_ids.sector + six);
+				if(s.texturefloor >= textures_count) {
+					problems.push_back(sector_str + " has id of non-existing texture " + std::to_string(s.texturefloor) + " set as texturefloor");
+				}
+
+				if(s.textureceiling >= textures_count) {
+					problems.push_back(sector_str + " has id of non-existing texture " + std::to_string(s.textureceiling) + " set as textureceiling");
+				}
+			}
+
+			return problems.empty();
+		}
+
+		std::string GetMapProblemsStr(const StringArray& problems) {
+			// a broken map may have a problem per element, the first ones tell what is wrong
+			const size_t listed_problems_max = 20;
+
+			std::string problems_str = std::to_string(problems.size()) + " problem(s): ";
+			for(size_t pix=0; pix<problems.size() && pix<listed_problems_max; pix++) {
+				problems_str += ((pix == 0) ? "" : "; ") + problems[pix];
+			}
+
+			if(problems.size() > listed_problems_max) {
+				problems_str += "; ... and " + std::to_string(problems.size() - listed_problems_max) + " more";
+			}
+			return problems_str;
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TextmapWriter - formats TEXTMAP text into a big buffer and writes it to the stream by blocks
+
+namespace RoadGen {
+	namespace Udmf {
+		// the buffer is written to the stream when it gets that big
+		static const size_t TEXTMAP_BLOCK_SIZE = 4 * 1024 * 1024;
+
+		// doubles are formatted by integers, if they scaled by 10^precision are less than that
+		// (rounding errors of the scaling stay far below FAST_HALF_MARGIN)
+		static const double FAST_SCALED_MAX = 1099511627776.0; // 2^40
+		static const unsigned char FAST_PRECISION_MAX = 9;
+
+		// numbers, that are closer to a half of the last digit than that, are formatted by the C library,
+		// it rounds their exact binary values
+		static const double FAST_HALF_MARGIN = 1.0 / 1024;
+
+		// a thing appears for all skills, game modes and player classes
+		static const char TEXTMAP_THING_FLAGS[] = "skill1 = true;\n"
+		                                          "skill2 = true;\n"
+		                                          "skill3 = true;\n"
+		                                          "skill4 = true;\n"
+		                                          "skill5 = true;\n"
+		                                          "skill6 = true;\n"
+		                                          "skill7 = true;\n"
+		                                          "skill8 = true;\n"
+		                                          "single = true;\n"
+		                                          "coop = true;\n"
+		                                          "dm = true;\n"
+		                                          "class1 = true;\n"
+		                                          "class2 = true;\n"
+		                                          "class3 = true;\n"
+		                                          "class4 = true;\n"
+		                                          "class5 = true;\n"
+		                                          "class6 = true;\n"
+		                                          "class7 = true;\n"
+		                                          "class8 = true;\n";
+
+		// TextmapFormat - formatting settings of a map, shared by all writers of its text
+		struct TextmapFormat {
+			// number of digits after the point in doubles (std::fixed)
+			unsigned char precision;
+			double scale;
+
+			// doubles closer to zero than that are written as zero
+			double eps;
+
+			// compact text - no comments and whitespace, trailing zeros of doubles are trimmed
+			bool compact;
+
+			// separators of the text: " = " after a field name, ";\n" after a field value, "}\n\n" after a block
+			// (without whitespace in compact text)
+			std::string assignment;
+			std::string field_end;
+			std::string block_end;
+
+			// TEXTMAP_THING_FLAGS, without whitespace in compact text
+			std::string thing_flags;
+
+			// texture names of the map in quotes, followed by the field end
+			StringArray quoted_textures;
+
+			TextmapFormat(unsigned char precision_, bool compact_, const StringArray& textures)
+				: precision(precision_)
+				, scale(1.0)
+				, eps(1.0)
+				, compact(compact_)
+				, assignment(compact_ ? "=" : " = ")
+				, field_end(compact_ ? ";" : ";\n")
+				, block_end(compact_ ? "}" : "}\n\n")
+				, thing_flags(TEXTMAP_THING_FLAGS)
+			{
+				if(compact) {
+					thing_flags.erase(std::remove_if(thing_flags.begin(), thing_flags.end(), [](char c) { return c == ' ' || c == '\n'; }),
+									  thing_flags.end());
+				}
+
+				const unsigned char max_ix = (precision < 7) ? precision : 7;
+				for(unsigned char ix=0; ix<max_ix; ix++) {
+					eps /= 10;
+				}
+
+				for(unsigned char ix=0; ix<precision && ix<FAST_PRECISION_MAX; ix++) {
+					scale *= 10;
+				}
+
+				quoted_textures.reserve(textures.size());
+				for(size_t tix=0; tix<textures.size(); tix++) {
+					quoted_textures.push_back("\"" + textures[tix] + "\"" + field_end);
+				}
+			}
+		};
+
+		class TextmapWriter {
+		public:
+			// the text is written to the stream
+			TextmapWriter(const TextmapFormat& format, Io::OutStream& out_stream)
+				: m_format(format)
+				, m_out_stream(&out_stream)
+				, m_data(TEXTMAP_BLOCK_SIZE + 1024)
+				, m_size(0)
+			{}
+
+			// the text is collected in memory, 'size' - expected size of it
+			TextmapWriter(const TextmapFormat& format, size_t size)
+				: m_format(format)
+				, m_out_stream(nullptr)
+				, m_data(size)
+				, m_size(0)
+			{}
+
+			void Put(const char* text, size_t length) {
+				if(m_size + length > m_data.size()) {
+					if(m_out_stream == nullptr) {
+						m_data.resize(std::max(m_data.size() * 2, m_size + length));
+
+					} else {
+						Flush();
+						if(length > m_data.size()) {
+							m_out_stream->write(text, length);
+							return;
+						}
+					}
+				}
+
+				std::memcpy(m_data.data() + m_size, text, length);
+				m_size += length;
+			}
+
+			template<size_t N>
+			void Put(const char (&text)[N]) {
+				Put(text, N - 1);
+			}
+
+			// puts the text collected by another writer, big texts go to the stream without copying
+			void Put(const TextmapWriter& writer) {
+				if(m_out_stream != nullptr && writer.m_size >= TEXTMAP_BLOCK_SIZE / 16) {
+					Flush();
+					m_out_stream->write(writer.m_data.data(), writer.m_size);
+				} else {
+					Put(writer.m_data.data(), writer.m_size);
+				}
+			}
+
+			void PutUInt(uint64_t number) {
+				char digits[20];
+				size_t count = 0;
+				do {
+					digits[sizeof(digits) - ++count] = (char)('0' + number % 10);
+					number /= 10;
+				} while(number != 0);
+				Put(digits + sizeof(digits) - count, count);
+			}
+
+			void PutInt(int64_t number) {
+				if(number < 0) {
+					Put("-");
+					PutUInt(0 - (uint64_t)number);
+				} else {
+					PutUInt((uint64_t)number);
+				}
+			}
+
+			// puts the number the same way as a stream with std::fixed and std::setprecision(precision);
+			// in compact text trailing zeros of the fraction are trimmed (with the point for integer values)
+			// and zero is written without the sign
+			void PutDouble(double number) {
+				const unsigned char precision = m_format.precision;
+				const double scaled = std::abs(number) * m_format.scale;
+				if(precision <= FAST_PRECISION_MAX && scaled < FAST_SCALED_MAX) {
+					const double whole = std::floor(scaled);
+					const double fraction = scaled - whole;
+					if(std::abs(fraction - 0.5) > FAST_HALF_MARGIN) {
+						const uint64_t rounded = (uint64_t)whole + ((fraction > 0.5) ? 1 : 0);
+						const uint64_t divisor = (uint64_t)m_format.scale;
+						if(std::signbit(number) && (rounded != 0 || !m_format.compact)) {
+							Put("-");
+						}
+						PutUInt(rounded / divisor);
+
+						uint64_t fraction_digits = rounded % divisor;
+						unsigned char digits_count = precision;
+						while(m_format.compact && digits_count > 0 && fraction_digits % 10 == 0) {
+							fraction_digits /= 10;
+							digits_count--;
+						}
+
+						if(digits_count != 0) {
+							char digits[FAST_PRECISION_MAX + 1];
+							digits[0] = '.';
+							for(unsigned char ix=digits_count; ix>0; ix--) {
+								digits[ix] = (char)('0' + fraction_digits % 10);
+								fraction_digits /= 10;
+							}
+							Put(digits, digits_count + 1);
+						}
+						return;
+					}
+				}
+
+				const int length = std::snprintf(nullptr, 0, "%.*f", (int)precision, number);
+				std::vector<char> text(length + 1);
+				std::snprintf(text.data(), text.size(), "%.*f", (int)precision, number);
+
+				size_t text_length = length;
+				if(m_format.compact && precision != 0) {
+					while(text[text_length - 1] == '0') {
+						text_length--;
+					}
+					if(text[text_length - 1] == '.') {
+						text_length--;
 					}
-					out_stream << "sideback = " << l.sideback << ";\n";
+				}
+
+				if(m_format.compact && text_length == 2 && text[0] == '-' && text[1] == '0') {
+					Put("0");
+				} else {
+					Put(text.data(), text_length);
+				}
+			}
+
+			// puts the texture name in quotes, followed by ";\n"
+			void PutQuotedTexture(unsigned int texture) {
+				const std::string& quoted_texture = m_format.quoted_textures[texture];
+				Put(quoted_texture.data(), quoted_texture.size());
+			}
+
+			// puts "name // number\n{\n" or "name{" in compact text
+			template<size_t N>
+			void StartBlock(const char (&name)[N], uint64_t number) {
+				Put(name);
+				if(m_format.compact) {
+					Put("{");
+				} else {
+					Put(" // ");
+					PutUInt(number);
+					Put("\n{\n");
+				}
+			}
+
+			void EndBlock() {
+				Put(m_format.block_end.data(), m_format.block_end.size());
+			}
+
+			template<size_t N>
+			void PutUIntField(const char (&name)[N], uint64_t value) {
+				PutFieldName(name);
+				PutUInt(value);
+				PutFieldEnd();
+			}
+
+			template<size_t N>
+			void PutIntField(const char (&name)[N], int64_t value) {
+				PutFieldName(name);
+				PutInt(value);
+				PutFieldEnd();
+			}
+
+			template<size_t N>
+			void PutDoubleField(const char (&name)[N], double value) {
+				PutFieldName(name);
+				PutDouble(value);
+				PutFieldEnd();
+			}
+
+			template<size_t N>
+			void PutTextureField(const char (&name)[N], unsigned int texture) {
+				PutFieldName(name);
+				PutQuotedTexture(texture);
+			}
+
+			// puts the field set to "true"
+			template<size_t N>
+			void PutFlagField(const char (&name)[N]) {
+				PutFieldName(name);
+				Put("true");
+				PutFieldEnd();
+			}
+
+			void PutThingFlags() {
+				Put(m_format.thing_flags.data(), m_format.thing_flags.size());
+			}
+
+			bool IsCompact() const {
+				return m_format.compact;
+			}
+
+			bool IsDoubleNonZero(double value) const {
+				return value <= -m_format.eps || value >= m_format.eps;
+			}
+
+			// writes the text to the stream when a block of it is collected
+			void FlushIfFull() {
+				if(m_out_stream != nullptr && m_size >= TEXTMAP_BLOCK_SIZE) {
+					Flush();
+				}
+			}
+
+			void Flush() {
+				if(m_out_stream != nullptr && m_size != 0) {
+					m_out_stream->write(m_data.data(), m_size);
+					m_size = 0;
+				}
+			}
+
+		private:
+			template<size_t N>
+			void PutFieldName(const char (&name)[N]) {
+				Put(name);
+				Put(m_format.assignment.data(), m_format.assignment.size());
+			}
+
+			void PutFieldEnd() {
+				Put(m_format.field_end.data(), m_format.field_end.size());
+			}
+
+			const TextmapFormat& m_format;
+			Io::OutStream* m_out_stream;
+			CharArray m_data;
+			size_t m_size;
+		};
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TextmapElementsWriter - writes TEXTMAP blocks of map elements, the text of an element depends only on
+// the element and its number, so elements may be written by different threads; the map must be valid
+// (checked by ValidateMap), elements are written without checks
+
+namespace RoadGen {
+	namespace Udmf {
+		// elements are formatted in parallel by chunks of that many elements
+		static const size_t TEXTMAP_CHUNK_ELEMENTS = 4096;
+
+		// number of chunks per hardware thread, that are formatted before they are put into the stream
+		// (it limits the memory taken by formatted chunks)
+		static const size_t TEXTMAP_CHUNKS_PER_THREAD = 4;
+
+		class TextmapElementsWriter {
+		public:
+			TextmapElementsWriter(const Map& map)
+				: m_map(map)
+			{}
+
+			// writes elements [0, elements_count) by 'write_element(writer, element_index)' in their order; chunks
+			// of elements are formatted by all hardware threads into their own buffers, which are put into 'writer'
+			// in order; the error of the element with the lowest index is thrown
+			template<class TWriteElement>
+			static void WriteInParallel(size_t elements_count, TextmapWriter& writer, const TextmapFormat& format, const TWriteElement& write_element) {
+				const size_t threads_count = (std::thread::hardware_concurrency() > 0) ? std::thread::hardware_concurrency() : 1;
+				if(threads_count == 1 || elements_count <= TEXTMAP_CHUNK_ELEMENTS) {
+					for(size_t eix=0; eix<elements_count; eix++) {
+						write_element(writer, eix);
+						writer.FlushIfFull();
+					}
+					return;
+				}
+
+				const size_t chunks_count = (elements_count + TEXTMAP_CHUNK_ELEMENTS - 1) / TEXTMAP_CHUNK_ELEMENTS;
+				const size_t round_chunks_count = threads_count * TEXTMAP_CHUNKS_PER_THREAD;
+				for(size_t round_begin=0; round_begin<chunks_count; round_begin+=round_chunks_count) {
+					const size_t round_end = std::min(chunks_count, round_begin + round_chunks_count);
+					std::vector<std::unique_ptr<TextmapWriter> > chunks(round_end - round_begin);
+					std::vector<std::exception_ptr> errors(round_end - round_begin);
+					std::atomic<size_t> next_chunk_ix(round_begin);
+					const auto write_chunks = [&]() {
+						for(size_t cix=next_chunk_ix++; cix<round_end; cix=next_chunk_ix++) {
+							try {
+								std::unique_ptr<TextmapWriter> chunk(new TextmapWriter(format, TEXTMAP_CHUNK_ELEMENTS * 256));
+								const size_t elements_end = std::min(elements_count, (cix + 1) * TEXTMAP_CHUNK_ELEMENTS);
+								for(size_t eix=cix*TEXTMAP_CHUNK_ELEMENTS; eix<elements_end; eix++) {
+									write_element(*chunk, eix);
+								}
+								chunks[cix - round_begin] = std::move(chunk);
+
+							} catch(...) {
+								errors[cix - round_begin] = std::current_exception();
+							}
+						}
+					};
+
+					const size_t round_threads_count = std::min(threads_count, round_end - round_begin);
+					std::vector<std::thread> threads;
+					for(size_t thix=1; thix<round_threads_count; thix++) {
+						threads.push_back(std::thread(write_chunks));
+					}
+					write_chunks();
+					for(size_t thix=0; thix<threads.size(); thix++) {
+						threads[thix].join();
+					}
+
+					for(size_t cix=0; cix<chunks.size(); cix++) {
+						if(errors[cix]) {
+							std::rethrow_exception(errors[cix]);
+						}
+
+						writer.Put(*chunks[cix]);
+						chunks[cix].reset();
+						writer.FlushIfFull();
+					}
+				}
+			}
+
+			// 'number' - number of the thing in TEXTMAP (the player start goes first)
+			void WriteThing(TextmapWriter& writer, size_t tix, unsigned int number) const {
+				const Thing& t = m_map.things[tix];
+				writer.StartBlock("thing", number);
+				writer.PutDoubleField("x", t.x);
+				writer.PutDoubleField("y", t.y);
+
+				if(writer.IsDoubleNonZero(t.height)) {
+					writer.PutDoubleField("height", t.height);
+				}
+
+				if(!writer.IsCompact() || t.deg_angle != 0) {
+					writer.PutIntField("angle", t.deg_angle);
+				}
+
+				writer.PutIntField("type", t.type);
+				writer.PutThingFlags();
+				writer.EndBlock();
+			}
+
+			void WritePlayerStart(TextmapWriter& writer) const {
+				writer.StartBlock("thing", 0);
+				writer.PutDoubleField("x", m_map.player_start_info.x);
+				writer.PutDoubleField("y", m_map.player_start_info.y);
+				if(!writer.IsCompact() || m_map.player_start_info.deg_angle != 0) {
+					writer.PutIntField("angle", m_map.player_start_info.deg_angle);
+				}
+
+				writer.PutIntField("type", 1);
+				writer.PutThingFlags();
+				writer.EndBlock();
+			}
+
+			// elements are given by their indexes in the map arrays, blocks are numbered by element ids
+			void WriteVertex(TextmapWriter& writer, size_t vix) const {
+				const Vertex& v = m_map.vertices[vix];
+				writer.StartBlock("vertex", m_map.first_ids.vertex + vix);
+				writer.PutDoubleField("x", v.x);
+				writer.PutDoubleField("y", v.y);
+
+				if(v.have_zfloor) {
+					writer.PutDoubleField("zfloor", v.zfloor);
+				}
+
+				if(v.have_zceiling) {
+					writer.PutDoubleField("zceiling", v.zceiling);
+				}
+
+				writer.EndBlock();
+			}
+
+			void WriteLinedef(TextmapWriter& writer, size_t lix) const {
+				const Linedef& l = m_map.linedefs[lix];
+				writer.StartBlock("linedef", m_map.first_ids.linedef + lix);
+				writer.PutUIntField("v1", l.v1);
+				writer.PutUIntField("v2", l.v2);
+				writer.PutUIntField("sidefront", l.sidefront);
+
+				if(l.sideback != ID_INVALID) {
+					writer.PutUIntField("sideback", l.sideback);
 				}
 
 				if(l.tag != ID_NULL) {
-					out_stream << "id = " << l.tag << ";\n";
+					writer.PutUIntField("id", l.tag);
 				}
 
 				if(l.twosided) {
-					out_stream << "twosided = true;\n";
+					writer.PutFlagField("twosided");
 				}
 
 				if(l.blocking) {
-					out_stream << "blocking = true;\n";
+					writer.PutFlagField("blocking");
 				}
 
 				if(l.blockmonsters) {
-					out_stream << "blockmonsters = true;\n";
+					writer.PutFlagField("blockmonsters");
 				}
 
 				if(l.dontpegtop) {
-					out_stream << "dontpegtop = true;\n";
+					writer.PutFlagField("dontpegtop");
 				}
 
 				if(l.dontpegbottom) {
-					out_stream << "dontpegbottom = true;\n";
+					writer.PutFlagField("dontpegbottom");
 				}
 
 				if(l.secret) {
-					out_stream << "secret = true;\n";
+					writer.PutFlagField("secret");
 				}
 
 				if(l.dontdraw) {
-					out_stream << "dontdraw = true;\n";
+					writer.PutFlagField("dontdraw");
 				}
 
 				if(l.mapped) {
-					out_stream << "mapped = true;\n";
+					writer.PutFlagField("mapped");
 				}
 
 				if(l.action_special.special != ID_NULL) {
 					const Linedef::ActionSpecial& asp = l.action_special;
-					out_stream << "special = " << asp.special << ";\n";
+					writer.PutUIntField("special", asp.special);
 
 					if(asp.arg0 != 0) {
-						out_stream << "arg0 = " << asp.arg0 << ";\n";
+						writer.PutIntField("arg0", asp.arg0);
 					}
 
 					if(asp.arg1 != 0) {
-						out_stream << "arg1 = " << asp.arg1 << ";\n";
+						writer.PutIntField("arg1", asp.arg1);
 					}
 
 					if(asp.arg2 != 0) {
-						out_stream << "arg2 = " << asp.arg2 << ";\n";
+						writer.PutIntField("arg2", asp.arg2);
 					}
 
 					if(asp.arg3 != 0) {
-						out_stream << "arg3 = " << asp.arg3 << ";\n";
+						writer.PutIntField("arg3", asp.arg3);
 					}
 
 					if(asp.arg4 != 0) {
-						out_stream << "arg4 = " << asp.arg4 << ";\n";
+						writer.PutIntField("arg4", asp.arg4);
 					}
 
 					if(asp.repeatspecial) {
-						out_stream << "repeatspecial = true;\n";
+						writer.PutFlagField("repeatspecial");
 					}
 
 					if(asp.playeruse) {
-						out_stream << "playeruse = true;\n";
+						writer.PutFlagField("playeruse");
 					}
 
 					if(asp.playercross) {
-						out_stream << "playercross = true;\n";
+						writer.PutFlagField("playercross");
 					}
 
 					if(asp.monstercross) {
-						out_stream << "monstercross = true;\n";
+						writer.PutFlagField("monstercross");
 					}
 
 					if(asp.monsteruse) {
-						out_stream << "monsteruse = true;\n";
+						writer.PutFlagField("monsteruse");
 					}
 
 					if(asp.impact) {
-						out_stream << "impact = true;\n";
+						writer.PutFlagField("impact");
 					}
 
 					if(asp.playerpush) {
-						out_stream << "playerpush = true;\n";
+						writer.PutFlagField("playerpush");
 					}
 
 					if(asp.monsterpush) {
-						out_stream << "monsterpush = true;\n";
+						writer.PutFlagField("monsterpush");
 					}
 
 					if(asp.missilecross) {
-						out_stream << "missilecross = true;\n";
+						writer.PutFlagField("missilecross");
 					}
 				}
 
-				out_stream << "}\n"
-							<< "\n";
+				writer.EndBlock();
 			}
 
-			// add sidedefs
-			for(unsigned int sdix=0; sdix<map.sidedefs.size(); sdix++) {
-				const Sidedef& sd = map.sidedefs[sdix];
-
-				out_stream << "sidedef // " << sdix << "\n"
-							<< "{\n";
-				if(sd.sector >= map.sectors.size()) {
-					throw Exception("error writing UDMF map to stream - bad UDMF map, sidedef " + std::to_string(sdix) + " has number of non-existing sector "
-									+ std::to_string(sd.sector) + " set as sector");
-				}
-				out_stream << "sector = " << sd.sector << ";\n";
+			void WriteSidedef(TextmapWriter& writer, size_t sdix) const {
+				const Sidedef& sd = m_map.sidedefs[sdix];
+				writer.StartBlock("sidedef", m_map.first_ids.sidedef + sdix);
+				writer.PutUIntField("sector", sd.sector);
 
 				// do not put "-" texture name,
 				// it is the default value and may be skipped
 				if(sd.texturetop != ID_NULL) {
-					if(sd.texturetop >= map.textures.size()) {
-						throw Exception("error writing UDMF map to stream - bad UDMF map, sidedef " + std::to_string(sdix) + " has id of non-existing texture "
-										+ std::to_string(sd.texturetop) + " set as texturetop");
-					}
-					out_stream << "texturetop = \"" << map.textures[sd.texturetop] << "\";\n";
+					writer.PutTextureField("texturetop", sd.texturetop);
 				}
 
 				if(sd.texturebottom != ID_NULL) {
-					if(sd.texturebottom >= map.textures.size()) {
-						throw Exception("error writing UDMF map to stream - bad UDMF map, sidedef " + std::to_string(sdix) + " has id of non-existing texture "
-										+ std::to_string(sd.texturebottom) + " set as texturebottom");
-					}
-					out_stream << "texturebottom = \"" << map.textures[sd.texturebottom] << "\";\n";
+					writer.PutTextureField("texturebottom", sd.texturebottom);
 				}
 
 				if(sd.texturemiddle != ID_NULL) {
-					if(sd.texturemiddle >= map.textures.size()) {
-						throw Exception("error writing UDMF map to stream - bad UDMF map, sidedef " + std::to_string(sdix) + " has id of non-existing texture "
-										+ std::to_string(sd.texturemiddle) + " set as texturemiddle");
-					}
-					out_stream << "texturemiddle = \"" << map.textures[sd.texturemiddle] << "\";\n";
+					writer.PutTextureField("texturemiddle", sd.texturemiddle);
 				}
 
 				if(sd.offsetx != 0) {
-					out_stream << "offsetx = " << sd.offsetx << ";\n";
+					writer.PutIntField("offsetx", sd.offsetx);
 				}
 
 				if(sd.offsety != 0) {
-					out_stream << "offsety = " << sd.offsety << ";\n";
+					writer.PutIntField("offsety", sd.offsety);
 				}
 
-				out_stream << "}\n"
-						   << "\n";
+				writer.EndBlock();
 			}
 
-			// add sectors
-			for(unsigned int six=0; six<map.sectors.size(); six++) {
-				const Sector& s = map.sectors[six];
-
-				out_stream << "sector // " << six << "\n"
-							<< "{\n";
-
-				out_stream << "heightfloor = " << s.heightfloor << ";\n";
-				out_stream << "heightceiling = " << s.heightceiling << ";\n";
-
-				if(s.texturefloor >= map.textures.size()) {
-					throw Exception("error writing UDMF map to stream - bad UDMF map, sector " + std::to_string(six) + " has id of non-existing texture "
-									+ std::to_string(s.texturefloor) + " set as texturefloor");
+			void WriteSector(TextmapWriter& writer, size_t six) const {
+				const Sector& s = m_map.sectors[six];
+				writer.StartBlock("sector", m_map.first_ids.sector + six);
+				// zero heights are UDMF defaults, they are omitted in compact mode only
+				if(!writer.IsCompact() || s.heightfloor != 0) {
+					writer.PutIntField("heightfloor", s.heightfloor);
 				}
-				out_stream << "texturefloor = \"" << map.textures[s.texturefloor] << "\";\n";
 
-				if(s.textureceiling >= map.textures.size()) {
-					throw Exception("error writing UDMF map to stream - bad UDMF map, sector " + std::to_string(six) + " has id of non-existing texture "
-									+ std::to_string(s.textureceiling) + " set as textureceiling");
+				if(!writer.IsCompact() || s.heightceiling != 0) {
+					writer.PutIntField("heightceiling", s.heightceiling);
 				}
-				out_stream << "textureceiling = \"" << map.textures[s.textureceiling] << "\";\n";
+
+				writer.PutTextureField("texturefloor", s.texturefloor);
+				writer.PutTextureField("textureceiling", s.textureceiling);
 
 				if(s.lightlevel != 160) {
-					out_stream << "lightlevel = " << (int)s.lightlevel << ";\n";
+					writer.PutIntField("lightlevel", s.lightlevel);
 				}
 
 				if(s.special != ID_NULL) {
-					out_stream << "special = " << s.special << ";\n";
+					writer.PutUIntField("special", s.special);
 				}
 
 				if(s.tag != ID_NULL) {
-					out_stream << "id = " << s.tag << ";\n";
+					writer.PutUIntField("id", s.tag);
+				}
+
+				if(writer.IsDoubleNonZero(s.xpanningfloor)) {
+					writer.PutDoubleField("xpanningfloor", s.xpanningfloor);
+				}
+
+				if(writer.IsDoubleNonZero(s.ypanningfloor)) {
+					writer.PutDoubleField("ypanningfloor", s.ypanningfloor);
 				}
 
-				if(   utils.IsDoubleNonZero(s.floor_plane_equation.cx)
-				   || utils.IsDoubleNonZero(s.floor_plane_equation.cy)
-				   || utils.IsDoubleNonZero(s.floor_plane_equation.cz))
+				if(writer.IsDoubleNonZero(s.rotationfloor)) {
+					writer.PutDoubleField("rotationfloor", s.rotationfloor);
+				}
+
+				if(   writer.IsDoubleNonZero(s.floor_plane_equation.cx)
+				   || writer.IsDoubleNonZero(s.floor_plane_equation.cy)
+				   || writer.IsDoubleNonZero(s.floor_plane_equation.cz))
 				{
-					out_stream << "floorplane_a = " << utils.FormatDoubleStr(s.floor_plane_equation.cx) << ";\n";
-					out_stream << "floorplane_b = " << utils.FormatDoubleStr(s.floor_plane_equation.cy) << ";\n";
-					out_stream << "floorplane_c = " << utils.FormatDoubleStr(s.floor_plane_equation.cz) << ";\n";
-					out_stream << "floorplane_d = " << utils.FormatDoubleStr(s.floor_plane_equation.c) << ";\n";
+					writer.PutDoubleField("floorplane_a", s.floor_plane_equation.cx);
+					writer.PutDoubleField("floorplane_b", s.floor_plane_equation.cy);
+					writer.PutDoubleField("floorplane_c", s.floor_plane_equation.cz);
+					writer.PutDoubleField("floorplane_d", s.floor_plane_equation.c);
 				}
 
-				if(   utils.IsDoubleNonZero(s.ceiling_plane_equation.cx)
-				   || utils.IsDoubleNonZero(s.ceiling_plane_equation.cy)
-				   || utils.IsDoubleNonZero(s.ceiling_plane_equation.cz))
+				if(   writer.IsDoubleNonZero(s.ceiling_plane_equation.cx)
+				   || writer.IsDoubleNonZero(s.ceiling_plane_equation.cy)
+				   || writer.IsDoubleNonZero(s.ceiling_plane_equation.cz))
 				{
-					out_stream << "ceilingplane_a = " << utils.FormatDoubleStr(s.ceiling_plane_equation.cx) << ";\n";
-					out_stream << "ceilingplane_b = " << utils.FormatDoubleStr(s.ceiling_plane_equation.cy) << ";\n";
-					out_stream << "ceilingplane_c = " << utils.FormatDoubleStr(s.ceiling_plane_equation.cz) << ";\n";
-					out_stream << "ceilingplane_d = " << utils.FormatDoubleStr(s.ceiling_plane_equation.c) << ";\n";
+					writer.PutDoubleField("ceilingplane_a", s.ceiling_plane_equation.cx);
+					writer.PutDoubleField("ceilingplane_b", s.ceiling_plane_equation.cy);
+					writer.PutDoubleField("ceilingplane_c", s.ceiling_plane_equation.cz);
+					writer.PutDoubleField("ceilingplane_d", s.ceiling_plane_equation.c);
 				}
 
-				out_stream << "}\n"
-						   << "\n";
+				writer.EndBlock();
+			}
+
+		private:
+			const Map& m_map;
+		};
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WriteMapToStream implementation
+
+namespace RoadGen {
+	namespace Udmf {
+		static void WriteNamespace(TextmapWriter& writer) {
+			if(writer.IsCompact()) {
+				writer.Put("namespace=\"zdoom\";");
+			} else {
+				writer.Put("namespace = \"zdoom\";\n\n");
+			}
+		}
+
+		// things, player start goes first
+		static void WriteMapThings(const Map& map, TextmapWriter& writer) {
+			const TextmapElementsWriter elements_writer(map);
+			unsigned int thing_number = 0;
+			if(map.have_player_start) {
+				elements_writer.WritePlayerStart(writer);
+				thing_number++;
 			}
+
+			for(unsigned int tix=0; tix<map.things.size(); tix++) {
+				elements_writer.WriteThing(writer, tix, thing_number++);
+				writer.FlushIfFull();
+			}
+		}
+
+		// vertices, linedefs, sidedefs and sectors: 'counts' first elements of each array
+		static void WriteMapElements(const Map& map, const MapIds& counts, const TextmapFormat& format, TextmapWriter& writer) {
+			const TextmapElementsWriter elements_writer(map);
+			TextmapElementsWriter::WriteInParallel(counts.vertex, writer, format, [&elements_writer](TextmapWriter& chunk_writer, size_t vix) {
+				elements_writer.WriteVertex(chunk_writer, vix);
+			});
+
+			TextmapElementsWriter::WriteInParallel(counts.linedef, writer, format, [&elements_writer](TextmapWriter& chunk_writer, size_t lix) {
+				elements_writer.WriteLinedef(chunk_writer, lix);
+			});
+
+			TextmapElementsWriter::WriteInParallel(counts.sidedef, writer, format, [&elements_writer](TextmapWriter& chunk_writer, size_t sdix) {
+				elements_writer.WriteSidedef(chunk_writer, sdix);
+			});
+
+			TextmapElementsWriter::WriteInParallel(counts.sector, writer, format, [&elements_writer](TextmapWriter& chunk_writer, size_t six) {
+				elements_writer.WriteSector(chunk_writer, six);
+			});
+		}
+
+		void WriteMapToStream(const Map& map, unsigned char float_precision, Io::OutStream& out_stream, bool compact) {
+			// nothing is written for a bad map
+			StringArray problems;
+			if(!ValidateMap(map, problems)) {
+				throw Exception("error writing UDMF map to stream - bad UDMF map, " + GetMapProblemsStr(problems));
+			}
+
+			const TextmapFormat format(float_precision, compact, map.textures);
+			TextmapWriter writer(format, out_stream);
+			WriteNamespace(writer);
+			WriteMapThings(map, writer);
+			WriteMapElements(map, MapIds((unsigned int)map.vertices.size(), (unsigned int)map.linedefs.size(),
+									  (unsigned int)map.sidedefs.size(), (unsigned int)map.sectors.size()),
+						  format, writer);
+			writer.Flush();
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TextmapStreamWriter implementation
+
+namespace RoadGen {
+	namespace Udmf {
+		TextmapStreamWriter::TextmapStreamWriter(Map& map, unsigned char float_precision, Io::OutStream& out_stream, bool compact)
+			: m_map(map)
+			, m_format(new TextmapFormat(float_precision, compact, map.textures))
+			, m_writer(new TextmapWriter(*m_format, out_stream))
+		{
+			WriteNamespace(*m_writer);
+		}
+
+		TextmapStreamWriter::~TextmapStreamWriter() {
+		}
+
+		// number of elements of the array with ids below 'final_id'
+		static unsigned int GetFinalElementsCount(unsigned int final_id, unsigned int first_id, size_t elements_count) {
+			return (final_id > first_id) ? std::min(final_id - first_id, (unsigned int)elements_count) : 0;
+		}
+
+		void TextmapStreamWriter::WriteFinalElements(const MapIds& final_ids) {
+			// elements are written by chunks, that are formatted by all hardware threads
+			const MapIds& first_ids = m_map.first_ids;
+			if(   GetFinalElementsCount(final_ids.vertex, first_ids.vertex, m_map.vertices.size()) >= TEXTMAP_CHUNK_ELEMENTS
+			   || GetFinalElementsCount(final_ids.linedef, first_ids.linedef, m_map.linedefs.size()) >= TEXTMAP_CHUNK_ELEMENTS
+			   || GetFinalElementsCount(final_ids.sidedef, first_ids.sidedef, m_map.sidedefs.size()) >= TEXTMAP_CHUNK_ELEMENTS
+			   || GetFinalElementsCount(final_ids.sector, first_ids.sector, m_map.sectors.size()) >= TEXTMAP_CHUNK_ELEMENTS)
+			{
+				WriteElements(final_ids);
+			}
+		}
+
+		void TextmapStreamWriter::Finish() {
+			WriteElements(m_map.GetEndIds());
+			WriteMapThings(m_map, *m_writer);
+			m_writer->Flush();
+		}
+
+		void TextmapStreamWriter::WriteElements(const MapIds& final_ids) {
+			StringArray problems;
+			if(!ValidateMap(m_map, problems)) {
+				throw Exception("error writing UDMF map to stream - bad UDMF map, " + GetMapProblemsStr(problems));
+			}
+
+			const MapIds first_ids = m_map.first_ids;
+			const MapIds counts(GetFinalElementsCount(final_ids.vertex, first_ids.vertex, m_map.vertices.size()),
+								GetFinalElementsCount(final_ids.linedef, first_ids.linedef, m_map.linedefs.size()),
+								GetFinalElementsCount(final_ids.sidedef, first_ids.sidedef, m_map.sidedefs.size()),
+								GetFinalElementsCount(final_ids.sector, first_ids.sector, m_map.sectors.size()));
+			WriteMapElements(m_map, counts, *m_format, *m_writer);
+
+			// the map keeps the elements after the written ones, their ids stay the same
+			m_map.vertices.erase(m_map.vertices.begin(), m_map.vertices.begin() + counts.vertex);
+			m_map.linedefs.erase(m_map.linedefs.begin(), m_map.linedefs.begin() + counts.linedef);
+			m_map.sidedefs.erase(m_map.sidedefs.begin(), m_map.sidedefs.begin() + counts.sidedef);
+			m_map.sectors.erase(m_map.sectors.begin(), m_map.sectors.begin() + counts.sector);
+			m_map.first_ids = MapIds(first_ids.vertex + counts.vertex, first_ids.linedef + counts.linedef,
+									 first_ids.sidedef + counts.sidedef, first_ids.sector + counts.sector);
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GetLoadedGeometry implementation
+
+namespace RoadGen {
+	namespace Udmf {
+		double GetLoadedCoordinate(double coordinate, unsigned char float_precision) {
+			const double fixed_point_scale = 65536.0;
+
+			// the coordinate as it is written into TEXTMAP
+			double scale = 1.0;
+			const unsigned char max_ix = (float_precision < 7) ? float_precision : 7;
+			for(unsigned char ix=0; ix<max_ix; ix++) {
+				scale *= 10;
+			}
+
+			return std::round(std::round(coordinate * scale) / scale * fixed_point_scale) / fixed_point_scale;
+		}
+
+		void GetLoadedGeometry(const Map& map, unsigned char float_precision, LoadedGeometry& geometry) {
+			// map coordinates limit of fixed point numbers
+			const double coordinate_max = 32767.0;
+
+			geometry = LoadedGeometry();
+			geometry.vertices.resize(map.vertices.size());
+			for(size_t vix=0; vix<map.vertices.size(); vix++) {
+				const double x = GetLoadedCoordinate(map.vertices[vix].x, float_precision);
+				const double y = GetLoadedCoordinate(map.vertices[vix].y, float_precision);
+				if(std::abs(x) > coordinate_max || std::abs(y) > coordinate_max) {
+					throw Exception("bad map - vertex " + std::to_string(vix) + " is out of map coordinates limits");
+				}
+
+				geometry.vertices[vix] = Math::Point2D(x, y);
+				geometry.left = (vix == 0) ? x : std::min(geometry.left, x);
+				geometry.right = (vix == 0) ? x : std::max(geometry.right, x);
+				geometry.bottom = (vix == 0) ? y : std::min(geometry.bottom, y);
+				geometry.top = (vix == 0) ? y : std::max(geometry.top, y);
+			}
+
+			// ZDoom removes zero length linedefs while loading the map, next linedefs are renumbered
+			geometry.map_linedefs.reserve(map.linedefs.size());
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				const Linedef& l = map.linedefs[lix];
+				if(l.v1 >= geometry.vertices.size() || l.v2 >= geometry.vertices.size()) {
+					throw Exception("bad map - linedef " + std::to_string(lix) + " references non-existing vertex");
+				}
+
+				const Math::Point2D& p1 = geometry.vertices[l.v1];
+				const Math::Point2D& p2 = geometry.vertices[l.v2];
+				if(p1.x != p2.x || p1.y != p2.y) {
+					geometry.map_linedefs.push_back((uint32_t)lix);
+				}
+			}
+		}
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GetHexenMapLumps implementation
+
+namespace RoadGen {
+	namespace Udmf {
+		void GetHexenMapLumps(const Map& map, HexenMapLumps& lumps) {
+			class Utils {
+			public:
+				Utils(const Map& map)
+					: m_map(map)
+				{}
+
+				static void Put2Bytes(CharArray& data, int number) {
+					data.push_back((char)(number & 0xFF));
+					data.push_back((char)((number >> 8) & 0xFF));
+				}
+
+				static void PutByte(CharArray& data, int number) {
+					data.push_back((char)(number & 0xFF));
+				}
+
+				// the number must fit a signed 16-bit field
+				static int GetShort(double number, const std::string& what) {
+					const double rounded_number = std::round(number);
+					if(rounded_number < -32768.0 || rounded_number > 32767.0) {
+						throw Exception("error converting map to Hexen format - " + what + " (" + std::to_string(number) + ") is out of 16-bit number range");
+					}
+					return (int)rounded_number;
+				}
+
+				// the number must fit an unsigned 8-bit field
+				static int GetByte(int number, const std::string& what) {
+					if(number < 0 || number > 255) {
+						throw Exception("error converting map to Hexen format - " + what + " (" + std::to_string(number) + ") is out of 8-bit number range");
+					}
+					return number;
+				}
+
+				// texture names are padded with zeros to 8 characters, no texture is "-"
+				void PutTextureName(CharArray& data, unsigned int texture, const std::string& what) const {
+					const std::string name = (texture != ID_NULL) ? m_map.textures[texture] : "-";
+					if(name.size() > 8) {
+						throw Exception("error converting map to Hexen format - " + what + " has texture name '" + name + "' longer than 8 characters");
+					}
+
+					for(size_t cix=0; cix<8; cix++) {
+						data.push_back((cix < name.size()) ? name[cix] : '\0');
+					}
+				}
+
+			private:
+				const Map& m_map;
+			} utils(map);
+
+			StringArray problems;
+			if(!ValidateMap(map, problems)) {
+				throw Exception("error converting map to Hexen format - bad UDMF map, " + GetMapProblemsStr(problems));
+			}
+
+			// a thing appears for all skills, game modes and player classes (Hexen format thing flags)
+			const int thing_flags = 0x0001 | 0x0002 | 0x0004 | 0x0020 | 0x0040 | 0x0080 | 0x0100 | 0x0200 | 0x0400;
+
+			// Hexen format linedef flags
+			enum EnLinedefFlags {
+				enLinedefFlags_Blocking = 0x0001,
+				enLinedefFlags_BlockMonsters = 0x0002,
+				enLinedefFlags_TwoSided = 0x0004,
+				enLinedefFlags_DontPegTop = 0x0008,
+				enLinedefFlags_DontPegBottom = 0x0010,
+				enLinedefFlags_Secret = 0x0020,
+				enLinedefFlags_DontDraw = 0x0080,
+				enLinedefFlags_Mapped = 0x0100,
+				enLinedefFlags_RepeatSpecial = 0x0200,
+				enLinedefFlags_MonstersActivate = 0x2000
+			};
+
+			// the activation of a special is a number in bits 10-12 of linedef flags
+			const int activation_shift = 10;
+
+			// special Line_SetIdentification sets the id of a linedef without another special
+			const unsigned int line_set_identification_special = 121;
+
+			// records are 4 bytes
+			lumps.vertexes.clear();
+			lumps.vertexes.reserve(map.vertices.size() * 4);
+			std::vector<std::pair<int, int> > vertices_positions(map.vertices.size());
+			for(size_t vix=0; vix<map.vertices.size(); vix++) {
+				const Vertex& v = map.vertices[vix];
+				if(v.have_zfloor || v.have_zceiling) {
+					throw Exception("error converting map to Hexen format - vertex " + std::to_string(vix) + " has heights, the map must be written in UDMF");
+				}
+
+				vertices_positions[vix].first = Utils::GetShort(v.x, "x of vertex " + std::to_string(vix));
+				vertices_positions[vix].second = Utils::GetShort(v.y, "y of vertex " + std::to_string(vix));
+				Utils::Put2Bytes(lumps.vertexes, vertices_positions[vix].first);
+				Utils::Put2Bytes(lumps.vertexes, vertices_positions[vix].second);
+			}
+
+			if(map.vertices.size() > 0x10000) {
+				throw Exception("error converting map to Hexen format - too many vertices (" + std::to_string(map.vertices.size()) + "), at most 65536 are supported");
+			}
+
+			// 0xFFFF is no sidedef
+			if(map.sidedefs.size() >= 0xFFFF) {
+				throw Exception("error converting map to Hexen format - too many sidedefs (" + std::to_string(map.sidedefs.size()) + "), at most 65534 are supported");
+			}
+
+			// records are 20 bytes, player start goes first
+			lumps.things.clear();
+			lumps.things.reserve((map.things.size() + 1) * 20);
+			std::vector<Thing> things;
+			if(map.have_player_start) {
+				things.push_back(Thing(map.player_start_info.x, map.player_start_info.y, map.player_start_info.deg_angle, 1));
+			}
+			things.insert(things.end(), map.things.begin(), map.things.end());
+			for(size_t tix=0; tix<things.size(); tix++) {
+				const Thing& t = things[tix];
+				const std::string what = "thing " + std::to_string(tix);
+				Utils::Put2Bytes(lumps.things, 0); // tid
+				Utils::Put2Bytes(lumps.things, Utils::GetShort(t.x, "x of " + what));
+				Utils::Put2Bytes(lumps.things, Utils::GetShort(t.y, "y of " + what));
+				Utils::Put2Bytes(lumps.things, Utils::GetShort(t.height, "height of " + what));
+				Utils::Put2Bytes(lumps.things, Utils::GetShort(t.deg_angle, "angle of " + what));
+				Utils::Put2Bytes(lumps.things, Utils::GetShort(t.type, "type of " + what));
+				Utils::Put2Bytes(lumps.things, thing_flags);
+				lumps.things.insert(lumps.things.end(), 6, '\0'); // special and its arguments
+			}
+
+			// records are 16 bytes
+			lumps.linedefs.clear();
+			lumps.linedefs.reserve(map.linedefs.size() * 16);
+			for(size_t lix=0; lix<map.linedefs.size(); lix++) {
+				const Linedef& l = map.linedefs[lix];
+				const std::string what = "linedef " + std::to_string(lix);
+				if(vertices_positions[l.v1] == vertices_positions[l.v2]) {
+					continue;
+				}
+
+				int flags = (l.blocking ? enLinedefFlags_Blocking : 0)
+						  | (l.blockmonsters ? enLinedefFlags_BlockMonsters : 0)
+						  | (l.twosided ? enLinedefFlags_TwoSided : 0)
+						  | (l.dontpegtop ? enLinedefFlags_DontPegTop : 0)
+						  | (l.dontpegbottom ? enLinedefFlags_DontPegBottom : 0)
+						  | (l.secret ? enLinedefFlags_Secret : 0)
+						  | (l.dontdraw ? enLinedefFlags_DontDraw : 0)
+						  | (l.mapped ? enLinedefFlags_Mapped : 0);
+
+				Linedef::ActionSpecial action_special = l.action_special;
+				if(l.tag != ID_NULL) {
+					if(action_special.special != ID_NULL) {
+						throw Exception("error converting map to Hexen format - " + what + " has both id and special, the map must be written in UDMF");
+					}
+					action_special = Linedef::ActionSpecial(line_set_identification_special, (int)l.tag);
+				}
+
+				if(action_special.special != ID_NULL) {
+					// one activation of players (or anything for crossing projectiles), monsters may use
+					// or push the line as players do
+					const bool activations[] = {action_special.playercross,
+												action_special.playeruse,
+												action_special.monstercross,
+												action_special.impact,
+												action_special.playerpush,
+												action_special.missilecross};
+					int activation = -1;
+					for(int aix=0; aix<(int)_countof(activations); aix++) {
+						if(activations[aix]) {
+							if(activation >= 0) {
+								throw Exception("error converting map to Hexen format - " + what + " has several activations of its special, the map must be written in UDMF");
+							}
+							activation = aix;
+						}
+					}
+
+					if(   (action_special.monsteruse && !action_special.playeruse)
+					   || (action_special.monsterpush && !action_special.playerpush))
+					{
+						throw Exception("error converting map to Hexen format - " + what + " has monster activation without player activation, the map must be written in UDMF");
+					}
+
+					flags |= (std::max(activation, 0) << activation_shift)
+						   | (action_special.repeatspecial ? enLinedefFlags_RepeatSpecial : 0)
+						   | ((action_special.monsteruse || action_special.monsterpush) ? enLinedefFlags_MonstersActivate : 0);
+				}
+
+				Utils::Put2Bytes(lumps.linedefs, (int)l.v1);
+				Utils::Put2Bytes(lumps.linedefs, (int)l.v2);
+				Utils::Put2Bytes(lumps.linedefs, flags);
+				Utils::PutByte(lumps.linedefs, Utils::GetByte((int)action_special.special, "special of " + what));
+				Utils::PutByte(lumps.linedefs, Utils::GetByte(action_special.arg0, "arg0 of " + what));
+				Utils::PutByte(lumps.linedefs, Utils::GetByte(action_special.arg1, "arg1 of " + what));
+				Utils::PutByte(lumps.linedefs, Utils::GetByte(action_special.arg2, "arg2 of " + what));
+				Utils::PutByte(lumps.linedefs, Utils::GetByte(action_special.arg3, "arg3 of " + what));
+				Utils::PutByte(lumps.linedefs, Utils::GetByte(action_special.arg4, "arg4 of " + what));
+				Utils::Put2Bytes(lumps.linedefs, (int)l.sidefront);
+				Utils::Put2Bytes(lumps.linedefs, (l.sideback != ID_INVALID) ? (int)l.sideback : 0xFFFF);
+			}
+
+			// records are 30 bytes
+			lumps.sidedefs.clear();
+			lumps.sidedefs.reserve(map.sidedefs.size() * 30);
+			for(size_t sdix=0; sdix<map.sidedefs.size(); sdix++) {
+				const Sidedef& sd = map.sidedefs[sdix];
+				const std::string what = "sidedef " + std::to_string(sdix);
+				Utils::Put2Bytes(lumps.sidedefs, Utils::GetShort(sd.offsetx, "offsetx of " + what));
+				Utils::Put2Bytes(lumps.sidedefs, Utils::GetShort(sd.offsety, "offsety of " + what));
+				utils.PutTextureName(lumps.sidedefs, sd.texturetop, what);
+				utils.PutTextureName(lumps.sidedefs, sd.texturebottom, what);
+				utils.PutTextureName(lumps.sidedefs, sd.texturemiddle, what);
+				Utils::Put2Bytes(lumps.sidedefs, (int)sd.sector);
+			}
+
+			// records are 26 bytes
+			lumps.sectors.clear();
+			lumps.sectors.reserve(map.sectors.size() * 26);
+			for(size_t six=0; six<map.sectors.size(); six++) {
+				const Sector& s = map.sectors[six];
+				const std::string what = "sector " + std::to_string(six);
+				const Sector::PlaneEquation& floor_plane = s.floor_plane_equation;
+				const Sector::PlaneEquation& ceiling_plane = s.ceiling_plane_equation;
+				if(   floor_plane.cx != 0.0 || floor_plane.cy != 0.0 || floor_plane.cz != 0.0
+				   || ceiling_plane.cx != 0.0 || ceiling_plane.cy != 0.0 || ceiling_plane.cz != 0.0)
+				{
+					throw Exception("error converting map to Hexen format - " + what + " has plane equations, the map must be written in UDMF");
+				}
+
+				if(s.xpanningfloor != 0.0 || s.ypanningfloor != 0.0 || s.rotationfloor != 0.0) {
+					throw Exception("error converting map to Hexen format - " + what + " has floor texture panning or rotation, the map must be written in UDMF");
+				}
+
+				Utils::Put2Bytes(lumps.sectors, Utils::GetShort(s.heightfloor, "heightfloor of " + what));
+				Utils::Put2Bytes(lumps.sectors, Utils::GetShort(s.heightceiling, "heightceiling of " + what));
+				utils.PutTextureName(lumps.sectors, s.texturefloor, what);
+				utils.PutTextureName(lumps.sectors, s.textureceiling, what);
+				Utils::Put2Bytes(lumps.sectors, s.lightlevel);
+				Utils::Put2Bytes(lumps.sectors, Utils::GetShort(s.special, "special of " + what));
+				Utils::Put2Bytes(lumps.sectors, Utils::GetShort(s.tag, "id of " + what));
+			}
+
+			// empty ACS library: header ('ACS', 0, offset of the directory) and the directory
+			// without scripts and strings
+			const char behavior[] = {'A', 'C', 'S', 0, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+			lumps.behavior.assign(behavior, behavior + _countof(behavior));
 		}
 	}
 }
@@ -11,6 +11,7 @@
 #include "common.h"
 #include "umath.h"
 #include "io.h"
+#include <memory>
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -87,6 +88,10 @@ namespace RoadGen {
 			// sector action special
 			unsigned int special;
 
+			// floor texture offsets (map units) and rotation (degrees, counter-clockwise), ZDoom extension
+			double xpanningfloor, ypanningfloor;
+			double rotationfloor;
+
 			struct PlaneEquation {
 				double cx, cy, cz, c;
 				PlaneEquation(): cx(0.0), cy(0.0), cz(0.0), c(0.0) {}
@@ -105,6 +110,9 @@ namespace RoadGen {
 				, lightlevel(0)
 				, tag(ID_NULL)
 				, special(ID_NULL)
+				, xpanningfloor(0.0)
+				, ypanningfloor(0.0)
+				, rotationfloor(0.0)
 			{}
 
 			Sector(int heightfloor_,
@@ -120,6 +128,9 @@ namespace RoadGen {
 				, lightlevel(lightlevel_)
 				, tag(tag_)
 				, special(0)
+				, xpanningfloor(0.0)
+				, ypanningfloor(0.0)
+				, rotationfloor(0.0)
 			{}
 
 			Sector GetWithNoFloorPlaneEquation() const;
@@ -360,14 +371,67 @@ namespace RoadGen {
 			Linedef GetFlipped() const;
 		};
 
+		// Thing - an object on the map (monster, item, decoration, etc.);
+		// a thing appears for all skills, game modes and player classes
+		struct Thing {
+			// 2D coordinates
+			double x, y;
+
+			// z position related to the floor
+			double height;
+
+			// direction the thing faces, degrees
+			int deg_angle;
+
+			// thing type (DoomEdNum)
+			int type;
+
+		public:
+			Thing()
+				: x(0.0)
+				, y(0.0)
+				, height(0.0)
+				, deg_angle(0)
+				, type(0)
+			{}
+
+			Thing(double x_, double y_, int deg_angle_, int type_)
+				: x(x_)
+				, y(y_)
+				, height(0.0)
+				, deg_angle(deg_angle_)
+				, type(type_)
+			{}
+		};
+
+		// MapIds - numbers of vertices, linedefs, sidedefs and sectors (ids of elements of each kind or counts of them)
+		struct MapIds {
+			unsigned int vertex, linedef, sidedef, sector;
+
+			MapIds()
+				: vertex(0)
+				, linedef(0)
+				, sidedef(0)
+				, sector(0)
+			{}
+
+			MapIds(unsigned int vertex_, unsigned int linedef_, unsigned int sidedef_, unsigned int sector_)
+				: vertex(vertex_)
+				, linedef(linedef_)
+				, sidedef(sidedef_)
+				, sector(sector_)
+			{}
+		};
+
 		// Map - full UDMF map definition;
-		// maps also contain Things, but only player start is implemented here
+		// player start is kept apart from other things and is always written first
 		struct Map {
 		public:
 			std::vector<Vertex> vertices;
 			std::vector<Linedef> linedefs;
 			std::vector<Sidedef> sidedefs;
 			std::vector<Sector> sectors;
+			std::vector<Thing> things;
 
 			std::vector<std::string> textures;
 
@@ -392,15 +456,45 @@ namespace RoadGen {
 
 			bool have_player_start;
 			PlayerStartInfo player_start_info;
+
+			// ids of the first elements of the arrays, the id of an element is the id of the first element plus
+			// its index; TextmapStreamWriter removes written elements from the arrays while the map is built
+			// and moves the first ids past them, all other processing needs whole maps (zero first ids)
+			MapIds first_ids;
+
 			Map()
 				: have_player_start(false)
 			{}
+
+			// ids of the next added elements
+			MapIds GetEndIds() const {
+				return MapIds(first_ids.vertex + (unsigned int)vertices.size(), first_ids.linedef + (unsigned int)linedefs.size(),
+							  first_ids.sidedef + (unsigned int)sidedefs.size(), first_ids.sector + (unsigned int)sectors.size());
+			}
+
+			// elements by their ids, throw for removed elements
+			Vertex& GetVertex(unsigned int id) {
+				return vertices.at(id - first_ids.vertex);
+			}
+
+			Linedef& GetLinedef(unsigned int id) {
+				return linedefs.at(id - first_ids.linedef);
+			}
+
+			const Sidedef& GetSidedef(unsigned int id) const {
+				return sidedefs.at(id - first_ids.sidedef);
+			}
+
+			Sector& GetSector(unsigned int id) {
+				return sectors.at(id - first_ids.sector);
+			}
 		};
 
 		unsigned int operator<< (Map& map, const Vertex& v);
 		unsigned int operator<< (Map& map, const Linedef& l);
 		unsigned int operator<< (Map& map, const Sidedef& sd);
 		unsigned int operator<< (Map& map, const Sector& s);
+		unsigned int operator<< (Map& map, const Thing& t);
 		void operator<< (Map& map, const Map::PlayerStartInfo& player_start_info);
 
 		enum EnMapCtrl {
@@ -409,7 +503,95 @@ namespace RoadGen {
 		};
 		void operator<< (Map& map, EnMapCtrl ctrl);
 
-		void WriteMapToStream(const Map& map, unsigned char float_precision, Io::OutStream& out_stream);
+		// check, that the map may be written: linedefs, sidedefs and sectors reference existing elements and textures,
+		// coordinates of vertices, things and the player start are within map limits; all found problems are put into
+		// 'problems' with element ids; each array is scanned by a loop without branches, elements of the array are
+		// checked one by one only if the scan finds a problem; returns 'true' if there are no problems
+		bool ValidateMap(const Map& map, StringArray& problems);
+
+		// problems found by ValidateMap for an error message (the first ones are listed)
+		std::string GetMapProblemsStr(const StringArray& problems);
+
+		// write the map as TEXTMAP lump data; the map is validated by ValidateMap before anything is written,
+		// throws with found problems; 'compact' - the text has no comments and whitespace, numbers have no trailing
+		// zeros (integer values have no point), zero heights and angles are omitted
+		void WriteMapToStream(const Map& map, unsigned char float_precision, Io::OutStream& out_stream, bool compact = false);
+
+		struct TextmapFormat;
+		class TextmapWriter;
+
+		// TextmapStreamWriter - writes TEXTMAP lump data of a map while the map is built (as WriteMapToStream does):
+		// elements, that do not change anymore, are written and removed from the map, so the map keeps its last
+		// elements only; UDMF numbers elements of each kind in their order and blocks of different kinds may go
+		// in any order, so elements are written by parts and things (the player start first) go last
+		class TextmapStreamWriter {
+		public:
+			// textures of the map must be set, they are not changed while the map is built
+			TextmapStreamWriter(Map& map, unsigned char float_precision, Io::OutStream& out_stream, bool compact = false);
+			~TextmapStreamWriter();
+
+			// write and remove elements with ids below 'final_ids', when a chunk of them is collected (smaller parts
+			// wait for the next call); the map is validated by ValidateMap before elements are written, throws
+			// with found problems, parts written before stay in the stream
+			void WriteFinalElements(const MapIds& final_ids);
+
+			// write all remaining elements and things, the map keeps no elements then
+			void Finish();
+
+		private:
+			void WriteElements(const MapIds& final_ids);
+
+			Map& m_map;
+			std::unique_ptr<TextmapFormat> m_format;
+			std::unique_ptr<TextmapWriter> m_writer;
+		};
+
+		// LoadedGeometry - vertices and linedefs of the map as the game loads them from the written TEXTMAP: coordinates
+		// are rounded to the precision of TEXTMAP and then to fixed point numbers (16.16), zero length linedefs
+		// are removed and next linedefs are renumbered; nodes, reject and blockmap are built for it, so their lumps
+		// agree on coordinates and numbers of linedefs
+		struct LoadedGeometry {
+			std::vector<Math::Point2D> vertices;
+
+			// map linedef of each loaded linedef
+			std::vector<uint32_t> map_linedefs;
+
+			// bounding box of vertices
+			double left, right, bottom, top;
+
+			LoadedGeometry()
+				: left(0.0)
+				, right(0.0)
+				, bottom(0.0)
+				, top(0.0)
+			{}
+		};
+
+		// get the coordinate as the game loads it from TEXTMAP written with 'float_precision': rounded to the precision
+		// of TEXTMAP and then to a fixed point number (16.16)
+		double GetLoadedCoordinate(double coordinate, unsigned char float_precision);
+
+		// get the geometry of the map as the game loads it from TEXTMAP written with 'float_precision'; throws
+		// if a linedef references a non-existing vertex or a vertex is out of map coordinates limits
+		void GetLoadedGeometry(const Map& map, unsigned char float_precision, LoadedGeometry& geometry);
+
+		// HexenMapLumps - the map in Hexen binary format: lumps of records of fixed size (little-endian);
+		// BEHAVIOR is an empty ACS library, the game tells Hexen format maps from Doom format ones by it;
+		// Hexen map format information: https://zdoom.org/wiki/Hexen_map_format
+		struct HexenMapLumps {
+			CharArray things;
+			CharArray linedefs;
+			CharArray sidedefs;
+			CharArray vertexes;
+			CharArray sectors;
+			CharArray behavior;
+		};
+
+		// convert the map into Hexen format lumps; coordinates are rounded to integers, linedefs of zero length
+		// after rounding are not put (the game removes them anyway); throws for bad maps (see ValidateMap) and
+		// if the map needs UDMF: vertex heights, plane equations, panning or rotation of flats, texture names longer
+		// than 8 characters, several activations of a linedef special, numbers out of record fields ranges
+		void GetHexenMapLumps(const Map& map, HexenMapLumps& lumps);
 	}
 }
 
@@ -44,6 +44,10 @@ namespace RoadGen {
 			return sin(x);
 		}
 
+		double Atan2(double y, double x) {
+			return atan2(y, x);
+		}
+
 		EnPointLinePos2D GetPointLinePos2D(const Point2D& p, const LineEquation2D& l_eq) {
 			const double val = l_eq.a * p.x + l_eq.b * p.y + l_eq.c;
 			if(IsZeroOrCloseTo(val)) {
@@ -34,6 +34,9 @@ namespace RoadGen {
 
 		double Sin(double x);
 
+		// angle of the vector (x, y) in radians, [-PI, PI]
+		double Atan2(double y, double x);
+
 		struct Point2D {
 			double x, y;
 